@@ -0,0 +1,663 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef BPFGEN_CPP
+#define BPFGEN_CPP
+
+#include <cstdio>           // sprintf
+
+#include "bpfgen.h"         // BPFGenerator
+
+#define BPFGEN_NONE ((unsigned int)-1)     // label of jumps without target
+
+// Parameterized constructor: translates the filter, accepting frames with
+// given number of bytes
+BPFGenerator::BPFGenerator(const PacketFilter & filter, unsigned int accept)
+  : p_filter(filter), p_valid(false), p_partial(false) {
+  unsigned int root = make_binary(Node::bn_or, bypass(), build(filter.root(), true));
+
+  // A filter accepting everything needs no kernel program
+  if (p_nodes[root].type == Node::bn_true)
+    return;
+
+  unsigned int accepted = new_label(), rejected = new_label();
+
+  generate(root, accepted, rejected);
+  place(accepted);
+  emit(BPF_RET | BPF_K, accept);
+  place(rejected);
+  emit(BPF_RET | BPF_K, 0);
+
+  thread_jumps();
+  remove_unreachable();
+  p_valid = resolve();
+}
+
+// Returns true if a program narrowing the traffic was generated
+bool BPFGenerator::valid() const {
+  return p_valid;
+}
+
+// Returns true if some tests of the filter could not be translated
+bool BPFGenerator::partial() const {
+  return p_partial;
+}
+
+// Returns a new constant node
+unsigned int BPFGenerator::make_const(bool value) {
+  Node n;
+
+  n.type = (value ? Node::bn_true : Node::bn_false);
+  n.left = n.right = 0;
+  p_nodes.push_back(n);
+
+  return p_nodes.size() - 1;
+}
+
+// Returns a new test node
+unsigned int BPFGenerator::make_test(BPFTest::LoadKind kind, unsigned short size, unsigned int offset,
+                                     unsigned int mask, unsigned short jump, unsigned int k, bool negate) {
+  Node n;
+
+  n.type        = Node::bn_test;
+  n.test.kind   = kind;
+  n.test.size   = size;
+  n.test.offset = offset;
+  n.test.mask   = mask;
+  n.test.jump   = jump;
+  n.test.k      = k;
+  n.test.negate = negate;
+  n.left = n.right = 0;
+  p_nodes.push_back(n);
+
+  return p_nodes.size() - 1;
+}
+
+// Returns a new "and" or "or" node, folding constant operands
+unsigned int BPFGenerator::make_binary(Node::NodeType type, unsigned int left, unsigned int right) {
+  Node::NodeType absorbing = (type == Node::bn_or ? Node::bn_true : Node::bn_false);
+  Node::NodeType neutral   = (type == Node::bn_or ? Node::bn_false : Node::bn_true);
+
+  if (p_nodes[left].type == absorbing || p_nodes[right].type == neutral)
+    return left;
+  if (p_nodes[right].type == absorbing || p_nodes[left].type == neutral)
+    return right;
+
+  Node n;
+  n.type  = type;
+  n.left  = left;
+  n.right = right;
+  p_nodes.push_back(n);
+
+  return p_nodes.size() - 1;
+}
+
+// Returns a new "not" node; negated tests simply swap their jump targets
+unsigned int BPFGenerator::make_not(unsigned int child) {
+  const Node c = p_nodes[child];
+
+  switch (c.type) {
+    case Node::bn_true  : return make_const(false);
+    case Node::bn_false : return make_const(true);
+    case Node::bn_not   : return c.left;
+    case Node::bn_test  :
+      return make_test(c.test.kind, c.test.size, c.test.offset, c.test.mask, c.test.jump, c.test.k, !c.test.negate);
+    default : {
+      Node n;
+      n.type  = Node::bn_not;
+      n.left  = child;
+      n.right = 0;
+      p_nodes.push_back(n);
+      return p_nodes.size() - 1;
+    }
+  }
+}
+
+// Returns the node testing that the frame holds an Ethernet header
+unsigned int BPFGenerator::ethernet() {
+  return make_test(BPFTest::bt_length, BPF_W, 0, 0xFFFFFFFF, BPF_JGE, 14);
+}
+
+// Returns the node testing that the frame holds a whole IPv4 header: IPv4
+// EtherType, version 4, header length of at least 20 bytes, all captured.
+// Loads are guarded by length tests, out of bounds loads rejecting the frame
+unsigned int BPFGenerator::ipv4() {
+  return make_binary(Node::bn_and, make_test(BPFTest::bt_length, BPF_W, 0, 0xFFFFFFFF, BPF_JGE, 14 + 20),
+         make_binary(Node::bn_and, make_test(BPFTest::bt_absolute, BPF_H, 12, 0xFFFFFFFF, BPF_JEQ, 0x0800),
+         make_binary(Node::bn_and, make_test(BPFTest::bt_absolute, BPF_B, 14, 0xFFFFFFFF, BPF_JGE, 0x45),
+         make_binary(Node::bn_and, make_test(BPFTest::bt_absolute, BPF_B, 14, 0xFFFFFFFF, BPF_JGT, 0x4F, true),
+                                   make_test(BPFTest::bt_header, BPF_W, 0, 0xFFFFFFFF, BPF_JGE, 14)))));
+}
+
+// Returns the node testing that the frame is the first fragment of an IPv4
+// packet of given protocol, whose payload holds at least given bytes both in
+// the capture and according to the IP total length
+unsigned int BPFGenerator::transport(unsigned int protocol, unsigned int bytes, bool superset) {
+  unsigned int n = make_binary(Node::bn_and, ipv4(),
+                   make_binary(Node::bn_and, make_test(BPFTest::bt_absolute, BPF_B, 23, 0xFFFFFFFF, BPF_JEQ, protocol),
+                   make_binary(Node::bn_and, make_test(BPFTest::bt_absolute, BPF_H, 20, 0xFFFFFFFF, BPF_JSET, 0x1FFF, true),
+                   make_binary(Node::bn_and, make_test(BPFTest::bt_remaining, BPF_W, 0, 0xFFFFFFFF, BPF_JGE, 14 + bytes),
+                                             make_test(BPFTest::bt_payload, BPF_W, 0, 0xFFFFFFFF, BPF_JGE, bytes)))));
+
+  // The TCP header must also fit the segment, which BPF cannot compare with
+  // the loaded data offset: a subset only admits 20 byte headers
+  if (protocol == 6) {
+    p_partial |= !superset;
+    n = make_binary(Node::bn_and, n, make_test(BPFTest::bt_indirect, BPF_B, 14 + 12, 0xF0,
+                                               superset ? BPF_JGE : BPF_JEQ, 0x50));
+  }
+
+  return n;
+}
+
+// Returns the node accepting the frames whose innermost headers are not the
+// ones at fixed offsets: VLAN tagged frames and tunnel carriers
+unsigned int BPFGenerator::bypass() {
+  unsigned int tunnel = make_binary(Node::bn_or,
+                        make_test(BPFTest::bt_absolute, BPF_B, 23, 0xFFFFFFFF, BPF_JEQ, 47),
+                        make_binary(Node::bn_or,
+                        make_test(BPFTest::bt_absolute, BPF_B, 23, 0xFFFFFFFF, BPF_JEQ, 4),
+                        make_binary(Node::bn_and, transport(17, 8, true),
+                                    make_test(BPFTest::bt_indirect, BPF_H, 14 + 2, 0xFFFFFFFF, BPF_JEQ, VXLAN_PORT))));
+
+  return make_binary(Node::bn_or,
+                     make_binary(Node::bn_and, ethernet(),
+                                 make_test(BPFTest::bt_absolute, BPF_H, 12, 0xFFFFFFFF, BPF_JEQ, 0x8100)),
+                     make_binary(Node::bn_and, ipv4(), tunnel));
+}
+
+// Translates a comparison of the filter. Returns a constant if it cannot be
+// expressed: true for a superset, false otherwise
+unsigned int BPFGenerator::compare(FilterField field, FilterOperator op, unsigned int k, unsigned int mask,
+                                   bool superset) {
+  unsigned int presence;
+  BPFTest      t;
+
+  // Prefix tables are only available to the process
+  if (op == fop_in) {
+    p_partial = true;
+    return make_const(superset);
+  }
+
+  t.kind = BPFTest::bt_absolute;
+  t.size = BPF_B;
+  t.offset = 0;
+
+  switch (field) {
+    case ff_eth_type     : presence = ethernet(); t.size = BPF_H; t.offset = 12; break;
+    case ff_ip           : presence = ipv4(); break;
+    case ff_ip_src       : presence = ipv4(); t.size = BPF_W; t.offset = 26; break;
+    case ff_ip_dst       : presence = ipv4(); t.size = BPF_W; t.offset = 30; break;
+    case ff_ip_proto     : presence = ipv4(); t.offset = 23; break;
+    case ff_ip_ttl       : presence = ipv4(); t.offset = 22; break;
+    case ff_ip_len       : presence = ipv4(); t.size = BPF_H; t.offset = 16; break;
+    case ff_tcp          : presence = transport(6, 20, superset); break;
+    case ff_tcp_srcport  : presence = transport(6, 20, superset); t.kind = BPFTest::bt_indirect; t.size = BPF_H; t.offset = 14; break;
+    case ff_tcp_dstport  : presence = transport(6, 20, superset); t.kind = BPFTest::bt_indirect; t.size = BPF_H; t.offset = 16; break;
+    case ff_tcp_flags    : presence = transport(6, 20, superset); t.kind = BPFTest::bt_indirect; t.offset = 14 + 13; break;
+    case ff_udp          : presence = transport(17, 8, superset); break;
+    case ff_udp_srcport  : presence = transport(17, 8, superset); t.kind = BPFTest::bt_indirect; t.size = BPF_H; t.offset = 14; break;
+    case ff_udp_dstport  : presence = transport(17, 8, superset); t.kind = BPFTest::bt_indirect; t.size = BPF_H; t.offset = 16; break;
+    case ff_icmp         : presence = transport(1, 8, superset); break;
+    case ff_icmp_type    : presence = transport(1, 8, superset); t.kind = BPFTest::bt_indirect; t.offset = 14; break;
+    case ff_icmp_code    : presence = transport(1, 8, superset); t.kind = BPFTest::bt_indirect; t.offset = 15; break;
+
+    default :
+      p_partial = true;
+      return make_const(superset);
+  }
+
+  // Presence tests, and fields only telling presence (worth 1), need no load
+  if (mask == 0 || t.offset == 0) {
+    unsigned int v = (t.offset == 0 ? 1 : 0) & mask;
+    bool         r;
+
+    switch (op) {
+      case fop_eq : r = (v == k); break;
+      case fop_ne : r = (v != k); break;
+      case fop_lt : r = (v <  k); break;
+      case fop_le : r = (v <= k); break;
+      case fop_gt : r = (v >  k); break;
+      default     : r = (v >= k); break;
+    }
+    return (r ? presence : make_const(false));
+  }
+
+  // Masks covering the whole field are useless
+  unsigned int width = (t.size == BPF_W ? 0xFFFFFFFF : t.size == BPF_H ? 0xFFFF : 0xFF);
+  t.mask = ((mask & width) == width ? 0xFFFFFFFF : mask);
+
+  // Comparisons map to forward jumps, possibly with swapped targets
+  switch (op) {
+    case fop_eq : t.jump = BPF_JEQ; t.negate = false; break;
+    case fop_ne : t.jump = BPF_JEQ; t.negate = true;  break;
+    case fop_gt : t.jump = BPF_JGT; t.negate = false; break;
+    case fop_ge : t.jump = BPF_JGE; t.negate = false; break;
+    case fop_lt : t.jump = BPF_JGE; t.negate = true;  break;
+    default     : t.jump = BPF_JGT; t.negate = true;  break;   // fop_le
+  }
+
+  return make_binary(Node::bn_and, presence, make_test(t.kind, t.size, t.offset, t.mask, t.jump, k, t.negate));
+}
+
+// Translates a node of the filter into a superset (or a subset, under an odd
+// number of negations) of the frames it accepts
+unsigned int BPFGenerator::build(unsigned int index, bool superset) {
+  const FilterNode & n = p_filter.node(index);
+
+  switch (n.type) {
+    case FilterNode::fn_const   : return make_const(n.value);
+    case FilterNode::fn_compare : return compare(n.field, n.op, n.operand, n.mask, superset);
+    case FilterNode::fn_and     : return make_binary(Node::bn_and, build(n.left, superset), build(n.right, superset));
+    case FilterNode::fn_or      : return make_binary(Node::bn_or, build(n.left, superset), build(n.right, superset));
+    case FilterNode::fn_not     : return make_not(build(n.left, !superset));
+    default :
+      p_partial = true;
+      return make_const(superset);
+  }
+}
+
+// Returns a new jump label
+unsigned int BPFGenerator::new_label() {
+  p_labels.push_back(-1);
+  return p_labels.size() - 1;
+}
+
+// Places a label on the next instruction
+void BPFGenerator::place(unsigned int label) {
+  p_labels[label] = p_code.size();
+}
+
+// Appends an instruction without jump
+void BPFGenerator::emit(unsigned short code, unsigned int k) {
+  emit_jump(code, k, BPFGEN_NONE, BPFGEN_NONE);
+}
+
+// Appends an instruction jumping to given labels, resolved later
+void BPFGenerator::emit_jump(unsigned short code, unsigned int k, unsigned int jt, unsigned int jf) {
+  bpf_insn in;
+
+  in.code = code;
+  in.jt   = in.jf = 0;
+  in.k    = k;
+  p_code.push_back(in);
+  p_targets.push_back(jt);
+  p_targets.push_back(jf);
+}
+
+// Generates the code of given node, jumping to label t if it holds and to
+// label f otherwise
+void BPFGenerator::generate(unsigned int index, unsigned int t, unsigned int f) {
+  const Node n = p_nodes[index];
+
+  switch (n.type) {
+    case Node::bn_true :
+      emit_jump(BPF_JMP | BPF_JA, 0, t, BPFGEN_NONE);
+      break;
+
+    case Node::bn_false :
+      emit_jump(BPF_JMP | BPF_JA, 0, f, BPFGEN_NONE);
+      break;
+
+    case Node::bn_and : {
+      unsigned int next = new_label();
+      generate(n.left, next, f);
+      place(next);
+      generate(n.right, t, f);
+      break;
+    }
+
+    case Node::bn_or : {
+      unsigned int next = new_label();
+      generate(n.left, t, next);
+      place(next);
+      generate(n.right, t, f);
+      break;
+    }
+
+    case Node::bn_not :
+      generate(n.left, f, t);
+      break;
+
+    case Node::bn_test : {
+      p_starts.resize(p_code.size() + 1, -1);
+      p_starts[p_code.size()] = index;
+
+      unsigned short src = (n.test.kind == BPFTest::bt_header ? BPF_X : BPF_K);
+      unsigned int   k   = (n.test.kind == BPFTest::bt_header ? 0 : n.test.k);
+
+      switch (n.test.kind) {
+        case BPFTest::bt_absolute :
+          emit(BPF_LD | n.test.size | BPF_ABS, n.test.offset);
+          break;
+        case BPFTest::bt_indirect :           // X = IPv4 header length
+          emit(BPF_LDX | BPF_B | BPF_MSH, 14);
+          emit(BPF_LD | n.test.size | BPF_IND, n.test.offset);
+          break;
+        case BPFTest::bt_length :
+          emit(BPF_LD | BPF_W | BPF_LEN, 0);
+          break;
+        case BPFTest::bt_remaining :          // frame length minus IPv4 header
+          emit(BPF_LDX | BPF_B | BPF_MSH, 14);
+          emit(BPF_LD | BPF_W | BPF_LEN, 0);
+          emit(BPF_ALU | BPF_SUB | BPF_X, 0);
+          break;
+        case BPFTest::bt_header :             // frame length minus Ethernet header, against X
+          emit(BPF_LDX | BPF_B | BPF_MSH, 14);
+          emit(BPF_LD | BPF_W | BPF_LEN, 0);
+          emit(BPF_ALU | BPF_SUB | BPF_K, n.test.k);
+          break;
+        case BPFTest::bt_payload :            // IP total length minus IPv4 header
+          emit(BPF_LDX | BPF_B | BPF_MSH, 14);
+          emit(BPF_LD | BPF_H | BPF_ABS, 16);
+          emit(BPF_ALU | BPF_SUB | BPF_X, 0);
+          break;
+      }
+
+      if (n.test.mask != 0xFFFFFFFF)
+        emit(BPF_ALU | BPF_AND | BPF_K, n.test.mask);
+
+      if (n.test.negate)
+        emit_jump(BPF_JMP | n.test.jump | src, k, f, t);
+      else
+        emit_jump(BPF_JMP | n.test.jump | src, k, t, f);
+      break;
+    }
+  }
+}
+
+// Returns true if the outcome of test b is known once test a has the given
+// outcome (both loading the same value), storing it in outcome
+static bool implied(const BPFTest & a, bool holds, const BPFTest & b, bool & outcome) {
+  if (a.kind != b.kind || a.size != b.size || a.offset != b.offset || a.mask != b.mask ||
+      (a.kind == BPFTest::bt_header && a.k != b.k))
+    return false;
+
+  if (a.jump == b.jump && a.k == b.k) {
+    outcome = holds;
+    return true;
+  }
+  if (a.kind == BPFTest::bt_header || a.jump == BPF_JSET || b.jump == BPF_JSET)
+    return false;
+
+  // Range of values a leaves, and range for which b holds
+  unsigned int lo = 0, hi = 0xFFFFFFFF, blo = b.k, bhi = 0xFFFFFFFF;
+
+  if (a.jump == BPF_JEQ) {
+    if (!holds)
+      return false;
+    lo = hi = a.k;
+  }
+  else {
+    unsigned int first = a.k + (a.jump == BPF_JGT);   // first value for which a holds
+    if (first == 0)
+      return false;
+    if (holds)
+      lo = first;
+    else
+      hi = first - 1;
+  }
+
+  if (b.jump == BPF_JEQ)
+    bhi = b.k;
+  else if (b.jump == BPF_JGT) {
+    if (b.k == 0xFFFFFFFF)
+      return false;
+    blo = b.k + 1;
+  }
+
+  if (lo >= blo && hi <= bhi)
+    outcome = true;
+  else if (hi < blo || lo > bhi)
+    outcome = false;
+  else
+    return false;
+
+  return true;
+}
+
+// Returns true if two tests load and compare the same way
+static bool same_test(const BPFTest & a, const BPFTest & b) {
+  return a.kind == b.kind && a.size == b.size && a.offset == b.offset && a.mask == b.mask &&
+         a.jump == b.jump && a.k == b.k;
+}
+
+// Redirects jumps landing on a test whose outcome is known along them (e.g.
+// repeated IPv4 header checks) to the target of that outcome. Jumps only
+// going forward, the jumps landing on a test are all known once the
+// instructions before it are done
+void BPFGenerator::thread_jumps() {
+  typedef vector< pair<BPFTest, bool> > Facts;
+
+  // Jumps landing on each instruction, and the outcomes known along them
+  vector< vector<unsigned int> > edges(p_code.size() + 1);
+  vector< vector<Facts> >        facts(p_code.size() + 1);
+
+  p_starts.resize(p_code.size() + 1, -1);
+
+  for (unsigned int i = 0; i < p_code.size(); i++) {
+    if (p_starts[i] < 0)
+      continue;
+
+    const BPFTest & t = p_nodes[p_starts[i]].test;
+
+    unsigned int j = i;
+    while (BPF_CLASS(p_code[j].code) != BPF_JMP)
+      j++;
+
+    // Jumps along which the outcome is known skip the test
+    unsigned int kept = 0;
+    for (unsigned int e = 0; e < edges[i].size(); e++) {
+      bool outcome = false, decided = false;
+
+      for (unsigned int f = 0; f < facts[i][e].size() && !decided; f++)
+        decided = implied(facts[i][e][f].first, facts[i][e][f].second, t, outcome);
+
+      if (decided) {
+        unsigned int label = p_targets[2*j + (outcome ? 0 : 1)];
+        int          pos   = p_labels[label];
+
+        p_targets[edges[i][e]] = label;
+        edges[pos].push_back(edges[i][e]);
+        facts[pos].push_back(facts[i][e]);
+      }
+      else {
+        edges[i][kept] = edges[i][e];
+        facts[i][kept] = facts[i][e];
+        kept++;
+      }
+    }
+    edges[i].resize(kept);
+    facts[i].resize(kept);
+
+    if (i > 0 && kept == 0)
+      continue;
+
+    // Outcomes known on every remaining path reaching the test
+    Facts known;
+    for (unsigned int f = 0; i > 0 && f < facts[i][0].size(); f++) {
+      bool everywhere = true;
+      for (unsigned int e = 1; e < kept && everywhere; e++) {
+        everywhere = false;
+        for (unsigned int g = 0; g < facts[i][e].size(); g++)
+          if (same_test(facts[i][e][g].first, facts[i][0][f].first) &&
+              facts[i][e][g].second == facts[i][0][f].second)
+            everywhere = true;
+      }
+      if (everywhere)
+        known.push_back(facts[i][0][f]);
+    }
+
+    // Each branch adds the outcome of the test to the known ones
+    for (unsigned int branch = 0; branch < 2; branch++) {
+      int pos = p_labels[p_targets[2*j + branch]];
+
+      edges[pos].push_back(2*j + branch);
+      facts[pos].push_back(known);
+      facts[pos].back().push_back(make_pair(t, branch == 0));
+    }
+  }
+}
+
+// Removes the instructions no jump reaches any more
+void BPFGenerator::remove_unreachable() {
+  vector<bool> reached(p_code.size(), false);
+  vector<int>  moved(p_code.size() + 1, 0);
+
+  reached[0] = true;
+  for (unsigned int i = 0; i < p_code.size(); i++) {
+    if (!reached[i])
+      continue;
+
+    unsigned short code = p_code[i].code;
+    if (BPF_CLASS(code) == BPF_JMP) {
+      reached[p_labels[p_targets[2*i]]] = true;
+      if (BPF_OP(code) != BPF_JA)
+        reached[p_labels[p_targets[2*i+1]]] = true;
+    }
+    else if (BPF_CLASS(code) != BPF_RET)
+      reached[i + 1] = true;
+  }
+
+  // Compact the program, labels moving to the next instruction kept
+  unsigned int n = 0;
+  for (unsigned int i = 0; i < p_code.size(); i++) {
+    moved[i] = n;
+    if (reached[i]) {
+      p_code[n] = p_code[i];
+      p_targets[2*n]   = p_targets[2*i];
+      p_targets[2*n+1] = p_targets[2*i+1];
+      n++;
+    }
+  }
+  moved[p_code.size()] = n;
+
+  for (unsigned int l = 0; l < p_labels.size(); l++)
+    if (p_labels[l] >= 0)
+      p_labels[l] = moved[p_labels[l]];
+
+  p_code.resize(n);
+  p_targets.resize(2*n);
+  p_starts.clear();
+}
+
+// Resolves jump labels into offsets. Returns false if a conditional jump is
+// too long
+bool BPFGenerator::resolve() {
+  for (unsigned int i = 0; i < p_code.size(); i++) {
+    bpf_insn & in = p_code[i];
+
+    if (BPF_CLASS(in.code) != BPF_JMP)
+      continue;
+
+    unsigned int jt = p_labels[p_targets[2*i]] - (i + 1);
+
+    if (BPF_OP(in.code) == BPF_JA) {
+      in.k = jt;
+      continue;
+    }
+
+    unsigned int jf = p_labels[p_targets[2*i+1]] - (i + 1);
+    if (jt > 255 || jf > 255)
+      return false;
+
+    in.jt = jt;
+    in.jf = jf;
+  }
+
+  return true;
+}
+
+// Runs given program (e.g. compiled by pcap_compile) before the generated
+// one: its accepting returns become jumps to the generated program
+void BPFGenerator::prepend(const bpf_program & first) {
+  vector<bpf_insn> code(first.bf_insns, first.bf_insns + first.bf_len);
+
+  for (unsigned int i = 0; i < code.size(); i++)
+    if (BPF_CLASS(code[i].code) == BPF_RET && !(BPF_RVAL(code[i].code) == BPF_K && code[i].k == 0)) {
+      code[i].code = BPF_JMP | BPF_JA;
+      code[i].k    = code.size() - (i + 1);
+    }
+
+  p_code.insert(p_code.begin(), code.begin(), code.end());
+}
+
+// Fills a program referencing the generated code, valid as long as the
+// instance
+void BPFGenerator::program(bpf_program & prog) {
+  prog.bf_len   = p_code.size();
+  prog.bf_insns = (p_code.empty() ? NULL : &p_code[0]);
+}
+
+// Output operator displaying the program in the form of tcpdump -d
+ostream & operator<<(ostream & ostr, const BPFGenerator & gen) {
+  static const char * sizes[] = { "", "h", "b" };
+  char outstr[64];
+
+  for (unsigned int i = 0; i < gen.p_code.size(); i++) {
+    const bpf_insn & in = gen.p_code[i];
+    const char *     sz = sizes[BPF_SIZE(in.code) >> 3];
+
+    switch (BPF_CLASS(in.code)) {
+      case BPF_LD :
+        if (BPF_MODE(in.code) == BPF_LEN)
+          sprintf(outstr, "ld       #pktlen");
+        else if (BPF_MODE(in.code) == BPF_IND)
+          sprintf(outstr, "ld%-6s [x + %u]", sz, in.k);
+        else
+          sprintf(outstr, "ld%-6s [%u]", sz, in.k);
+        break;
+      case BPF_LDX :
+        sprintf(outstr, "ldxb     4*([%u]&0xf)", in.k);
+        break;
+      case BPF_ALU :
+        if (BPF_OP(in.code) == BPF_AND)
+          sprintf(outstr, "and      #0x%x", in.k);
+        else if (BPF_SRC(in.code) == BPF_X)
+          sprintf(outstr, "sub      x");
+        else
+          sprintf(outstr, "sub      #%u", in.k);
+        break;
+      case BPF_JMP :
+        if (BPF_OP(in.code) == BPF_JA)
+          sprintf(outstr, "ja       %u", i + 1 + in.k);
+        else {
+          const char * op = (BPF_OP(in.code) == BPF_JEQ ? "jeq" : BPF_OP(in.code) == BPF_JGT ? "jgt" :
+                             BPF_OP(in.code) == BPF_JGE ? "jge" : "jset");
+          if (BPF_SRC(in.code) == BPF_X)
+            sprintf(outstr, "%-8s x jt %u jf %u", op, i + 1 + in.jt, i + 1 + in.jf);
+          else
+            sprintf(outstr, "%-8s #0x%x jt %u jf %u", op, in.k, i + 1 + in.jt, i + 1 + in.jf);
+        }
+        break;
+      case BPF_RET :
+        sprintf(outstr, "ret      #%u", in.k);
+        break;
+      default :
+        sprintf(outstr, "code 0x%x k %u", in.code, in.k);
+        break;
+    }
+
+    ostr << "(" << (i < 10 ? "00" : i < 100 ? "0" : "") << i << ") " << outstr << endl;
+  }
+
+  ostr << flush;
+
+  return ostr;
+}
+
+#endif
@@ -0,0 +1,153 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef BPFGEN_H
+#define BPFGEN_H
+
+#include <iostream>
+#include <vector>
+
+#include <pcap.h>               // bpf_insn, bpf_program
+
+#include "filter.h"             // PacketFilter, FilterNode
+
+using namespace std;
+
+#define BPFGEN_ACCEPT 262144    // bytes kept by accepting instructions (whole frame)
+
+/* BPFTest: elementary test of a classic BPF program: a header field loaded at
+ *   a fixed offset (or at an offset past the IPv4 header), optionally masked,
+ *   compared with a constant.
+ *
+ * Attributes
+ *   kind    : absolute load, load past the IPv4 header, frame length, IPv4
+ *             header captured (k is the bytes preceding it), or bytes past the
+ *             IPv4 header (captured, or according to the IP total length)
+ *   size    : BPF_W, BPF_H or BPF_B
+ *   offset  : offset of the field in the frame (or past the IPv4 header, plus 14)
+ *   mask    : bits compared (all ones for none)
+ *   jump    : BPF_JEQ, BPF_JGT, BPF_JGE or BPF_JSET
+ *   k       : constant compared with
+ *   negate  : test holds when the jump is not taken
+ */
+struct BPFTest {
+  // Enumeration of load kinds
+  typedef enum {
+    bt_absolute, bt_indirect, bt_length, bt_header, bt_remaining, bt_payload
+  } LoadKind;
+
+  LoadKind       kind;
+  unsigned short size;
+  unsigned int   offset;
+  unsigned int   mask;
+  unsigned short jump;
+  unsigned int   k;
+  bool           negate;
+};
+
+/* BPFGenerator: classic BPF program accepting a superset of the frames a
+ *   PacketFilter accepts, built from the tests of the filter that header
+ *   offsets can express (EtherType, IPv4 fields, protocols, ports, TCP flags,
+ *   ICMP type and code).
+ *
+ * Attributes
+ *   p_nodes   : boolean expression over BPF tests
+ *   p_code    : generated program
+ *   p_labels  : position of each jump label (-1 until placed)
+ *   p_targets : labels of the jumps of each instruction (true, false)
+ *   p_starts  : node of the test starting at each instruction (-1 if none)
+ *   p_valid   : a program narrowing the traffic was generated
+ *   p_partial : some tests of the filter were left to the process
+ *
+ * Notes
+ *   1. tests BPF cannot express (strings, prefix files, flow state, ...) are
+ *      replaced by whatever keeps the program a superset of the filter: true
+ *      where they count positively, false under a negation. The process still
+ *      evaluates the whole filter on the frames the kernel lets through.
+ *   2. the filter tests the innermost headers of tunneled frames, so VLAN
+ *      tagged frames and tunnel carriers (GRE, IP in IP, VXLAN) are always
+ *      accepted by the kernel.
+ *   3. jumps landing on a test whose outcome they imply (the IPv4 header
+ *      checks preceding each field, comparisons of the same field) are
+ *      threaded to the target of that outcome, and unreachable tests removed.
+ *   4. classic BPF only jumps forward, by at most 255 instructions for
+ *      conditional jumps; a filter needing longer jumps gets no kernel
+ *      program.
+ */
+class BPFGenerator {
+  public:
+    BPFGenerator(const PacketFilter &, unsigned int = BPFGEN_ACCEPT);  // parameterized constructor
+
+    bool valid() const;                                  // a program was generated
+    bool partial() const;                                // some tests are left to the process
+
+    void prepend(const bpf_program &);                   // runs given program first
+    void program(bpf_program &);                         // fills a program referencing the code
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, const BPFGenerator &);
+
+  private:
+    // Node of the boolean expression over BPF tests
+    struct Node {
+      typedef enum {
+        bn_true, bn_false, bn_test, bn_and, bn_or, bn_not
+      } NodeType;
+
+      NodeType     type;
+      BPFTest      test;
+      unsigned int left, right;
+    };
+
+    const PacketFilter & p_filter;
+    vector<Node>         p_nodes;
+    vector<bpf_insn>     p_code;
+    vector<int>          p_labels;
+    vector<unsigned int> p_targets;
+    vector<int>          p_starts;
+    bool                 p_valid, p_partial;
+
+    // Expression building, with constant folding
+    unsigned int make_const(bool);
+    unsigned int make_test(BPFTest::LoadKind, unsigned short, unsigned int, unsigned int,
+                           unsigned short, unsigned int, bool = false);
+    unsigned int make_binary(Node::NodeType, unsigned int, unsigned int);
+    unsigned int make_not(unsigned int);
+
+    unsigned int build(unsigned int, bool);              // translates a filter node
+    unsigned int compare(FilterField, FilterOperator, unsigned int, unsigned int, bool);
+    unsigned int ethernet();                             // frame holds an Ethernet header
+    unsigned int ipv4();                                 // frame holds an IPv4 header
+    unsigned int transport(unsigned int, unsigned int, bool);  // first fragment of given protocol
+    unsigned int bypass();                               // frames only the process can judge
+
+    // Code generation
+    unsigned int new_label();
+    void place(unsigned int);
+    void generate(unsigned int, unsigned int, unsigned int);
+    void emit(unsigned short, unsigned int);
+    void emit_jump(unsigned short, unsigned int, unsigned int, unsigned int);
+    void thread_jumps();
+    void remove_unreachable();
+    bool resolve();
+
+    // Copying is not allowed
+    BPFGenerator(const BPFGenerator &);
+    BPFGenerator & operator=(const BPFGenerator &);
+};
+
+#endif
@@ -0,0 +1,480 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef CLASSIFIER_CPP
+#define CLASSIFIER_CPP
+
+#include <cstdio>           // fopen, fgets, sscanf
+#include <cstring>          // strtok
+#include <cctype>           // isalpha
+#include <algorithm>        // sort, unique
+#include <map>
+
+#include "classifier.h"     // PacketClassifier
+#include "datagramfragment.h"  // hash_long
+
+// Returns the mask of a prefix of given length over 32 and 16 bits
+static inline unsigned int mask32(unsigned int len) {
+  return (len ? 0xFFFFFFFF << (32 - len) : 0);
+}
+
+static inline unsigned short mask16(unsigned int len) {
+  return (unsigned short)(len ? 0xFFFF << (16 - len) : 0);
+}
+
+// Returns true if key a sorts before key b
+static bool key_less(const ClassifierKey & a, const ClassifierKey & b) {
+  if (a.src != b.src)     return a.src < b.src;
+  if (a.dst != b.dst)     return a.dst < b.dst;
+  if (a.sport != b.sport) return a.sport < b.sport;
+  if (a.dport != b.dport) return a.dport < b.dport;
+  return a.proto < b.proto;
+}
+
+// Returns true if both keys are the same
+static inline bool key_equal(const ClassifierKey & a, const ClassifierKey & b) {
+  return a.src == b.src && a.dst == b.dst && a.sport == b.sport && a.dport == b.dport && a.proto == b.proto;
+}
+
+// Orders (masked key, rule) pairs by key, then by priority
+static bool entry_less(const pair<ClassifierKey,unsigned int> & a, const pair<ClassifierKey,unsigned int> & b) {
+  if (key_equal(a.first, b.first))
+    return a.second < b.second;
+  return key_less(a.first, b.first);
+}
+
+// Returns true if both (masked key, rule) pairs are the same
+static bool entry_same(const pair<ClassifierKey,unsigned int> & a, const pair<ClassifierKey,unsigned int> & b) {
+  return a.second == b.second && key_equal(a.first, b.first);
+}
+
+// Returns true if the key matches the rule
+bool ClassifierRule::matches(const ClassifierKey & k) const {
+  return ((k.src ^ src) & mask32(src_len)) == 0 && ((k.dst ^ dst) & mask32(dst_len)) == 0 &&
+         (k.proto & proto_mask) == proto &&
+         k.sport >= sport_lo && k.sport <= sport_hi && k.dport >= dport_lo && k.dport <= dport_hi;
+}
+
+// Parameterized constructor: number of port prefixes a range may expand to,
+// and granularity of the prefix lengths of tuples (1 to 16)
+PacketClassifier::PacketClassifier(unsigned int expansion, unsigned int granularity)
+  : p_expansion(expansion ? expansion : 1),
+    p_granularity(granularity < 1 ? 1 : granularity > 16 ? 16 : granularity),
+    p_built(false), p_malformed(0) {
+}
+
+// Adds a rule, of lower priority than the rules already added. Returns its
+// priority
+unsigned int PacketClassifier::add(const ClassifierRule & r) {
+  ClassifierRule rule = r;
+
+  // Normalize the rule so that masked keys compare with its fields
+  if (rule.src_len > 32) rule.src_len = 32;
+  if (rule.dst_len > 32) rule.dst_len = 32;
+  rule.src  &= mask32(rule.src_len);
+  rule.dst  &= mask32(rule.dst_len);
+  rule.proto_mask = (rule.proto_mask ? 0xFF : 0);
+  rule.proto &= rule.proto_mask;
+
+  p_rules.push_back(rule);
+  p_hits.push_back(0);
+  p_built = false;
+
+  return p_rules.size() - 1;
+}
+
+// Adds the rules of a file in ClassBench format. Returns the number of rules
+// added, or -1 if the file cannot be read
+int PacketClassifier::load(const char * fname) {
+  FILE * f = fopen(fname, "r");
+  char   line[512];
+  int    added = 0;
+
+  if (f == NULL)
+    return -1;
+
+  while (fgets(line, sizeof(line), f) != NULL) {
+    unsigned int   s[4], d[4], slen, dlen, slo, shi, dlo, dhi, proto, pmask;
+    int            used = 0;
+
+    if (line[0] != '@')
+      continue;
+
+    if (sscanf(line, "@%u.%u.%u.%u/%u %u.%u.%u.%u/%u %u : %u %u : %u %x/%x%n",
+               &s[0], &s[1], &s[2], &s[3], &slen, &d[0], &d[1], &d[2], &d[3], &dlen,
+               &slo, &shi, &dlo, &dhi, &proto, &pmask, &used) < 16 ||
+        slen > 32 || dlen > 32 || slo > shi || shi > 0xFFFF || dlo > dhi || dhi > 0xFFFF ||
+        proto > 0xFF || pmask > 0xFF) {
+      p_malformed++;
+      continue;
+    }
+
+    ClassifierRule r;
+    r.src        = s[0] << 24 | s[1] << 16 | s[2] << 8 | s[3];
+    r.dst        = d[0] << 24 | d[1] << 16 | d[2] << 8 | d[3];
+    r.src_len    = slen;
+    r.dst_len    = dlen;
+    r.proto      = proto;
+    r.proto_mask = pmask;
+    r.sport_lo   = slo;
+    r.sport_hi   = shi;
+    r.dport_lo   = dlo;
+    r.dport_hi   = dhi;
+    r.action     = ClassifierRule::ra_tag;
+    r.tag        = "match";
+
+    // Optional action, following any ClassBench flags
+    for (char * tok = strtok(line + used, " \t\r\n"); tok != NULL; tok = strtok(NULL, " \t\r\n"))
+      if (isalpha((unsigned char)tok[0])) {
+        if (strcmp(tok, "drop") == 0)
+          r.action = ClassifierRule::ra_drop;
+        else if (strcmp(tok, "accept") == 0)
+          r.action = ClassifierRule::ra_accept;
+        else
+          r.tag = tok;
+        break;
+      }
+
+    add(r);
+    added++;
+  }
+
+  fclose(f);
+  return added;
+}
+
+// Appends to prefixes the (value, length) prefixes covering a port range: the
+// exact expansion, or the smallest prefix holding the range if the expansion
+// needs more than p_expansion prefixes
+void PacketClassifier::expand(unsigned short lo, unsigned short hi,
+                              vector< pair<unsigned short,unsigned int> > & prefixes) const {
+  unsigned int first = prefixes.size();
+
+  for (unsigned int v = lo; v <= hi; ) {
+    unsigned int bits = 0;
+
+    // Largest aligned block starting at v and ending within the range
+    while (bits < 16 && (v & ((2U << bits) - 1)) == 0 && v + (2U << bits) - 1 <= hi)
+      bits++;
+
+    prefixes.push_back(make_pair((unsigned short)v, 16 - bits));
+    v += 1U << bits;
+  }
+
+  if (prefixes.size() - first > p_expansion) {
+    unsigned int len = 16;
+    while (len > 0 && ((lo ^ hi) & mask16(len)) != 0)
+      len--;
+
+    prefixes.resize(first);
+    prefixes.push_back(make_pair((unsigned short)(lo & mask16(len)), len));
+  }
+}
+
+// Returns the hash of a key
+unsigned long long PacketClassifier::hash(const ClassifierKey & k) {
+  return hash_long(((unsigned long long)k.src << 32 | k.dst) ^
+                   ((unsigned long long)(k.sport << 16 | k.dport) << 11) ^ ((unsigned long long)k.proto << 53));
+}
+
+// Masks a key to the prefix lengths of a tuple
+inline void PacketClassifier::mask(const ClassifierKey & k, const Tuple & t, ClassifierKey & masked) {
+  masked.src   = k.src & t.src_mask;
+  masked.dst   = k.dst & t.dst_mask;
+  masked.sport = k.sport & t.sport_mask;
+  masked.dport = k.dport & t.dport_mask;
+  masked.proto = k.proto & t.proto_mask;
+}
+
+// Builds the tuples from the rules. Called by the classification routines
+// when rules were added since the last build
+void PacketClassifier::build() {
+  typedef vector< pair<ClassifierKey,unsigned int> > Entries;
+
+  map<unsigned long long, Entries>            groups;
+  vector< pair<unsigned short,unsigned int> > sports, dports;
+
+  // Each rule yields an entry per combination of port prefixes, prefix
+  // lengths being rounded down to the granularity
+  for (unsigned int r = 0; r < p_rules.size(); r++) {
+    const ClassifierRule & rule = p_rules[r];
+    unsigned int           slen = rule.src_len - rule.src_len % p_granularity;
+    unsigned int           dlen = rule.dst_len - rule.dst_len % p_granularity;
+
+    sports.clear();
+    dports.clear();
+    expand(rule.sport_lo, rule.sport_hi, sports);
+    expand(rule.dport_lo, rule.dport_hi, dports);
+
+    for (unsigned int i = 0; i < sports.size(); i++)
+      for (unsigned int j = 0; j < dports.size(); j++) {
+        unsigned int spl = sports[i].second - sports[i].second % p_granularity;
+        unsigned int dpl = dports[j].second - dports[j].second % p_granularity;
+        unsigned long long sig = (unsigned long long)slen | dlen << 6 |
+                                 (rule.proto_mask ? 1 : 0) << 12 | spl << 13 | dpl << 18;
+        ClassifierKey k;
+
+        k.src   = rule.src & mask32(slen);
+        k.dst   = rule.dst & mask32(dlen);
+        k.sport = sports[i].first & mask16(spl);
+        k.dport = dports[j].first & mask16(dpl);
+        k.proto = rule.proto;
+        groups[sig].push_back(make_pair(k, r));
+      }
+  }
+
+  // One hash table per tuple, its slots holding the rules of a masked key
+  p_tuples.clear();
+  p_tuples.reserve(groups.size());
+
+  for (map<unsigned long long, Entries>::iterator g = groups.begin(); g != groups.end(); g++) {
+    Entries & e   = g->second;
+    unsigned long long sig = g->first;
+
+    // Port prefixes rounded down to the same one leave duplicates
+    sort(e.begin(), e.end(), entry_less);
+    e.erase(unique(e.begin(), e.end(), entry_same), e.end());
+
+    p_tuples.push_back(Tuple());
+    Tuple & t = p_tuples.back();
+
+    t.src_mask   = mask32(sig & 0x3F);
+    t.dst_mask   = mask32((sig >> 6) & 0x3F);
+    t.proto_mask = ((sig >> 12) & 1 ? 0xFF : 0);
+    t.sport_mask = mask16((sig >> 13) & 0x1F);
+    t.dport_mask = mask16((sig >> 18) & 0x1F);
+    t.best       = CLASSIFIER_NONE;
+
+    unsigned int slots = 4;
+    while (slots < 2 * e.size())
+      slots <<= 1;
+
+    Slot empty;
+    empty.count = 0;
+    t.slots.assign(slots, empty);
+
+    for (unsigned int i = 0; i < e.size(); ) {
+      unsigned int j = i;
+      while (j < e.size() && key_equal(e[j].first, e[i].first))
+        t.rules.push_back(e[j++].second);
+
+      unsigned int s = hash(e[i].first) & (slots - 1);
+      while (t.slots[s].count)
+        s = (s + 1) & (slots - 1);
+
+      t.slots[s].key   = e[i].first;
+      t.slots[s].first = t.rules.size() - (j - i);
+      t.slots[s].count = j - i;
+
+      if (e[i].second < t.best)
+        t.best = e[i].second;
+      i = j;
+    }
+  }
+
+  // Tuples holding the rules of highest priority come first
+  vector< pair<unsigned int,unsigned int> > order;
+  for (unsigned int i = 0; i < p_tuples.size(); i++)
+    order.push_back(make_pair(p_tuples[i].best, i));
+  sort(order.begin(), order.end());
+
+  vector<Tuple> sorted(order.size());
+  for (unsigned int i = 0; i < order.size(); i++)
+    sorted[i] = p_tuples[order[i].second];
+  p_tuples.swap(sorted);
+
+  p_built = true;
+}
+
+// Returns the rule of highest priority, better than best, among the rules of
+// the tuple stored under the masked key, probing from given slot
+unsigned int PacketClassifier::probe(const Tuple & t, const ClassifierKey & masked, const ClassifierKey & key,
+                                     unsigned int slot, unsigned int best) const {
+  unsigned int m = t.slots.size() - 1;
+
+  for (unsigned int s = slot & m; t.slots[s].count; s = (s + 1) & m)
+    if (key_equal(t.slots[s].key, masked)) {
+      // Rules are sorted by priority, and only covered port ranges need a check
+      for (unsigned int i = 0; i < t.slots[s].count; i++) {
+        unsigned int r = t.rules[t.slots[s].first + i];
+        if (r >= best)
+          break;
+        if (p_rules[r].matches(key))
+          return r;
+      }
+      break;
+    }
+
+  return best;
+}
+
+// Returns the priority of the first rule matching the key, CLASSIFIER_NONE if
+// none
+unsigned int PacketClassifier::classify(const ClassifierKey & key) {
+  unsigned int best = CLASSIFIER_NONE;
+
+  if (!p_built)
+    build();
+
+  for (unsigned int i = 0; i < p_tuples.size() && p_tuples[i].best < best; i++) {
+    ClassifierKey masked;
+
+    mask(key, p_tuples[i], masked);
+    best = probe(p_tuples[i], masked, key, hash(masked), best);
+  }
+
+  return best;
+}
+
+// Returns the priority of the first rule matching a dissected datagram,
+// CLASSIFIER_NONE if none or if it is not IPv4. The rule's hit count is
+// incremented
+unsigned int PacketClassifier::classify(const PacketMeta & meta) {
+  if (!meta.has_ip)
+    return CLASSIFIER_NONE;
+
+  ClassifierKey key;
+  key.src   = meta.src_ip;
+  key.dst   = meta.dst_ip;
+  key.sport = meta.sport;
+  key.dport = meta.dport;
+  key.proto = meta.protocol;
+
+  unsigned int r = classify(key);
+  if (r != CLASSIFIER_NONE)
+    p_hits[r]++;
+
+  return r;
+}
+
+// Classifies given number of keys, storing the priorities of their first
+// matching rules in results. Each tuple is probed for a batch of keys at a
+// time, the slots of the next tuple being hashed and prefetched before the
+// current one is probed
+void PacketClassifier::classify(const ClassifierKey * keys, unsigned int * results, unsigned int count) {
+  ClassifierKey masked[2][CLASSIFIER_BATCH];
+  unsigned int  slot[2][CLASSIFIER_BATCH];
+
+  if (!p_built)
+    build();
+
+  for (unsigned int b = 0; b < count; b += CLASSIFIER_BATCH) {
+    unsigned int n = (count - b < CLASSIFIER_BATCH ? count - b : CLASSIFIER_BATCH);
+
+    for (unsigned int i = 0; i < n; i++)
+      results[b + i] = CLASSIFIER_NONE;
+
+    if (!p_tuples.empty())
+      locate(p_tuples[0], keys + b, results + b, n, masked[0], slot[0]);
+
+    for (unsigned int t = 0; t < p_tuples.size(); t++) {
+      const Tuple & tuple = p_tuples[t];
+      bool          needed = false;
+
+      // Tuples come by priority: once no key can find a better rule in this
+      // one, none can in the following ones
+      for (unsigned int i = 0; i < n && !needed; i++)
+        needed = (tuple.best < results[b + i]);
+      if (!needed)
+        break;
+
+      // Slots of the next tuple are fetched while this one is probed; keys
+      // finding a better rule here may then skip them
+      if (t + 1 < p_tuples.size())
+        locate(p_tuples[t + 1], keys + b, results + b, n, masked[(t + 1) & 1], slot[(t + 1) & 1]);
+
+      for (unsigned int i = 0; i < n; i++)
+        if (tuple.best < results[b + i])
+          results[b + i] = probe(tuple, masked[t & 1][i], keys[b + i], slot[t & 1][i], results[b + i]);
+    }
+  }
+}
+
+// Masks and hashes the keys that may find a better rule in a tuple than
+// their current results, prefetching their slots
+void PacketClassifier::locate(const Tuple & t, const ClassifierKey * keys, const unsigned int * results,
+                              unsigned int n, ClassifierKey * masked, unsigned int * slot) const {
+  for (unsigned int i = 0; i < n; i++)
+    if (t.best < results[i]) {
+      mask(keys[i], t, masked[i]);
+      slot[i] = hash(masked[i]) & (t.slots.size() - 1);
+      __builtin_prefetch(&t.slots[slot[i]]);
+    }
+}
+
+// Returns the rule of given priority
+const ClassifierRule & PacketClassifier::rule(unsigned int r) const {
+  return p_rules[r];
+}
+
+// Returns the number of rules
+unsigned int PacketClassifier::size() const {
+  return p_rules.size();
+}
+
+// Returns the number of tuples (0 until built)
+unsigned int PacketClassifier::tuples() const {
+  return p_tuples.size();
+}
+
+// Returns the number of lines of loaded files that were rejected
+unsigned int PacketClassifier::malformed() const {
+  return p_malformed;
+}
+
+// Returns the number of bytes used by the tuples
+unsigned long long PacketClassifier::memory() const {
+  unsigned long long bytes = 0;
+
+  for (unsigned int i = 0; i < p_tuples.size(); i++)
+    bytes += sizeof(Tuple) + p_tuples[i].slots.size() * sizeof(Slot) + p_tuples[i].rules.size() * sizeof(unsigned int);
+
+  return bytes;
+}
+
+// Output operator displaying the rules that classified datagrams, by
+// decreasing number of hits
+ostream & operator<<(ostream & ostr, const PacketClassifier & c) {
+  static const char * actions[] = { "tag", "accept", "drop" };
+  vector< pair<unsigned long long,unsigned int> > hits;
+  char outstr[160];
+
+  for (unsigned int r = 0; r < c.p_rules.size(); r++)
+    if (c.p_hits[r])
+      hits.push_back(make_pair(c.p_hits[r], r));
+  sort(hits.rbegin(), hits.rend());
+
+  ostr << "Classifier: " << c.p_rules.size() << " rules in " << c.p_tuples.size() << " tuples ("
+       << c.memory() / 1024 << " KB), " << hits.size() << " rules matched" << endl;
+
+  for (unsigned int i = 0; i < hits.size() && i < 20; i++) {
+    const ClassifierRule & r = c.p_rules[hits[i].second];
+
+    sprintf(outstr, "  #%-6u %u.%u.%u.%u/%u -> %u.%u.%u.%u/%u  %u:%u -> %u:%u  proto %s%u  %s %s",
+            hits[i].second, r.src >> 24, (r.src >> 16) & 0xFF, (r.src >> 8) & 0xFF, r.src & 0xFF, r.src_len,
+            r.dst >> 24, (r.dst >> 16) & 0xFF, (r.dst >> 8) & 0xFF, r.dst & 0xFF, r.dst_len,
+            r.sport_lo, r.sport_hi, r.dport_lo, r.dport_hi, (r.proto_mask ? "" : "any "),
+            r.proto, actions[r.action], (r.action == ClassifierRule::ra_tag ? r.tag.c_str() : ""));
+    ostr << outstr << "  " << hits[i].first << " datagrams" << endl;
+  }
+
+  ostr << flush;
+
+  return ostr;
+}
+
+#endif
@@ -0,0 +1,165 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef CLASSIFIER_H
+#define CLASSIFIER_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include "packetmeta.h"         // PacketMeta
+
+using namespace std;
+
+#define CLASSIFIER_NONE  0xFFFFFFFF     // no rule matched
+#define CLASSIFIER_BATCH 16             // keys whose table slots are prefetched together
+
+/* ClassifierKey: fields of a datagram a rule set classifies on.
+ */
+struct ClassifierKey {
+  unsigned int   src, dst;      // IPv4 addresses (host order)
+  unsigned short sport, dport;  // transport ports (0 if none)
+  unsigned char  proto;         // IP protocol
+};
+
+/* ClassifierRule: rule of a firewall-like rule set.
+ *
+ * Attributes
+ *   src, src_len       : source prefix
+ *   dst, dst_len       : destination prefix
+ *   proto, proto_mask  : IP protocol (mask 0 for any protocol)
+ *   sport_lo, sport_hi : range of source ports
+ *   dport_lo, dport_hi : range of destination ports
+ *   action             : what to do with datagrams matching the rule
+ *   tag                : name of the tag of tagging rules
+ */
+struct ClassifierRule {
+  // Enumeration of actions
+  typedef enum {
+    ra_tag, ra_accept, ra_drop
+  } Action;
+
+  unsigned int   src, dst;
+  unsigned char  src_len, dst_len;
+  unsigned char  proto, proto_mask;
+  unsigned short sport_lo, sport_hi, dport_lo, dport_hi;
+  Action         action;
+  string         tag;
+
+  bool matches(const ClassifierKey &) const;     // key matches the rule
+};
+
+/* PacketClassifier: classifies datagrams against a rule set using tuple space
+ *   search. Rules are prioritized in the order they are added: the first
+ *   rule matching a datagram wins.
+ *
+ * Attributes
+ *   p_rules       : rules, in priority order
+ *   p_hits        : datagrams classified by each rule
+ *   p_tuples      : hash tables of rules sharing the same prefix lengths
+ *   p_expansion   : port prefixes a range may expand to (see note 2)
+ *   p_granularity : prefix lengths of tuples are multiples of it (see note 3)
+ *   p_built       : tuples reflect the rules
+ *   p_malformed   : lines of loaded files rejected
+ *
+ * Notes
+ *   1. rules are grouped by tuple, the prefix lengths of their fields. Each
+ *      tuple is a hash table keyed on the fields masked to those lengths, so
+ *      classifying costs one probe per tuple whatever the number of rules.
+ *      Tuples are searched by increasing priority of their best rule, and the
+ *      search stops at the first tuple that cannot beat the match found.
+ *   2. port ranges are expanded into prefixes (up to 30 for a 16-bit range).
+ *      A range needing more than p_expansion prefixes is covered by the
+ *      smallest prefix holding it instead, and its candidates checked
+ *      against the range: small values save memory, large values save
+ *      checks.
+ *   3. prefix lengths are rounded down to multiples of p_granularity to
+ *      build tuples, candidates being checked against the rule itself.
+ *      Random prefix lengths would otherwise make about as many tuples as
+ *      rules. A granularity of 8 bounds them to 5 lengths per address and 3
+ *      per port; larger values make fewer tuples with more candidates per
+ *      slot, 1 makes exact tuples.
+ *   4. the batch classification probes each tuple for CLASSIFIER_BATCH keys
+ *      at a time, hashing the keys for the next tuple and prefetching their
+ *      slots while the current one is probed. Masking and hashing dominate
+ *      while the tuples fit in the cache, and batches are then no faster;
+ *      with 100000 rules (9 MB of tuples) they classify 15 to 35% more keys
+ *      per second.
+ *   5. rule files follow the ClassBench format, one rule per line:
+ *        @a.b.c.d/len  a.b.c.d/len  lo : hi  lo : hi  0xPP/0xMM  [action]
+ *      where action is "drop", "accept" or a tag name (default "match").
+ */
+class PacketClassifier {
+  public:
+    PacketClassifier(unsigned int = 8, unsigned int = 8);  // parameterized constructor
+
+    unsigned int add(const ClassifierRule &);            // adds a rule of lowest priority
+    int load(const char *);                              // adds the rules of a file
+    void build();                                        // builds the tuples from the rules
+
+    unsigned int classify(const ClassifierKey &);        // returns the rule matched by a key
+    unsigned int classify(const PacketMeta &);           // returns the rule matched by a datagram, counted
+    void classify(const ClassifierKey *, unsigned int *, unsigned int);  // batch classification
+
+    const ClassifierRule & rule(unsigned int) const;     // rule of given priority
+    unsigned int size() const;                           // number of rules
+    unsigned int tuples() const;                         // number of tuples
+    unsigned int malformed() const;                      // lines of loaded files rejected
+    unsigned long long memory() const;                   // bytes used by the tuples
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, const PacketClassifier &);
+
+  private:
+    // Slot of a tuple: masked key and the rules sharing it, by priority
+    struct Slot {
+      ClassifierKey key;
+      unsigned int  first, count;
+    };
+
+    // Hash table of the rules of same prefix lengths
+    struct Tuple {
+      unsigned int         src_mask, dst_mask;
+      unsigned short       sport_mask, dport_mask;
+      unsigned char        proto_mask;
+      unsigned int         best;            // priority of its best rule
+      vector<Slot>         slots;           // power of two, empty slots have no rule
+      vector<unsigned int> rules;
+    };
+
+    vector<ClassifierRule>     p_rules;
+    vector<unsigned long long> p_hits;
+    vector<Tuple>              p_tuples;
+    unsigned int               p_expansion, p_granularity;
+    bool                       p_built;
+    unsigned int               p_malformed;
+
+    void expand(unsigned short, unsigned short, vector< pair<unsigned short,unsigned int> > &) const;
+    static unsigned long long hash(const ClassifierKey &);
+    static void mask(const ClassifierKey &, const Tuple &, ClassifierKey &);
+    unsigned int probe(const Tuple &, const ClassifierKey &, const ClassifierKey &, unsigned int,
+                       unsigned int) const;
+    void locate(const Tuple &, const ClassifierKey *, const unsigned int *, unsigned int, ClassifierKey *,
+                unsigned int *) const;
+
+    // Copying is not allowed
+    PacketClassifier(const PacketClassifier &);
+    PacketClassifier & operator=(const PacketClassifier &);
+};
+
+#endif
@@ -157,4 +157,28 @@ unsigned int char4word(const unsigned char *p) {
     return res;
 }
 
+// Utility function mixing the bits of an unsigned int so that it can be used
+// as a hash table index (finalizer of MurmurHash3)
+unsigned int hash_word(unsigned int h) {
+    h ^= h >> 16;
+    h *= 0x85EBCA6B;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35;
+    h ^= h >> 16;
+
+    return h;
+}
+
+// Utility function mixing the bits of an unsigned long long so that all of
+// them may be used as independent hash bits (finalizer of SplitMix64)
+unsigned long long hash_long(unsigned long long h) {
+    h ^= h >> 30;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 27;
+    h *= 0x94D049BB133111EBULL;
+    h ^= h >> 31;
+
+    return h;
+}
+
 #endif
@@ -70,5 +70,7 @@ class DatagramFragment {
 
 unsigned int char2word(const unsigned char *p);    // utility function to extract an unsigned int from 2 bytes
 unsigned int char4word(const unsigned char *p);    // utility function to extract an unsigned int from 4 bytes
+unsigned int hash_word(unsigned int);              // utility function mixing the bits of an unsigned int
+unsigned long long hash_long(unsigned long long);  // utility function mixing the bits of an unsigned long long
 
 #endif
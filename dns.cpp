@@ -0,0 +1,492 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef DNS_CPP
+#define DNS_CPP
+
+#include "dns.h"
+
+#define DNS_HEADER_LEN 12     // length of DNS message header in bytes
+#define DNS_PROBES      4     // slots probed by the transaction table
+
+// Default constructor
+DNSMessage::DNSMessage(bool owned) : DatagramFragment(owned) {
+}
+
+// Parameterized constructor
+DNSMessage::DNSMessage(bool owned, unsigned char * s, unsigned int l) : DatagramFragment(owned, s, l) {
+}
+
+// Returns the DNS message header length in bytes
+unsigned int DNSMessage::header_length() const {
+  return DNS_HEADER_LEN;
+}
+
+// Returns true if the data block is large enough to hold a DNS header
+bool DNSMessage::valid() const {
+  return p_data != NULL && p_len >= DNS_HEADER_LEN;
+}
+
+// Returns the transaction identifier field
+unsigned int DNSMessage::id() const {
+  return char2word(p_data);
+}
+
+// Returns true if the message is a response (QR flag set)
+bool DNSMessage::is_response() const {
+  return p_data[2] & 0x80;
+}
+
+// Returns the opcode field (0 = standard query)
+unsigned int DNSMessage::opcode() const {
+  return (p_data[2] >> 3) & 0x0F;
+}
+
+// Returns the AA (authoritative answer) flag value
+bool DNSMessage::flag_aa() const {
+  return p_data[2] & 0x04;
+}
+
+// Returns the TC (truncated) flag value
+bool DNSMessage::flag_tc() const {
+  return p_data[2] & 0x02;
+}
+
+// Returns the RD (recursion desired) flag value
+bool DNSMessage::flag_rd() const {
+  return p_data[2] & 0x01;
+}
+
+// Returns the RA (recursion available) flag value
+bool DNSMessage::flag_ra() const {
+  return p_data[3] & 0x80;
+}
+
+// Returns the response code field
+unsigned int DNSMessage::rcode() const {
+  return p_data[3] & 0x0F;
+}
+
+// Returns the number of entries in the question section
+unsigned int DNSMessage::qdcount() const {
+  return char2word(p_data+4);
+}
+
+// Returns the number of resource records in the answer section
+unsigned int DNSMessage::ancount() const {
+  return char2word(p_data+6);
+}
+
+// Returns the number of resource records in the authority section
+unsigned int DNSMessage::nscount() const {
+  return char2word(p_data+8);
+}
+
+// Returns the number of resource records in the additional section
+unsigned int DNSMessage::arcount() const {
+  return char2word(p_data+10);
+}
+
+// Decodes the domain name starting at offset pos into buf (dotted form, null
+// terminated). Compression pointers are followed, but each one must point before
+// the previous one, which makes pointer loops impossible. On return, next holds
+// the offset of the byte following the name as encoded at pos. Returns false if
+// the name is malformed or does not fit in buf
+bool DNSMessage::name(unsigned int pos, char * buf, unsigned int buflen, unsigned int & next) const {
+  unsigned int limit  = pos,      // pointers must target bytes before this offset
+               out    = 0;        // number of characters written in buf
+  bool         jumped = false;    // indicates if a pointer was followed
+
+  if (buf == NULL || buflen == 0)
+    return false;
+
+  while (true) {
+    if (pos >= p_len)
+      return false;
+
+    unsigned int len = p_data[pos];
+
+    // Compression pointer: continue decoding at an earlier offset
+    if ((len & 0xC0) == 0xC0) {
+      if (pos + 1 >= p_len)
+        return false;
+
+      unsigned int target = (len & 0x3F) << 8 | p_data[pos+1];
+      if (target >= limit)
+        return false;
+
+      if (!jumped) {
+        next   = pos + 2;
+        jumped = true;
+      }
+
+      pos = limit = target;
+      continue;
+    }
+
+    // Extended label types (0x40 and 0x80) are obsolete
+    if (len & 0xC0)
+      return false;
+
+    // Root label ends the name
+    if (len == 0) {
+      if (!jumped)
+        next = pos + 1;
+      break;
+    }
+
+    // Make sure the label is within the message and fits in the buffer
+    if (pos + 1 + len > p_len || out + len + 1 >= buflen || out + len + 1 > 255)
+      return false;
+
+    if (out > 0)
+      buf[out++] = '.';
+
+    for (unsigned int i = 1; i <= len; i++) {
+      unsigned char c = p_data[pos+i];
+      buf[out++] = (c >= 32 && c <= 126 ? c : '?');
+    }
+
+    pos += len + 1;
+  }
+
+  // The root domain is displayed as a single dot
+  if (out == 0)
+    buf[out++] = '.';
+  buf[out] = '\0';
+
+  return true;
+}
+
+// Moves pos past the encoded name found at that offset without decoding it.
+// Returns false if the name runs past the end of the message
+bool DNSMessage::skip_name(unsigned int & pos) const {
+  while (pos < p_len) {
+    unsigned int len = p_data[pos];
+
+    if ((len & 0xC0) == 0xC0) {             // pointer ends the encoded name
+      pos += 2;
+      return pos <= p_len;
+    }
+    else if (len & 0xC0)                    // obsolete label types
+      return false;
+    else if (len == 0) {                    // root label ends the name
+      pos++;
+      return true;
+    }
+
+    pos += len + 1;
+  }
+
+  return false;
+}
+
+// Returns the offset of the first question of the message
+unsigned int DNSMessage::first_question() const {
+  return DNS_HEADER_LEN;
+}
+
+// Decodes the question starting at offset pos and moves pos to the following
+// entry. The question name is decoded in buf unless buf is NULL, in which case
+// it is skipped. Returns false if the question is malformed
+bool DNSMessage::next_question(unsigned int & pos, DNSQuestion & q, char * buf, unsigned int buflen) const {
+  if (buf != NULL) {
+    if (!name(pos, buf, buflen, pos))
+      return false;
+  }
+  else if (!skip_name(pos))
+    return false;
+
+  // Question type and class follow the name
+  if (pos + 4 > p_len)
+    return false;
+
+  q.qtype  = char2word(p_data+pos);
+  q.qclass = char2word(p_data+pos+2);
+  pos += 4;
+
+  return true;
+}
+
+// Decodes the resource record starting at offset pos and moves pos to the
+// following record. The owner name is decoded in buf unless buf is NULL, in
+// which case it is skipped. Returns false if the record is malformed
+bool DNSMessage::next_record(unsigned int & pos, DNSRecord & rr, char * buf, unsigned int buflen) const {
+  if (buf != NULL) {
+    if (!name(pos, buf, buflen, pos))
+      return false;
+  }
+  else if (!skip_name(pos))
+    return false;
+
+  // Fixed part of the record follows the name
+  if (pos + 10 > p_len)
+    return false;
+
+  rr.type     = char2word(p_data+pos);
+  rr.rclass   = char2word(p_data+pos+2);
+  rr.ttl      = char4word(p_data+pos+4);
+  rr.rdlength = char2word(p_data+pos+8);
+  rr.rdoffset = pos + 10;
+  rr.rdata    = p_data + rr.rdoffset;
+
+  if (rr.rdoffset + rr.rdlength > p_len)
+    return false;
+
+  pos = rr.rdoffset + rr.rdlength;
+
+  return true;
+}
+
+// Returns a string textually identifying most popular record types
+const char * DNSMessage::type_name(unsigned int type) {
+  switch (type) {
+    case   1: return "A";
+    case   2: return "NS";
+    case   5: return "CNAME";
+    case   6: return "SOA";
+    case  12: return "PTR";
+    case  15: return "MX";
+    case  16: return "TXT";
+    case  28: return "AAAA";
+    case  33: return "SRV";
+    case  41: return "OPT";
+    case  43: return "DS";
+    case  46: return "RRSIG";
+    case  48: return "DNSKEY";
+    case  64: return "SVCB";
+    case  65: return "HTTPS";
+    case 255: return "ANY";
+    default : return "unknown";
+  }
+}
+
+// Returns a string textually identifying response codes
+const char * DNSMessage::rcode_name(unsigned int code) {
+  switch (code) {
+    case 0 : return "NOERROR";
+    case 1 : return "FORMERR";
+    case 2 : return "SERVFAIL";
+    case 3 : return "NXDOMAIN";
+    case 4 : return "NOTIMP";
+    case 5 : return "REFUSED";
+    default: return "unknown";
+  }
+}
+
+// Output operator displaying the DNS message header, questions and resource
+// records in human readable form
+ostream & operator<<(ostream & ostr, const DNSMessage & dns) {
+  if (dns.valid()) {
+    char outstr[48];
+    char name[DNS_MAX_NAME];
+
+    sprintf(outstr, "0x%.4x", dns.id());
+    ostr << "transaction ID = " << outstr << endl;
+    ostr << "message type = " << (dns.is_response() ? "response" : "query")
+         << " (opcode = " << dns.opcode() << ")" << endl;
+    ostr << "flags = " << (dns.flag_aa() ? "AA " : "") << (dns.flag_tc() ? "TC " : "")
+         << (dns.flag_rd() ? "RD " : "") << (dns.flag_ra() ? "RA " : "") << endl;
+    if (dns.is_response())
+      ostr << "response code = " << DNSMessage::rcode_name(dns.rcode())
+           << " [" << dns.rcode() << "]" << endl;
+    ostr << "questions = " << dns.qdcount() << ", answers = " << dns.ancount()
+         << ", authority = " << dns.nscount() << ", additional = " << dns.arcount() << endl;
+
+    // Display questions
+    unsigned int pos = dns.first_question();
+    for (unsigned int i = 0; i < dns.qdcount(); i++) {
+      DNSQuestion q;
+      if (!dns.next_question(pos, q, name, sizeof(name))) {
+        ostr << "  malformed question" << endl;
+        return ostr << flush;
+      }
+
+      ostr << "  question #" << i << ": " << name << " "
+           << DNSMessage::type_name(q.qtype) << " [" << q.qtype << "]" << endl;
+    }
+
+    // Display resource records of all three sections
+    unsigned int count = dns.ancount() + dns.nscount() + dns.arcount();
+    for (unsigned int i = 0; i < count; i++) {
+      DNSRecord rr;
+      if (!dns.next_record(pos, rr, name, sizeof(name))) {
+        ostr << "  malformed resource record" << endl;
+        return ostr << flush;
+      }
+
+      ostr << "  record #" << i << ": " << name << " "
+           << DNSMessage::type_name(rr.type) << " ttl = " << rr.ttl;
+
+      // Display the record data of most common types
+      unsigned int next;
+      if (rr.type == 1 && rr.rdlength == 4) {
+        sprintf(outstr, "%d.%d.%d.%d", rr.rdata[0], rr.rdata[1], rr.rdata[2], rr.rdata[3]);
+        ostr << " -> " << outstr;
+      }
+      else if (rr.type == 28 && rr.rdlength == 16) {
+        ostr << " -> ";
+        for (unsigned int j = 0; j < 16; j += 2) {
+          sprintf(outstr, "%x", char2word(rr.rdata+j));
+          ostr << outstr << (j < 14 ? ":" : "");
+        }
+      }
+      else if ((rr.type == 2 || rr.type == 5 || rr.type == 12) &&
+               dns.name(rr.rdoffset, name, sizeof(name), next))
+        ostr << " -> " << name;
+      else if (rr.type == 15 && rr.rdlength > 2 &&
+               dns.name(rr.rdoffset + 2, name, sizeof(name), next))
+        ostr << " -> " << char2word(rr.rdata) << " " << name;
+      else
+        ostr << " (" << rr.rdlength << " bytes)";
+
+      ostr << endl;
+    }
+  }
+
+  ostr << flush;
+
+  return ostr;
+}
+
+// Parameterized constructor: the table size is rounded up to a power of two
+DNSTransactionTable::DNSTransactionTable(unsigned int size)
+  : p_queries(0), p_matched(0), p_orphans(0), p_evicted(0), p_latency(0) {
+  unsigned int n = DNS_PROBES;
+  while (n < size)
+    n <<= 1;
+
+  p_slots = new Slot[n];
+  p_mask  = n - 1;
+  memset(p_slots, 0, n * sizeof(Slot));
+}
+
+// Destructor
+DNSTransactionTable::~DNSTransactionTable() {
+  delete [] p_slots;
+}
+
+// Returns the first slot to probe for given transaction
+unsigned int DNSTransactionTable::slot(unsigned int client, unsigned int port, unsigned int id) const {
+  return hash_word(client ^ (port << 16 | id)) & p_mask;
+}
+
+// Records a query sent by client at given time. A pending query with the same
+// transaction is replaced (retransmission), otherwise a free slot among the
+// probed ones is used if any, otherwise the oldest pending query is overwritten
+void DNSTransactionTable::query(unsigned int client, unsigned int port, unsigned int id,
+                                unsigned long long now) {
+  unsigned int first = slot(client, port, id),
+               victim = first;
+  bool         found = false;
+
+  p_queries++;
+
+  // Retransmission of a pending query, wherever it lies among the probed slots
+  for (unsigned int i = 0; i < DNS_PROBES && !found; i++) {
+    Slot & s = p_slots[(first + i) & p_mask];
+
+    if (s.time != 0 && s.client == client && s.port == port && s.id == id) {
+      victim = (first + i) & p_mask;
+      found  = true;
+    }
+  }
+
+  // Otherwise the first free slot, or the oldest pending query
+  for (unsigned int i = 0; i < DNS_PROBES && !found; i++) {
+    Slot & s = p_slots[(first + i) & p_mask];
+
+    if (s.time == 0) {
+      victim = (first + i) & p_mask;
+      found  = true;
+    }
+    else if (s.time < p_slots[victim].time)
+      victim = (first + i) & p_mask;
+  }
+
+  if (!found)
+    p_evicted++;
+
+  Slot & s = p_slots[victim];
+  s.time   = now ? now : 1;
+  s.client = client;
+  s.port   = port;
+  s.id     = id;
+}
+
+// Pairs a response sent to client with its pending query. Returns true and the
+// query/response delay (microseconds) if the query was found
+bool DNSTransactionTable::response(unsigned int client, unsigned int port, unsigned int id,
+                                   unsigned long long now, unsigned long long & delay) {
+  unsigned int first = slot(client, port, id);
+
+  for (unsigned int i = 0; i < DNS_PROBES; i++) {
+    Slot & s = p_slots[(first + i) & p_mask];
+
+    if (s.time != 0 && s.client == client && s.port == port && s.id == id) {
+      delay  = (now > s.time ? now - s.time : 0);
+      s.time = 0;
+
+      p_matched++;
+      p_latency += delay;
+
+      return true;
+    }
+  }
+
+  p_orphans++;
+
+  return false;
+}
+
+// Returns the number of queries recorded
+unsigned long long DNSTransactionTable::queries() const {
+  return p_queries;
+}
+
+// Returns the number of responses paired with their query
+unsigned long long DNSTransactionTable::matched() const {
+  return p_matched;
+}
+
+// Returns the number of responses without a pending query
+unsigned long long DNSTransactionTable::orphans() const {
+  return p_orphans;
+}
+
+// Returns the number of pending queries overwritten before being answered
+unsigned long long DNSTransactionTable::evicted() const {
+  return p_evicted;
+}
+
+// Returns the average query/response delay in microseconds
+unsigned long long DNSTransactionTable::average_latency() const {
+  return p_matched ? p_latency / p_matched : 0;
+}
+
+// Output operator displaying the pairing statistics
+ostream & operator<<(ostream & ostr, const DNSTransactionTable & t) {
+  ostr << "DNS queries = " << t.queries() << ", answered = " << t.matched()
+       << ", unsolicited responses = " << t.orphans() << ", evicted = " << t.evicted() << endl;
+  ostr << "DNS average response time = " << t.average_latency() << " us" << endl;
+
+  ostr << flush;
+
+  return ostr;
+}
+
+#endif
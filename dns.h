@@ -0,0 +1,171 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef DNS_H
+#define DNS_H
+
+#include <iostream>
+
+#include "datagramfragment.h"   // DatagramFragment
+
+using namespace std;
+
+#define DNS_MAX_NAME 256        // buffer size able to hold any decoded domain name
+
+/* DNSQuestion: attributes of an entry in the question section of a DNS message.
+ *   The name itself is decoded in a buffer supplied by the caller.
+ */
+struct DNSQuestion {
+  unsigned int qtype;           // type of the query (A, AAAA, MX, ...)
+  unsigned int qclass;          // class of the query (usually IN)
+};
+
+/* DNSRecord: attributes of a resource record found in the answer, authority or
+ *   additional sections of a DNS message. The owner name is decoded in a buffer
+ *   supplied by the caller, and rdata points inside the message bytes.
+ */
+struct DNSRecord {
+  unsigned int          type;        // type of the record
+  unsigned int          rclass;      // class of the record
+  unsigned int          ttl;         // time to live in seconds
+  unsigned int          rdlength;    // length of rdata in bytes
+  unsigned int          rdoffset;    // offset of rdata within the message
+  const unsigned char * rdata;       // record data (not owned)
+};
+
+/* DNSMessage: class mapping the inherited data block as a DNS message.
+ *
+ * Attributes
+ *   p_data (inherited) : array of bytes
+ *   p_len (inherited)  : size of p_data
+ *
+ * Notes
+ *   1. the data block referenced by p_data may not be owned by the instance
+ *      but instead owned by a Datagram instance which shares its data with
+ *      instances of classes derived from DatagramFragment, including this
+ *      class.
+ *   2. questions and records are walked with a cursor (offset within the
+ *      message) so that a complete message is decoded in a single pass. Names
+ *      are written into caller supplied buffers, so no heap allocation ever
+ *      takes place while decoding.
+ *   3. every access past the header is bounds checked since the message comes
+ *      straight from the wire; malformed messages make the walk routines
+ *      return false rather than throw.
+ */
+class DNSMessage : public DatagramFragment {
+  public:
+    DNSMessage(bool = false);                            // default constructor
+    DNSMessage(bool, unsigned char *, unsigned int);     // parameterized constructor
+
+    unsigned int header_length() const;                  // length of DNS message header in bytes
+
+    bool valid() const;                                  // indicates if the header is complete
+
+    // Routines returning header field values
+    unsigned int id() const;                             // transaction identifier
+    bool is_response() const;                            // QR flag
+    unsigned int opcode() const;                         // kind of query
+    bool flag_aa() const;                                // authoritative answer flag
+    bool flag_tc() const;                                // truncation flag
+    bool flag_rd() const;                                // recursion desired flag
+    bool flag_ra() const;                                // recursion available flag
+    unsigned int rcode() const;                          // response code
+
+    unsigned int qdcount() const;                        // number of questions
+    unsigned int ancount() const;                        // number of answers
+    unsigned int nscount() const;                        // number of authority records
+    unsigned int arcount() const;                        // number of additional records
+
+    // Decodes a possibly compressed domain name found at given offset
+    bool name(unsigned int, char *, unsigned int, unsigned int &) const;
+
+    // Cursor based walk of the questions and resource records
+    unsigned int first_question() const;
+    bool next_question(unsigned int &, DNSQuestion &, char *, unsigned int) const;
+    bool next_record(unsigned int &, DNSRecord &, char *, unsigned int) const;
+
+    // Returns a string textually identifying common record types and response codes
+    static const char * type_name(unsigned int);
+    static const char * rcode_name(unsigned int);
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, const DNSMessage &);
+
+  protected:
+    bool skip_name(unsigned int &) const;                // moves offset past an encoded name
+};
+
+/* DNSTransactionTable: fixed size table pairing DNS queries with their responses
+ *   using the transaction identifier, client address and client port.
+ *
+ * Attributes
+ *   p_slots    : open addressed table of pending queries
+ *   p_mask     : table size minus one (size is a power of two)
+ *   p_queries  : number of queries recorded
+ *   p_matched  : number of responses paired with a pending query
+ *   p_orphans  : number of responses without pending query
+ *   p_evicted  : number of pending queries overwritten before being answered
+ *   p_latency  : sum of query/response delays of matched pairs (microseconds)
+ *
+ * Notes
+ *   1. the table never grows: when a slot is already busy the oldest pending
+ *      query is overwritten and accounted as evicted, so memory is bounded
+ *      whatever the query rate.
+ */
+class DNSTransactionTable {
+  public:
+    DNSTransactionTable(unsigned int = 65536);           // parameterized constructor
+    ~DNSTransactionTable();                              // destructor
+
+    // Records a query sent by client (address, port) at given time (microseconds)
+    void query(unsigned int, unsigned int, unsigned int, unsigned long long);
+
+    // Pairs a response sent to client (address, port); returns true and the delay if found
+    bool response(unsigned int, unsigned int, unsigned int, unsigned long long, unsigned long long &);
+
+    // Various statistics getters
+    unsigned long long queries() const;
+    unsigned long long matched() const;
+    unsigned long long orphans() const;
+    unsigned long long evicted() const;
+    unsigned long long average_latency() const;
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, const DNSTransactionTable &);
+
+  private:
+    // Pending query slot
+    struct Slot {
+      unsigned long long time;      // time the query was seen (0 if slot is free)
+      unsigned int       client;    // client IP address
+      unsigned short     port;      // client UDP port
+      unsigned short     id;        // transaction identifier
+    };
+
+    Slot *       p_slots;
+    unsigned int p_mask;
+
+    unsigned long long p_queries, p_matched, p_orphans, p_evicted, p_latency;
+
+    unsigned int slot(unsigned int, unsigned int, unsigned int) const;
+
+    // Copying is not allowed
+    DNSTransactionTable(const DNSTransactionTable &);
+    DNSTransactionTable & operator=(const DNSTransactionTable &);
+};
+
+#endif
@@ -66,5 +66,20 @@ class EBadHardwareException: public EPacketAnalysisException {
       : EPacketAnalysisException(msg) {}
 };
 
+/* EFilterSyntaxException: derived exception class to be thrown when a filter
+ *   expression cannot be compiled.
+ *
+ * Attributes
+ *   message (inherited): message to be displayed when catched
+ *   position           : offset of the offending character in the expression
+ */
+class EFilterSyntaxException: public EPacketAnalysisException {
+  public:
+    EFilterSyntaxException(const char * msg, unsigned int pos)
+      : EPacketAnalysisException(msg), position(pos) {}
+
+    unsigned int position;
+};
+
 #endif
 
@@ -0,0 +1,1024 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef FILTER_CPP
+#define FILTER_CPP
+
+#include <cstring>          // strlen, strncmp
+#include <cctype>           // isalpha, isdigit, tolower
+#include <strings.h>        // strcasecmp
+
+#include "filter.h"         // PacketFilter
+
+// Fields of the language: name, field, field of the other endpoint (ff_count
+// if none) and largest value
+static const struct {
+  const char * name;
+  FilterField  field;
+  FilterField  either;
+  unsigned int max;
+} filter_fields[] = {
+  { "frame.len",     ff_frame_len,    ff_count,       0xFFFFFFFF },
+  { "eth.type",      ff_eth_type,     ff_count,       0xFFFF },
+  { "vlan.id",       ff_vlan,         ff_count,       0x0FFF },
+  { "ip",            ff_ip,           ff_count,       1 },
+  { "ip.src",        ff_ip_src,       ff_count,       0xFFFFFFFF },
+  { "ip.dst",        ff_ip_dst,       ff_count,       0xFFFFFFFF },
+  { "ip.addr",       ff_ip_src,       ff_ip_dst,      0xFFFFFFFF },
+  { "ip.proto",      ff_ip_proto,     ff_count,       0xFF },
+  { "ip.ttl",        ff_ip_ttl,       ff_count,       0xFF },
+  { "ip.len",        ff_ip_len,       ff_count,       0xFFFF },
+  { "tcp",           ff_tcp,          ff_count,       1 },
+  { "tcp.srcport",   ff_tcp_srcport,  ff_count,       0xFFFF },
+  { "tcp.dstport",   ff_tcp_dstport,  ff_count,       0xFFFF },
+  { "tcp.port",      ff_tcp_srcport,  ff_tcp_dstport, 0xFFFF },
+  { "tcp.flags",     ff_tcp_flags,    ff_count,       0xFF },
+  { "udp",           ff_udp,          ff_count,       1 },
+  { "udp.srcport",   ff_udp_srcport,  ff_count,       0xFFFF },
+  { "udp.dstport",   ff_udp_dstport,  ff_count,       0xFFFF },
+  { "udp.port",      ff_udp_srcport,  ff_udp_dstport, 0xFFFF },
+  { "icmp",          ff_icmp,         ff_count,       1 },
+  { "icmp.type",     ff_icmp_type,    ff_count,       0xFF },
+  { "icmp.code",     ff_icmp_code,    ff_count,       0xFF },
+  { "payload.len",   ff_payload_len,  ff_count,       0xFFFF },
+  { "tunnel",        ff_tunnel,       ff_count,       1 },
+  { "tunnel.depth",  ff_tunnel_depth, ff_count,       PACKET_MAX_TUNNELS },
+  { "tunnel.id",     ff_tunnel_id,    ff_count,       0xFFFFFFFF },
+  { "tunnel.src",    ff_tunnel_src,   ff_count,       0xFFFFFFFF },
+  { "tunnel.dst",    ff_tunnel_dst,   ff_count,       0xFFFFFFFF },
+  { "flow.packets",  ff_flow_packets, ff_count,       0xFFFFFFFF },
+  { "flow.bytes",    ff_flow_bytes,   ff_count,       0xFFFFFFFF },
+  { "flow.age",      ff_flow_age,     ff_count,       0xFFFFFFFF },
+  { "dns",           ff_dns,          ff_count,       1 },
+  { "tls",           ff_tls,          ff_count,       1 },
+  { "dns.qname",     ff_dns_qname,    ff_count,       0 },
+  { "tls.sni",       ff_tls_sni,      ff_count,       0 },
+  { NULL,            ff_count,        ff_count,       0 }
+};
+
+// Symbols of the language, longest first
+static const char * filter_symbols[] = {
+  "&&", "||", "==", "!=", "<=", ">=", "<<",
+  "(", ")", "!", "<", ">", "&", "|", "+", "-", "*", "/", NULL
+};
+
+// Bits of decoded string fields
+#define FILTER_DNS_TRIED 0x01
+#define FILTER_DNS_OK    0x02
+#define FILTER_TLS_TRIED 0x04
+#define FILTER_TLS_OK    0x08
+
+// Returns true if the field is a string field
+static bool string_field(FilterField f) {
+  return f == ff_dns_qname || f == ff_tls_sni;
+}
+
+// Returns the largest value of the field
+static unsigned int field_max(FilterField f) {
+  for (unsigned int i = 0; filter_fields[i].name != NULL; i++)
+    if (filter_fields[i].field == f)
+      return filter_fields[i].max;
+
+  return 0xFFFFFFFF;
+}
+
+// Returns a counter clamped to the width of the filter registers
+static unsigned int saturate(unsigned long long v) {
+  return v > 0xFFFFFFFFULL ? 0xFFFFFFFF : (unsigned int)v;
+}
+
+// Returns true if text holds pattern, ignoring case
+static bool contains(const char * text, const char * pattern) {
+  unsigned int n = strlen(pattern);
+
+  for (; *text; text++)
+    if (strncasecmp(text, pattern, n) == 0)
+      return true;
+
+  return n == 0;
+}
+
+// Parameterized constructor: compiles the expression, throwing an
+// EFilterSyntaxException if it is invalid. Flows are tracked in a table of
+// given capacity if the expression tests flow fields
+PacketFilter::PacketFilter(const char * expr, unsigned int flows)
+  : p_flows(flows), p_uses_flow(false), p_flow(NULL), p_now(0), p_decoded(0),
+    p_matched(0), p_rejected(0), p_expr(expr), p_pos(0) {
+  p_root = parse_or();
+
+  skip_blanks();
+  if (p_expr[p_pos] != '\0')
+    error("unexpected characters", p_pos);
+
+  compile(p_root, 0);
+  emit(FilterInstruction::fo_return, 0);
+  thread_jumps();
+
+  p_expr = NULL;
+}
+
+// Destructor
+PacketFilter::~PacketFilter() {
+  for (unsigned int i = 0; i < p_tables.size(); i++)
+    delete p_tables[i];
+}
+
+// Throws a syntax error at given offset. The destructor not being called when
+// the constructor throws, prefix tables loaded so far are released here
+void PacketFilter::error(const char * msg, unsigned int pos) {
+  for (unsigned int i = 0; i < p_tables.size(); i++)
+    delete p_tables[i];
+  p_tables.clear();
+
+  throw EFilterSyntaxException(msg, pos);
+}
+
+// Moves the parser past blanks
+void PacketFilter::skip_blanks() {
+  while (isspace((unsigned char)p_expr[p_pos]))
+    p_pos++;
+}
+
+// Returns the index of the symbol found at the parser position (-1 if none)
+unsigned int PacketFilter::symbol() const {
+  for (unsigned int i = 0; filter_symbols[i] != NULL; i++)
+    if (strncmp(p_expr + p_pos, filter_symbols[i], strlen(filter_symbols[i])) == 0)
+      return i;
+
+  return (unsigned int)-1;
+}
+
+// Consumes the given symbol if it is the next one (the longest symbol found
+// is considered, so that "&" does not match "&&")
+bool PacketFilter::accept(const char * sym) {
+  skip_blanks();
+
+  unsigned int i = symbol();
+  if (i == (unsigned int)-1 || strcmp(filter_symbols[i], sym) != 0)
+    return false;
+
+  p_pos += strlen(sym);
+  return true;
+}
+
+// Consumes the given keyword if it is the next word
+bool PacketFilter::accept_word(const char * word) {
+  skip_blanks();
+
+  unsigned int n = strlen(word);
+  if (strncmp(p_expr + p_pos, word, n) != 0)
+    return false;
+
+  char next = p_expr[p_pos + n];
+  if (isalnum((unsigned char)next) || next == '_' || next == '.')
+    return false;
+
+  p_pos += n;
+  return true;
+}
+
+// Consumes and returns the next identifier (empty if none)
+string PacketFilter::identifier() {
+  skip_blanks();
+
+  unsigned int start = p_pos;
+  if (isalpha((unsigned char)p_expr[p_pos]))
+    while (isalnum((unsigned char)p_expr[p_pos]) || p_expr[p_pos] == '_' || p_expr[p_pos] == '.')
+      p_pos++;
+
+  return string(p_expr + start, p_pos - start);
+}
+
+// Parses alternatives: and-expressions separated by "or"
+unsigned int PacketFilter::parse_or() {
+  unsigned int n = parse_and();
+
+  while (accept("||") || accept_word("or"))
+    n = make_binary(FilterNode::fn_or, n, parse_and());
+
+  return n;
+}
+
+// Parses conjunctions: negations separated by "and"
+unsigned int PacketFilter::parse_and() {
+  unsigned int n = parse_not();
+
+  while (accept("&&") || accept_word("and"))
+    n = make_binary(FilterNode::fn_and, n, parse_not());
+
+  return n;
+}
+
+// Parses negations
+unsigned int PacketFilter::parse_not() {
+  if (accept("!") || accept_word("not"))
+    return make_not(parse_not());
+
+  return parse_primary();
+}
+
+// Parses parenthesized expressions, boolean constants and field tests
+unsigned int PacketFilter::parse_primary() {
+  if (accept("(")) {
+    unsigned int n = parse_or();
+    if (!accept(")"))
+      error("missing closing parenthesis", p_pos);
+    return n;
+  }
+
+  if (accept_word("true"))
+    return make_const(true);
+  if (accept_word("false"))
+    return make_const(false);
+
+  unsigned int start = p_pos;
+  string       name  = identifier();
+  if (name.empty())
+    error("field name expected", p_pos);
+
+  for (unsigned int i = 0; filter_fields[i].name != NULL; i++)
+    if (name == filter_fields[i].name)
+      return parse_comparison(filter_fields[i].field, filter_fields[i].either, start);
+
+  error("unknown field", start);
+  return 0;
+}
+
+// Parses the test of a field (and of the field of the other endpoint if
+// either is not ff_count) named at given offset
+unsigned int PacketFilter::parse_comparison(FilterField field, FilterField either, unsigned int start) {
+  if (field >= ff_flow_packets && field <= ff_flow_age)
+    p_uses_flow = true;
+
+  // Optional mask of the field
+  unsigned int mask = 0xFFFFFFFF;
+  if (accept("&")) {
+    unsigned int prefix;
+    mask = parse_const(prefix);
+    if (prefix != 0xFFFFFFFF)
+      error("network prefix used as a mask", p_pos);
+    if (string_field(field))
+      error("string fields cannot be masked", start);
+  }
+
+  FilterOperator op;
+  if (accept("=="))                op = fop_eq;
+  else if (accept("!="))           op = fop_ne;
+  else if (accept("<="))           op = fop_le;
+  else if (accept(">="))           op = fop_ge;
+  else if (accept("<"))            op = fop_lt;
+  else if (accept(">"))            op = fop_gt;
+  else if (accept_word("contains")) op = fop_contains;
+  else if (accept_word("in"))      op = fop_in;
+  else {
+    // A field alone tests its presence, a masked field tests its bits
+    unsigned int n = (mask != 0xFFFFFFFF ? make_compare(field, fop_ne, 0, mask) : make_compare(field, fop_eq, 0, 0));
+    if (either != ff_count)
+      n = make_binary(FilterNode::fn_or, n, (mask != 0xFFFFFFFF ? make_compare(either, fop_ne, 0, mask)
+                                                                : make_compare(either, fop_eq, 0, 0)));
+    return n;
+  }
+
+  // String fields compare with string constants
+  if (string_field(field)) {
+    if (op != fop_eq && op != fop_ne && op != fop_contains)
+      error("string fields only compare with ==, != or contains", start);
+
+    FilterNode n;
+    n.type  = FilterNode::fn_string;
+    n.value = false;
+    n.field = field;
+    n.op    = op;
+    n.text  = p_strings.size();
+    n.operand = n.mask = n.left = n.right = 0;
+    p_strings.push_back(parse_string());
+    p_nodes.push_back(n);
+    return p_nodes.size() - 1;
+  }
+
+  if (op == fop_contains)
+    error("contains only applies to string fields", start);
+
+  // Address fields compare with the prefixes of a file
+  if (op == fop_in) {
+    if (field != ff_ip_src && field != ff_ip_dst && field != ff_tunnel_src && field != ff_tunnel_dst)
+      error("in only applies to address fields", start);
+    if (mask != 0xFFFFFFFF)
+      error("address fields compared with in cannot be masked", start);
+
+    unsigned int   fpos  = p_pos;
+    string         fname = parse_string();
+    PrefixTable *  table = new PrefixTable;
+
+    p_tables.push_back(table);
+    if (table->load(fname.c_str()) < 0)
+      error("cannot read prefix file", fpos);
+
+    unsigned int n = make_compare(field, fop_in, p_tables.size() - 1, mask);
+    p_nodes[n].text = p_strings.size();
+    p_strings.push_back(fname);
+
+    if (either != ff_count) {
+      unsigned int m = make_compare(either, fop_in, p_tables.size() - 1, mask);
+      p_nodes[m].text = p_nodes[n].text;
+      n = make_binary(FilterNode::fn_or, n, m);
+    }
+    return n;
+  }
+
+  unsigned int prefix, value = parse_const(prefix);
+
+  if (prefix != 0xFFFFFFFF) {
+    if (op != fop_eq && op != fop_ne)
+      error("network prefixes only compare with == or !=", start);
+    mask &= prefix;
+  }
+
+  // Either endpoint: a != b means that neither endpoint is b
+  if (either != ff_count) {
+    FilterOperator pos = (op == fop_ne ? fop_eq : op);
+    unsigned int   n   = make_binary(FilterNode::fn_or, make_compare(field, pos, value, mask),
+                                     make_compare(either, pos, value, mask));
+    return (op == fop_ne ? make_not(n) : n);
+  }
+
+  return make_compare(field, op, value, mask);
+}
+
+// Parses a constant expression. A lone network prefix (a.b.c.d/len) sets
+// prefix to its mask, which is all ones otherwise
+unsigned int PacketFilter::parse_const(unsigned int & prefix) {
+  unsigned int value = parse_term(prefix), mask;
+
+  for (;;) {
+    unsigned int pos = p_pos, rhs;
+
+    if (accept("+"))
+      rhs = value + parse_term(mask);
+    else if (accept("-"))
+      rhs = value - parse_term(mask);
+    else if (accept("|"))
+      rhs = value | parse_term(mask);
+    else
+      return value;
+
+    if (prefix != 0xFFFFFFFF || mask != 0xFFFFFFFF)
+      error("network prefix used in arithmetic", pos);
+    value = rhs;
+  }
+}
+
+// Parses products of constant factors
+unsigned int PacketFilter::parse_term(unsigned int & prefix) {
+  unsigned int value = parse_factor(prefix), mask;
+
+  for (;;) {
+    unsigned int pos = p_pos, rhs;
+
+    if (accept("*"))
+      rhs = value * parse_factor(mask);
+    else if (accept("&"))
+      rhs = value & parse_factor(mask);
+    else if (accept("<<")) {
+      rhs = parse_factor(mask);
+      rhs = (rhs > 31 ? 0 : value << rhs);
+    }
+    else if (accept("/")) {
+      if ((rhs = parse_factor(mask)) == 0)
+        error("division by zero", pos);
+      rhs = value / rhs;
+    }
+    else
+      return value;
+
+    if (prefix != 0xFFFFFFFF || mask != 0xFFFFFFFF)
+      error("network prefix used in arithmetic", pos);
+    value = rhs;
+  }
+}
+
+// Parses a number (decimal or hexadecimal), an IPv4 address with optional
+// prefix length, or a parenthesized constant expression
+unsigned int PacketFilter::parse_factor(unsigned int & prefix) {
+  prefix = 0xFFFFFFFF;
+
+  if (accept("(")) {
+    unsigned int value = parse_const(prefix);
+    if (!accept(")"))
+      error("missing closing parenthesis", p_pos);
+    return value;
+  }
+
+  skip_blanks();
+  unsigned int start = p_pos;
+  if (!isdigit((unsigned char)p_expr[p_pos]))
+    error("constant expected", p_pos);
+
+  // Hexadecimal number
+  if (p_expr[p_pos] == '0' && tolower(p_expr[p_pos+1]) == 'x') {
+    unsigned long long value = 0;
+
+    p_pos += 2;
+    if (!isxdigit((unsigned char)p_expr[p_pos]))
+      error("hexadecimal digits expected", p_pos);
+    while (isxdigit((unsigned char)p_expr[p_pos])) {
+      value = value * 16 + (isdigit((unsigned char)p_expr[p_pos]) ? p_expr[p_pos] - '0'
+                                                                   : tolower(p_expr[p_pos]) - 'a' + 10);
+      if (value > 0xFFFFFFFFULL)
+        error("number out of range", start);
+      p_pos++;
+    }
+    return value;
+  }
+
+  // Decimal number, or dotted address
+  unsigned long long parts[4];
+  unsigned int       count = 0;
+
+  for (;;) {
+    unsigned long long value = 0;
+
+    if (!isdigit((unsigned char)p_expr[p_pos]))
+      error("malformed address", start);
+    while (isdigit((unsigned char)p_expr[p_pos])) {
+      value = value * 10 + (p_expr[p_pos++] - '0');
+      if (value > 0xFFFFFFFFULL)
+        error("number out of range", start);
+    }
+
+    parts[count++] = value;
+    if (count == 4 || p_expr[p_pos] != '.')
+      break;
+    p_pos++;
+  }
+
+  if (count == 1)
+    return parts[0];
+  if (count != 4 || parts[0] > 255 || parts[1] > 255 || parts[2] > 255 || parts[3] > 255)
+    error("malformed address", start);
+
+  unsigned int address = (parts[0] << 24) | (parts[1] << 16) | (parts[2] << 8) | parts[3];
+
+  // Optional prefix length
+  if (p_expr[p_pos] == '/') {
+    unsigned int length = 0, pos = ++p_pos;
+
+    if (!isdigit((unsigned char)p_expr[p_pos]))
+      error("prefix length expected", p_pos);
+    while (isdigit((unsigned char)p_expr[p_pos]) && length <= 32)
+      length = length * 10 + (p_expr[p_pos++] - '0');
+    if (length > 32)
+      error("prefix length out of range", pos);
+
+    prefix  = (length == 0 ? 0 : 0xFFFFFFFF << (32 - length));
+    address &= prefix;
+  }
+
+  return address;
+}
+
+// Parses a string constant between double quotes, where \" and \\ stand for
+// the quote and backslash characters
+string PacketFilter::parse_string() {
+  skip_blanks();
+  if (p_expr[p_pos] != '"')
+    error("string expected", p_pos);
+
+  unsigned int start = p_pos++;
+  string       s;
+
+  while (p_expr[p_pos] != '"') {
+    if (p_expr[p_pos] == '\0')
+      error("unterminated string", start);
+    if (p_expr[p_pos] == '\\' && (p_expr[p_pos+1] == '"' || p_expr[p_pos+1] == '\\'))
+      p_pos++;
+    s += p_expr[p_pos++];
+  }
+
+  p_pos++;
+  return s;
+}
+
+// Returns a new constant node
+unsigned int PacketFilter::make_const(bool value) {
+  FilterNode n;
+
+  n.type  = FilterNode::fn_const;
+  n.value = value;
+  n.field = ff_count;
+  n.op    = fop_eq;
+  n.operand = n.mask = n.text = n.left = n.right = 0;
+  p_nodes.push_back(n);
+
+  return p_nodes.size() - 1;
+}
+
+// Returns a new comparison node, folded to a constant or to a presence test
+// when the width of the field decides the outcome
+unsigned int PacketFilter::make_compare(FilterField field, FilterOperator op, unsigned int value, unsigned int mask) {
+  unsigned int max = field_max(field);
+
+  // Largest masked value: the field may set every bit up to its highest one
+  if (mask != 0xFFFFFFFF) {
+    max |= max >> 1;
+    max |= max >> 2;
+    max |= max >> 4;
+    max |= max >> 8;
+    max |= max >> 16;
+    max &= mask;
+  }
+
+  bool         always = false, never = false;
+
+  // Bits outside the mask can never be matched
+  if ((value & ~mask) != 0) {
+    if (op == fop_eq)
+      never = true;
+    else if (op == fop_ne)
+      always = true;
+  }
+
+  switch (op) {
+    case fop_eq : never  = never || value > max;  break;
+    case fop_ne : always = always || value > max; break;
+    case fop_lt : always = value > max;  never = (value == 0); break;
+    case fop_le : always = value >= max; break;
+    case fop_gt : never  = value >= max; break;
+    case fop_ge : never  = value > max;  always = (value == 0); break;
+    default     : break;
+  }
+
+  if (never)
+    return make_const(false);
+
+  FilterNode n;
+  n.type  = FilterNode::fn_compare;
+  n.value = false;
+  n.field = field;
+  n.op    = (always ? fop_eq : op);
+  n.operand = (always ? 0 : value);
+  n.mask    = (always ? 0 : mask);
+  n.text = n.left = n.right = 0;
+  p_nodes.push_back(n);
+
+  return p_nodes.size() - 1;
+}
+
+// Returns a new "and" or "or" node, folding constant operands
+unsigned int PacketFilter::make_binary(FilterNode::NodeType type, unsigned int left, unsigned int right) {
+  bool absorbing = (type == FilterNode::fn_or);     // true absorbs "or", false absorbs "and"
+
+  if (p_nodes[left].type == FilterNode::fn_const)
+    return (p_nodes[left].value == absorbing ? left : right);
+  if (p_nodes[right].type == FilterNode::fn_const)
+    return (p_nodes[right].value == absorbing ? right : left);
+
+  FilterNode n;
+  n.type  = type;
+  n.value = false;
+  n.field = ff_count;
+  n.op    = fop_eq;
+  n.operand = n.mask = n.text = 0;
+  n.left  = left;
+  n.right = right;
+  p_nodes.push_back(n);
+
+  return p_nodes.size() - 1;
+}
+
+// Returns a new "not" node, folding constants and double negations
+unsigned int PacketFilter::make_not(unsigned int child) {
+  if (p_nodes[child].type == FilterNode::fn_const)
+    return make_const(!p_nodes[child].value);
+  if (p_nodes[child].type == FilterNode::fn_not)
+    return p_nodes[child].left;
+
+  FilterNode n;
+  n.type  = FilterNode::fn_not;
+  n.value = false;
+  n.field = ff_count;
+  n.op    = fop_eq;
+  n.operand = n.mask = n.text = n.right = 0;
+  n.left  = child;
+  p_nodes.push_back(n);
+
+  return p_nodes.size() - 1;
+}
+
+// Appends an instruction to the program
+void PacketFilter::emit(unsigned char opcode, unsigned char dst, unsigned char src, unsigned char field,
+                        unsigned char op, unsigned int operand, unsigned int mask) {
+  if (p_code.size() >= FILTER_MAX_CODE)
+    error("expression too long", 0);
+
+  FilterInstruction in;
+  in.opcode  = opcode;
+  in.dst     = dst;
+  in.src     = src;
+  in.field   = field;
+  in.op      = op;
+  in.operand = operand;
+  in.mask    = mask;
+  p_code.push_back(in);
+}
+
+// Generates the code of given node, leaving its result in register dst
+void PacketFilter::compile(unsigned int node, unsigned int dst) {
+  const FilterNode n = p_nodes[node];
+  unsigned int     jump;
+
+  switch (n.type) {
+    case FilterNode::fn_const :
+      emit(FilterInstruction::fo_const, dst, 0, 0, 0, n.value);
+      break;
+
+    case FilterNode::fn_compare :
+      emit(FilterInstruction::fo_load, dst + 1, 0, n.field);
+      emit(FilterInstruction::fo_compare, dst, dst + 1, n.field, n.op, n.operand, n.mask);
+      break;
+
+    case FilterNode::fn_string :
+      emit(FilterInstruction::fo_string, dst, 0, n.field, n.op, n.text);
+      break;
+
+    case FilterNode::fn_and :
+    case FilterNode::fn_or :
+      // The right operand is skipped once the left one decides the outcome
+      compile(n.left, dst);
+      jump = p_code.size();
+      emit(n.type == FilterNode::fn_and ? FilterInstruction::fo_jump_false : FilterInstruction::fo_jump_true, dst);
+      compile(n.right, dst);
+      p_code[jump].operand = p_code.size();
+      break;
+
+    case FilterNode::fn_not :
+      compile(n.left, dst);
+      emit(FilterInstruction::fo_not, dst, dst);
+      break;
+  }
+}
+
+// Redirects jumps landing on conditional jumps of the same register, whose
+// outcome is then known: a jump taken on false landing on another jump on
+// false goes straight to its target, landing on a jump on true falls through
+void PacketFilter::thread_jumps() {
+  for (unsigned int i = 0; i < p_code.size(); i++) {
+    FilterInstruction & in = p_code[i];
+
+    if (in.opcode != FilterInstruction::fo_jump_false && in.opcode != FilterInstruction::fo_jump_true)
+      continue;
+
+    for (;;) {
+      const FilterInstruction & target = p_code[in.operand];
+
+      if (target.opcode == in.opcode && target.dst == in.dst)
+        in.operand = target.operand;
+      else if ((target.opcode == FilterInstruction::fo_jump_false ||
+                target.opcode == FilterInstruction::fo_jump_true) && target.dst == in.dst)
+        in.operand = in.operand + 1;
+      else
+        break;
+    }
+  }
+}
+
+// Decodes the first question of a DNS message carried by the frame. Returns
+// true if found
+bool PacketFilter::decode_dns(const PacketMeta & meta) {
+  if (!(p_decoded & FILTER_DNS_TRIED)) {
+    p_decoded |= FILTER_DNS_TRIED;
+
+    if (meta.has_udp && meta.payload != NULL && (meta.sport == 53 || meta.dport == 53)) {
+      DNSMessage   dns(false, meta.payload, meta.payload_len);
+      DNSQuestion  q;
+      unsigned int pos = dns.first_question();
+
+      if (dns.valid() && dns.qdcount() > 0 && dns.next_question(pos, q, p_qname, DNS_MAX_NAME))
+        p_decoded |= FILTER_DNS_OK;
+    }
+  }
+
+  return p_decoded & FILTER_DNS_OK;
+}
+
+// Decodes a TLS hello starting the payload of the frame. Returns true if found
+bool PacketFilter::decode_tls(const PacketMeta & meta) {
+  if (!(p_decoded & FILTER_TLS_TRIED)) {
+    p_decoded |= FILTER_TLS_TRIED;
+
+    if (meta.has_tcp && meta.payload != NULL) {
+      TLSRecord rec(false, meta.payload, meta.payload_len);
+
+      if (rec.valid() && rec.hello(p_hello) == TLSRecord::tls_complete)
+        p_decoded |= FILTER_TLS_OK;
+    }
+  }
+
+  return p_decoded & FILTER_TLS_OK;
+}
+
+// Returns the value of a string field of the frame (NULL if absent)
+const char * PacketFilter::load_string(FilterField field, const PacketMeta & meta) {
+  switch (field) {
+    case ff_dns_qname : return (decode_dns(meta) ? p_qname : NULL);
+    case ff_tls_sni   : return (decode_tls(meta) && p_hello.sni[0] ? p_hello.sni : NULL);
+    default           : return NULL;
+  }
+}
+
+// Loads the value of a field of the frame. Returns false if the field is absent
+bool PacketFilter::load(FilterField field, const PacketMeta & meta, unsigned int & v) {
+  v = 1;
+
+  switch (field) {
+    case ff_frame_len    : v = meta.length; return true;
+    case ff_eth_type     : v = meta.ether_code; return meta.layers > 0;
+    case ff_vlan         : v = meta.vlan; return meta.vlan != 0;
+
+    case ff_ip           : return meta.has_ip;
+    case ff_ip_src       : v = meta.src_ip; return meta.has_ip;
+    case ff_ip_dst       : v = meta.dst_ip; return meta.has_ip;
+    case ff_ip_proto     : v = meta.protocol; return meta.has_ip;
+    case ff_ip_ttl       : v = (meta.has_ip ? meta.ip.ttl() : 0); return meta.has_ip;
+    case ff_ip_len       : v = (meta.has_ip ? meta.ip.total_length() : 0); return meta.has_ip;
+
+    case ff_tcp          : return meta.has_tcp;
+    case ff_tcp_srcport  : v = meta.sport; return meta.has_tcp;
+    case ff_tcp_dstport  : v = meta.dport; return meta.has_tcp;
+    case ff_tcp_flags    :
+      if (!meta.has_tcp)
+        return false;
+      v = meta.tcp.flag_cwr() << 7 | meta.tcp.flag_ece() << 6 | meta.tcp.flag_urg() << 5 |
+          meta.tcp.flag_ack() << 4 | meta.tcp.flag_psh() << 3 | meta.tcp.flag_rst() << 2 |
+          meta.tcp.flag_syn() << 1 | meta.tcp.flag_fin();
+      return true;
+
+    case ff_udp          : return meta.has_udp;
+    case ff_udp_srcport  : v = meta.sport; return meta.has_udp;
+    case ff_udp_dstport  : v = meta.dport; return meta.has_udp;
+
+    case ff_icmp         : return meta.has_icmp;
+    case ff_icmp_type    : v = (meta.has_icmp ? meta.icmp.type() : 0); return meta.has_icmp;
+    case ff_icmp_code    : v = (meta.has_icmp ? meta.icmp.code() : 0); return meta.has_icmp;
+
+    case ff_payload_len  : v = meta.payload_len; return meta.has_tcp || meta.has_udp;
+
+    case ff_tunnel       : return meta.tunnels > 0;
+    case ff_tunnel_depth : v = meta.tunnels; return true;
+    case ff_tunnel_id    : v = (meta.tunnels ? meta.tunnel[meta.tunnels-1].id : 0); return meta.tunnels > 0;
+    case ff_tunnel_src   : v = (meta.tunnels ? meta.tunnel[meta.tunnels-1].outer_src : 0); return meta.tunnels > 0;
+    case ff_tunnel_dst   : v = (meta.tunnels ? meta.tunnel[meta.tunnels-1].outer_dst : 0); return meta.tunnels > 0;
+
+    case ff_flow_packets : v = (p_flow ? saturate(p_flow->packets) : 0); return p_flow != NULL;
+    case ff_flow_bytes   : v = (p_flow ? saturate(p_flow->bytes) : 0); return p_flow != NULL;
+    case ff_flow_age     : v = (p_flow ? saturate((p_now - p_flow->first) / 1000) : 0); return p_flow != NULL;
+
+    case ff_dns          : return decode_dns(meta);
+    case ff_tls          : return decode_tls(meta);
+
+    default              : return load_string(field, meta) != NULL;
+  }
+}
+
+// Compares a field value with a constant (or looks it up in a prefix table)
+bool PacketFilter::compare(unsigned char op, unsigned int v, unsigned int operand) const {
+  switch (op) {
+    case fop_eq : return v == operand;
+    case fop_ne : return v != operand;
+    case fop_lt : return v <  operand;
+    case fop_le : return v <= operand;
+    case fop_gt : return v >  operand;
+    case fop_in : return p_tables[operand]->lookup(v) != 0;
+    default     : return v >= operand;
+  }
+}
+
+// Compares a string field of the frame with a string constant. False if the
+// field is absent
+bool PacketFilter::compare_string(FilterField field, unsigned char op, unsigned int text, const PacketMeta & meta) {
+  const char * s = load_string(field, meta);
+
+  if (s == NULL)
+    return false;
+  if (op == fop_contains)
+    return contains(s, p_strings[text].c_str());
+
+  return (strcasecmp(s, p_strings[text].c_str()) == 0) == (op == fop_eq);
+}
+
+// Prepares the evaluation of a frame captured at given time: counts it in its
+// flow state and forgets the strings decoded from the previous frame
+void PacketFilter::begin(const PacketMeta & meta, unsigned long long now) {
+  p_decoded = 0;
+  p_flow    = NULL;
+  p_now     = now;
+
+  // Flow state counts the frame itself
+  if (p_uses_flow && meta.has_ip) {
+    FlowKey     key(meta.src_ip, meta.dst_ip, meta.sport, meta.dport, meta.protocol);
+    bool        created;
+    FlowState * flow = p_flows.insert(key, now, created);
+
+    if (created)
+      flow->first = now;
+    flow->packets++;
+    flow->bytes += meta.length;
+    p_flow = flow;
+  }
+}
+
+// Evaluates a node of the folded syntax tree on the frame given to begin(),
+// without counting it as matched or rejected
+bool PacketFilter::evaluate(unsigned int n, const PacketMeta & meta) {
+  const FilterNode & node = p_nodes[n];
+  unsigned int       v;
+
+  switch (node.type) {
+    case FilterNode::fn_const :
+      return node.value;
+
+    case FilterNode::fn_compare :
+      return load(node.field, meta, v) && compare(node.op, v & node.mask, node.operand);
+
+    case FilterNode::fn_string :
+      return compare_string(node.field, node.op, node.text, meta);
+
+    case FilterNode::fn_and :
+      return evaluate(node.left, meta) && evaluate(node.right, meta);
+
+    case FilterNode::fn_or :
+      return evaluate(node.left, meta) || evaluate(node.right, meta);
+
+    default :                            // fn_not
+      return !evaluate(node.left, meta);
+  }
+}
+
+// Evaluates the program on a dissected frame captured at given time.
+// Returns true if the frame is accepted
+bool PacketFilter::match(const PacketMeta & meta, unsigned long long now) {
+  unsigned int reg[FILTER_REGISTERS];
+  bool         valid[FILTER_REGISTERS];
+
+  begin(meta, now);
+
+  for (unsigned int pc = 0; ; ) {
+    const FilterInstruction & in = p_code[pc++];
+
+    switch (in.opcode) {
+      case FilterInstruction::fo_const :
+        reg[in.dst] = in.operand;
+        break;
+
+      case FilterInstruction::fo_load :
+        valid[in.dst] = load((FilterField)in.field, meta, reg[in.dst]);
+        break;
+
+      case FilterInstruction::fo_compare :
+        reg[in.dst] = valid[in.src] && compare(in.op, reg[in.src] & in.mask, in.operand);
+        break;
+
+      case FilterInstruction::fo_string :
+        reg[in.dst] = compare_string((FilterField)in.field, in.op, in.operand, meta);
+        break;
+
+      case FilterInstruction::fo_not :
+        reg[in.dst] = !reg[in.src];
+        break;
+
+      case FilterInstruction::fo_jump_false :
+        if (!reg[in.dst])
+          pc = in.operand;
+        break;
+
+      case FilterInstruction::fo_jump_true :
+        if (reg[in.dst])
+          pc = in.operand;
+        break;
+
+      default :                          // fo_return
+        if (reg[in.dst])
+          p_matched++;
+        else
+          p_rejected++;
+        return reg[in.dst] != 0;
+    }
+  }
+}
+
+// Returns the number of instructions of the program
+unsigned int PacketFilter::size() const {
+  return p_code.size();
+}
+
+// Returns true if the expression tests flow fields
+bool PacketFilter::uses_flow() const {
+  return p_uses_flow;
+}
+
+// Returns the index of the root node of the folded syntax tree
+unsigned int PacketFilter::root() const {
+  return p_root;
+}
+
+// Returns a node of the folded syntax tree
+const FilterNode & PacketFilter::node(unsigned int n) const {
+  return p_nodes[n];
+}
+
+// Returns a string constant of the expression
+const string & PacketFilter::text(unsigned int n) const {
+  return p_strings[n];
+}
+
+// Returns the number of frames accepted
+unsigned long long PacketFilter::matched() const {
+  return p_matched;
+}
+
+// Returns the number of frames rejected
+unsigned long long PacketFilter::rejected() const {
+  return p_rejected;
+}
+
+// Returns the textual name of a field (the first endpoint for fields testing
+// either endpoint)
+const char * PacketFilter::field_name(FilterField f) {
+  for (unsigned int i = 0; filter_fields[i].name != NULL; i++)
+    if (filter_fields[i].field == f)
+      return filter_fields[i].name;
+
+  return "unknown";
+}
+
+// Returns the textual form of a comparison operator
+const char * PacketFilter::operator_name(FilterOperator op) {
+  static const char * names[] = { "==", "!=", "<", "<=", ">", ">=", "contains", "in" };
+
+  return (op <= fop_in ? names[op] : "?");
+}
+
+// Output operator displaying the program in human readable form
+ostream & operator<<(ostream & ostr, const PacketFilter & f) {
+  char outstr[96];
+
+  for (unsigned int i = 0; i < f.p_code.size(); i++) {
+    const FilterInstruction & in = f.p_code[i];
+
+    switch (in.opcode) {
+      case FilterInstruction::fo_const :
+        sprintf(outstr, "const  r%u, %u", in.dst, in.operand);
+        break;
+      case FilterInstruction::fo_load :
+        sprintf(outstr, "load   r%u, %s", in.dst, PacketFilter::field_name((FilterField)in.field));
+        break;
+      case FilterInstruction::fo_compare :
+        if (in.op == fop_in)
+          sprintf(outstr, "cmp    r%u, r%u in table %u (%u prefixes)", in.dst, in.src, in.operand,
+                  f.p_tables[in.operand]->size());
+        else
+          sprintf(outstr, "cmp    r%u, r%u & 0x%x %s 0x%x", in.dst, in.src, in.mask,
+                  PacketFilter::operator_name((FilterOperator)in.op), in.operand);
+        break;
+      case FilterInstruction::fo_string :
+        snprintf(outstr, sizeof(outstr), "str    r%u, %s %s \"%s\"", in.dst,
+                 PacketFilter::field_name((FilterField)in.field),
+                 PacketFilter::operator_name((FilterOperator)in.op), f.p_strings[in.operand].c_str());
+        break;
+      case FilterInstruction::fo_not :
+        sprintf(outstr, "not    r%u, r%u", in.dst, in.src);
+        break;
+      case FilterInstruction::fo_jump_false :
+        sprintf(outstr, "jf     r%u, %u", in.dst, in.operand);
+        break;
+      case FilterInstruction::fo_jump_true :
+        sprintf(outstr, "jt     r%u, %u", in.dst, in.operand);
+        break;
+      default :
+        sprintf(outstr, "ret    r%u", in.dst);
+        break;
+    }
+
+    ostr << "  " << i << ": " << outstr << endl;
+  }
+
+  ostr << flush;
+
+  return ostr;
+}
+
+#endif
@@ -0,0 +1,258 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include "packetmeta.h"         // PacketMeta
+#include "flowtable.h"          // FlowTable, FlowKey
+#include "dns.h"                // DNS_MAX_NAME
+#include "tls.h"                // TLSHello
+#include "exceptions.h"         // EFilterSyntaxException
+#include "lpm.h"                // PrefixTable
+
+using namespace std;
+
+#define FILTER_REGISTERS  2     // registers of the filter machine
+#define FILTER_MAX_CODE 512     // instructions per program at most
+
+/* FilterField: fields of the dissected metadata a filter may test. String
+ *   fields (ff_dns_qname and above) are decoded only when evaluated.
+ */
+typedef enum {
+  ff_frame_len, ff_eth_type, ff_vlan,
+  ff_ip, ff_ip_src, ff_ip_dst, ff_ip_proto, ff_ip_ttl, ff_ip_len,
+  ff_tcp, ff_tcp_srcport, ff_tcp_dstport, ff_tcp_flags,
+  ff_udp, ff_udp_srcport, ff_udp_dstport,
+  ff_icmp, ff_icmp_type, ff_icmp_code,
+  ff_payload_len,
+  ff_tunnel, ff_tunnel_depth, ff_tunnel_id, ff_tunnel_src, ff_tunnel_dst,
+  ff_flow_packets, ff_flow_bytes, ff_flow_age,
+  ff_dns, ff_tls,
+  ff_dns_qname, ff_tls_sni,
+  ff_count
+} FilterField;
+
+/* FilterOperator: comparison operators of the filter language.
+ */
+typedef enum {
+  fop_eq, fop_ne, fop_lt, fop_le, fop_gt, fop_ge, fop_contains, fop_in
+} FilterOperator;
+
+/* FilterNode: node of the syntax tree of a filter expression, after constant
+ *   folding.
+ *
+ * Attributes
+ *   type        : kind of node
+ *   value       : result of a constant node
+ *   field, op   : compared field and comparison operator
+ *   operand     : constant compared with (integer comparisons), or prefix table
+ *   mask        : bits of the field compared (all ones unless masked)
+ *   text        : index of the compared string (or prefix file name) in the string pool
+ *   left, right : operands of boolean nodes (indices of nodes)
+ *
+ * Notes
+ *   1. a field tested for presence is a comparison of the field masked with 0
+ *      against 0, which holds whenever the field is present.
+ */
+struct FilterNode {
+  // Enumeration of node types
+  typedef enum {
+    fn_const, fn_compare, fn_string, fn_and, fn_or, fn_not
+  } NodeType;
+
+  NodeType       type;
+  bool           value;
+  FilterField    field;
+  FilterOperator op;
+  unsigned int   operand, mask;
+  unsigned int   text;
+  unsigned int   left, right;
+};
+
+/* FilterInstruction: instruction of the filter bytecode.
+ *
+ * Attributes
+ *   opcode   : operation
+ *   dst, src : registers written and read
+ *   field    : field loaded or compared
+ *   op       : comparison operator
+ *   operand  : constant compared with, string index or jump target
+ *   mask     : bits of the register compared
+ */
+struct FilterInstruction {
+  // Enumeration of operations
+  typedef enum {
+    fo_const, fo_load, fo_compare, fo_string, fo_not, fo_jump_false, fo_jump_true, fo_return
+  } Opcode;
+
+  unsigned char  opcode;
+  unsigned char  dst, src;
+  unsigned char  field;
+  unsigned char  op;
+  unsigned int   operand;
+  unsigned int   mask;
+};
+
+/* PacketFilter: filter expression over the dissected metadata of frames,
+ *   compiled into a register based bytecode.
+ *
+ * Attributes
+ *   p_nodes, p_root : folded syntax tree of the expression
+ *   p_strings       : string constants of the expression
+ *   p_tables        : prefix tables loaded by "in" comparisons
+ *   p_code          : compiled program
+ *   p_flows         : per-flow state (only maintained if flow fields are used)
+ *   p_uses_flow     : expression tests flow fields
+ *   p_flow, p_now   : state of the flow of the current frame, and its capture time
+ *   p_qname, p_hello: lazily decoded DNS question name and TLS hello of the current frame
+ *   p_decoded       : string fields decoded for the current frame (bit mask)
+ *   p_matched, p_rejected : statistics
+ *
+ * Notes
+ *   1. the language, in order of increasing precedence:
+ *        expr    := expr ("or" | "||") expr | expr ("and" | "&&") expr
+ *                 | ("not" | "!") expr | "(" expr ")" | "true" | "false"
+ *                 | field | field ["&" const] cmp const | field cmp "string"
+ *                 | field "in" "file"
+ *        cmp     := "==" | "!=" | "<" | "<=" | ">" | ">=" | "contains"
+ *        const   := number | a.b.c.d | a.b.c.d/len | const (+ - * / & | <<) const
+ *      A field alone holds if the field is present (e.g. "tcp", "tls.sni").
+ *      Comparisons of absent fields are false, except through "not". The
+ *      fields ip.addr, tcp.port and udp.port test either endpoint. "in"
+ *      tests whether an address field falls in one of the prefixes listed in
+ *      a file (see PrefixTable), e.g. ip.addr in "blocklist.txt". flow.age
+ *      is in milliseconds; flow counters saturate at 2^32 - 1.
+ *   2. constant sub-expressions are folded at compile time, as are boolean
+ *      constants and comparisons that can only hold or fail given the width
+ *      of the field. Network prefixes compile to masked comparisons.
+ *   3. "and" and "or" short-circuit: they compile to conditional jumps, and
+ *      jumps landing on a jump that must follow are threaded to its target.
+ *      String fields being decoded only when reached, cheap tests should come
+ *      first.
+ *   4. the filter refines the kernel BPF filter: it only sees frames the BPF
+ *      program accepted. BPFGenerator moves the tests BPF can express into
+ *      the kernel program.
+ *   5. parts of the expression may be evaluated on their own (as PacketTap
+ *      does to share them between filters): begin() is called once per
+ *      frame, then evaluate() or load() as often as needed. Frames evaluated
+ *      this way are not counted as matched or rejected.
+ */
+class PacketFilter {
+  public:
+    PacketFilter(const char *, unsigned int = 4096);     // parameterized constructor
+    ~PacketFilter();                                     // destructor
+
+    bool match(const PacketMeta &, unsigned long long);  // evaluates the filter on a dissected frame
+
+    // Evaluation of parts of the expression (see note 5)
+    void begin(const PacketMeta &, unsigned long long);  // prepares the evaluation of a frame
+    bool evaluate(unsigned int, const PacketMeta &);     // evaluates a node of the syntax tree
+    bool load(FilterField, const PacketMeta &, unsigned int &);  // loads a field, false if absent
+
+    unsigned int size() const;                           // number of instructions
+    bool uses_flow() const;                              // expression tests flow fields
+    unsigned int root() const;                           // root node of the folded syntax tree
+    const FilterNode & node(unsigned int) const;         // node of the folded syntax tree
+    const string & text(unsigned int) const;             // string constant of the expression
+
+    unsigned long long matched() const;                  // frames accepted
+    unsigned long long rejected() const;                 // frames rejected
+
+    static const char * field_name(FilterField);         // textual name of a field
+    static const char * operator_name(FilterOperator);   // textual form of an operator
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, const PacketFilter &);
+
+  private:
+    // Per-flow state
+    struct FlowState {
+      unsigned long long packets, bytes, first;
+    };
+
+    vector<FilterNode>        p_nodes;
+    unsigned int              p_root;
+    vector<string>            p_strings;
+    vector<PrefixTable *>     p_tables;
+    vector<FilterInstruction> p_code;
+
+    FlowTable<FlowState>      p_flows;
+    bool                      p_uses_flow;
+    const FlowState *         p_flow;
+    unsigned long long        p_now;
+
+    char                      p_qname[DNS_MAX_NAME];
+    TLSHello                  p_hello;
+    unsigned int              p_decoded;
+
+    unsigned long long        p_matched, p_rejected;
+
+    // Parser state
+    const char *              p_expr;
+    unsigned int              p_pos;
+
+    // Parsing routines, each returning the index of the node built
+    unsigned int parse_or();
+    unsigned int parse_and();
+    unsigned int parse_not();
+    unsigned int parse_primary();
+    unsigned int parse_comparison(FilterField, FilterField, unsigned int);
+
+    // Constant expressions
+    unsigned int parse_const(unsigned int &);
+    unsigned int parse_term(unsigned int &);
+    unsigned int parse_factor(unsigned int &);
+    string parse_string();
+
+    // Lexical routines
+    void skip_blanks();
+    bool accept(const char *);
+    bool accept_word(const char *);
+    unsigned int symbol() const;
+    string identifier();
+    void error(const char *, unsigned int);
+
+    // Node building, with constant folding
+    unsigned int make_const(bool);
+    unsigned int make_compare(FilterField, FilterOperator, unsigned int, unsigned int);
+    unsigned int make_binary(FilterNode::NodeType, unsigned int, unsigned int);
+    unsigned int make_not(unsigned int);
+
+    // Code generation
+    void compile(unsigned int, unsigned int);
+    void emit(unsigned char, unsigned char, unsigned char = 0, unsigned char = 0, unsigned char = 0,
+              unsigned int = 0, unsigned int = 0);
+    void thread_jumps();
+
+    // Field access
+    const char * load_string(FilterField, const PacketMeta &);
+    bool decode_dns(const PacketMeta &);
+    bool decode_tls(const PacketMeta &);
+    bool compare(unsigned char, unsigned int, unsigned int) const;
+    bool compare_string(FilterField, unsigned char, unsigned int, const PacketMeta &);
+
+    // Copying is not allowed
+    PacketFilter(const PacketFilter &);
+    PacketFilter & operator=(const PacketFilter &);
+};
+
+#endif
@@ -0,0 +1,70 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef FLOWTABLE_CPP
+#define FLOWTABLE_CPP
+
+#include "flowtable.h"
+
+// Default constructor
+FlowKey::FlowKey() : a_ip(0), b_ip(0), a_port(0), b_port(0), protocol(0) {
+}
+
+// Parameterized constructor: builds the canonical key of a packet given its
+// source and destination addresses, ports and IP protocol number
+FlowKey::FlowKey(unsigned int src, unsigned int dst, unsigned int sport,
+                 unsigned int dport, unsigned int proto) : protocol(proto) {
+  if (direction(src, dst, sport, dport)) {
+    a_ip = src;  a_port = sport;
+    b_ip = dst;  b_port = dport;
+  }
+  else {
+    a_ip = dst;  a_port = dport;
+    b_ip = src;  b_port = sport;
+  }
+}
+
+// Returns true if the source endpoint sorts first, i.e. the packet travels from
+// endpoint a to endpoint b of the canonical key
+bool FlowKey::direction(unsigned int src, unsigned int dst, unsigned int sport, unsigned int dport) {
+  return src < dst || (src == dst && sport <= dport);
+}
+
+// Returns a hash value of the key
+unsigned int FlowKey::hash() const {
+  return hash_word(a_ip ^ hash_word(b_ip ^ (hash_word((unsigned int)a_port << 16 | b_port) + protocol)));
+}
+
+// Relational operator comparing keys field by field
+bool FlowKey::operator==(const FlowKey & k) const {
+  return a_ip == k.a_ip && b_ip == k.b_ip && a_port == k.a_port &&
+         b_port == k.b_port && protocol == k.protocol;
+}
+
+// Output operator displaying the key as "a:port <-> b:port/protocol"
+ostream & operator<<(ostream & ostr, const FlowKey & k) {
+  char outstr[64];
+
+  sprintf(outstr, "%u.%u.%u.%u:%u <-> %u.%u.%u.%u:%u/%u",
+          k.a_ip >> 24, (k.a_ip >> 16) & 0xFF, (k.a_ip >> 8) & 0xFF, k.a_ip & 0xFF, k.a_port,
+          k.b_ip >> 24, (k.b_ip >> 16) & 0xFF, (k.b_ip >> 8) & 0xFF, k.b_ip & 0xFF, k.b_port,
+          k.protocol);
+
+  return ostr << outstr;
+}
+
+#endif
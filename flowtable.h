@@ -0,0 +1,234 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef FLOWTABLE_H
+#define FLOWTABLE_H
+
+#include <iostream>
+
+#include "datagramfragment.h"   // hash_word
+
+using namespace std;
+
+#define FLOW_WAYS 8             // number of entries per flow table bucket
+
+/* FlowKey: bidirectional identifier of a transport flow (IPv4 5-tuple).
+ *
+ * Attributes
+ *   a_ip, a_port : address and port of the endpoint sorting first
+ *   b_ip, b_port : address and port of the other endpoint
+ *   protocol     : IP protocol number
+ *
+ * Notes
+ *   1. endpoints are stored in canonical order so that both directions of a
+ *      conversation map onto the same key. Use direction() to know whether a
+ *      given packet travels from endpoint a to endpoint b.
+ */
+class FlowKey {
+  public:
+    FlowKey();                                           // default constructor
+    FlowKey(unsigned int, unsigned int, unsigned int,    // parameterized constructor
+            unsigned int, unsigned int);
+
+    // Returns true if a packet (source ip, destination ip, source port, destination port)
+    // travels from endpoint a to endpoint b
+    static bool direction(unsigned int, unsigned int, unsigned int, unsigned int);
+
+    unsigned int hash() const;                           // hash value of the key
+
+    // Operator overloads
+    bool operator==(const FlowKey &) const;
+    friend ostream & operator<<(ostream &, const FlowKey &);
+
+    unsigned int   a_ip, b_ip;
+    unsigned short a_port, b_port;
+    unsigned char  protocol;
+};
+
+/* FlowTable: fixed capacity table associating per-flow state of type T to flow keys.
+ *
+ * Attributes
+ *   p_entries : array of entries, grouped in buckets of FLOW_WAYS entries
+ *   p_buckets : number of buckets (power of two)
+ *   p_evicted : number of live flows evicted to make room for new ones
+ *
+ * Notes
+ *   1. the table is set associative: a key may only live in the bucket selected
+ *      by its hash. When a bucket is full, its least recently seen entry is
+ *      evicted, so memory stays fixed whatever the number of concurrent flows.
+ *   2. T must be default constructible; an evicted entry is reset to T().
+ */
+template <class T>
+class FlowTable {
+  public:
+    // Flow table entry
+    struct Entry {
+      FlowKey            key;          // flow identifier
+      unsigned long long last_seen;    // time of last packet (0 if entry is free)
+      T                  value;        // per-flow state
+    };
+
+    FlowTable(unsigned int = 65536);                     // parameterized constructor
+    ~FlowTable();                                        // destructor
+
+    T * find(const FlowKey &, unsigned long long = 0);   // returns state of existing flow
+    T * insert(const FlowKey &, unsigned long long, bool &); // returns state, creating it if need be
+    void remove(const FlowKey &);                        // releases the flow entry
+    void clear();                                        // releases all entries
+
+    unsigned int capacity() const;                       // number of entries
+    unsigned int count() const;                          // number of live flows
+    unsigned long long evicted() const;                  // number of flows evicted
+
+    Entry & entry(unsigned int);                         // direct access for reports
+
+  private:
+    Entry *            p_entries;
+    unsigned int       p_buckets;
+    unsigned long long p_evicted;
+
+    Entry * bucket(const FlowKey &) const;
+
+    // Copying is not allowed
+    FlowTable(const FlowTable &);
+    FlowTable & operator=(const FlowTable &);
+};
+
+// Parameterized constructor: capacity is rounded up to a power of two
+template <class T>
+FlowTable<T>::FlowTable(unsigned int cap) : p_evicted(0) {
+  p_buckets = 1;
+  while (p_buckets * FLOW_WAYS < cap)
+    p_buckets <<= 1;
+
+  p_entries = new Entry[p_buckets * FLOW_WAYS];
+  for (unsigned int i = 0; i < p_buckets * FLOW_WAYS; i++)
+    p_entries[i].last_seen = 0;
+}
+
+// Destructor
+template <class T>
+FlowTable<T>::~FlowTable() {
+  delete [] p_entries;
+}
+
+// Returns the first entry of the bucket where given key may be found
+template <class T>
+typename FlowTable<T>::Entry * FlowTable<T>::bucket(const FlowKey & key) const {
+  return p_entries + (key.hash() & (p_buckets - 1)) * FLOW_WAYS;
+}
+
+// Returns the state of given flow, or NULL if the flow is unknown. If now is
+// not 0, the flow is marked as seen at that time
+template <class T>
+T * FlowTable<T>::find(const FlowKey & key, unsigned long long now) {
+  Entry * b = bucket(key);
+
+  for (unsigned int i = 0; i < FLOW_WAYS; i++)
+    if (b[i].last_seen != 0 && b[i].key == key) {
+      if (now != 0)
+        b[i].last_seen = now;
+      return &b[i].value;
+    }
+
+  return NULL;
+}
+
+// Returns the state of given flow, creating it if the flow is unknown (created
+// is then set to true). The least recently seen flow of the bucket is evicted
+// when no entry is free
+template <class T>
+T * FlowTable<T>::insert(const FlowKey & key, unsigned long long now, bool & created) {
+  Entry * b      = bucket(key);
+  Entry * victim = b;
+
+  if (now == 0)
+    now = 1;   // 0 marks free entries
+
+  for (unsigned int i = 0; i < FLOW_WAYS; i++) {
+    if (b[i].last_seen != 0 && b[i].key == key) {
+      b[i].last_seen = now;
+      created = false;
+      return &b[i].value;
+    }
+
+    if (b[i].last_seen < victim->last_seen)
+      victim = b + i;
+  }
+
+  if (victim->last_seen != 0)
+    p_evicted++;
+
+  victim->key       = key;
+  victim->last_seen = now;
+  victim->value     = T();
+  created = true;
+
+  return &victim->value;
+}
+
+// Releases the entry of given flow, if any
+template <class T>
+void FlowTable<T>::remove(const FlowKey & key) {
+  Entry * b = bucket(key);
+
+  for (unsigned int i = 0; i < FLOW_WAYS; i++)
+    if (b[i].last_seen != 0 && b[i].key == key) {
+      b[i].last_seen = 0;
+      return;
+    }
+}
+
+// Releases all entries; their state is reset when they are reused
+template <class T>
+void FlowTable<T>::clear() {
+  for (unsigned int i = 0; i < capacity(); i++)
+    p_entries[i].last_seen = 0;
+}
+
+// Returns the number of entries of the table
+template <class T>
+unsigned int FlowTable<T>::capacity() const {
+  return p_buckets * FLOW_WAYS;
+}
+
+// Returns the number of live flows (walks the whole table)
+template <class T>
+unsigned int FlowTable<T>::count() const {
+  unsigned int n = 0;
+
+  for (unsigned int i = 0; i < capacity(); i++)
+    if (p_entries[i].last_seen != 0)
+      n++;
+
+  return n;
+}
+
+// Returns the number of live flows evicted to make room for new ones
+template <class T>
+unsigned long long FlowTable<T>::evicted() const {
+  return p_evicted;
+}
+
+// Returns the entry at given index (0 to capacity()-1); free entries have a
+// last_seen field of 0
+template <class T>
+typename FlowTable<T>::Entry & FlowTable<T>::entry(unsigned int idx) {
+  return p_entries[idx];
+}
+
+#endif
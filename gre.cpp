@@ -0,0 +1,145 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef GRE_CPP
+#define GRE_CPP
+
+#include "gre.h"             // GREPacket
+#include "ethernetframe.h"   // EthernetFrame
+#include "ippacket.h"        // IPPacket
+#include "exceptions.h"      // EBadTransportException
+
+// Default constructor
+GREPacket::GREPacket(bool owned) : DatagramFragment(owned) {
+}
+
+// Parameterized constructor
+GREPacket::GREPacket(bool owned, unsigned char * s, unsigned int l) : DatagramFragment(owned, s, l) {
+}
+
+// Returns the GRE header length in bytes: 4 bytes plus 4 bytes for each
+// optional field present
+unsigned int GREPacket::header_length() const {
+  if (!p_data)
+    return 0;
+  else
+    return 4 + (flag_checksum() ? 4 : 0) + (flag_key() ? 4 : 0) + (flag_sequence() ? 4 : 0);
+}
+
+// Returns true if the data block holds the complete header
+bool GREPacket::valid() const {
+  return p_data != NULL && p_len >= 4 && header_length() <= p_len;
+}
+
+// Returns the C flag value (checksum present)
+bool GREPacket::flag_checksum() const {
+  return p_data[0] & 0x80;
+}
+
+// Returns the K flag value (key present)
+bool GREPacket::flag_key() const {
+  return p_data[0] & 0x20;
+}
+
+// Returns the S flag value (sequence number present)
+bool GREPacket::flag_sequence() const {
+  return p_data[0] & 0x10;
+}
+
+// Returns the version field
+unsigned int GREPacket::version() const {
+  return p_data[1] & 0x07;
+}
+
+// Returns the protocol type field (EtherType of the payload)
+unsigned int GREPacket::protocol_code() const {
+  return char2word(p_data+2);
+}
+
+// Indicates which protocol is encapsulated within the packet's payload
+GREPacket::GREProtocol GREPacket::protocol() const {
+  switch (protocol_code()) {
+    case 0x0800 : return gre_IPv4;
+    case 0x6558 : return gre_Ethernet;    // transparent Ethernet bridging (NVGRE, Ethernet over GRE)
+    case 0x86DD : return gre_IPv6;
+    default     : return gre_other;
+  }
+}
+
+// Returns the key field, which follows the optional checksum field
+unsigned int GREPacket::key() const {
+  if (flag_key())
+    return char4word(p_data + 4 + (flag_checksum() ? 4 : 0));
+  else
+    throw EBadTransportException("GRE packet does not hold key field");
+}
+
+// Returns the sequence number field, which follows the optional checksum and key fields
+unsigned int GREPacket::sequence_nb() const {
+  if (flag_sequence())
+    return char4word(p_data + 4 + (flag_checksum() ? 4 : 0) + (flag_key() ? 4 : 0));
+  else
+    throw EBadTransportException("GRE packet does not hold sequence number field");
+}
+
+// Returns the Ethernet frame transported as payload
+EthernetFrame GREPacket::ethernet() {
+  if (protocol() != gre_Ethernet)
+    throw EBadTransportException("GRE packet not transporting Ethernet frames");
+
+  return EthernetFrame(false, data(), data() ? length() - header_length() : 0);
+}
+
+// Returns the IP packet transported as payload
+IPPacket GREPacket::ip4() {
+  if (protocol() != gre_IPv4)
+    throw EBadTransportException("GRE packet not transporting IPv4 traffic");
+
+  return IPPacket(false, data(), data() ? length() - header_length() : 0);
+}
+
+// Output operator displaying the GRE header fields in human readable form
+ostream & operator<<(ostream & ostr, const GREPacket & gre) {
+  if (gre.valid()) {
+    char outstr[16];
+
+    sprintf(outstr, "0x%.4x", gre.protocol_code());
+    ostr << "protocol type = ";
+    switch (gre.protocol()) {
+      case GREPacket::gre_IPv4     : ostr << "IPv4 ["     << outstr << "]" << endl; break;
+      case GREPacket::gre_Ethernet : ostr << "Ethernet [" << outstr << "]" << endl; break;
+      case GREPacket::gre_IPv6     : ostr << "IPv6 ["     << outstr << "]" << endl; break;
+      default                      : ostr << "unknown ["  << outstr << "]" << endl; break;
+    }
+
+    ostr << "version = " << gre.version() << endl;
+
+    if (gre.flag_key()) {
+      sprintf(outstr, "0x%.8x", gre.key());
+      ostr << "key = " << outstr << endl;
+    }
+
+    if (gre.flag_sequence())
+      ostr << "sequence number = " << gre.sequence_nb() << endl;
+  }
+
+  ostr << flush;
+
+  return ostr;
+}
+
+#endif
@@ -0,0 +1,77 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef GRE_H
+#define GRE_H
+
+#include <iostream>
+
+#include "datagramfragment.h"   // DatagramFragment
+
+using namespace std;
+
+class EthernetFrame;            // defined in ethernetframe.h
+class IPPacket;                 // defined in ippacket.h
+
+/* GREPacket: class mapping the inherited data block as a GRE packet (RFC 2784
+ *   and RFC 2890).
+ *
+ * Attributes
+ *   p_data (inherited) : array of bytes
+ *   p_len (inherited)  : size of p_data
+ *
+ * Notes
+ *   1. the data block referenced by p_data may not be owned by the instance
+ *      but instead owned by a Datagram instance which shares its data with
+ *      instances of classes derived from DatagramFragment, including this
+ *      class.
+ *   2. the header length depends on the optional checksum, key and sequence
+ *      number fields announced by the flags.
+ */
+class GREPacket : public DatagramFragment {
+  public:
+    // Enumeration of transported protocols
+    typedef enum {
+      gre_IPv4, gre_Ethernet, gre_IPv6, gre_other
+    } GREProtocol;
+
+    GREPacket(bool = false);                             // default constructor
+    GREPacket(bool, unsigned char *, unsigned int);      // parameterized constructor
+
+    unsigned int header_length() const;                  // length of GRE header in bytes
+
+    bool valid() const;                                  // indicates if the header is complete
+
+    // Routines returning header field values
+    bool flag_checksum() const;                          // checksum field present
+    bool flag_key() const;                               // key field present
+    bool flag_sequence() const;                          // sequence number field present
+    unsigned int version() const;                        // 0 for GRE, 1 for PPTP
+    unsigned int protocol_code() const;                  // EtherType of payload
+    GREProtocol protocol() const;                        // protocol transported in payload
+
+    unsigned int key() const;                            // key field (tunnel identifier)
+    unsigned int sequence_nb() const;                    // sequence number field
+
+    EthernetFrame ethernet();                            // returns Ethernet frame transported in payload
+    IPPacket ip4();                                      // returns IP packet transported in payload
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, const GREPacket &);
+};
+
+#endif
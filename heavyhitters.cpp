@@ -0,0 +1,290 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef HEAVYHITTERS_CPP
+#define HEAVYHITTERS_CPP
+
+#include <algorithm>
+
+#include "heavyhitters.h"   // HeavyHitters, TopTalkers
+
+#define HH_EMPTY 0xFFFFFFFFU   // free slot of the key index
+
+// Parameterized constructor: kind of keys, ranking by bytes (true) or packets
+// (false), and counter budget
+HeavyHitters::HeavyHitters(KeyType type, bool by_bytes, unsigned int capacity)
+  : p_type(type), p_by_bytes(by_bytes), p_size(0), p_capacity(capacity ? capacity : 1) {
+  p_heap = new Entry[p_capacity];
+
+  // Keep the index at most half full
+  unsigned int slots = 2;
+  while (slots < 2 * p_capacity)
+    slots <<= 1;
+  p_index = new unsigned int[slots];
+  p_mask  = slots - 1;
+
+  clear();
+}
+
+// Destructor
+HeavyHitters::~HeavyHitters() {
+  delete [] p_heap;
+  delete [] p_index;
+}
+
+// Forgets all keys
+void HeavyHitters::clear() {
+  p_size = 0;
+  for (unsigned int i = 0; i <= p_mask; i++)
+    p_index[i] = HH_EMPTY;
+}
+
+// Returns the ranking weight of given counter
+unsigned long long HeavyHitters::weight(const Entry & e) const {
+  return p_by_bytes ? e.bytes : e.packets;
+}
+
+// Returns the index slot where given key's probing starts
+unsigned int HeavyHitters::home(unsigned long long key) const {
+  return hash_word((unsigned int)key ^ hash_word((unsigned int)(key >> 32))) & p_mask;
+}
+
+// Moves the heap counter at given position down until the heap is ordered
+// again, after its weight grew
+void HeavyHitters::sift_down(unsigned int pos) {
+  Entry e = p_heap[pos];
+
+  for (;;) {
+    unsigned int child = 2 * pos + 1;
+    if (child >= p_size)
+      break;
+    if (child + 1 < p_size && weight(p_heap[child + 1]) < weight(p_heap[child]))
+      child++;
+    if (weight(e) <= weight(p_heap[child]))
+      break;
+
+    p_heap[pos] = p_heap[child];
+    p_index[p_heap[pos].slot] = pos;
+    pos = child;
+  }
+
+  p_heap[pos] = e;
+  p_index[e.slot] = pos;
+}
+
+// Frees given index slot, shifting back the following keys of its probe
+// sequence so that lookups never stop early
+void HeavyHitters::unlink(unsigned int slot) {
+  unsigned int i = slot, j = slot;
+
+  for (;;) {
+    j = (j + 1) & p_mask;
+    if (p_index[j] == HH_EMPTY)
+      break;
+
+    // Move the key back unless its home lies cyclically within (i, j]
+    unsigned int k = home(p_heap[p_index[j]].key);
+    if ((i <= j) ? (k <= i || k > j) : (k <= i && k > j)) {
+      p_index[i] = p_index[j];
+      p_heap[p_index[i]].slot = i;
+      i = j;
+    }
+  }
+
+  p_index[i] = HH_EMPTY;
+}
+
+// Counts given number of packets of given total size for given key
+void HeavyHitters::add(unsigned long long key, unsigned long long bytes, unsigned int packets) {
+  unsigned int slot = home(key);
+
+  // Known key: update its counter in place
+  while (p_index[slot] != HH_EMPTY) {
+    unsigned int pos = p_index[slot];
+
+    if (p_heap[pos].key == key) {
+      p_heap[pos].packets += packets;
+      p_heap[pos].bytes   += bytes;
+      sift_down(pos);
+      return;
+    }
+
+    slot = (slot + 1) & p_mask;
+  }
+
+  // New key: take a free counter, or take over the lightest one
+  unsigned int pos;
+  Entry        e;
+
+  if (p_size < p_capacity) {
+    pos = p_size++;
+    e.packets = e.bytes = e.error = 0;
+  }
+  else {
+    pos = 0;
+    e   = p_heap[0];
+    unlink(e.slot);
+
+    // The probe sequence may have shifted: look for a free slot again
+    slot = home(key);
+    while (p_index[slot] != HH_EMPTY)
+      slot = (slot + 1) & p_mask;
+
+    e.error = weight(e);
+    if (p_by_bytes)
+      e.packets = 0;
+    else
+      e.bytes = 0;
+  }
+
+  e.key   = key;
+  e.slot  = slot;
+  e.packets += packets;
+  e.bytes   += bytes;
+
+  p_heap[pos]   = e;
+  p_index[slot] = pos;
+  sift_down(pos);
+}
+
+// Comparison function ordering counters by decreasing bytes
+static bool heavier_bytes(const HeavyHitters::Entry & a, const HeavyHitters::Entry & b) {
+  return a.bytes > b.bytes;
+}
+
+// Comparison function ordering counters by decreasing packets
+static bool heavier_packets(const HeavyHitters::Entry & a, const HeavyHitters::Entry & b) {
+  return a.packets > b.packets;
+}
+
+// Copies at most n of the heaviest counters into out, heaviest first. Returns
+// the number of counters copied
+unsigned int HeavyHitters::top(Entry * out, unsigned int n) const {
+  Entry * work = new Entry[p_size];
+  unsigned int k = (n < p_size ? n : p_size);
+
+  copy(p_heap, p_heap + p_size, work);
+  partial_sort(work, work + k, work + p_size, p_by_bytes ? heavier_bytes : heavier_packets);
+  copy(work, work + k, out);
+
+  delete [] work;
+
+  return k;
+}
+
+// Output operator displaying the HH_TOP_K heaviest keys
+ostream & operator<<(ostream & ostr, const HeavyHitters & hh) {
+  static const char * names[] = { "source IP", "destination IP", "destination service", "MAC" };
+  HeavyHitters::Entry best[HH_TOP_K];
+  unsigned int n = hh.top(best, HH_TOP_K);
+
+  ostr << "top " << names[hh.p_type] << " by " << (hh.p_by_bytes ? "bytes" : "packets") << endl;
+
+  for (unsigned int i = 0; i < n; i++) {
+    char outstr[32];
+    unsigned long long k = best[i].key;
+
+    switch (hh.p_type) {
+      case HeavyHitters::hh_dst_service :
+        sprintf(outstr, "%u.%u.%u.%u:%u", (unsigned int)(k >> 40) & 0xFF, (unsigned int)(k >> 32) & 0xFF,
+                (unsigned int)(k >> 24) & 0xFF, (unsigned int)(k >> 16) & 0xFF, (unsigned int)k & 0xFFFF);
+        break;
+      case HeavyHitters::hh_mac :
+        sprintf(outstr, "%.2x:%.2x:%.2x:%.2x:%.2x:%.2x", (unsigned int)(k >> 40) & 0xFF,
+                (unsigned int)(k >> 32) & 0xFF, (unsigned int)(k >> 24) & 0xFF,
+                (unsigned int)(k >> 16) & 0xFF, (unsigned int)(k >> 8) & 0xFF, (unsigned int)k & 0xFF);
+        break;
+      default :
+        sprintf(outstr, "%u.%u.%u.%u", (unsigned int)(k >> 24) & 0xFF, (unsigned int)(k >> 16) & 0xFF,
+                (unsigned int)(k >> 8) & 0xFF, (unsigned int)k & 0xFF);
+        break;
+    }
+
+    ostr << "  " << outstr << " : packets = " << best[i].packets << ", bytes = " << best[i].bytes;
+    if (best[i].error > 0)
+      ostr << " (overestimated by at most " << best[i].error << ")";
+    ostr << endl;
+  }
+
+  ostr << flush;
+
+  return ostr;
+}
+
+// Parameterized constructor: interval length in microseconds and counter
+// budget of each summary
+TopTalkers::TopTalkers(unsigned long long interval, unsigned int counters)
+  : p_interval(interval), p_start(0) {
+  for (unsigned int t = 0; t < 4; t++)
+    for (unsigned int b = 0; b < 2; b++)
+      p_summaries[t][b] = new HeavyHitters((HeavyHitters::KeyType)t, b == 1, counters);
+}
+
+// Destructor
+TopTalkers::~TopTalkers() {
+  for (unsigned int t = 0; t < 4; t++)
+    for (unsigned int b = 0; b < 2; b++)
+      delete p_summaries[t][b];
+}
+
+// Returns true if the current interval is over at given time
+bool TopTalkers::expired(unsigned long long now) const {
+  return p_start != 0 && now - p_start >= p_interval;
+}
+
+// Forgets all keys and starts a new interval at given time
+void TopTalkers::reset(unsigned long long now) {
+  for (unsigned int t = 0; t < 4; t++)
+    for (unsigned int b = 0; b < 2; b++)
+      p_summaries[t][b]->clear();
+
+  p_start = now;
+}
+
+// Counts a dissected packet of given wire size, captured at given time, under
+// each of its keys. A sampled packet stands for weight packets
+void TopTalkers::add(PacketMeta & meta, unsigned int len, unsigned long long now, unsigned int weight) {
+  unsigned long long bytes = (unsigned long long)len * weight;
+
+  if (p_start == 0)
+    p_start = now;   // first interval starts with the first packet
+
+  for (unsigned int b = 0; b < 2; b++) {
+    if (meta.ether.length() >= 12) {
+      const unsigned char * mac = meta.ether.header() + 6;
+      unsigned long long key = ((unsigned long long)char2word(mac) << 32) | char4word(mac + 2);
+      p_summaries[HeavyHitters::hh_mac][b]->add(key, bytes, weight);
+    }
+
+    if (meta.has_ip) {
+      p_summaries[HeavyHitters::hh_src_ip][b]->add(meta.src_ip, bytes, weight);
+      p_summaries[HeavyHitters::hh_dst_ip][b]->add(meta.dst_ip, bytes, weight);
+      p_summaries[HeavyHitters::hh_dst_service][b]->add(((unsigned long long)meta.dst_ip << 16) | meta.dport, bytes, weight);
+    }
+  }
+}
+
+// Output operator displaying the heavy hitters of the current interval
+ostream & operator<<(ostream & ostr, const TopTalkers & top) {
+  for (unsigned int t = 0; t < 4; t++)
+    for (unsigned int b = 0; b < 2; b++)
+      ostr << *top.p_summaries[t][b];
+
+  return ostr;
+}
+
+#endif
@@ -0,0 +1,126 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef HEAVYHITTERS_H
+#define HEAVYHITTERS_H
+
+#include <iostream>
+
+#include "packetmeta.h"         // PacketMeta
+
+using namespace std;
+
+#define HH_TOP_K 10             // number of heavy hitters displayed per summary
+
+/* HeavyHitters: Space-Saving summary of the heaviest keys of a stream, within
+ *   a fixed budget of counters.
+ *
+ * Attributes
+ *   p_type     : kind of keys summarized (used for display)
+ *   p_by_bytes : keys are ranked by bytes rather than by packets
+ *   p_heap     : counters, as a min-heap on the ranking weight
+ *   p_size     : number of counters in use
+ *   p_capacity : counter budget
+ *   p_index    : open addressing table giving the heap position of each key
+ *   p_mask     : size of p_index minus 1 (power of two)
+ *
+ * Notes
+ *   1. a key without counter takes over the lightest one when the budget is
+ *      exhausted: its weight starts from the evicted weight, which is recorded
+ *      as its maximum overestimation (error). Any key heavier than the total
+ *      weight divided by the budget is guaranteed to hold a counter.
+ *   2. the non-ranking count (packets when ranked by bytes, and vice versa)
+ *      only covers the time the key held its counter.
+ *   3. updates cost an index probe and a heap sift, memory stays fixed whatever
+ *      the number of distinct keys.
+ */
+class HeavyHitters {
+  public:
+    // Enumeration of summarized keys
+    typedef enum {
+      hh_src_ip, hh_dst_ip, hh_dst_service, hh_mac
+    } KeyType;
+
+    // Summary counter
+    struct Entry {
+      unsigned long long key;        // summarized key
+      unsigned long long packets;    // packet count
+      unsigned long long bytes;      // byte count
+      unsigned long long error;      // maximum overestimation of the ranking weight
+      unsigned int       slot;       // position in p_index
+    };
+
+    HeavyHitters(KeyType, bool, unsigned int = 1024);    // parameterized constructor
+    ~HeavyHitters();                                     // destructor
+
+    void add(unsigned long long, unsigned long long, unsigned int = 1);  // counts packets of given total size for key
+    void clear();                                        // forgets all keys
+
+    unsigned int top(Entry *, unsigned int) const;       // copies the heaviest counters, heaviest first
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, const HeavyHitters &);
+
+  private:
+    KeyType        p_type;
+    bool           p_by_bytes;
+    Entry *        p_heap;
+    unsigned int   p_size, p_capacity;
+    unsigned int * p_index;
+    unsigned int   p_mask;
+
+    unsigned long long weight(const Entry &) const;
+    unsigned int home(unsigned long long) const;
+    void sift_down(unsigned int);
+    void unlink(unsigned int);
+
+    // Copying is not allowed
+    HeavyHitters(const HeavyHitters &);
+    HeavyHitters & operator=(const HeavyHitters &);
+};
+
+/* TopTalkers: heavy hitters of source IP, destination IP, destination service
+ *   (IP and port) and MAC address, ranked by packets and by bytes over fixed
+ *   intervals.
+ *
+ * Attributes
+ *   p_summaries : summaries, by key type then packets/bytes ranking
+ *   p_interval  : interval length in microseconds
+ *   p_start     : start time of the current interval (0 until first packet)
+ */
+class TopTalkers {
+  public:
+    TopTalkers(unsigned long long = 10000000, unsigned int = 1024);  // parameterized constructor
+    ~TopTalkers();                                                   // destructor
+
+    bool expired(unsigned long long) const;              // current interval is over at given time
+    void reset(unsigned long long);                      // starts a new interval at given time
+    void add(PacketMeta &, unsigned int, unsigned long long, unsigned int = 1);  // counts a dissected packet of given wire size
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, const TopTalkers &);
+
+  private:
+    HeavyHitters *     p_summaries[4][2];
+    unsigned long long p_interval, p_start;
+
+    // Copying is not allowed
+    TopTalkers(const TopTalkers &);
+    TopTalkers & operator=(const TopTalkers &);
+};
+
+#endif
@@ -0,0 +1,62 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef HISTOGRAM_CPP
+#define HISTOGRAM_CPP
+
+#include "histogram.h"
+
+#define HIST_SUB (1U << HIST_SUB_BITS)   // buckets per power of two
+
+// Returns the index of the bucket holding given value. Values below HIST_SUB
+// have a bucket of their own; above, the power of two of the value selects a
+// group of HIST_SUB buckets and the bits following its leading one select the
+// bucket within the group
+unsigned int histogram_bucket(unsigned long long value) {
+  if (value < HIST_SUB)
+    return value;
+
+  unsigned int e = 63;   // position of leading one
+#ifdef __GNUC__
+  e -= __builtin_clzll(value);
+#else
+  while (!(value >> e))
+    e--;
+#endif
+
+  unsigned int idx = (e - HIST_SUB_BITS + 1) * HIST_SUB +
+                     ((value >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+
+  return idx < HIST_BUCKETS ? idx : HIST_BUCKETS - 1;
+}
+
+// Returns the smallest value counted in given bucket
+unsigned long long histogram_lower(unsigned int idx) {
+  if (idx < HIST_SUB)
+    return idx;
+
+  unsigned int e = idx / HIST_SUB + HIST_SUB_BITS - 1;
+
+  return (unsigned long long)(HIST_SUB + idx % HIST_SUB) << (e - HIST_SUB_BITS);
+}
+
+// Returns the largest value counted in given bucket
+unsigned long long histogram_upper(unsigned int idx) {
+  return histogram_lower(idx + 1) - 1;
+}
+
+#endif
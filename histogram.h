@@ -0,0 +1,149 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <iostream>
+
+using namespace std;
+
+#define HIST_SUB_BITS 2         // log2 of the number of buckets per power of two
+#define HIST_BUCKETS  100       // buckets covering values up to 2^26 (about 67 s in us)
+
+unsigned int histogram_bucket(unsigned long long);      // bucket index of a value
+unsigned long long histogram_lower(unsigned int);       // smallest value of a bucket
+unsigned long long histogram_upper(unsigned int);       // largest value of a bucket
+
+/* Histogram: fixed-size log-linear histogram of latency samples (in microseconds).
+ *
+ * Attributes
+ *   p_counts : sample count per bucket
+ *   p_total  : number of samples
+ *   p_min    : smallest sample
+ *   p_max    : largest sample
+ *
+ * Notes
+ *   1. each power of two is split into 2^HIST_SUB_BITS linear buckets, so the
+ *      relative error of reported values is bounded (about 25%) whatever their
+ *      magnitude. Values beyond the last bucket are counted in it.
+ *   2. counters of type T saturate instead of wrapping, so small counter types
+ *      may be used for per-flow histograms and wide ones for aggregates.
+ */
+template <class T>
+class Histogram {
+  public:
+    Histogram();                                         // default constructor
+
+    void add(unsigned long long);                        // records a sample
+
+    unsigned long long count() const;                    // number of samples recorded
+    unsigned long long min() const;                      // smallest sample (0 if none)
+    unsigned long long max() const;                      // largest sample (0 if none)
+    unsigned long long percentile(double) const;         // approximate value at given percentile
+
+  private:
+    T            p_counts[HIST_BUCKETS];
+    T            p_total;
+    unsigned int p_min, p_max;
+};
+
+// Default constructor
+template <class T>
+Histogram<T>::Histogram() : p_total(0), p_min(0), p_max(0) {
+  for (unsigned int i = 0; i < HIST_BUCKETS; i++)
+    p_counts[i] = 0;
+}
+
+// Records given sample, saturating counters at the capacity of T
+template <class T>
+void Histogram<T>::add(unsigned long long value) {
+  unsigned int idx = histogram_bucket(value);
+
+  if (value > 0xFFFFFFFFULL)
+    value = 0xFFFFFFFFULL;
+
+  if (p_total == 0 || value < p_min)
+    p_min = value;
+  if (value > p_max)
+    p_max = value;
+
+  if (p_counts[idx] != (T)~(T)0)
+    p_counts[idx]++;
+  if (p_total != (T)~(T)0)
+    p_total++;
+}
+
+// Returns the number of samples recorded (saturated)
+template <class T>
+unsigned long long Histogram<T>::count() const {
+  return p_total;
+}
+
+// Returns the smallest sample recorded
+template <class T>
+unsigned long long Histogram<T>::min() const {
+  return p_min;
+}
+
+// Returns the largest sample recorded
+template <class T>
+unsigned long long Histogram<T>::max() const {
+  return p_max;
+}
+
+// Returns the value below which given percentage (0 to 100) of samples fall,
+// estimated as the middle of the bucket holding that rank and clamped to the
+// observed range
+template <class T>
+unsigned long long Histogram<T>::percentile(double pct) const {
+  unsigned long long sum = 0, total = 0;
+
+  // Saturated bucket counters may not add up to p_total: rank on their sum
+  for (unsigned int i = 0; i < HIST_BUCKETS; i++)
+    total += p_counts[i];
+  if (total == 0)
+    return 0;
+
+  unsigned long long rank = (unsigned long long)(pct / 100.0 * total + 0.5);
+  if (rank < 1)
+    rank = 1;
+
+  for (unsigned int i = 0; i < HIST_BUCKETS; i++) {
+    sum += p_counts[i];
+    if (sum >= rank) {
+      unsigned long long v = (histogram_lower(i) + histogram_upper(i)) / 2;
+      return v < p_min ? p_min : (v > p_max ? p_max : v);
+    }
+  }
+
+  return p_max;
+}
+
+// Output operator displaying a summary of the samples
+template <class T>
+ostream & operator<<(ostream & ostr, const Histogram<T> & h) {
+  ostr << "samples = " << h.count();
+  if (h.count() > 0)
+    ostr << ", min = " << h.min() << " us, p50 = " << h.percentile(50)
+         << " us, p90 = " << h.percentile(90) << " us, p99 = " << h.percentile(99)
+         << " us, max = " << h.max() << " us";
+
+  return ostr;
+}
+
+#endif
@@ -0,0 +1,357 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef HTTP_CPP
+#define HTTP_CPP
+
+#include <cstring>       // memcpy, memcmp, strcmp
+#include <strings.h>     // strncasecmp
+
+#if defined(__AVX2__)
+#include <immintrin.h>   // AVX2 intrinsics
+#elif defined(__SSE2__)
+#include <emmintrin.h>   // SSE2 intrinsics
+#endif
+
+#include "http.h"
+
+#define HTTP_PROBE 16    // bytes needed to recognize a request or status line
+
+// Tokens starting request and status lines
+static const char * http_starts[] = {
+  "GET ", "POST ", "PUT ", "HEAD ", "DELETE ", "OPTIONS ", "PATCH ", "CONNECT ", "TRACE ", "HTTP/1.", NULL
+};
+
+// Copies at most n bytes of s into a null terminated buffer of given size
+static void http_copy(char * buf, unsigned int size, const unsigned char * s, unsigned int n) {
+  if (n >= size)
+    n = size - 1;
+
+  memcpy(buf, s, n);
+  buf[n] = '\0';
+}
+
+// Default constructor
+HTTPRecord::HTTPRecord()
+  : version(0), status(0), content_length(-1), requests(0), responses(0) {
+  method[0] = uri[0] = host[0] = '\0';
+}
+
+// Output operator displaying the record fields in human readable form
+ostream & operator<<(ostream & ostr, const HTTPRecord & rec) {
+  if (rec.requests > 0) {
+    ostr << "request = " << rec.method << " " << rec.uri << endl;
+    if (rec.host[0] != '\0')
+      ostr << "host = " << rec.host << endl;
+  }
+
+  if (rec.responses > 0)
+    ostr << "status = " << rec.status << endl;
+
+  ostr << "version = HTTP/" << rec.version / 10 << "." << rec.version % 10 << endl;
+
+  if (rec.content_length >= 0)
+    ostr << "content length = " << rec.content_length << endl;
+
+  ostr << flush;
+
+  return ostr;
+}
+
+// Default constructor
+HTTPScanner::HTTPScanner() {
+  for (unsigned int i = 0; i < 2; i++) {
+    p_dir[i].len      = 0;
+    p_dir[i].overflow = false;
+    p_dir[i].headers  = false;
+    p_dir[i].state    = hs_idle;
+    p_dir[i].body     = 0;
+    p_dir[i].length   = -1;
+  }
+}
+
+// Returns a pointer to the first occurrence of byte c within [p, end), or NULL
+// if not found. Scans 32 or 16 bytes per step when AVX2 or SSE2 is available
+const unsigned char * HTTPScanner::find(const unsigned char * p, const unsigned char * end, unsigned char c) {
+#if defined(__AVX2__)
+  const __m256i v32 = _mm256_set1_epi8(c);
+
+  while (end - p >= 32) {
+    unsigned int m = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), v32));
+    if (m)
+      return p + __builtin_ctz(m);
+    p += 32;
+  }
+#endif
+
+#if defined(__SSE2__)
+  const __m128i v16 = _mm_set1_epi8(c);
+
+  while (end - p >= 16) {
+    unsigned int m = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), v16));
+    if (m)
+      return p + __builtin_ctz(m);
+    p += 16;
+  }
+#endif
+
+  for (; p < end; p++)
+    if (*p == c)
+      return p;
+
+  return NULL;
+}
+
+// Indicates if the given bytes start a request (hs_request) or a status line
+// (hs_response). Returns hs_idle if more bytes are needed to decide, and
+// hs_skip if the bytes cannot start an HTTP message
+int HTTPScanner::start_line(const unsigned char * p, unsigned int n) const {
+  for (unsigned int i = 0; http_starts[i] != NULL; i++) {
+    unsigned int tl = strlen(http_starts[i]),
+                 m  = (n < tl ? n : tl);
+
+    if (memcmp(p, http_starts[i], m) == 0) {
+      if (m < tl)
+        return hs_idle;
+
+      return (http_starts[i+1] == NULL ? hs_response : hs_request);
+    }
+  }
+
+  return hs_skip;
+}
+
+// Parses a complete line (without its line feed) of the given direction.
+// Returns true if the line ends a header block
+bool HTTPScanner::parse_line(Direction & d, const unsigned char * s, unsigned int n, HTTPRecord & rec) {
+  const unsigned char * e = s + n;
+
+  // Remove the carriage return of CRLF
+  if (e > s && e[-1] == '\r')
+    e--;
+
+  // Start line: "METHOD URI HTTP/1.x" or "HTTP/1.x STATUS REASON"
+  if (!d.headers) {
+    const unsigned char * sp1 = find(s, e, ' ');
+    if (sp1 == NULL)
+      sp1 = e;
+
+    d.headers = true;
+    d.length  = -1;
+
+    if (d.state == hs_request) {
+      const unsigned char * uri = (sp1 < e ? sp1 + 1 : e),
+                          * sp2 = find(uri, e, ' ');
+      if (sp2 == NULL)
+        sp2 = e;
+
+      http_copy(rec.method, sizeof(rec.method), s, sp1 - s);
+      http_copy(rec.uri, sizeof(rec.uri), uri, sp2 - uri);
+      rec.host[0] = '\0';
+
+      if (e - sp2 >= 9 && memcmp(sp2 + 1, "HTTP/1.", 7) == 0)
+        rec.version = 10 + (sp2[8] - '0');
+    }
+    else {
+      rec.version = (n > 7 ? 10 + (s[7] - '0') : 0);
+      rec.status  = 0;
+      for (const unsigned char * c = sp1 + 1; c < e && c < sp1 + 4 && *c >= '0' && *c <= '9'; c++)
+        rec.status = rec.status * 10 + (*c - '0');
+    }
+
+    return false;
+  }
+
+  // Empty line ends the header block: prepare to skip the body
+  if (e == s) {
+    rec.content_length = d.length;
+    d.body = (d.length > 0 ? d.length : 0);
+
+    if (d.state == hs_request)
+      rec.requests++;
+    else {
+      rec.responses++;
+
+      // These responses never carry a body
+      if (rec.status < 200 || rec.status == 204 || rec.status == 304 || strcmp(rec.method, "HEAD") == 0)
+        d.body = 0;
+    }
+
+    d.state   = hs_idle;
+    d.headers = false;
+
+    return true;
+  }
+
+  // Header line: "Name: value"
+  const unsigned char * colon = find(s, e, ':');
+  if (colon == NULL)
+    return false;
+
+  const unsigned char * v = colon + 1;
+  while (v < e && (*v == ' ' || *v == '\t'))
+    v++;
+  while (e > v && (e[-1] == ' ' || e[-1] == '\t'))
+    e--;
+
+  unsigned int nlen = colon - s;
+
+  if (nlen == 4 && strncasecmp((const char *)s, "host", 4) == 0 && d.state == hs_request)
+    http_copy(rec.host, sizeof(rec.host), v, e - v);
+  else if (nlen == 14 && strncasecmp((const char *)s, "content-length", 14) == 0) {
+    d.length = 0;
+    for (; v < e && *v >= '0' && *v <= '9' && d.length < 0x7FFFFFFFFFFFLL; v++)
+      d.length = d.length * 10 + (*v - '0');
+  }
+  else if (nlen == 17 && strncasecmp((const char *)s, "transfer-encoding", 17) == 0)
+    d.length = -1;    // chunked body: length unknown
+
+  return false;
+}
+
+// Feeds payload bytes of given direction. Complete lines are parsed in place;
+// a trailing partial line is saved and completed by the next call for that
+// direction. Returns the number of header blocks completed
+unsigned int HTTPScanner::feed(unsigned int dir, const unsigned char * p, unsigned int n, HTTPRecord & rec) {
+  Direction &           d    = p_dir[dir & 1];
+  const unsigned char * end  = p + n;
+  unsigned int          done = 0;
+
+  if (p == NULL)
+    return 0;
+
+  while (p < end) {
+    // Skip body bytes of the previous message
+    if (d.body > 0) {
+      unsigned long long skip = (d.body < (unsigned long long)(end - p) ? d.body : end - p);
+      p      += skip;
+      d.body -= skip;
+      continue;
+    }
+
+    // Between messages, make sure the bytes start a request or status line
+    if (d.state == hs_idle) {
+      int kind;
+
+      if (d.len == 0)
+        kind = start_line(p, end - p);
+      else {
+        unsigned char probe[HTTP_PROBE];
+        unsigned int  m = HTTP_PROBE - d.len;
+
+        if (m > (unsigned int)(end - p))
+          m = end - p;
+        memcpy(probe, d.line, d.len);
+        memcpy(probe + d.len, p, m);
+        kind = start_line(probe, d.len + m);
+      }
+
+      if (kind == hs_skip) {            // not HTTP (or unknown body length): ignore segment
+        d.len = 0;
+        return done;
+      }
+
+      if (kind == hs_idle) {            // too few bytes to decide: keep them for later
+        memcpy(d.line + d.len, p, end - p);
+        d.len += end - p;
+        return done;
+      }
+
+      d.state   = (HTTPState)kind;
+      d.headers = false;
+    }
+
+    // Locate the end of the current line
+    const unsigned char * nl = find(p, end, '\n');
+
+    if (nl == NULL) {
+      // Slow path: carry the partial line over to the next segment
+      unsigned int m = end - p;
+      if (d.len + m > HTTP_MAX_LINE) {
+        m = HTTP_MAX_LINE - d.len;
+        d.overflow = true;
+      }
+      memcpy(d.line + d.len, p, m);
+      d.len += m;
+
+      break;
+    }
+
+    bool ended;
+
+    if (d.len > 0 || d.overflow) {
+      // Complete the line started in a previous segment (truncated if too long)
+      unsigned int m = nl - p;
+      if (d.len + m > HTTP_MAX_LINE)
+        m = HTTP_MAX_LINE - d.len;
+      memcpy(d.line + d.len, p, m);
+
+      ended = parse_line(d, (const unsigned char *)d.line, d.len + m, rec);
+
+      d.len      = 0;
+      d.overflow = false;
+    }
+    else
+      ended = parse_line(d, p, nl - p, rec);   // fast path: parse in place
+
+    if (ended)
+      done++;
+
+    p = nl + 1;
+  }
+
+  return done;
+}
+
+// Default constructor: nothing fed in either direction
+HTTPFlow::HTTPFlow() {
+  for (unsigned int d = 0; d < 2; d++) {
+    next[d]   = 0;
+    synced[d] = false;
+  }
+}
+
+// Feeds a TCP payload of given direction and sequence number to the scanner,
+// skipping the bytes of retransmitted segments already fed. Returns the number
+// of header blocks completed, whose fields were stored in the record
+unsigned int HTTPFlow::feed(unsigned int dir, unsigned int seq, const unsigned char * p, unsigned int n) {
+  dir &= 1;
+
+  if (p == NULL || n == 0)
+    return 0;
+
+  if (synced[dir]) {
+    int delta = (int)(seq - next[dir]);
+
+    // Bytes already fed are skipped
+    if (delta < 0) {
+      if ((unsigned int)-delta >= n)
+        return 0;
+
+      p  += -delta;
+      n  -= -delta;
+      seq = next[dir];
+    }
+  }
+
+  synced[dir] = true;
+  next[dir]   = seq + n;
+
+  return scanner.feed(dir, p, n, record);
+}
+
+#endif
@@ -0,0 +1,123 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef HTTP_H
+#define HTTP_H
+
+#include <iostream>
+
+using namespace std;
+
+#define HTTP_MAX_METHOD  16     // buffer size for request methods
+#define HTTP_MAX_URI    256     // buffer size for request URIs (longer ones are truncated)
+#define HTTP_MAX_HOST   128     // buffer size for Host header values
+#define HTTP_MAX_LINE   512     // longest partial line carried from one segment to the next
+
+/* HTTPRecord: per-flow summary of the last HTTP/1.x request and response seen.
+ *
+ * Attributes
+ *   method, uri, host : fields of the last request (null terminated)
+ *   version           : HTTP version of the last message (10 or 11)
+ *   status            : status code of the last response (0 if none yet)
+ *   content_length    : Content-Length of the last message (-1 if absent)
+ *   requests          : number of request headers parsed on the flow
+ *   responses         : number of response headers parsed on the flow
+ */
+struct HTTPRecord {
+  char         method[HTTP_MAX_METHOD];
+  char         uri[HTTP_MAX_URI];
+  char         host[HTTP_MAX_HOST];
+  unsigned int version;
+  unsigned int status;
+  long long    content_length;
+  unsigned int requests;
+  unsigned int responses;
+
+  HTTPRecord();                                          // default constructor
+
+  // Operator overloads
+  friend ostream & operator<<(ostream &, const HTTPRecord &);
+};
+
+/* HTTPScanner: incremental HTTP/1.x header scanner fed with TCP payloads (or
+ *   reassembled stream chunks) of both directions of a flow.
+ *
+ * Attributes
+ *   p_dir : per-direction scanning state
+ *
+ * Notes
+ *   1. lines are located with a vectorized byte search (AVX2 or SSE2 when the
+ *      compiler targets them, plain loop otherwise). Complete lines are parsed
+ *      in place, straight from the segment.
+ *   2. only the trailing partial line of a segment is copied, into a small
+ *      per-direction buffer, and completed with the next segment (slow path).
+ *   3. message bodies are skipped using Content-Length. When the length is
+ *      unknown (chunked encoding, close delimited), segments are skipped until
+ *      one starts with a request or status line.
+ */
+class HTTPScanner {
+  public:
+    HTTPScanner();                                       // default constructor
+
+    // Feeds payload bytes of given direction (0 or 1); returns the number of
+    // header blocks completed, whose fields were stored in the record
+    unsigned int feed(unsigned int, const unsigned char *, unsigned int, HTTPRecord &);
+
+    // Returns the first occurrence of a byte within a memory block, or NULL
+    static const unsigned char * find(const unsigned char *, const unsigned char *, unsigned char);
+
+  private:
+    // Scanning state of one direction
+    typedef enum {
+      hs_idle, hs_request, hs_response, hs_skip
+    } HTTPState;
+
+    struct Direction {
+      char               line[HTTP_MAX_LINE];   // partial line carried across segments
+      unsigned int       len;                   // bytes in line
+      bool               overflow;              // partial line was too long and is ignored
+      bool               headers;               // start line parsed, now reading header lines
+      HTTPState          state;                 // kind of message being parsed
+      unsigned long long body;                  // body bytes left to skip
+      long long          length;                // Content-Length of message being parsed
+    } p_dir[2];
+
+    int start_line(const unsigned char *, unsigned int) const;
+    bool parse_line(Direction &, const unsigned char *, unsigned int, HTTPRecord &);
+};
+
+/* HTTPFlow: per-flow state of the HTTP analyzer, meant to be kept in a FlowTable.
+ *
+ * Notes
+ *   1. segments are expected in sequence order: the bytes of retransmitted
+ *      segments already fed to the scanner are skipped, so a repeated header
+ *      block is not parsed twice. Bytes following missing ones are fed as is.
+ */
+struct HTTPFlow {
+  HTTPScanner  scanner;
+  HTTPRecord   record;
+  unsigned int next[2];       // sequence number of the next byte expected per direction
+  bool         synced[2];     // next is known
+
+  HTTPFlow();                                            // default constructor
+
+  // Feeds a TCP payload of given direction and sequence number to the scanner,
+  // skipping the bytes already fed; returns the number of header blocks completed
+  unsigned int feed(unsigned int, unsigned int, const unsigned char *, unsigned int);
+};
+
+#endif
@@ -0,0 +1,161 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef ICMPCORRELATOR_CPP
+#define ICMPCORRELATOR_CPP
+
+#include "icmpcorrelator.h"   // ICMPCorrelator
+
+// Default constructor
+ICMPFlowEvents::ICMPFlowEvents() : sender(0), unreachables(0), last_code(0), frag_needed(0), mtu(0),
+                                   oversized(0), ttl_exceeded(0), router(0), router_hits(0),
+                                   last_event(0), blackhole(false), loop(false) {
+}
+
+// Output operator displaying the errors received by the flow
+ostream & operator<<(ostream & ostr, const ICMPFlowEvents & ev) {
+  if (ev.unreachables > 0)
+    ostr << "destination unreachable = " << ev.unreachables << " (last code " << ev.last_code << ")" << endl;
+
+  if (ev.frag_needed > 0)
+    ostr << "fragmentation needed = " << ev.frag_needed << " (MTU " << ev.mtu << ", "
+         << ev.oversized << " larger packets sent since)" << (ev.blackhole ? " - PMTU black hole suspected" : "")
+         << endl;
+
+  if (ev.ttl_exceeded > 0) {
+    char outstr[16];
+    sprintf(outstr, "%u.%u.%u.%u", ev.router >> 24, (ev.router >> 16) & 0xFF, (ev.router >> 8) & 0xFF,
+            ev.router & 0xFF);
+    ostr << "TTL exceeded = " << ev.ttl_exceeded << " (last from " << outstr << ")"
+         << (ev.loop ? " - routing loop suspected" : "") << endl;
+  }
+
+  ostr << flush;
+
+  return ostr;
+}
+
+// Parameterized constructor: number of flows tracked
+ICMPCorrelator::ICMPCorrelator(unsigned int flows) : p_flows(flows), p_errors(0) {
+}
+
+// Processes a dissected packet: ICMP errors are attached to the flow they
+// quote, packets of flows having received a frag-needed error are checked
+// against the reported MTU
+ICMPCorrelator::ICMPEvent ICMPCorrelator::process(const PacketMeta & meta, unsigned long long now,
+                                                  FlowKey & key, const ICMPFlowEvents * & events) {
+  if (!meta.has_ip)
+    return icmpc_none;
+
+  // Datagrams of a flow: look for a sender ignoring a frag-needed error
+  if (meta.has_tcp || meta.has_udp) {
+    key = FlowKey(meta.src_ip, meta.dst_ip, meta.sport, meta.dport, meta.protocol);
+
+    ICMPFlowEvents * ev  = p_flows.find(key);
+    unsigned int     dir = (FlowKey::direction(meta.src_ip, meta.dst_ip, meta.sport, meta.dport) ? 1 : 0);
+
+    if (ev == NULL || ev->mtu == 0 || ev->sender != dir)
+      return icmpc_none;
+
+    if (meta.ip.total_length() > ev->mtu && ++ev->oversized >= ICMPC_BLACKHOLE && !ev->blackhole) {
+      ev->blackhole = true;
+      events = ev;
+      return icmpc_blackhole;
+    }
+
+    return icmpc_none;
+  }
+
+  // ICMP errors: attach to the quoted flow
+  unsigned int src, dst, sport, dport, proto;
+
+  if (!meta.has_icmp || !meta.icmp.quoted_flow(src, dst, sport, dport, proto))
+    return icmpc_none;
+
+  unsigned int type = meta.icmp.type(), code = meta.icmp.code();
+  if (type != 3 && type != 11)
+    return icmpc_none;
+
+  bool             created;
+  ICMPEvent        event = icmpc_none;
+  ICMPFlowEvents * ev;
+
+  key = FlowKey(src, dst, sport, dport, proto);
+  ev  = p_flows.insert(key, now, created);
+
+  ev->sender     = (FlowKey::direction(src, dst, sport, dport) ? 1 : 0);
+  ev->last_event = now;
+  p_errors++;
+
+  if (type == 3 && code == 4) {
+    // Fragmentation needed: keep the smallest MTU reported
+    unsigned int mtu = meta.icmp.next_hop_MTU();
+
+    ev->frag_needed++;
+    if (mtu >= 68 && (ev->mtu == 0 || mtu < ev->mtu)) {
+      ev->mtu       = mtu;
+      ev->oversized = 0;
+    }
+    event = icmpc_frag_needed;
+  }
+  else if (type == 3) {
+    ev->unreachables++;
+    ev->last_code = code;
+    event = icmpc_unreachable;
+  }
+  else if (code == 0) {
+    // TTL exceeded in transit: count consecutive errors of a same router
+    ev->ttl_exceeded++;
+    if (ev->router == meta.src_ip)
+      ev->router_hits++;
+    else {
+      ev->router      = meta.src_ip;
+      ev->router_hits = 1;
+    }
+
+    event = icmpc_ttl_exceeded;
+    if (ev->router_hits >= ICMPC_LOOP && !ev->loop) {
+      ev->loop = true;
+      event    = icmpc_loop;
+    }
+  }
+  else
+    return icmpc_none;   // fragment reassembly time exceeded
+
+  events = ev;
+
+  return event;
+}
+
+// Output operator displaying the correlation statistics and the flows
+// suspected of PMTU black holes or routing loops
+ostream & operator<<(ostream & ostr, ICMPCorrelator & ic) {
+  ostr << "ICMP errors correlated = " << ic.p_errors << ", flows evicted = " << ic.p_flows.evicted() << endl;
+
+  for (unsigned int i = 0; i < ic.p_flows.capacity(); i++) {
+    FlowTable<ICMPFlowEvents>::Entry & e = ic.p_flows.entry(i);
+
+    if (e.last_seen != 0 && (e.value.blackhole || e.value.loop))
+      ostr << "flow " << e.key << endl << e.value;
+  }
+
+  ostr << flush;
+
+  return ostr;
+}
+
+#endif
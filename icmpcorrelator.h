@@ -0,0 +1,97 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef ICMPCORRELATOR_H
+#define ICMPCORRELATOR_H
+
+#include <iostream>
+
+#include "packetmeta.h"         // PacketMeta
+#include "flowtable.h"          // FlowTable, FlowKey
+
+using namespace std;
+
+#define ICMPC_BLACKHOLE 3       // oversized packets after a frag-needed error suggesting a PMTU black hole
+#define ICMPC_LOOP      3       // TTL exceeded errors from a same router suggesting a routing loop
+
+/* ICMPFlowEvents: ICMP errors received about the datagrams of a flow.
+ *
+ * Attributes
+ *   sender       : direction (see FlowKey::direction()) of the datagrams the errors quote
+ *   unreachables : destination unreachable errors (other than frag-needed)
+ *   last_code    : code of the last destination unreachable error
+ *   frag_needed  : fragmentation needed errors
+ *   mtu          : smallest next-hop MTU reported (0 if none)
+ *   oversized    : packets larger than mtu sent after the first frag-needed error
+ *   ttl_exceeded : time exceeded in transit errors
+ *   router       : address of the router that sent the last TTL exceeded error
+ *   router_hits  : consecutive TTL exceeded errors from that router
+ *   last_event   : time of the last error
+ *   blackhole, loop : a PMTU black hole or a routing loop was reported
+ */
+struct ICMPFlowEvents {
+  ICMPFlowEvents();                                      // default constructor
+
+  unsigned int       sender;
+  unsigned int       unreachables, last_code;
+  unsigned int       frag_needed, mtu, oversized;
+  unsigned int       ttl_exceeded, router, router_hits;
+  unsigned long long last_event;
+  bool               blackhole, loop;
+
+  // Operator overloads
+  friend ostream & operator<<(ostream &, const ICMPFlowEvents &);
+};
+
+/* ICMPCorrelator: attaches ICMP errors to the flow whose datagram they quote.
+ *
+ * Attributes
+ *   p_flows  : per-flow events
+ *   p_errors : number of ICMP errors correlated to a flow
+ *
+ * Notes
+ *   1. a flow entry is created by the first error quoting one of its
+ *      datagrams; other packets only cost a lookup in the table of flows
+ *      having received errors.
+ *   2. a flow whose sender keeps sending ICMPC_BLACKHOLE packets larger than
+ *      the reported MTU is reported as a PMTU black hole (the errors do not
+ *      reach the sender, or are ignored). A flow receiving ICMPC_LOOP TTL
+ *      exceeded errors in a row from a same router is reported as looping.
+ */
+class ICMPCorrelator {
+  public:
+    // Enumeration of correlated events
+    typedef enum {
+      icmpc_none, icmpc_unreachable, icmpc_frag_needed, icmpc_ttl_exceeded,
+      icmpc_blackhole, icmpc_loop
+    } ICMPEvent;
+
+    ICMPCorrelator(unsigned int = 16384);                // parameterized constructor
+
+    // Processes a dissected packet captured at given time. Returns the event
+    // it caused, in which case key and events describe the affected flow
+    ICMPEvent process(const PacketMeta &, unsigned long long, FlowKey &, const ICMPFlowEvents * &);
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, ICMPCorrelator &);
+
+  private:
+    FlowTable<ICMPFlowEvents> p_flows;
+    unsigned long long        p_errors;
+};
+
+#endif
@@ -19,6 +19,7 @@
 #define ICMPPACKET_CPP
 
 #include "icmppacket.h"  // ICMPPacket
+#include "ippacket.h"    // IPPacket
 #include "exceptions.h"  // EBadTransportException
 
 // Default constructor
@@ -39,7 +40,7 @@ unsigned int ICMPPacket::header_length() const {
 
 // Returns a textual description of the packet according to its type and code fields
 const char * ICMPPacket::description() const {
-  unsigned int msg_id = type() << 8 + code();
+  unsigned int msg_id = (type() << 8) + code();
 
   switch (msg_id) {
     case 0x0000 : return "echo reply";
@@ -166,6 +167,55 @@ IPAddress ICMPPacket::address_mask() const {
     throw EBadTransportException("ICMP packet does not hold address mask field");
 }
 
+// Returns true if the packet is an error message (destination unreachable,
+// source quench, redirect, time exceeded or parameter problem), which quotes
+// the IP header and first 8 payload bytes of the offending datagram
+bool ICMPPacket::error() const {
+  switch (type()) {
+    case 3: case 4: case 5: case 11: case 12: return true;
+    default: return false;
+  }
+}
+
+// Returns the quoted IP header and leading payload bytes of error messages
+IPPacket ICMPPacket::quoted_ip() {
+  if (error())
+    return IPPacket(false, p_len > 8 ? p_data + 8 : NULL, p_len > 8 ? p_len - 8 : 0);
+  else
+    throw EBadTransportException("ICMP packet does not quote an IP datagram");
+}
+
+// Decodes the addresses (host order), ports and protocol of the datagram
+// quoted by error messages. Ports are 0 unless the quoted datagram is TCP or
+// UDP. Returns false if the packet is not an error message or the quote is
+// truncated
+bool ICMPPacket::quoted_flow(unsigned int & src, unsigned int & dst, unsigned int & sport,
+                             unsigned int & dport, unsigned int & protocol) const {
+  if (p_data == NULL || p_len < 8 + 20 || !error())
+    return false;
+
+  const unsigned char * q   = p_data + 8;
+  unsigned int          ihl = (q[0] & 0x0F) * 4;
+
+  if ((q[0] >> 4) != 4 || ihl < 20 || p_len < 8 + ihl)
+    return false;
+
+  src      = char4word(q + 12);
+  dst      = char4word(q + 16);
+  protocol = q[9];
+  sport    = dport = 0;
+
+  // TCP and UDP ports lie in the 8 quoted payload bytes
+  if (protocol == 6 || protocol == 17) {
+    if (p_len < 8 + ihl + 4)
+      return false;
+    sport = char2word(q + ihl);
+    dport = char2word(q + ihl + 2);
+  }
+
+  return true;
+}
+
 // Output operator displaying the ICMP packet header fields in human readable
 // form
 ostream & operator<<(ostream & ostr, const ICMPPacket & icmp) {
@@ -198,7 +248,7 @@ ostream & operator<<(ostream & ostr, const ICMPPacket & icmp) {
     // Display next-hop MTU field for packets of type 3
     try {
       unsigned int nexthop = icmp.next_hop_MTU();
-      ostr << "sequence number = " << nexthop << endl;
+      ostr << "next-hop MTU = " << nexthop << endl;
     }
     catch (EBadTransportException) {
     }
@@ -210,6 +260,16 @@ ostream & operator<<(ostream & ostr, const ICMPPacket & icmp) {
     }
     catch (EBadTransportException) {
     }
+
+    // Display the flow of the datagram quoted by error messages
+    unsigned int src, dst, sport, dport, proto;
+    if (icmp.quoted_flow(src, dst, sport, dport, proto)) {
+      char quoted[64];
+      sprintf(quoted, "%u.%u.%u.%u:%u -> %u.%u.%u.%u:%u", src >> 24, (src >> 16) & 0xFF,
+              (src >> 8) & 0xFF, src & 0xFF, sport, dst >> 24, (dst >> 16) & 0xFF,
+              (dst >> 8) & 0xFF, dst & 0xFF, dport);
+      ostr << "quoted datagram = " << quoted << " (protocol " << proto << ")" << endl;
+    }
   }
 
   ostr << flush;
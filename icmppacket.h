@@ -25,6 +25,8 @@
 
 using namespace std;
 
+class IPPacket;                 // defined in ippacket.h
+
 /* ICMPPacket: class mapping the inherited data block as an ICMP packet.
  *
  * Attributes
@@ -64,6 +66,12 @@ class ICMPPacket : public DatagramFragment {
     IPAddress    ipaddress() const;
     IPAddress    address_mask() const;
 
+    // Routines giving access to the datagram quoted by error messages
+    bool         error() const;                           // indicates if packet quotes an offending datagram
+    IPPacket     quoted_ip();                             // returns quoted IP header and leading payload
+    bool         quoted_flow(unsigned int &, unsigned int &, unsigned int &,  // decodes quoted addresses,
+                             unsigned int &, unsigned int &) const;           // ports and protocol
+
     // Operator overloads
     friend ostream & operator<<(ostream &, const ICMPPacket &);
 
@@ -0,0 +1,324 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef INDICATORS_CPP
+#define INDICATORS_CPP
+
+#include <cstdio>           // fopen, fgets, fwrite
+#include <cstdlib>          // posix_memalign, calloc, free
+#include <cstring>          // memcmp, memcpy, strchr, strspn, strcspn, strtok
+#include <algorithm>        // sort, unique
+#include <fcntl.h>          // open
+#include <unistd.h>         // read, close
+#include <sys/mman.h>       // mmap, munmap
+#include <sys/stat.h>       // fstat
+#include <arpa/inet.h>      // inet_pton
+
+#include "indicators.h"     // IndicatorSet
+#include "datagramfragment.h"  // hash_long
+
+#define INDICATOR_DOMAIN 0x8000000000000000ULL  // top bit of the keys of domains
+
+// Odd multipliers picking the bit set in each word of a block
+static const unsigned int bloom_salt[INDICATOR_WORDS] = {
+  0x47B6137B, 0x44974D91, 0x8824AD5B, 0xA2B7289D, 0x705495C7, 0x2DF1424B, 0x9EFC4947, 0x5C6BFB31
+};
+
+// Parameterized constructor: Bloom filter bits per indicator of built sets
+IndicatorSet::IndicatorSet(unsigned int bits_per_key)
+  : p_bits_per_key(bits_per_key ? bits_per_key : 1), p_blocks(NULL), p_block_count(0),
+    p_slots(NULL), p_slot_bits(0), p_addresses(0), p_domains(0), p_map(NULL), p_map_len(0),
+    p_probes(0), p_passed(0), p_hits(0), p_malformed(0) {
+}
+
+// Destructor
+IndicatorSet::~IndicatorSet() {
+  release();
+}
+
+// Releases the filter and table, mapped or built
+void IndicatorSet::release() {
+  if (p_map != NULL)
+    munmap(p_map, p_map_len);
+  else {
+    free(p_blocks);
+    free(p_slots);
+  }
+
+  p_map       = NULL;
+  p_blocks    = NULL;
+  p_slots     = NULL;
+  p_addresses = p_domains = 0;
+}
+
+// Returns the key of an address (host order)
+unsigned long long IndicatorSet::key(unsigned int addr) {
+  unsigned long long k = hash_long(addr) & ~INDICATOR_DOMAIN;
+
+  return (k ? k : 1);
+}
+
+// Returns the key of a domain name of given length, case ignored
+unsigned long long IndicatorSet::key(const char * name, unsigned int len) {
+  unsigned long long h = 0xCBF29CE484222325ULL;     // FNV-1a
+
+  for (unsigned int i = 0; i < len; i++) {
+    unsigned char c = name[i];
+    h = (h ^ (c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c)) * 0x100000001B3ULL;
+  }
+
+  return hash_long(h) | INDICATOR_DOMAIN;
+}
+
+// Looks a key up: in the Bloom filter block it selects, then in the table if
+// the filter passes it
+bool IndicatorSet::probe(unsigned long long k) {
+  if (p_blocks == NULL)
+    return false;
+
+  p_probes++;
+
+  const unsigned long long * b = p_blocks + ((k & 0xFFFFFFFF) * p_block_count >> 32) * INDICATOR_WORDS;
+  unsigned int               h = k >> 31;
+  bool                       passed = true;
+
+  for (unsigned int i = 0; i < INDICATOR_WORDS; i++)
+    passed &= (b[i] >> ((h * bloom_salt[i]) >> 26)) & 1;
+
+  if (!passed)
+    return false;
+
+  p_passed++;
+
+  unsigned long long mask = (1ULL << p_slot_bits) - 1;
+  for (unsigned long long s = (k * 0x9E3779B97F4A7C15ULL) >> (64 - p_slot_bits); p_slots[s] != 0; s = (s + 1) & mask)
+    if (p_slots[s] == k) {
+      p_hits++;
+      return true;
+    }
+
+  return false;
+}
+
+// Builds the filter and table from the keys of the indicators
+void IndicatorSet::build(vector<unsigned long long> & keys) {
+  sort(keys.begin(), keys.end());
+  keys.erase(unique(keys.begin(), keys.end()), keys.end());
+
+  unsigned long long bits = (unsigned long long)keys.size() * p_bits_per_key;
+  void *             mem  = NULL;
+
+  p_block_count = (bits + 64 * INDICATOR_WORDS - 1) / (64 * INDICATOR_WORDS);
+  if (p_block_count == 0)
+    p_block_count = 1;
+
+  // Table at most half full
+  p_slot_bits = 1;
+  while ((1ULL << p_slot_bits) < 2 * keys.size())
+    p_slot_bits++;
+
+  if (posix_memalign(&mem, 64, (size_t)p_block_count * INDICATOR_WORDS * 8) != 0)
+    return;
+  p_blocks = (unsigned long long *)mem;
+  memset(p_blocks, 0, (size_t)p_block_count * INDICATOR_WORDS * 8);
+
+  if ((p_slots = (unsigned long long *)calloc(1ULL << p_slot_bits, 8)) == NULL) {
+    free(p_blocks);
+    p_blocks = NULL;
+    return;
+  }
+
+  unsigned long long mask = (1ULL << p_slot_bits) - 1;
+
+  for (unsigned int i = 0; i < keys.size(); i++) {
+    unsigned long long k = keys[i];
+    unsigned long long * b = p_blocks + ((k & 0xFFFFFFFF) * p_block_count >> 32) * INDICATOR_WORDS;
+    unsigned int       h = k >> 31;
+
+    for (unsigned int w = 0; w < INDICATOR_WORDS; w++)
+      b[w] |= 1ULL << ((h * bloom_salt[w]) >> 26);
+
+    unsigned long long s = (k * 0x9E3779B97F4A7C15ULL) >> (64 - p_slot_bits);
+    while (p_slots[s] != 0)
+      s = (s + 1) & mask;
+    p_slots[s] = k;
+
+    if (k & INDICATOR_DOMAIN)
+      p_domains++;
+    else
+      p_addresses++;
+  }
+}
+
+// Loads the indicators of a list, or maps a compiled file, replacing the
+// indicators loaded before. Returns the number of indicators, or -1 if the
+// file cannot be read or the set built
+int IndicatorSet::load(const char * fname) {
+  int         fd = open(fname, O_RDONLY);
+  struct stat st;
+  Header      h;
+
+  if (fd < 0)
+    return -1;
+
+  // Compiled file: map it as is
+  if (fstat(fd, &st) == 0 && read(fd, &h, sizeof(h)) == (ssize_t)sizeof(h) &&
+      memcmp(h.magic, INDICATOR_MAGIC, sizeof(h.magic)) == 0) {
+    size_t len = sizeof(h) + (size_t)h.block_count * INDICATOR_WORDS * 8 + (8ULL << h.slot_bits);
+    void * map;
+
+    if (h.block_count == 0 || h.slot_bits == 0 || h.slot_bits > 40 || (size_t)st.st_size != len ||
+        (map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+      close(fd);
+      return -1;
+    }
+    close(fd);
+
+    release();
+    p_map         = map;
+    p_map_len     = len;
+    p_blocks      = (unsigned long long *)((char *)map + sizeof(h));
+    p_block_count = h.block_count;
+    p_slots       = p_blocks + (size_t)h.block_count * INDICATOR_WORDS;
+    p_slot_bits   = h.slot_bits;
+    p_addresses   = h.addresses;
+    p_domains     = h.domains;
+
+    return p_addresses + p_domains;
+  }
+  close(fd);
+
+  // List of addresses and domains
+  FILE *                     f = fopen(fname, "r");
+  char                       line[512];
+  vector<unsigned long long> keys;
+
+  if (f == NULL)
+    return -1;
+
+  while (fgets(line, sizeof(line), f) != NULL) {
+    char * comment = strchr(line, '#');
+    if (comment != NULL)
+      *comment = '\0';
+
+    char * item = strtok(line, " \t\r\n");
+    if (item == NULL)
+      continue;
+
+    unsigned char addr[4];
+    unsigned int  len = strlen(item);
+
+    if (inet_pton(AF_INET, item, addr) == 1)
+      keys.push_back(key((unsigned int)addr[0] << 24 | addr[1] << 16 | addr[2] << 8 | addr[3]));
+    else if (strspn(item, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_.") == len &&
+             item[0] != '.') {
+      if (item[len-1] == '.')
+        len--;
+      keys.push_back(key(item, len));
+    }
+    else
+      p_malformed++;
+  }
+
+  fclose(f);
+
+  release();
+  build(keys);
+
+  return (p_blocks != NULL ? (int)(p_addresses + p_domains) : -1);
+}
+
+// Writes the filter and table in a file that may later be mapped. Returns
+// false if the set is empty or the file cannot be written
+bool IndicatorSet::save(const char * fname) const {
+  if (p_blocks == NULL)
+    return false;
+
+  FILE * f = fopen(fname, "wb");
+  Header h;
+
+  if (f == NULL)
+    return false;
+
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, INDICATOR_MAGIC, sizeof(h.magic));
+  h.block_count = p_block_count;
+  h.slot_bits   = p_slot_bits;
+  h.addresses   = p_addresses;
+  h.domains     = p_domains;
+
+  bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+            fwrite(p_blocks, INDICATOR_WORDS * 8, p_block_count, f) == p_block_count &&
+            fwrite(p_slots, 8, 1ULL << p_slot_bits, f) == (1ULL << p_slot_bits);
+
+  return (fclose(f) == 0 && ok);
+}
+
+// Returns true if given address (host order) is listed
+bool IndicatorSet::contains(unsigned int addr) {
+  return probe(key(addr));
+}
+
+// Returns true if given domain name, or one of its parent domains, is listed.
+// A port following the name (as in HTTP Host headers) is ignored
+bool IndicatorSet::contains(const char * name) {
+  unsigned int len = strcspn(name, ":");
+
+  if (len > 0 && name[len-1] == '.')
+    len--;
+
+  for (unsigned int i = 0; i < len; i++)
+    if ((i == 0 || name[i-1] == '.') && probe(key(name + i, len - i)))
+      return true;
+
+  return false;
+}
+
+// Returns the number of indicators
+unsigned long long IndicatorSet::size() const {
+  return p_addresses + p_domains;
+}
+
+// Returns true if the set is mapped from a compiled file
+bool IndicatorSet::mapped() const {
+  return p_map != NULL;
+}
+
+// Returns the number of bytes of the Bloom filter and table
+unsigned long long IndicatorSet::memory() const {
+  return (p_blocks != NULL ? (unsigned long long)p_block_count * INDICATOR_WORDS * 8 + (8ULL << p_slot_bits) : 0);
+}
+
+// Output operator summarizing the set and its lookups
+ostream & operator<<(ostream & ostr, const IndicatorSet & s) {
+  ostr << s.p_addresses << " addresses, " << s.p_domains << " domains ("
+       << s.memory() / 1024 << " KB " << (s.p_map != NULL ? "mapped" : "built") << ", "
+       << s.p_block_count << " Bloom filter blocks)";
+  if (s.p_malformed)
+    ostr << ", " << s.p_malformed << " malformed lines";
+  ostr << endl;
+
+  if (s.p_probes)
+    ostr << "  " << s.p_probes << " lookups, " << s.p_passed << " passed the Bloom filter ("
+         << 100.0 * s.p_passed / s.p_probes << "%), " << s.p_hits << " listed" << endl;
+
+  ostr << flush;
+
+  return ostr;
+}
+
+#endif
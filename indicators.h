@@ -0,0 +1,109 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef INDICATORS_H
+#define INDICATORS_H
+
+#include <iostream>
+#include <vector>
+#include <cstddef>
+
+using namespace std;
+
+#define INDICATOR_MAGIC "IOCSET1"       // first bytes of compiled indicator files
+#define INDICATOR_WORDS 8               // 64-bit words per Bloom filter block (one cache line)
+
+/* IndicatorSet: exact set of listed IPv4 addresses and domain names (indicators
+ *   of compromise), fronted by a blocked Bloom filter.
+ *
+ * Attributes
+ *   p_bits_per_key : Bloom filter bits per indicator when building a set
+ *   p_blocks       : Bloom filter, INDICATOR_WORDS words per block
+ *   p_block_count  : number of blocks
+ *   p_slots        : open addressing table of indicator keys (0 if free)
+ *   p_slot_bits    : log2 of the number of slots
+ *   p_addresses, p_domains : indicators of each kind
+ *   p_map, p_map_len : mapping of a compiled file (NULL if the set was built)
+ *   p_probes, p_passed, p_hits : keys looked up, passed by the Bloom filter, and found
+ *   p_malformed    : lines of loaded lists rejected
+ *
+ * Notes
+ *   1. indicators are stored as 64-bit keys hashed from the address or the
+ *      lower case name, its top bit telling which kind of indicator it is.
+ *      Distinct indicators sharing a key are too unlikely to matter.
+ *   2. each key sets one bit in each word of a single 64 byte block, so a
+ *      lookup of an unlisted key reads one cache line and is rejected there,
+ *      apart from about 0.4% of keys with 12 bits per indicator (0.3% for an
+ *      even spread, plus the uneven load of blocks). Only keys passing the
+ *      filter probe the exact table.
+ *   3. compiled files hold a 64 byte header, the blocks and the slots, and are
+ *      mapped read only: loading takes no time whatever their size, and pages
+ *      are shared between processes. They use the byte order of the host that
+ *      wrote them.
+ *   4. lists hold one address (a.b.c.d) or domain name per line. Text
+ *      following '#' is ignored. A listed domain also matches its subdomains.
+ */
+class IndicatorSet {
+  public:
+    IndicatorSet(unsigned int = 12);                     // parameterized constructor
+    ~IndicatorSet();                                     // destructor
+
+    int load(const char *);                              // loads a list or a compiled file
+    bool save(const char *) const;                       // writes the compiled set in a file
+
+    bool contains(unsigned int);                         // address (host order) is listed
+    bool contains(const char *);                         // domain or one of its parents is listed
+
+    unsigned long long size() const;                     // number of indicators
+    bool mapped() const;                                 // set is mapped from a compiled file
+    unsigned long long memory() const;                   // bytes of the filter and table
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, const IndicatorSet &);
+
+  private:
+    // Header of compiled files, followed by the blocks and the slots
+    struct Header {
+      char               magic[8];
+      unsigned int       block_count, slot_bits;
+      unsigned long long addresses, domains;
+      unsigned char      reserved[32];
+    };
+
+    unsigned int         p_bits_per_key;
+    unsigned long long * p_blocks;
+    unsigned int         p_block_count;
+    unsigned long long * p_slots;
+    unsigned int         p_slot_bits;
+    unsigned long long   p_addresses, p_domains;
+    void *               p_map;
+    size_t               p_map_len;
+    unsigned long long   p_probes, p_passed, p_hits;
+    unsigned int         p_malformed;
+
+    static unsigned long long key(unsigned int);
+    static unsigned long long key(const char *, unsigned int);
+    bool probe(unsigned long long);
+    void build(vector<unsigned long long> &);
+    void release();
+
+    // Copying is not allowed
+    IndicatorSet(const IndicatorSet &);
+    IndicatorSet & operator=(const IndicatorSet &);
+};
+
+#endif
@@ -44,6 +44,15 @@ bool IPAddress::valid() const {
   return false;
 }
 
+// Returns the address as an unsigned int in host byte order (first byte most
+// significant), or 0 if no address is mapped
+unsigned int IPAddress::value() const {
+  if (!p_data)
+    return 0;
+  else
+    return char4word(p_data);
+}
+
 // Output operator displaying the IP address in dot form  (X.X.X.X)
 ostream & operator<<(ostream & ostr, const IPAddress & adr) {
   char outstr[4];
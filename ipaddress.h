@@ -44,6 +44,7 @@ class IPAddress : public DatagramFragment {
     unsigned int header_length() const;    // length of IP address in bytes
 
     bool valid() const;                    // indicates if it's a valid IP address
+    unsigned int value() const;            // address as an unsigned int (host order)
 
     // Operator overloads
     friend ostream & operator<<(ostream &, const IPAddress &);
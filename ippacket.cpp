@@ -103,8 +103,10 @@ IPPacket::IPProtocol IPPacket::protocol() const {
   switch (protocol_id()) {
     case  1 : return ipp_icmp;
     case  2 : return ipp_igmp;
+    case  4 : return ipp_ipip;
     case  6 : return ipp_tcp;
     case 17 : return ipp_udp;
+    case 47 : return ipp_gre;
     default : return ipp_other;
   }
 }
@@ -180,12 +182,23 @@ bool IPPacket::option_header(unsigned int idx, unsigned int &optclass,
   return true;
 }
 
+// Returns the number of payload bytes. The Total Length field is used to exclude
+// any padding added by the link layer to short frames
+unsigned int IPPacket::payload_length() const {
+  unsigned int l = length() - header_length();
+
+  if (total_length() >= header_length() && total_length() - header_length() < l)
+    l = total_length() - header_length();
+
+  return l;
+}
+
 // Returns ICMP packet transported in payload
 ICMPPacket IPPacket::icmp() {
     if (protocol() != ipp_icmp)
         throw EBadTransportException("IP packet not transporting ICMP traffic");
 
-    return ICMPPacket(false, data(), length() - header_length());
+    return ICMPPacket(false, data(), payload_length());
 }
 
 // Returns TCP segment transported in payload
@@ -193,7 +206,7 @@ TCPSegment IPPacket::tcp() {
     if (protocol() != ipp_tcp)
         throw EBadTransportException("IP packet not transporting TCP traffic");
 
-    return TCPSegment(false, data(), length() - header_length());
+    return TCPSegment(false, data(), payload_length());
 }
 
 // Returns UDP segment transported in payload
@@ -201,7 +214,23 @@ UDPSegment IPPacket::udp() {
     if (protocol() != ipp_udp)
         throw EBadTransportException("IP packet not transporting UDP traffic");
 
-    return UDPSegment(false, data(), length() - header_length());
+    return UDPSegment(false, data(), payload_length());
+}
+
+// Returns GRE packet transported in payload
+GREPacket IPPacket::gre() {
+    if (protocol() != ipp_gre)
+        throw EBadTransportException("IP packet not transporting GRE traffic");
+
+    return GREPacket(false, data(), payload_length());
+}
+
+// Returns IP packet encapsulated in payload (IP in IP tunnel)
+IPPacket IPPacket::ipip() {
+    if (protocol() != ipp_ipip)
+        throw EBadTransportException("IP packet not transporting IP in IP traffic");
+
+    return IPPacket(false, data(), payload_length());
 }
 
 // Output operator displaying the IP packet header fields in human readable
@@ -268,6 +297,8 @@ ostream & operator<<(ostream & ostr, const IPPacket & ip) {
       case IPPacket::ipp_igmp: ostr << "IGMP ["; break;
       case IPPacket::ipp_tcp:  ostr << "TCP ["; break;
       case IPPacket::ipp_udp:  ostr << "UDP ["; break;
+      case IPPacket::ipp_ipip: ostr << "IP in IP ["; break;
+      case IPPacket::ipp_gre:  ostr << "GRE ["; break;
       default:                 ostr << "unknown ["; break;
     }
     sprintf(outstr, "0x%.2x", ip.protocol_id());
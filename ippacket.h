@@ -25,6 +25,7 @@
 #include "icmppacket.h"         // ICMPPacket
 #include "tcpsegment.h"         // TCPSegment
 #include "udpsegment.h"         // UDPSegment
+#include "gre.h"                // GREPacket
 
 using namespace std;
 
@@ -44,7 +45,7 @@ class IPPacket : public DatagramFragment {
   public:
     // Enumeration of most commonly transported protocols
     typedef enum {
-      ipp_icmp, ipp_igmp, ipp_udp, ipp_tcp, ipp_other, ipp_none
+      ipp_icmp, ipp_igmp, ipp_udp, ipp_tcp, ipp_ipip, ipp_gre, ipp_other, ipp_none
     } IPProtocol;
 
     IPPacket(bool = false);                            // default constructor
@@ -81,11 +82,14 @@ class IPPacket : public DatagramFragment {
     ICMPPacket icmp();                                 // returns ICMP packet transported in payload
     TCPSegment tcp();                                  // returns TCP segment transported in payload
     UDPSegment udp();                                  // returns UDP segment transported in payload
+    GREPacket gre();                                   // returns GRE packet transported in payload
+    IPPacket ipip();                                   // returns IP packet encapsulated in payload
 
     // Operator overloads
     friend ostream & operator<<(ostream &, const IPPacket &);
 
   protected:
+    unsigned int payload_length() const;               // bytes of payload, excluding link layer padding
 };
 
 #endif
@@ -0,0 +1,319 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef LPM_CPP
+#define LPM_CPP
+
+#include <cstdio>           // fopen, fgets
+#include <cstdlib>          // calloc, free, strtoul
+#include <cstring>          // strchr, strtok
+#include <arpa/inet.h>      // inet_pton
+
+#include "lpm.h"            // PrefixTable
+
+#define LPM_GROUP      0x80000000      // entry refers to a group of 256 entries
+#define LPM_VALUE      0x007FFFFF      // tag, or index of the group
+#define LPM_DEPTH(e)   (((e) >> 23) & 0xFF)
+#define LPM_ENTRY(v,d) ((v) | ((d) << 23))
+
+// Default constructor
+PrefixTable::PrefixTable()
+  : p_tbl24(NULL), p_prefixes(0), p_malformed(0) {
+  p_tags.push_back("");     // value 0: no match
+}
+
+// Destructor
+PrefixTable::~PrefixTable() {
+  free(p_tbl24);
+}
+
+// Returns a group of 256 entries initialized with given entry, as an entry
+// referring to it (0 if there are too many groups)
+unsigned int PrefixTable::expand(unsigned int entry, vector<unsigned int> & groups) {
+  unsigned int g = groups.size() / 256;
+
+  if (g > LPM_VALUE)
+    return 0;
+
+  groups.insert(groups.end(), 256, entry);
+  return LPM_GROUP | g;
+}
+
+// Stores a prefix of given length and tag in an entry, unless the entry
+// expands a longer prefix. Entries referring to a group get all theirs
+// overwritten
+void PrefixTable::overwrite(unsigned int & entry, unsigned int len, unsigned int value,
+                            vector<unsigned int> & groups) {
+  if (entry & LPM_GROUP) {
+    unsigned int base = (entry & LPM_VALUE) << 8;
+    for (unsigned int i = 0; i < 256; i++)
+      overwrite(groups[base + i], len, value, groups);
+  }
+  else if (LPM_DEPTH(entry) <= len)
+    entry = LPM_ENTRY(value, len);
+}
+
+// Adds an IPv4 prefix (address in host order) with given tag. Returns false if
+// the prefix or tag is invalid
+bool PrefixTable::insert(unsigned int addr, unsigned int len, unsigned int value) {
+  if (len > 32 || value == 0 || value > LPM_VALUE)
+    return false;
+
+  if (p_tbl24 == NULL && (p_tbl24 = (unsigned int *)calloc(1 << 24, sizeof(unsigned int))) == NULL)
+    return false;
+
+  addr &= (len ? 0xFFFFFFFF << (32 - len) : 0);
+
+  if (len <= 24) {
+    unsigned int first = addr >> 8, count = 1 << (24 - len);
+    for (unsigned int i = first; i < first + count; i++)
+      overwrite(p_tbl24[i], len, value, p_tbl8);
+  }
+  else {
+    unsigned int i = addr >> 8;
+    if (!(p_tbl24[i] & LPM_GROUP)) {
+      unsigned int e = expand(p_tbl24[i], p_tbl8);
+      if (e == 0)
+        return false;
+      p_tbl24[i] = e;
+    }
+
+    unsigned int base = (p_tbl24[i] & LPM_VALUE) << 8, count = 1 << (32 - len);
+    for (unsigned int j = addr & 0xFF; j < (addr & 0xFF) + count; j++)
+      overwrite(p_tbl8[base + j], len, value, p_tbl8);
+  }
+
+  p_prefixes++;
+  return true;
+}
+
+// Adds an IPv6 prefix (16 bytes in network order) with given tag. Returns
+// false if the prefix or tag is invalid
+bool PrefixTable::insert(const unsigned char * addr, unsigned int len, unsigned int value) {
+  if (len > 128 || value == 0 || value > LPM_VALUE)
+    return false;
+
+  if (p_root6.empty())
+    p_root6.assign(65536, 0);
+
+  // First level: 16 bits
+  unsigned int i = addr[0] << 8 | addr[1];
+
+  if (len <= 16) {
+    unsigned int span = 16 - len;
+    i &= ~((1 << span) - 1);
+    for (unsigned int j = 0; j < (1U << span); j++)
+      overwrite(p_root6[i + j], len, value, p_nodes6);
+
+    p_prefixes++;
+    return true;
+  }
+
+  if (!(p_root6[i] & LPM_GROUP)) {
+    unsigned int e = expand(p_root6[i], p_nodes6);
+    if (e == 0)
+      return false;
+    p_root6[i] = e;
+  }
+
+  // Following levels: 8 bits each
+  unsigned int node = p_root6[i] & LPM_VALUE;
+
+  for (unsigned int bit = 16; ; bit += 8) {
+    unsigned int byte = addr[bit / 8];
+
+    if (len <= bit + 8) {
+      unsigned int span = bit + 8 - len;
+      byte &= ~((1 << span) - 1);
+      for (unsigned int j = 0; j < (1U << span); j++)
+        overwrite(p_nodes6[(node << 8) + byte + j], len, value, p_nodes6);
+      break;
+    }
+
+    unsigned int idx = (node << 8) + byte;
+    if (!(p_nodes6[idx] & LPM_GROUP)) {
+      unsigned int e = expand(p_nodes6[idx], p_nodes6);
+      if (e == 0)
+        return false;
+      p_nodes6[idx] = e;
+    }
+    node = p_nodes6[idx] & LPM_VALUE;
+  }
+
+  p_prefixes++;
+  return true;
+}
+
+// Adds the prefixes listed in a file. Returns the number of prefixes added,
+// or -1 if the file cannot be read
+int PrefixTable::load(const char * fname) {
+  FILE * f = fopen(fname, "r");
+  char   line[512];
+  int    added = 0;
+
+  if (f == NULL)
+    return -1;
+
+  while (fgets(line, sizeof(line), f) != NULL) {
+    char * comment = strchr(line, '#');
+    if (comment != NULL)
+      *comment = '\0';
+
+    char * prefix = strtok(line, " \t\r\n");
+    char * name   = strtok(NULL, " \t\r\n");
+    if (prefix == NULL)
+      continue;
+
+    // Optional prefix length
+    char *        slash = strchr(prefix, '/');
+    unsigned long len   = 0;
+    char *        end   = NULL;
+
+    if (slash != NULL) {
+      *slash = '\0';
+      len = strtoul(slash + 1, &end, 10);
+      if (end == slash + 1 || *end != '\0')
+        len = 1000;                          // rejected below
+    }
+
+    unsigned char addr[16];
+    unsigned int  value = tag(name ? name : "listed");
+    bool          ok;
+
+    if (inet_pton(AF_INET, prefix, addr) == 1)
+      ok = insert((unsigned int)addr[0] << 24 | addr[1] << 16 | addr[2] << 8 | addr[3],
+                  (slash ? len : 32), value);
+    else if (inet_pton(AF_INET6, prefix, addr) == 1)
+      ok = insert(addr, (slash ? len : 128), value);
+    else
+      ok = false;
+
+    if (ok)
+      added++;
+    else
+      p_malformed++;
+  }
+
+  fclose(f);
+  return added;
+}
+
+// Returns the tag of the longest IPv4 prefix holding given address (host
+// order), 0 if none
+unsigned int PrefixTable::lookup(unsigned int addr) const {
+  if (p_tbl24 == NULL)
+    return 0;
+
+  unsigned int e = p_tbl24[addr >> 8];
+  if (e & LPM_GROUP)
+    e = p_tbl8[(e & LPM_VALUE) << 8 | (addr & 0xFF)];
+
+  return e & LPM_VALUE;
+}
+
+// Looks up given number of IPv4 addresses, storing their tags in values. The
+// entries of each batch are prefetched before being read
+void PrefixTable::lookup(const unsigned int * addrs, unsigned int * values, unsigned int count) const {
+  if (p_tbl24 == NULL) {
+    for (unsigned int i = 0; i < count; i++)
+      values[i] = 0;
+    return;
+  }
+
+  for (unsigned int b = 0; b < count; b += LPM_BATCH) {
+    unsigned int n = (count - b < LPM_BATCH ? count - b : LPM_BATCH);
+
+    for (unsigned int i = 0; i < n; i++)
+      __builtin_prefetch(p_tbl24 + (addrs[b + i] >> 8));
+
+    // Entries referring to a group get their second entry prefetched
+    for (unsigned int i = 0; i < n; i++) {
+      unsigned int e = p_tbl24[addrs[b + i] >> 8];
+      if (e & LPM_GROUP)
+        __builtin_prefetch(&p_tbl8[(e & LPM_VALUE) << 8 | (addrs[b + i] & 0xFF)]);
+      values[b + i] = e;
+    }
+
+    for (unsigned int i = 0; i < n; i++) {
+      unsigned int e = values[b + i];
+      if (e & LPM_GROUP)
+        e = p_tbl8[(e & LPM_VALUE) << 8 | (addrs[b + i] & 0xFF)];
+      values[b + i] = e & LPM_VALUE;
+    }
+  }
+}
+
+// Returns the tag of the longest IPv6 prefix holding given address (16 bytes
+// in network order), 0 if none
+unsigned int PrefixTable::lookup(const unsigned char * addr) const {
+  if (p_root6.empty())
+    return 0;
+
+  unsigned int e = p_root6[addr[0] << 8 | addr[1]];
+  for (unsigned int i = 2; (e & LPM_GROUP) && i < 16; i++)
+    e = p_nodes6[(e & LPM_VALUE) << 8 | addr[i]];
+
+  return e & LPM_VALUE;
+}
+
+// Returns the value of a tag name, creating the tag if new
+unsigned int PrefixTable::tag(const string & name) {
+  map<string,unsigned int>::iterator it = p_tag_ids.find(name);
+
+  if (it != p_tag_ids.end())
+    return it->second;
+
+  p_tags.push_back(name);
+  p_tag_ids[name] = p_tags.size() - 1;
+
+  return p_tags.size() - 1;
+}
+
+// Returns the name of a tag value (empty for 0 or unknown values)
+const char * PrefixTable::tag_name(unsigned int value) const {
+  return (value < p_tags.size() ? p_tags[value].c_str() : "");
+}
+
+// Returns the number of prefixes inserted
+unsigned int PrefixTable::size() const {
+  return p_prefixes;
+}
+
+// Returns the number of lines of loaded files that were rejected
+unsigned int PrefixTable::malformed() const {
+  return p_malformed;
+}
+
+// Returns the number of bytes of entries allocated (p_tbl24 counts in full,
+// though only its written pages use memory)
+unsigned long long PrefixTable::memory() const {
+  return (p_tbl24 ? (1ULL << 24) * sizeof(unsigned int) : 0) +
+         (p_tbl8.size() + p_root6.size() + p_nodes6.size()) * sizeof(unsigned int);
+}
+
+// Output operator summarizing the table
+ostream & operator<<(ostream & ostr, const PrefixTable & t) {
+  ostr << t.p_prefixes << " prefixes, " << t.p_tags.size() - 1 << " tags, "
+       << t.p_tbl8.size() / 256 << " IPv4 groups, " << t.p_nodes6.size() / 256 << " IPv6 nodes";
+  if (t.p_malformed)
+    ostr << ", " << t.p_malformed << " malformed lines";
+  ostr << endl << flush;
+
+  return ostr;
+}
+
+#endif
@@ -0,0 +1,98 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef LPM_H
+#define LPM_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+
+using namespace std;
+
+#define LPM_BATCH 16            // lookups whose table entries are prefetched together
+
+/* PrefixTable: longest prefix match table of IPv4 and IPv6 prefixes, each
+ *   mapped to a tag (e.g. "blocked", "internal").
+ *
+ * Attributes
+ *   p_tbl24   : IPv4 entries indexed by the first 24 bits of addresses
+ *   p_tbl8    : groups of 256 IPv4 entries indexed by the last 8 bits
+ *   p_root6   : IPv6 entries indexed by the first 16 bits of addresses
+ *   p_nodes6  : groups of 256 IPv6 entries, one per following byte
+ *   p_tags    : names of the tags (value 0 is no match)
+ *   p_tag_ids : value of each tag name
+ *   p_prefixes, p_malformed : prefixes inserted, and lines of loaded files rejected
+ *
+ * Notes
+ *   1. IPv4 prefixes are stored DIR-24-8 style: a lookup reads one entry of
+ *      p_tbl24, and one entry of p_tbl8 if the address falls in a /24 holding
+ *      longer prefixes. p_tbl24 (64 MB) is only allocated with the first IPv4
+ *      prefix, and its pages only committed when written.
+ *   2. IPv6 prefixes are stored in a multibit trie: 16 bits, then 8 bits per
+ *      level, so a /48 takes 5 reads and a /64 7 reads.
+ *   3. entries hold the tag and the length of the prefix they expand, so
+ *      prefixes may be inserted in any order: a prefix only overwrites the
+ *      entries of shorter prefixes.
+ *   4. the batch lookup prefetches the entries of LPM_BATCH addresses before
+ *      reading them, overlapping their cache misses.
+ *   5. prefix files hold one prefix per line (a.b.c.d/len or IPv6 x:y::/len,
+ *      without length for a single address), optionally followed by a tag
+ *      name. Text following '#' is ignored.
+ */
+class PrefixTable {
+  public:
+    PrefixTable();                                       // default constructor
+    ~PrefixTable();                                      // destructor
+
+    bool insert(unsigned int, unsigned int, unsigned int);  // adds an IPv4 prefix with given tag
+    bool insert(const unsigned char *, unsigned int, unsigned int);  // adds an IPv6 prefix with given tag
+    int load(const char *);                              // adds the prefixes of a file
+
+    unsigned int lookup(unsigned int) const;             // tag of the longest IPv4 prefix matched
+    void lookup(const unsigned int *, unsigned int *, unsigned int) const;  // batch IPv4 lookup
+    unsigned int lookup(const unsigned char *) const;    // tag of the longest IPv6 prefix matched
+
+    unsigned int tag(const string &);                    // value of a tag name (created if new)
+    const char * tag_name(unsigned int) const;           // name of a tag value
+
+    unsigned int size() const;                           // number of prefixes inserted
+    unsigned int malformed() const;                      // lines of loaded files rejected
+    unsigned long long memory() const;                   // bytes of entries allocated
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, const PrefixTable &);
+
+  private:
+    unsigned int *           p_tbl24;
+    vector<unsigned int>     p_tbl8;
+    vector<unsigned int>     p_root6;
+    vector<unsigned int>     p_nodes6;
+    vector<string>           p_tags;
+    map<string,unsigned int> p_tag_ids;
+    unsigned int             p_prefixes, p_malformed;
+
+    void overwrite(unsigned int &, unsigned int, unsigned int, vector<unsigned int> &);
+    unsigned int expand(unsigned int, vector<unsigned int> &);
+
+    // Copying is not allowed
+    PrefixTable(const PrefixTable &);
+    PrefixTable & operator=(const PrefixTable &);
+};
+
+#endif
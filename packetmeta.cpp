@@ -0,0 +1,297 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef PACKETMETA_CPP
+#define PACKETMETA_CPP
+
+#include "packetmeta.h"   // PacketMeta
+#include "gre.h"          // GREPacket
+#include "vxlan.h"        // VXLANPacket
+
+// Output operator displaying the tunnel context in human readable form
+ostream & operator<<(ostream & ostr, const TunnelContext & t) {
+  char outstr[40];
+
+  switch (t.type) {
+    case TunnelContext::tun_vxlan        : ostr << "VXLAN (VNI = " << t.id << ")"; break;
+    case TunnelContext::tun_gre          : ostr << "GRE (key = " << t.id << ")"; break;
+    case TunnelContext::tun_gre_ethernet : ostr << "Ethernet over GRE (key = " << t.id << ")"; break;
+    case TunnelContext::tun_ipip         : ostr << "IP in IP"; break;
+  }
+
+  sprintf(outstr, " from %u.%u.%u.%u", t.outer_src >> 24, (t.outer_src >> 16) & 0xFF,
+          (t.outer_src >> 8) & 0xFF, t.outer_src & 0xFF);
+  ostr << outstr;
+  sprintf(outstr, " to %u.%u.%u.%u", t.outer_dst >> 24, (t.outer_dst >> 16) & 0xFF,
+          (t.outer_dst >> 8) & 0xFF, t.outer_dst & 0xFF);
+  ostr << outstr;
+
+  return ostr;
+}
+
+// Default constructor
+PacketMeta::PacketMeta() : length(0), tunnels(0), ether_code(0), vlan(0), layers(0) {
+  clear_ip();
+}
+
+// Forgets the IP and transport layer fields
+void PacketMeta::clear_ip() {
+  has_ip  = has_tcp = has_udp = has_icmp = false;
+  src_ip  = dst_ip = protocol = 0;
+  sport   = dport = 0;
+  payload = NULL;
+  payload_len = 0;
+}
+
+// Records a tunnel crossed by the walk, using the current IP addresses as
+// outer addresses. Returns false if too many tunnels are nested
+bool PacketMeta::push_tunnel(TunnelContext::TunnelType type, unsigned int id) {
+  if (tunnels >= PACKET_MAX_TUNNELS)
+    return false;
+
+  tunnel[tunnels].type      = type;
+  tunnel[tunnels].id        = id;
+  tunnel[tunnels].outer_src = src_ip;
+  tunnel[tunnels].outer_dst = dst_ip;
+  tunnels++;
+
+  // The inner headers replace the outer ones
+  clear_ip();
+
+  return true;
+}
+
+// Returns the textual name of a protocol layer
+const char * PacketMeta::layer_name(Layer l) {
+  static const char * names[pl_count] = {
+    "eth", "vlan", "arp", "ipv4", "ipv6", "fragment", "tcp", "udp",
+    "icmp", "gre", "ipip", "vxlan", "dns", "dhcp", "tftp", "http", "tls",
+    "data", "other"
+  };
+
+  return (l < pl_count ? names[l] : "unknown");
+}
+
+// Records a protocol layer crossed by the walk
+void PacketMeta::push_layer(Layer l) {
+  if (layers < PACKET_MAX_LAYERS)
+    layer[layers++] = l;
+}
+
+// Records the application layer carried by the transport payload, identified
+// by well-known ports
+void PacketMeta::push_application(bool tcp) {
+  if (payload_len == 0)
+    return;
+
+  if (sport == 53 || dport == 53)
+    push_layer(pl_dns);
+  else if (tcp && (sport == 80 || dport == 80 || sport == 8080 || dport == 8080))
+    push_layer(pl_http);
+  else if (tcp && (sport == 443 || dport == 443))
+    push_layer(pl_tls);
+  else if (!tcp && (sport == 67 || dport == 67 || sport == 68 || dport == 68))
+    push_layer(pl_dhcp);
+  else if (!tcp && (sport == 69 || dport == 69))
+    push_layer(pl_tftp);
+  else
+    push_layer(pl_data);
+}
+
+// Walks the given frame down to its innermost headers. Returns true if an IPv4
+// packet was found, in which case the IP fields describe the innermost one
+bool PacketMeta::dissect(EthernetFrame frame) {
+  length     = frame.length();
+  tunnels    = 0;
+  ether_code = 0;
+  vlan       = 0;
+  layers     = 0;
+  clear_ip();
+
+  return walk_ethernet(frame);
+}
+
+// Walks an Ethernet frame, skipping any 802.1Q tag
+bool PacketMeta::walk_ethernet(EthernetFrame frame) {
+  if (frame.length() < 14)
+    return false;
+
+  ether      = frame;
+  ether_code = frame.ether_code();
+  vlan       = 0;
+  push_layer(pl_ethernet);
+
+  if (frame.ether_type() == EthernetFrame::et_IPv4)
+    return walk_ip(frame.ip4());
+
+  // Tagged frames carry the payload EtherType after the tag
+  if (frame.ether_type() == EthernetFrame::et_802_1Q && frame.length() >= 18) {
+    vlan       = frame.VID_8021Q();
+    ether_code = char2word(frame.header() + 16);
+    push_layer(pl_vlan);
+
+    if (ether_code == 0x0800)
+      return walk_ip(IPPacket(false, frame.data(), frame.length() - frame.header_length()));
+  }
+
+  // Other payloads are only counted
+  switch (ether_code) {
+    case 0x0806 : push_layer(pl_arp); break;
+    case 0x86DD : push_layer(pl_ipv6); break;
+    default     : push_layer(pl_other); break;
+  }
+
+  return false;
+}
+
+// Walks an IPv4 packet and its transport header, decapsulating VXLAN, GRE and
+// IP in IP tunnels
+bool PacketMeta::walk_ip(IPPacket pkt) {
+  if (pkt.length() < 20 || pkt.version() != 4 || pkt.header_length() < 20 ||
+      pkt.header_length() > pkt.length())
+    return false;
+
+  has_ip   = true;
+  ip       = pkt;
+  src_ip   = pkt.source_ip().value();
+  dst_ip   = pkt.destination_ip().value();
+  protocol = pkt.protocol_id();
+  push_layer(pl_ipv4);
+
+  // Only the first fragment holds the transport header
+  bool first, last;
+  if (pkt.fragmented(first, last) && !first) {
+    push_layer(pl_fragment);
+    return true;
+  }
+
+  switch (pkt.protocol()) {
+    case IPPacket::ipp_tcp : {
+      TCPSegment seg = pkt.tcp();
+      if (seg.length() < 20 || seg.header_length() < 20 || seg.header_length() > seg.length())
+        break;
+
+      has_tcp = true;
+      tcp     = seg;
+      sport   = seg.source_port();
+      dport   = seg.destination_port();
+      payload = seg.data();
+      payload_len = (payload ? seg.length() - seg.header_length() : 0);
+      push_layer(pl_tcp);
+      push_application(true);
+      break;
+    }
+
+    case IPPacket::ipp_udp : {
+      UDPSegment seg = pkt.udp();
+      if (seg.length() < 8)
+        break;
+
+      has_udp = true;
+      udp     = seg;
+      sport   = seg.source_port();
+      dport   = seg.destination_port();
+      payload = seg.data();
+      payload_len = (payload ? seg.length() - seg.header_length() : 0);
+      push_layer(pl_udp);
+
+      // VXLAN: re-enter the Ethernet walk on the inner frame
+      if (dport == VXLAN_PORT) {
+        VXLANPacket vx = seg.vxlan();
+        if (vx.valid() && vx.length() >= vx.header_length() + 14 &&
+            push_tunnel(TunnelContext::tun_vxlan, vx.vni())) {
+          push_layer(pl_vxlan);
+          return walk_ethernet(vx.ethernet());
+        }
+      }
+
+      push_application(false);
+      break;
+    }
+
+    case IPPacket::ipp_icmp : {
+      ICMPPacket msg = pkt.icmp();
+      if (msg.length() < 8)
+        break;
+
+      has_icmp = true;
+      icmp     = msg;
+      push_layer(pl_icmp);
+      break;
+    }
+
+    case IPPacket::ipp_gre : {
+      GREPacket gre = pkt.gre();
+      if (!gre.valid() || gre.version() != 0)
+        break;
+
+      unsigned int key = (gre.flag_key() ? gre.key() : 0);
+      push_layer(pl_gre);
+
+      // Ethernet over GRE (including NVGRE) re-enters the Ethernet walk,
+      // plain GRE re-enters the IP walk
+      if (gre.protocol() == GREPacket::gre_Ethernet && gre.length() >= gre.header_length() + 14 &&
+          push_tunnel(TunnelContext::tun_gre_ethernet, key))
+        return walk_ethernet(gre.ethernet());
+      else if (gre.protocol() == GREPacket::gre_IPv4 && gre.length() > gre.header_length() &&
+               push_tunnel(TunnelContext::tun_gre, key))
+        return walk_ip(gre.ip4());
+      break;
+    }
+
+    case IPPacket::ipp_ipip : {
+      if (pkt.length() > pkt.header_length() && push_tunnel(TunnelContext::tun_ipip, 0)) {
+        push_layer(pl_ipip);
+        return walk_ip(pkt.ipip());
+      }
+      break;
+    }
+
+    default :
+      push_layer(pl_other);
+      break;
+  }
+
+  return true;
+}
+
+// Output operator displaying the tunnels crossed and the innermost flow
+ostream & operator<<(ostream & ostr, const PacketMeta & meta) {
+  for (unsigned int i = 0; i < meta.tunnels; i++)
+    ostr << "tunnel #" << i << " = " << meta.tunnel[i] << endl;
+
+  if (meta.vlan != 0)
+    ostr << "VLAN = " << meta.vlan << endl;
+
+  if (meta.has_ip) {
+    char outstr[64];
+
+    sprintf(outstr, "%u.%u.%u.%u:%u -> %u.%u.%u.%u:%u",
+            meta.src_ip >> 24, (meta.src_ip >> 16) & 0xFF, (meta.src_ip >> 8) & 0xFF,
+            meta.src_ip & 0xFF, meta.sport,
+            meta.dst_ip >> 24, (meta.dst_ip >> 16) & 0xFF, (meta.dst_ip >> 8) & 0xFF,
+            meta.dst_ip & 0xFF, meta.dport);
+    ostr << "flow = " << outstr << " (protocol " << meta.protocol << ", "
+         << meta.payload_len << " payload bytes)" << endl;
+  }
+
+  ostr << flush;
+
+  return ostr;
+}
+
+#endif
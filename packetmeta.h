@@ -0,0 +1,131 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef PACKETMETA_H
+#define PACKETMETA_H
+
+#include <iostream>
+
+#include "ethernetframe.h"      // EthernetFrame
+#include "ippacket.h"           // IPPacket
+#include "tcpsegment.h"         // TCPSegment
+#include "udpsegment.h"         // UDPSegment
+#include "icmppacket.h"         // ICMPPacket
+
+using namespace std;
+
+#define PACKET_MAX_TUNNELS 4    // nested tunnels decapsulated at most
+#define PACKET_MAX_LAYERS 24    // protocol layers recorded at most
+
+/* TunnelContext: outer tunnel information of a decapsulated packet.
+ *
+ * Attributes
+ *   type      : kind of encapsulation
+ *   id        : VXLAN network identifier or GRE key (0 if none)
+ *   outer_src : source IP address of the outer packet
+ *   outer_dst : destination IP address of the outer packet
+ */
+struct TunnelContext {
+  // Enumeration of supported encapsulations
+  typedef enum {
+    tun_vxlan, tun_gre, tun_gre_ethernet, tun_ipip
+  } TunnelType;
+
+  TunnelType   type;
+  unsigned int id;
+  unsigned int outer_src;
+  unsigned int outer_dst;
+
+  // Operator overloads
+  friend ostream & operator<<(ostream &, const TunnelContext &);
+};
+
+/* PacketMeta: metadata of a captured frame, collected by a single walk of the
+ *   protocol classes down to the innermost headers.
+ *
+ * Attributes
+ *   length      : number of bytes of the outermost frame
+ *   tunnels     : number of tunnels crossed, described outermost first in tunnel
+ *   ether       : innermost Ethernet frame
+ *   ether_code  : EtherType of the innermost frame, past any 802.1Q tag
+ *   vlan        : VLAN identifier of the innermost frame (0 if untagged)
+ *   has_ip      : an IPv4 packet was found; ip, src_ip, dst_ip and protocol are valid
+ *   has_tcp, has_udp, has_icmp : which of tcp, udp or icmp is valid
+ *   sport/dport : transport ports (0 if none)
+ *   payload     : transport payload (NULL if none) and its length in payload_len
+ *   layers      : number of protocol layers crossed, described outermost first in layer
+ *
+ * Notes
+ *   1. header instances are views on the captured bytes: decapsulation re-enters
+ *      the Ethernet and IP classes on the inner headers without copying data.
+ *   2. the walk checks header lengths before handing bytes to the protocol
+ *      classes, so truncated frames stop the walk instead of being overrun.
+ *   3. the layers crossed form the path of the frame in the protocol hierarchy,
+ *      tunnels included. Application layers are identified by well-known ports.
+ */
+class PacketMeta {
+  public:
+    // Enumeration of protocol layers
+    typedef enum {
+      pl_ethernet, pl_vlan, pl_arp, pl_ipv4, pl_ipv6, pl_fragment, pl_tcp, pl_udp,
+      pl_icmp, pl_gre, pl_ipip, pl_vxlan, pl_dns, pl_dhcp, pl_tftp, pl_http, pl_tls,
+      pl_data, pl_other, pl_count
+    } Layer;
+
+    PacketMeta();                                        // default constructor
+
+    bool dissect(EthernetFrame);                         // walks the frame, returns true if IPv4 was found
+
+    unsigned int  length;
+    unsigned int  tunnels;
+    TunnelContext tunnel[PACKET_MAX_TUNNELS];
+
+    EthernetFrame ether;
+    unsigned int  ether_code;
+    unsigned int  vlan;
+
+    bool          has_ip;
+    IPPacket      ip;
+    unsigned int  src_ip, dst_ip, protocol;
+
+    bool          has_tcp, has_udp, has_icmp;
+    TCPSegment    tcp;
+    UDPSegment    udp;
+    ICMPPacket    icmp;
+    unsigned int  sport, dport;
+
+    unsigned char * payload;
+    unsigned int    payload_len;
+
+    unsigned int  layers;
+    Layer         layer[PACKET_MAX_LAYERS];
+
+    static const char * layer_name(Layer);               // textual name of a protocol layer
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, const PacketMeta &);
+
+  private:
+    void clear_ip();                                     // forgets IP and transport fields
+    bool push_tunnel(TunnelContext::TunnelType, unsigned int);
+    void push_layer(Layer);
+    void push_application(bool);
+    bool walk_ethernet(EthernetFrame);
+    bool walk_ip(IPPacket);
+};
+
+#endif
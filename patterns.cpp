@@ -0,0 +1,628 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef PATTERNS_CPP
+#define PATTERNS_CPP
+
+#include <cstdio>           // fopen, fgets, sprintf
+#include <cstring>          // memset, strlen
+#include <cstdlib>          // strtoul
+#include <cctype>           // isxdigit
+#include <algorithm>        // sort
+
+#if defined(__AVX2__)
+#include <immintrin.h>      // AVX2 intrinsics
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>      // SSSE3 intrinsics
+#endif
+
+#include "patterns.h"       // PatternSet, PayloadMatcher
+#include "regexset.h"       // RegexSet
+
+#define AC_MATCH 0x80000000     // transition leads to a state where patterns end
+#define AC_NONE  0xFFFFFFFF     // missing transition of the trie
+
+// Parameterized constructor
+PatternMatch::PatternMatch(unsigned int p, unsigned long long e)
+  : pattern(p), end(e) {
+}
+
+// Default constructor: start of a stream
+MatchState::MatchState()
+  : state(0), offset(0), epoch(0) {
+}
+
+// Parameterized constructor: patterns may ignore the case of ASCII letters
+PatternSet::PatternSet(bool nocase)
+  : p_nocase(nocase), p_classes(1), p_prefilter(false), p_teddy(false),
+    p_built(false), p_states(0), p_malformed(0) {
+  memset(p_class, 0, sizeof(p_class));
+  memset(p_first, 0, sizeof(p_first));
+  memset(p_pairs, 0, sizeof(p_pairs));
+}
+
+// Returns a byte with its case folded if the set ignores case
+inline unsigned char PatternSet::fold(unsigned char c) const {
+  return (p_nocase && c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+}
+
+// Returns true if a pattern may start with the two given bytes
+inline bool PatternSet::pair(const unsigned char * p) const {
+  return p_pairs[p[0] << 5 | p[1] >> 3] & (1 << (p[1] & 7));
+}
+
+// Adds a pattern and returns its identifier. The automaton must be built again
+unsigned int PatternSet::add(const string & pattern) {
+  p_patterns.push_back(pattern);
+  p_built = false;
+
+  return p_patterns.size() - 1;
+}
+
+// Adds the patterns listed in a file. Returns the number of patterns added, or
+// -1 if the file cannot be read
+int PatternSet::load(const char * fname) {
+  FILE * f = fopen(fname, "r");
+  char   line[1024];
+  int    added = 0;
+
+  if (f == NULL)
+    return -1;
+
+  while (fgets(line, sizeof(line), f) != NULL) {
+    unsigned int len = strlen(line);
+    while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r'))
+      line[--len] = '\0';
+
+    if (len == 0 || line[0] == '#')
+      continue;
+
+    // Decode escapes
+    string pattern;
+    bool   ok = true;
+
+    for (unsigned int i = 0; i < len && ok; i++) {
+      if (line[i] != '\\')
+        pattern += line[i];
+      else if (line[i+1] == '\\') {
+        pattern += '\\';
+        i++;
+      }
+      else if (line[i+1] == 'x' && isxdigit(line[i+2]) && isxdigit(line[i+3])) {
+        char hex[3] = { line[i+2], line[i+3], '\0' };
+        pattern += (char)strtoul(hex, NULL, 16);
+        i += 3;
+      }
+      else
+        ok = false;
+    }
+
+    if (ok) {
+      add(pattern);
+      added++;
+    }
+    else
+      p_malformed++;
+  }
+
+  fclose(f);
+  return added;
+}
+
+// Builds the automaton from the patterns. Returns false if the automaton
+// would be too large
+bool PatternSet::build() {
+  p_built = false;
+  p_table.clear();
+  p_out_first.clear();
+  p_outputs.clear();
+  memset(p_class, 0, sizeof(p_class));
+  memset(p_first, 0, sizeof(p_first));
+  memset(p_pairs, 0, sizeof(p_pairs));
+  memset(p_lo, 0, sizeof(p_lo));
+  memset(p_hi, 0, sizeof(p_hi));
+
+  // Byte classes: one per byte value patterns hold, case folded. Class 0
+  // gathers the others (or the last byte value if patterns hold all 256)
+  p_classes = 1;
+  for (unsigned int i = 0; i < p_patterns.size(); i++)
+    for (unsigned int j = 0; j < p_patterns[i].size(); j++) {
+      unsigned char c = fold(p_patterns[i][j]);
+      if (p_class[c] == 0 && p_classes < 256)
+        p_class[c] = p_classes++;
+    }
+
+  for (unsigned int c = 0; c < 256; c++)
+    p_class[c] = p_class[fold(c)];
+
+  // Trie of the patterns, states numbered in creation order
+  vector<unsigned int>          trie(p_classes, AC_NONE);
+  vector< vector<unsigned int> > out(1);
+
+  for (unsigned int i = 0; i < p_patterns.size(); i++) {
+    unsigned int s = 0;
+
+    if (p_patterns[i].empty())
+      continue;
+
+    for (unsigned int j = 0; j < p_patterns[i].size(); j++) {
+      unsigned int & t = trie[s * p_classes + p_class[(unsigned char)p_patterns[i][j]]];
+      if (t == AC_NONE) {
+        t = out.size();
+        out.push_back(vector<unsigned int>());
+        trie.resize(trie.size() + p_classes, AC_NONE);
+      }
+      s = trie[s * p_classes + p_class[(unsigned char)p_patterns[i][j]]];
+    }
+
+    out[s].push_back(i);
+  }
+
+  p_states = out.size();
+  if ((unsigned long long)p_states * p_classes >= AC_MATCH)
+    return false;
+
+  // Breadth first walk resolving failure links into transitions; the order of
+  // the walk numbers the states of the automaton
+  vector<unsigned int> fail(p_states, 0), order, number(p_states);
+
+  order.push_back(0);
+  for (unsigned int k = 0; k < order.size(); k++) {
+    unsigned int s = order[k];
+    number[s] = k;
+
+    for (unsigned int c = 0; c < p_classes; c++) {
+      unsigned int & t = trie[s * p_classes + c];
+
+      if (t == AC_NONE)
+        t = (s == 0 ? 0 : trie[fail[s] * p_classes + c]);
+      else {
+        fail[t] = (s == 0 ? 0 : trie[fail[s] * p_classes + c]);
+        out[t].insert(out[t].end(), out[fail[t]].begin(), out[fail[t]].end());
+        order.push_back(t);
+      }
+    }
+  }
+
+  p_table.resize(p_states * p_classes);
+  p_out_first.resize(p_states + 1);
+
+  for (unsigned int k = 0; k < p_states; k++) {
+    unsigned int s = order[k];
+
+    for (unsigned int c = 0; c < p_classes; c++) {
+      unsigned int t = trie[s * p_classes + c];
+      p_table[k * p_classes + c] = number[t] * p_classes | (out[t].empty() ? 0 : AC_MATCH);
+    }
+
+    p_out_first[k] = p_outputs.size();
+    p_outputs.insert(p_outputs.end(), out[s].begin(), out[s].end());
+  }
+  p_out_first[p_states] = p_outputs.size();
+
+  // Prefilter: first bytes and byte pairs starting a pattern, in both cases
+  for (unsigned int i = 0; i < p_patterns.size(); i++) {
+    const string & p = p_patterns[i];
+    if (p.empty())
+      continue;
+
+    unsigned int bucket = fold(p[0]) & 7;
+
+    for (unsigned int b0 = 0; b0 < 256; b0++) {
+      if (p_class[b0] != p_class[(unsigned char)p[0]])
+        continue;
+
+      p_first[b0] = 1;
+      for (unsigned int n = 0; n < 2; n++) {
+        p_lo[0][(b0 & 15) + 16 * n] |= 1 << bucket;
+        p_hi[0][(b0 >> 4) + 16 * n] |= 1 << bucket;
+      }
+
+      for (unsigned int b1 = 0; b1 < 256; b1++)
+        if (p.size() == 1 || p_class[b1] == p_class[(unsigned char)p[1]]) {
+          p_pairs[b0 << 5 | b1 >> 3] |= 1 << (b1 & 7);
+          for (unsigned int n = 0; n < 2; n++) {
+            p_lo[1][(b1 & 15) + 16 * n] |= 1 << bucket;
+            p_hi[1][(b1 >> 4) + 16 * n] |= 1 << bucket;
+          }
+        }
+    }
+  }
+
+  // Prefilters are only worth it if they skip most positions
+  unsigned int pairs = 0, teddy = 0;
+
+  for (unsigned int b0 = 0; b0 < 256; b0++)
+    for (unsigned int b1 = 0; b1 < 256; b1++) {
+      unsigned char pb[2] = { (unsigned char)b0, (unsigned char)b1 };
+      pairs += pair(pb);
+      teddy += (p_lo[0][b0 & 15] & p_hi[0][b0 >> 4] & p_lo[1][b1 & 15] & p_hi[1][b1 >> 4]) != 0;
+    }
+
+  p_prefilter = !p_patterns.empty() && pairs <= PATTERN_PREFILTER_MAX;
+#if defined(__SSSE3__)
+  p_teddy = p_prefilter && teddy <= PATTERN_PREFILTER_MAX;
+#else
+  p_teddy = false;
+#endif
+
+  p_built = true;
+  return true;
+}
+
+// Returns the first position from p on where a pattern may start, end if
+// none. The last byte of the block only needs to start a pattern
+const unsigned char * PatternSet::candidate(const unsigned char * p, const unsigned char * end) const {
+#if defined(__AVX2__)
+  if (p_teddy) {
+    const __m256i nibble = _mm256_set1_epi8(0x0F),
+                  lo0 = _mm256_loadu_si256((const __m256i *)p_lo[0]),
+                  hi0 = _mm256_loadu_si256((const __m256i *)p_hi[0]),
+                  lo1 = _mm256_loadu_si256((const __m256i *)p_lo[1]),
+                  hi1 = _mm256_loadu_si256((const __m256i *)p_hi[1]);
+
+    while (end - p >= 33) {
+      __m256i a = _mm256_loadu_si256((const __m256i *)p),
+              b = _mm256_loadu_si256((const __m256i *)(p + 1));
+      __m256i m = _mm256_and_si256(
+          _mm256_and_si256(_mm256_shuffle_epi8(lo0, _mm256_and_si256(a, nibble)),
+                           _mm256_shuffle_epi8(hi0, _mm256_and_si256(_mm256_srli_epi16(a, 4), nibble))),
+          _mm256_and_si256(_mm256_shuffle_epi8(lo1, _mm256_and_si256(b, nibble)),
+                           _mm256_shuffle_epi8(hi1, _mm256_and_si256(_mm256_srli_epi16(b, 4), nibble))));
+      unsigned int bits = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(m, _mm256_setzero_si256()));
+
+      for (; bits; bits &= bits - 1)
+        if (pair(p + __builtin_ctz(bits)))
+          return p + __builtin_ctz(bits);
+      p += 32;
+    }
+  }
+#endif
+
+#if defined(__SSSE3__)
+  if (p_teddy) {
+    const __m128i nibble = _mm_set1_epi8(0x0F),
+                  lo0 = _mm_loadu_si128((const __m128i *)p_lo[0]),
+                  hi0 = _mm_loadu_si128((const __m128i *)p_hi[0]),
+                  lo1 = _mm_loadu_si128((const __m128i *)p_lo[1]),
+                  hi1 = _mm_loadu_si128((const __m128i *)p_hi[1]);
+
+    while (end - p >= 17) {
+      __m128i a = _mm_loadu_si128((const __m128i *)p),
+              b = _mm_loadu_si128((const __m128i *)(p + 1));
+      __m128i m = _mm_and_si128(
+          _mm_and_si128(_mm_shuffle_epi8(lo0, _mm_and_si128(a, nibble)),
+                        _mm_shuffle_epi8(hi0, _mm_and_si128(_mm_srli_epi16(a, 4), nibble))),
+          _mm_and_si128(_mm_shuffle_epi8(lo1, _mm_and_si128(b, nibble)),
+                        _mm_shuffle_epi8(hi1, _mm_and_si128(_mm_srli_epi16(b, 4), nibble))));
+      unsigned int bits = ~_mm_movemask_epi8(_mm_cmpeq_epi8(m, _mm_setzero_si128())) & 0xFFFF;
+
+      for (; bits; bits &= bits - 1)
+        if (pair(p + __builtin_ctz(bits)))
+          return p + __builtin_ctz(bits);
+      p += 16;
+    }
+  }
+#endif
+
+  for (; end - p >= 2; p++)
+    if (pair(p))
+      return p;
+
+  return (p < end && p_first[*p] ? p : end);
+}
+
+// Scans a block of a stream from the given state, which is updated. Returns
+// the number of occurrences found, appended to matches if not NULL; their
+// offsets count from the start of the stream
+unsigned int PatternSet::scan(const unsigned char * data, unsigned int len, MatchState & ms,
+                              vector<PatternMatch> * matches) const {
+  if (!p_built || p_states <= 1) {
+    ms.offset += len;
+    return 0;
+  }
+
+  const unsigned int *  table = &p_table[0];
+  const unsigned char * p     = data;
+  const unsigned char * end   = data + len;
+  unsigned int          s     = ms.state,
+                        found = 0;
+
+  while (p < end) {
+    // In the root state, skip positions where no pattern starts
+    if (p_prefilter && s == 0 && (p = candidate(p, end)) == end)
+      break;
+
+    unsigned int e = table[s + p_class[*p++]];
+    s = e & ~AC_MATCH;
+
+    if (e & AC_MATCH) {
+      unsigned int k = s / p_classes;
+
+      for (unsigned int i = p_out_first[k]; i < p_out_first[k+1]; i++)
+        if (matches != NULL)
+          matches->push_back(PatternMatch(p_outputs[i], ms.offset + (p - data)));
+      found += p_out_first[k+1] - p_out_first[k];
+    }
+  }
+
+  ms.state   = s;
+  ms.offset += len;
+
+  return found;
+}
+
+// Scans a block on its own. Returns the number of occurrences found, appended
+// to matches if not NULL
+unsigned int PatternSet::scan(const unsigned char * data, unsigned int len, vector<PatternMatch> * matches) const {
+  MatchState ms;
+
+  return scan(data, len, ms, matches);
+}
+
+// Returns the pattern of given identifier
+const string & PatternSet::pattern(unsigned int id) const {
+  return p_patterns[id];
+}
+
+// Returns the pattern of given identifier, its unprintable bytes escaped
+string PatternSet::printable(unsigned int id) const {
+  const string & p = p_patterns[id];
+  string         s;
+  char           hex[8];
+
+  for (unsigned int i = 0; i < p.size(); i++) {
+    unsigned char c = p[i];
+
+    if (c == '\\')
+      s += "\\\\";
+    else if (c >= 32 && c < 127)
+      s += c;
+    else {
+      sprintf(hex, "\\x%02x", c);
+      s += hex;
+    }
+  }
+
+  return s;
+}
+
+// Returns the number of patterns
+unsigned int PatternSet::size() const {
+  return p_patterns.size();
+}
+
+// Returns the number of states of the automaton
+unsigned int PatternSet::states() const {
+  return p_states;
+}
+
+// Returns the number of lines of loaded files that were rejected
+unsigned int PatternSet::malformed() const {
+  return p_malformed;
+}
+
+// Returns the number of bytes used by the automaton
+unsigned long long PatternSet::memory() const {
+  return (p_table.size() + p_out_first.size() + p_outputs.size()) * sizeof(unsigned int);
+}
+
+// Output operator summarizing the automaton
+ostream & operator<<(ostream & ostr, const PatternSet & ps) {
+  ostr << ps.p_patterns.size() << " patterns, " << ps.p_states << " states, " << ps.p_classes
+       << " byte classes (" << ps.memory() / 1024 << " KB), prefilter "
+       << (ps.p_teddy ? "simd" : ps.p_prefilter ? "pairs" : "off");
+  if (ps.p_malformed)
+    ostr << ", " << ps.p_malformed << " malformed lines";
+  ostr << endl << flush;
+
+  return ostr;
+}
+
+// Default constructor: nothing scanned in either direction
+PatternFlow::PatternFlow() {
+  for (unsigned int d = 0; d < 2; d++) {
+    dir[d].next   = 0;
+    dir[d].synced = false;
+  }
+}
+
+// Parameterized constructor: patterns may ignore the case of ASCII letters;
+// capacity of the table of TCP flows
+PayloadMatcher::PayloadMatcher(bool nocase, unsigned int flows)
+  : p_set(nocase), p_regexes(new RegexSet(nocase)), p_flows(flows),
+    p_segments(0), p_datagrams(0), p_bytes(0), p_gaps(0), p_skipped(0) {
+}
+
+// Destructor
+PayloadMatcher::~PayloadMatcher() {
+  delete p_regexes;
+}
+
+// Loads the patterns of a file and builds the automaton. Returns the number of
+// patterns loaded, or -1 if the file cannot be read or the automaton built
+int PayloadMatcher::load(const char * fname) {
+  int added = p_set.load(fname);
+
+  if (added < 0 || !p_set.build())
+    return -1;
+
+  p_hits.assign(p_set.size(), 0);
+  return added;
+}
+
+// Loads the regular expressions of a file and builds their DFA. Returns the
+// number of expressions loaded, or -1 if the file cannot be read or the DFA built
+int PayloadMatcher::load_regexes(const char * fname) {
+  int added = p_regexes->load(fname);
+
+  if (added < 0 || !p_regexes->build())
+    return -1;
+
+  p_regex_hits.assign(p_regexes->size(), 0);
+  return added;
+}
+
+// Scans a payload for the patterns and the expressions, from given stream
+// states (NULL for a payload on its own). Returns the number of occurrences
+// found, appended to matches
+unsigned int PayloadMatcher::scan(const unsigned char * payload, unsigned int len, MatchState * pattern_state,
+                                  MatchState * regex_state, vector<PatternMatch> & matches) {
+  unsigned int from  = matches.size(),
+               found = (pattern_state != NULL ? p_set.scan(payload, len, *pattern_state, &matches)
+                                              : p_set.scan(payload, len, &matches)),
+               first = matches.size();
+
+  if (p_regexes->size() > 0) {
+    found += (regex_state != NULL ? p_regexes->scan(payload, len, *regex_state, &matches)
+                                  : p_regexes->scan(payload, len, &matches));
+
+    for (unsigned int i = first; i < matches.size(); i++)
+      matches[i].pattern |= PATTERN_REGEX;
+  }
+
+  count(matches, from);
+
+  return found;
+}
+
+// Counts the occurrences appended to matches from given index on
+void PayloadMatcher::count(const vector<PatternMatch> & matches, unsigned int from) {
+  for (unsigned int i = from; i < matches.size(); i++) {
+    unsigned int id = matches[i].pattern & ~PATTERN_REGEX;
+
+    if (!(matches[i].pattern & PATTERN_REGEX) && id < p_hits.size())
+      p_hits[id]++;
+    else if ((matches[i].pattern & PATTERN_REGEX) && id < p_regex_hits.size())
+      p_regex_hits[id]++;
+  }
+}
+
+// Scans a TCP payload of given flow and direction, continuing the scan of the
+// previous segments. Returns the number of occurrences found, appended to
+// matches with their offsets in the stream
+unsigned int PayloadMatcher::process(const FlowKey & key, unsigned int dir, const TCPSegment & tcp,
+                                     const unsigned char * payload, unsigned int len,
+                                     unsigned long long now, vector<PatternMatch> & matches) {
+  if (payload == NULL || len == 0)
+    return 0;
+
+  bool                     created;
+  PatternFlow::Direction & d   = p_flows.insert(key, now, created)->dir[dir & 1];
+  unsigned int             seq = tcp.sequence_nb();
+
+  if (d.synced) {
+    int delta = (int)(seq - d.next);
+
+    if (delta < 0) {
+      // Bytes already scanned are skipped
+      if ((unsigned int)-delta >= len) {
+        p_skipped += len;
+        return 0;
+      }
+
+      payload += -delta;
+      len     -= -delta;
+      seq      = d.next;
+      p_skipped += -delta;
+    }
+    else if (delta > 0) {
+      // Missing bytes: restart the automata past them
+      d.match.state   = 0;
+      d.match.offset += delta;
+      d.regex.state   = 0;
+      d.regex.offset += delta;
+      p_gaps++;
+    }
+  }
+
+  d.synced = true;
+  d.next   = seq + len;
+
+  p_segments++;
+  p_bytes += len;
+
+  return scan(payload, len, &d.match, &d.regex, matches);
+}
+
+// Scans the payload of a datagram on its own. Returns the number of
+// occurrences found, appended to matches
+unsigned int PayloadMatcher::process(const unsigned char * payload, unsigned int len,
+                                     vector<PatternMatch> & matches) {
+  if (payload == NULL || len == 0)
+    return 0;
+
+  p_datagrams++;
+  p_bytes += len;
+
+  return scan(payload, len, NULL, NULL, matches);
+}
+
+// Returns the patterns searched for
+const PatternSet & PayloadMatcher::patterns() const {
+  return p_set;
+}
+
+// Returns the regular expressions searched for
+const RegexSet & PayloadMatcher::regexes() const {
+  return *p_regexes;
+}
+
+// Returns the pattern or the expression of a match identifier, escaped
+string PayloadMatcher::printable(unsigned int id) const {
+  if (id & PATTERN_REGEX)
+    return "/" + p_regexes->pattern(id & ~PATTERN_REGEX) + "/";
+
+  return p_set.printable(id);
+}
+
+// Output operator reporting scanning counters and the most found patterns
+ostream & operator<<(ostream & ostr, const PayloadMatcher & pm) {
+  vector< pair<unsigned long long,unsigned int> > hits;
+  unsigned long long                              total = 0;
+
+  for (unsigned int i = 0; i < pm.p_hits.size(); i++)
+    if (pm.p_hits[i]) {
+      hits.push_back(make_pair(pm.p_hits[i], i));
+      total += pm.p_hits[i];
+    }
+  for (unsigned int i = 0; i < pm.p_regex_hits.size(); i++)
+    if (pm.p_regex_hits[i]) {
+      hits.push_back(make_pair(pm.p_regex_hits[i], i | PATTERN_REGEX));
+      total += pm.p_regex_hits[i];
+    }
+  sort(hits.rbegin(), hits.rend());
+
+  if (pm.p_set.size() > 0 || pm.p_regexes->size() == 0)
+    ostr << "Payload patterns: " << pm.p_set;
+  if (pm.p_regexes->size() > 0)
+    ostr << "Payload expressions: " << *pm.p_regexes;
+  ostr << "  " << pm.p_segments << " TCP segments and " << pm.p_datagrams << " datagrams scanned ("
+       << pm.p_bytes << " bytes), " << pm.p_gaps << " gaps, " << pm.p_skipped
+       << " retransmitted bytes skipped, flows evicted = " << pm.p_flows.evicted() << endl;
+  ostr << "  " << total << " occurrences of " << hits.size() << " patterns" << endl;
+
+  for (unsigned int i = 0; i < hits.size() && i < PATTERN_TOP; i++)
+    ostr << "  #" << (hits[i].second & ~PATTERN_REGEX) << " \"" << pm.printable(hits[i].second) << "\"  "
+         << hits[i].first << " occurrences" << endl;
+
+  ostr << flush;
+
+  return ostr;
+}
+
+#endif
@@ -0,0 +1,221 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef PATTERNS_H
+#define PATTERNS_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include "flowtable.h"          // FlowKey, FlowTable
+#include "tcpsegment.h"         // TCPSegment
+
+using namespace std;
+
+#define PATTERN_PREFILTER_MAX 16384     // byte pairs (of 65536) the prefilter may pass to be worth it
+#define PATTERN_TOP           20        // patterns listed in reports
+#define PATTERN_REGEX         0x80000000  // identifier flag of the matches of regular expressions
+
+class RegexSet;
+
+/* PatternMatch: occurrence of a pattern in a scanned block or stream.
+ *
+ * Attributes
+ *   pattern : identifier of the pattern (order it was added in), with
+ *             PATTERN_REGEX set for regular expressions of a PayloadMatcher
+ *   end     : offset of the byte following the occurrence
+ */
+struct PatternMatch {
+  unsigned int       pattern;
+  unsigned long long end;
+
+  PatternMatch(unsigned int = 0, unsigned long long = 0);  // parameterized constructor
+};
+
+/* MatchState: scanning state carried from one block of a stream to the next.
+ *
+ * Attributes
+ *   state  : automaton state reached by the last byte scanned
+ *   offset : number of bytes of the stream scanned so far
+ *   epoch  : generation of the automaton state (lazy automata, see RegexSet)
+ */
+struct MatchState {
+  unsigned int       state;
+  unsigned long long offset;
+  unsigned int       epoch;
+
+  MatchState();                                          // default constructor
+};
+
+/* PatternSet: set of byte strings searched for simultaneously with an
+ *   Aho-Corasick automaton.
+ *
+ * Attributes
+ *   p_patterns  : patterns, in the order they were added
+ *   p_nocase    : ASCII letters match regardless of case
+ *   p_class     : class of each byte value (0 for bytes no pattern holds)
+ *   p_classes   : number of byte classes
+ *   p_table     : transitions, one row of p_classes entries per state
+ *   p_out_first : first entry of p_outputs of each state (states + 1 entries)
+ *   p_outputs   : patterns ending at each state, failure links included
+ *   p_first     : bytes starting a pattern
+ *   p_pairs     : bitmap of the byte pairs starting a pattern
+ *   p_lo, p_hi  : nibble masks of the SIMD prefilter (see note 3)
+ *   p_prefilter : positions are skipped using p_pairs
+ *   p_teddy     : positions are skipped using the SIMD prefilter
+ *   p_built, p_states, p_malformed : automaton reflects the patterns, its
+ *                 number of states, and lines of loaded files rejected
+ *
+ * Notes
+ *   1. the automaton is built as a complete DFA: failure links are resolved at
+ *      build time, so a scan reads exactly one transition per byte. Bytes are
+ *      mapped to classes first, so rows only hold the bytes patterns use, and
+ *      states are numbered breadth first, keeping the shallow states most
+ *      scans stay in within a few cache lines.
+ *   2. entries hold the offset of the row of their target state, with
+ *      AC_MATCH set when patterns end there, so the scan loop neither
+ *      multiplies nor looks outputs up for states ending no pattern.
+ *   3. while in the root state, only a byte starting a pattern leaves it, so
+ *      positions whose two bytes start no pattern are skipped. Built with
+ *      SSSE3 or AVX2, the skip tests 16 or 32 positions at once in the style
+ *      of Teddy: patterns are spread over 8 buckets by first byte, and each
+ *      byte of a position is looked up by nibble in per-bucket masks. The
+ *      candidates are confirmed with p_pairs before the automaton resumes.
+ *      Sets whose pairs are too common skip the prefilter.
+ *   4. a MatchState carries the automaton state from one block to the next,
+ *      so patterns spanning TCP segments are found. The last byte of a block
+ *      is never skipped, as a pattern may start there.
+ *   5. pattern files hold one pattern per line; \xHH stands for any byte and
+ *      \\ for a backslash. Empty lines and lines starting with '#' are ignored.
+ */
+class PatternSet {
+  public:
+    PatternSet(bool = false);                            // parameterized constructor
+
+    unsigned int add(const string &);                    // adds a pattern, returns its identifier
+    int load(const char *);                              // adds the patterns of a file
+    bool build();                                        // builds the automaton from the patterns
+
+    // Scans a block of a stream, continuing from given state. Returns the number
+    // of occurrences found, appended to matches if not NULL
+    unsigned int scan(const unsigned char *, unsigned int, MatchState &, vector<PatternMatch> * = NULL) const;
+    unsigned int scan(const unsigned char *, unsigned int, vector<PatternMatch> * = NULL) const;  // scans a single block
+
+    const string & pattern(unsigned int) const;          // pattern of given identifier
+    string printable(unsigned int) const;                // pattern with unprintable bytes escaped
+    unsigned int size() const;                           // number of patterns
+    unsigned int states() const;                         // number of automaton states
+    unsigned int malformed() const;                      // lines of loaded files rejected
+    unsigned long long memory() const;                   // bytes used by the automaton
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, const PatternSet &);
+
+  private:
+    vector<string>       p_patterns;
+    bool                 p_nocase;
+    unsigned char        p_class[256];
+    unsigned int         p_classes;
+    vector<unsigned int> p_table;
+    vector<unsigned int> p_out_first;
+    vector<unsigned int> p_outputs;
+    unsigned char        p_first[256];
+    unsigned char        p_pairs[8192];
+    unsigned char        p_lo[2][32], p_hi[2][32];     // masks of first and second bytes, repeated per 16 bytes
+    bool                 p_prefilter, p_teddy;
+    bool                 p_built;
+    unsigned int         p_states, p_malformed;
+
+    unsigned char fold(unsigned char) const;
+    bool pair(const unsigned char *) const;
+    const unsigned char * candidate(const unsigned char *, const unsigned char *) const;
+};
+
+/* PatternFlow: per-flow state of the payload matcher, meant to be kept in a
+ *   FlowTable.
+ */
+struct PatternFlow {
+  // Scanning state of one direction
+  struct Direction {
+    MatchState   match;       // automaton state and stream offset
+    MatchState   regex;       // same for the regular expressions
+    unsigned int next;        // sequence number of the next byte expected
+    bool         synced;      // next is known
+  } dir[2];
+
+  PatternFlow();                                         // default constructor
+};
+
+/* PayloadMatcher: searches the payloads of datagrams for a set of patterns
+ *   and a set of regular expressions. TCP payloads are scanned as streams,
+ *   one per flow direction.
+ *
+ * Attributes
+ *   p_set     : patterns searched for
+ *   p_regexes : regular expressions searched for
+ *   p_flows   : scanning state of TCP flows
+ *   p_hits, p_regex_hits : occurrences found of each pattern and expression
+ *   p_segments, p_datagrams, p_bytes : TCP segments, other datagrams and bytes scanned
+ *   p_gaps    : TCP segments following missing bytes (scanning restarts)
+ *   p_skipped : retransmitted TCP bytes not scanned again
+ *
+ * Notes
+ *   1. segments are expected in sequence order: bytes already scanned are
+ *      skipped, and a gap restarts the automaton, so an occurrence spanning
+ *      missing bytes is not reported.
+ *   2. matches of regular expressions are identified by the number of the
+ *      expression with PATTERN_REGEX set.
+ */
+class PayloadMatcher {
+  public:
+    PayloadMatcher(bool = false, unsigned int = 16384);  // parameterized constructor
+    ~PayloadMatcher();                                   // destructor
+
+    int load(const char *);                              // loads the patterns of a file and builds the set
+    int load_regexes(const char *);                      // loads the regular expressions of a file and builds their DFA
+
+    // Scans a TCP payload of given flow and direction at given time. Returns the
+    // number of occurrences found, appended to matches
+    unsigned int process(const FlowKey &, unsigned int, const TCPSegment &, const unsigned char *,
+                         unsigned int, unsigned long long, vector<PatternMatch> &);
+    // Scans the payload of a datagram on its own
+    unsigned int process(const unsigned char *, unsigned int, vector<PatternMatch> &);
+
+    const PatternSet & patterns() const;                 // patterns searched for
+    const RegexSet & regexes() const;                    // regular expressions searched for
+    string printable(unsigned int) const;                // pattern or expression of a match identifier
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, const PayloadMatcher &);
+
+  private:
+    PatternSet                 p_set;
+    RegexSet *                 p_regexes;
+    FlowTable<PatternFlow>     p_flows;
+    vector<unsigned long long> p_hits, p_regex_hits;
+    unsigned long long         p_segments, p_datagrams, p_bytes, p_gaps, p_skipped;
+
+    unsigned int scan(const unsigned char *, unsigned int, MatchState *, MatchState *, vector<PatternMatch> &);
+    void count(const vector<PatternMatch> &, unsigned int);
+
+    // Copying is not allowed
+    PayloadMatcher(const PayloadMatcher &);
+    PayloadMatcher & operator=(const PayloadMatcher &);
+};
+
+#endif
@@ -0,0 +1,197 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef PORTSCAN_CPP
+#define PORTSCAN_CPP
+
+#include "portscan.h"   // PortScanDetector
+
+// Default constructor
+ScanWindow::ScanWindow() : targets(PSCAN_PRECISION), hosts(PSCAN_PRECISION),
+                           tcp_probes(0), tcp_answers(0), udp_probes(0), unreachables(0) {
+}
+
+// Default constructor
+ScanSource::ScanSource() : start(0), alerted(0) {
+}
+
+// Parameterized constructor: window length in microseconds and number of
+// sources tracked
+PortScanDetector::PortScanDetector(unsigned long long window, unsigned int sources)
+  : p_sources(sources), p_window(window ? window : 1), p_alerts(0) {
+}
+
+// Returns the activity of given source, creating it if create is true (NULL
+// otherwise). Windows are rotated according to given time
+ScanSource * PortScanDetector::source(unsigned int ip, unsigned long long now, bool create) {
+  FlowKey      key;
+  ScanSource * src;
+  bool         created;
+
+  key.a_ip = ip;
+  if (create)
+    src = p_sources.insert(key, now, created);
+  else if ((src = p_sources.find(key, now)) == NULL)
+    return NULL;
+
+  if (src->start == 0)
+    src->start = now;
+  else if (now - src->start >= p_window) {
+    // The current window becomes the previous one, unless both are over
+    if (now - src->start < 2 * p_window)
+      src->previous = src->current;
+    else
+      src->previous = ScanWindow();
+    src->current = ScanWindow();
+    src->start  += (now - src->start) / p_window * p_window;
+    src->alerted = 0;
+  }
+
+  return src;
+}
+
+// Returns the weight of the previous window in the sliding window: the share
+// of it still covered by a window ending at given time
+double PortScanDetector::weight(const ScanSource & src, unsigned long long now) const {
+  return 1.0 - (double)(now - src.start) / p_window;
+}
+
+// Returns the share of failed probes of given source over the sliding window
+// (the highest of the TCP and UDP failure shares)
+double PortScanDetector::failure(const ScanSource & src, unsigned long long now) const {
+  double w   = weight(src, now);
+  double tcp = src.current.tcp_probes + w * src.previous.tcp_probes;
+  double ans = src.current.tcp_answers + w * src.previous.tcp_answers;
+  double udp = src.current.udp_probes + w * src.previous.udp_probes;
+  double unr = src.current.unreachables + w * src.previous.unreachables;
+
+  double tcp_fail = (tcp > 0 ? 1.0 - (ans > tcp ? tcp : ans) / tcp : 0.0);
+  double udp_fail = (udp > 0 ? (unr > udp ? udp : unr) / udp : 0.0);
+
+  return tcp_fail > udp_fail ? tcp_fail : udp_fail;
+}
+
+// Returns the approximate number of distinct targets probed by given source
+// over the sliding window ending at given time
+double PortScanDetector::targets(unsigned int ip, unsigned long long now) {
+  ScanSource * src = source(ip, now, false);
+
+  return src ? src->current.targets.estimate() + weight(*src, now) * src->previous.targets.estimate() : 0.0;
+}
+
+// Returns the approximate number of distinct hosts probed by given source over
+// the sliding window ending at given time
+double PortScanDetector::hosts(unsigned int ip, unsigned long long now) {
+  ScanSource * src = source(ip, now, false);
+
+  return src ? src->current.hosts.estimate() + weight(*src, now) * src->previous.hosts.estimate() : 0.0;
+}
+
+// Returns the share of failed probes of given source over the sliding window
+// ending at given time
+double PortScanDetector::failure(unsigned int ip, unsigned long long now) {
+  ScanSource * src = source(ip, now, false);
+
+  return src ? failure(*src, now) : 0.0;
+}
+
+// Processes a dissected packet: probes are counted against their source,
+// answers and ICMP errors against their destination (the prober)
+unsigned int PortScanDetector::process(const PacketMeta & meta, unsigned long long now,
+                                       unsigned int & offender) {
+  if (!meta.has_ip)
+    return ps_none;
+
+  ScanSource * src;
+  bool         probe = false;
+
+  // Answers to probes are counted for known sources only
+  if (meta.has_tcp && meta.tcp.flag_syn() && meta.tcp.flag_ack()) {
+    if ((src = source(meta.dst_ip, now, false)) != NULL)
+      src->current.tcp_answers++;
+    return ps_none;
+  }
+
+  if (meta.has_icmp && meta.icmp.type() == 3 && meta.icmp.code() == 3) {
+    if ((src = source(meta.dst_ip, now, false)) != NULL)
+      src->current.unreachables++;
+    return ps_none;
+  }
+
+  // Probes: TCP segments without ACK flag, UDP datagrams and ICMP echo requests
+  if (meta.has_tcp)
+    probe = !meta.tcp.flag_ack() && !meta.tcp.flag_rst();
+  else if (meta.has_udp)
+    probe = true;
+  else if (meta.has_icmp)
+    probe = (meta.icmp.type() == 8);
+
+  if (!probe)
+    return ps_none;
+
+  src = source(meta.src_ip, now, true);
+
+  if (meta.has_tcp)
+    src->current.tcp_probes++;
+  else if (meta.has_udp)
+    src->current.udp_probes++;
+
+  // Estimates only change when a register of the counters is raised
+  bool changed = src->current.targets.add((unsigned long long)meta.protocol << 48 |
+                                          (unsigned long long)meta.dst_ip << 16 | meta.dport);
+  changed = src->current.hosts.add(meta.dst_ip) || changed;
+
+  if (!changed)
+    return ps_none;
+
+  double       w      = weight(*src, now);
+  double       fail   = failure(*src, now);
+  unsigned int alerts = ps_none;
+
+  if (!(src->alerted & ps_portscan)) {
+    double n = src->current.targets.estimate() + w * src->previous.targets.estimate();
+    if ((n >= PSCAN_TARGETS && fail >= PSCAN_FAILURE) ||
+        (n >= 4 * PSCAN_TARGETS && fail >= PSCAN_WIDE_FAILURE))
+      alerts |= ps_portscan;
+  }
+
+  if (!(src->alerted & ps_hostsweep)) {
+    double n = src->current.hosts.estimate() + w * src->previous.hosts.estimate();
+    if ((n >= PSCAN_HOSTS && fail >= PSCAN_FAILURE) ||
+        (n >= 4 * PSCAN_HOSTS && fail >= PSCAN_WIDE_FAILURE))
+      alerts |= ps_hostsweep;
+  }
+
+  if (alerts != ps_none) {
+    src->alerted |= alerts;
+    offender      = meta.src_ip;
+    p_alerts++;
+  }
+
+  return alerts;
+}
+
+// Output operator displaying the detector statistics
+ostream & operator<<(ostream & ostr, const PortScanDetector & ps) {
+  ostr << "port scan alerts = " << ps.p_alerts << ", sources evicted = " << ps.p_sources.evicted() << endl;
+
+  ostr << flush;
+
+  return ostr;
+}
+
+#endif
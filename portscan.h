@@ -0,0 +1,123 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef PORTSCAN_H
+#define PORTSCAN_H
+
+#include <iostream>
+
+#include "packetmeta.h"         // PacketMeta
+#include "flowtable.h"          // FlowTable
+#include "sketch.h"             // HyperLogLog
+
+using namespace std;
+
+#define PSCAN_TARGETS      100     // distinct (address, port) targets per window raising a port scan alert
+#define PSCAN_HOSTS         50     // distinct addresses per window raising a host sweep alert
+#define PSCAN_FAILURE      0.5     // share of failed probes confirming a scan
+#define PSCAN_WIDE_FAILURE 0.2     // share of failed probes confirming a scan four times as wide
+#define PSCAN_PRECISION      8     // HyperLogLog precision of per-source counters
+
+/* ScanWindow: probes sent by a source within a window.
+ *
+ * Attributes
+ *   targets      : distinct (protocol, address, port) probed
+ *   hosts        : distinct addresses probed
+ *   tcp_probes   : TCP segments sent without ACK flag (SYN, FIN, NULL, Xmas probes)
+ *   tcp_answers  : SYN/ACK segments received
+ *   udp_probes   : UDP datagrams sent
+ *   unreachables : ICMP port unreachable messages received
+ */
+struct ScanWindow {
+  ScanWindow();                                          // default constructor
+
+  HyperLogLog  targets;
+  HyperLogLog  hosts;
+  unsigned int tcp_probes, tcp_answers;
+  unsigned int udp_probes, unreachables;
+};
+
+/* ScanSource: probing activity of a source address.
+ *
+ * Attributes
+ *   start    : start time of the current window
+ *   current  : window in progress
+ *   previous : window preceding it
+ *   alerted  : alerts raised in the current window (PortScanDetector::ScanAlert bits)
+ */
+struct ScanSource {
+  ScanSource();                                          // default constructor
+
+  unsigned long long start;
+  ScanWindow         current, previous;
+  unsigned int       alerted;
+};
+
+/* PortScanDetector: detects port scans and host sweeps from per-source
+ *   distinct target counts and probe failure ratios.
+ *
+ * Attributes
+ *   p_sources : per-source activity, keyed by source address
+ *   p_window  : window length in microseconds
+ *   p_alerts  : number of alerts raised
+ *
+ * Notes
+ *   1. counts are evaluated over a sliding window approximated by the current
+ *      window plus the previous one weighted by the share of it still covered.
+ *   2. a source is reported when it probes at least PSCAN_TARGETS targets (port
+ *      scan) or PSCAN_HOSTS hosts (host sweep) and at least PSCAN_FAILURE of its
+ *      TCP or UDP probes fail (no SYN/ACK, or ICMP port unreachable), or when it
+ *      probes four times as many and at least PSCAN_WIDE_FAILURE of them fail.
+ *      Sources contacting many peers successfully (crawlers, resolvers, NAT
+ *      gateways) are thus not reported. Each alert is raised at most once per
+ *      window.
+ *   3. sources live in a bounded flow table evicting the least recently seen
+ *      one, so a flood of spoofed sources cannot exhaust memory; counters are
+ *      sparse HyperLogLogs of at most 2^PSCAN_PRECISION bytes.
+ */
+class PortScanDetector {
+  public:
+    // Alert bits returned by process()
+    typedef enum {
+      ps_none = 0, ps_portscan = 1, ps_hostsweep = 2
+    } ScanAlert;
+
+    PortScanDetector(unsigned long long = 10000000, unsigned int = 16384);  // parameterized constructor
+
+    // Processes a dissected packet captured at given time. Returns the alerts
+    // raised by the packet (ScanAlert bits), the offending source being given
+    // in source
+    unsigned int process(const PacketMeta &, unsigned long long, unsigned int &);
+
+    double targets(unsigned int, unsigned long long);    // approximate distinct targets of a source
+    double hosts(unsigned int, unsigned long long);      // approximate distinct hosts of a source
+    double failure(unsigned int, unsigned long long);    // approximate failed probe share of a source
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, const PortScanDetector &);
+
+  private:
+    FlowTable<ScanSource> p_sources;
+    unsigned long long    p_window;
+    unsigned long long    p_alerts;
+
+    ScanSource * source(unsigned int, unsigned long long, bool);
+    double weight(const ScanSource &, unsigned long long) const;
+    double failure(const ScanSource &, unsigned long long) const;
+};
+
+#endif
@@ -0,0 +1,136 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef PROTOHIERARCHY_CPP
+#define PROTOHIERARCHY_CPP
+
+#include <cstring>              // memset
+#include <cstdio>               // sprintf
+
+#include "protohierarchy.h"     // ProtocolHierarchy
+
+// Default constructor
+ProtocolHierarchy::ProtocolHierarchy() {
+  clear();
+}
+
+// Forgets all nodes and counts
+void ProtocolHierarchy::clear() {
+  memset(p_children, 0, sizeof(p_children));
+
+  p_nodes[0].layer   = PacketMeta::pl_count;   // root: all frames
+  p_nodes[0].parent  = 0;
+  p_nodes[0].packets = p_nodes[0].bytes = 0;
+  p_count     = 1;
+  p_truncated = 0;
+}
+
+// Returns the child of given node for given layer, creating it if need be.
+// Returns 0 if the tree is full
+unsigned int ProtocolHierarchy::child(unsigned int parent, PacketMeta::Layer layer) {
+  unsigned int node = p_children[parent][layer];
+
+  if (node == 0 && p_count < PHS_MAX_NODES) {
+    node = p_count++;
+    p_nodes[node].layer   = layer;
+    p_nodes[node].parent  = parent;
+    p_nodes[node].packets = p_nodes[node].bytes = 0;
+    p_children[parent][layer] = node;
+  }
+
+  return node;
+}
+
+// Counts a frame of given length at every node of its path. A sampled frame
+// stands for weight frames
+void ProtocolHierarchy::add(const PacketMeta & meta, unsigned int len, unsigned int weight) {
+  unsigned int       node  = 0;
+  unsigned long long bytes = (unsigned long long)len * weight;
+
+  p_nodes[0].packets += weight;
+  p_nodes[0].bytes += bytes;
+
+  for (unsigned int i = 0; i < meta.layers; i++) {
+    if ((node = child(node, meta.layer[i])) == 0) {
+      p_truncated += weight;
+      return;
+    }
+
+    p_nodes[node].packets += weight;
+    p_nodes[node].bytes += bytes;
+  }
+}
+
+// Adds the counts of another instance. Nodes of the other instance are
+// created after their parents, so parents are always mapped first. The
+// frames of a node that cannot be mapped are truncated there; those of its
+// descendants are among them
+void ProtocolHierarchy::merge(const ProtocolHierarchy & other) {
+  unsigned int map[PHS_MAX_NODES];
+
+  map[0] = 0;
+  for (unsigned int i = 0; i < other.p_count; i++) {
+    if (i > 0) {
+      bool mapped_parent = (map[other.p_nodes[i].parent] != 0 || other.p_nodes[i].parent == 0);
+
+      map[i] = (mapped_parent ? child(map[other.p_nodes[i].parent], other.p_nodes[i].layer) : 0);
+      if (map[i] == 0) {
+        if (mapped_parent)
+          p_truncated += other.p_nodes[i].packets;
+        continue;
+      }
+    }
+
+    p_nodes[map[i]].packets += other.p_nodes[i].packets;
+    p_nodes[map[i]].bytes   += other.p_nodes[i].bytes;
+  }
+
+  p_truncated += other.p_truncated;
+}
+
+// Displays given node and its descendants, indented by depth
+void ProtocolHierarchy::display(ostream & ostr, unsigned int node, unsigned int depth) const {
+  const Node & n = p_nodes[node];
+  char         outstr[80];
+  double       share = (p_nodes[0].packets ? 100.0 * n.packets / p_nodes[0].packets : 0.0);
+
+  sprintf(outstr, "%*s%-*s %6.2f%%", 2 * depth, "", 24 - 2 * (int)depth, PacketMeta::layer_name(n.layer), share);
+  ostr << outstr << "  frames = " << n.packets << ", bytes = " << n.bytes << endl;
+
+  for (unsigned int l = 0; l < PacketMeta::pl_count; l++)
+    if (p_children[node][l] != 0)
+      display(ostr, p_children[node][l], depth + 1);
+}
+
+// Output operator displaying the hierarchy, children in layer order
+ostream & operator<<(ostream & ostr, const ProtocolHierarchy & phs) {
+  ostr << "Protocol hierarchy statistics (" << phs.p_nodes[0].packets << " frames, "
+       << phs.p_nodes[0].bytes << " bytes)" << endl;
+
+  for (unsigned int l = 0; l < PacketMeta::pl_count; l++)
+    if (phs.p_children[0][l] != 0)
+      phs.display(ostr, phs.p_children[0][l], 0);
+
+  if (phs.p_truncated != 0)
+    ostr << "frames not fully counted (tree full) = " << phs.p_truncated << endl;
+
+  ostr << flush;
+
+  return ostr;
+}
+
+#endif
@@ -0,0 +1,73 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef PROTOHIERARCHY_H
+#define PROTOHIERARCHY_H
+
+#include <iostream>
+
+#include "packetmeta.h"         // PacketMeta
+
+using namespace std;
+
+#define PHS_MAX_NODES 256       // nodes of the protocol hierarchy tree at most
+
+/* ProtocolHierarchy: packet and byte counts at every node of the protocol
+ *   hierarchy, as crossed by the dissection walk (e.g. eth / ipv4 / udp / dns).
+ *
+ * Attributes
+ *   p_nodes    : tree nodes, each created after its parent (node 0 is the root)
+ *   p_children : index of the child node of each node for each layer (0 if none)
+ *   p_count    : number of nodes in use
+ *   p_truncated: frames whose path did not fit in the tree
+ *
+ * Notes
+ *   1. counter slots are indexed by the tree itself: a frame is counted by
+ *      following one table lookup per layer of its path. Nodes are only
+ *      created the first time a path is seen.
+ *   2. instances (e.g. per-thread copies) may be merged for reporting, even if
+ *      their nodes were created in different orders.
+ */
+class ProtocolHierarchy {
+  public:
+    ProtocolHierarchy();                                 // default constructor
+
+    void add(const PacketMeta &, unsigned int, unsigned int = 1);  // counts a dissected frame of given length
+    void merge(const ProtocolHierarchy &);               // adds the counts of another instance
+    void clear();                                        // forgets all counts
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, const ProtocolHierarchy &);
+
+  private:
+    // Node of the hierarchy
+    struct Node {
+      PacketMeta::Layer  layer;
+      unsigned int       parent;
+      unsigned long long packets, bytes;
+    };
+
+    Node               p_nodes[PHS_MAX_NODES];
+    unsigned short     p_children[PHS_MAX_NODES][PacketMeta::pl_count];
+    unsigned int       p_count;
+    unsigned long long p_truncated;
+
+    unsigned int child(unsigned int, PacketMeta::Layer); // returns child node, creating it if need be
+    void display(ostream &, unsigned int, unsigned int) const;
+};
+
+#endif
@@ -0,0 +1,861 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef REGEXSET_CPP
+#define REGEXSET_CPP
+
+#include <cstdio>           // fopen, fgets
+#include <cstring>          // memset, strlen
+#include <cstdlib>          // strtoul
+#include <cctype>           // isxdigit, isalnum, isdigit
+#include <algorithm>        // sort, unique, includes, set_difference
+#include <iterator>         // back_inserter
+
+#include "regexset.h"       // RegexSet
+
+#define RE_MATCH     0x80000000 // transition leads to a state where new matches end
+#define RE_UNKNOWN   0x7FFFFFFF // transition of the lazy DFA not computed yet
+#define RE_UNBOUNDED 0xFFFFFFFF // repetition without upper bound
+
+// Parameterized constructor: expressions may ignore the case of ASCII letters
+RegexSet::RegexSet(bool nocase)
+  : p_nocase(nocase), p_fold(nocase), p_classes(1), p_mark(0), p_built(false), p_lazy(false),
+    p_states(0), p_unminimized(0), p_epoch(0), p_flushes(0), p_malformed(0) {
+  memset(p_class, 0, sizeof(p_class));
+  memset(p_rep, 0, sizeof(p_rep));
+}
+
+// Adds letters of the other case to a byte set if the expression ignores case
+static void fold(bitset<256> & bytes, bool nocase) {
+  if (nocase)
+    for (unsigned int c = 'a'; c <= 'z'; c++)
+      if (bytes[c] || bytes[c - 'a' + 'A'])
+        bytes.set(c).set(c - 'a' + 'A');
+}
+
+// Creates an NFA state with given byte set (-1 for none) and returns it
+unsigned int RegexSet::state(int set) {
+  NState s;
+
+  s.set    = set;
+  s.next   = 0;
+  s.accept = -1;
+  p_nfa.push_back(s);
+
+  return p_nfa.size() - 1;
+}
+
+// Returns a fragment matching one byte of given set
+RegexSet::Fragment RegexSet::set_fragment(const bitset<256> & bytes) {
+  p_sets.push_back(bytes);
+
+  unsigned int s = state(p_sets.size() - 1), e = state();
+  p_nfa[s].next = e;
+
+  return Fragment(s, e);
+}
+
+// Parses alternatives up to the end of the expression or of the group
+bool RegexSet::alternation(const string & re, unsigned int & pos, Fragment & f) {
+  if (!concatenation(re, pos, f))
+    return false;
+
+  while (pos < re.size() && re[pos] == '|') {
+    Fragment g;
+
+    pos++;
+    if (!concatenation(re, pos, g))
+      return false;
+
+    unsigned int s = state(), e = state();
+    p_nfa[s].eps.push_back(f.first);
+    p_nfa[s].eps.push_back(g.first);
+    p_nfa[f.second].eps.push_back(e);
+    p_nfa[g.second].eps.push_back(e);
+    f = Fragment(s, e);
+  }
+
+  return true;
+}
+
+// Parses a sequence of repeated atoms, possibly empty
+bool RegexSet::concatenation(const string & re, unsigned int & pos, Fragment & f) {
+  unsigned int s = state();
+
+  f = Fragment(s, s);
+  while (pos < re.size() && re[pos] != '|' && re[pos] != ')') {
+    Fragment g;
+
+    if (!repetition(re, pos, re.size(), g) || p_nfa.size() > REGEX_MAX_NFA)
+      return false;
+
+    p_nfa[f.second].eps.push_back(g.first);
+    f.second = g.second;
+  }
+
+  return true;
+}
+
+// Parses an atom and the quantifiers following it before limit. Repeated
+// units are parsed again from the expression for each copy needed
+bool RegexSet::repetition(const string & re, unsigned int & pos, unsigned int limit, Fragment & f) {
+  unsigned int from = pos;
+
+  if (!atom(re, pos, f))
+    return false;
+
+  while (pos < limit && (re[pos] == '*' || re[pos] == '+' || re[pos] == '?' || re[pos] == '{')) {
+    unsigned int to = pos, min, max;
+
+    if (re[pos] == '{') {
+      // Counted repetition, or a plain '{' if not well formed
+      unsigned int p = pos + 1;
+
+      if (p >= limit || !isdigit(re[p]))
+        break;
+      min = max = strtoul(re.c_str() + p, NULL, 10);
+      while (p < limit && isdigit(re[p]))
+        p++;
+
+      if (p < limit && re[p] == ',') {
+        p++;
+        if (p < limit && isdigit(re[p])) {
+          max = strtoul(re.c_str() + p, NULL, 10);
+          while (p < limit && isdigit(re[p]))
+            p++;
+        }
+        else
+          max = RE_UNBOUNDED;
+      }
+
+      if (p >= limit || re[p] != '}')
+        break;
+      pos = p + 1;
+
+      if (min > REGEX_MAX_REPEAT || (max != RE_UNBOUNDED && (max < min || max > REGEX_MAX_REPEAT)))
+        return false;
+    }
+    else {
+      min = (re[pos] == '+' ? 1 : 0);
+      max = (re[pos] == '?' ? 1 : RE_UNBOUNDED);
+      pos++;
+    }
+
+    // Lazy quantifiers find the same match ends
+    if (pos < limit && re[pos] == '?')
+      pos++;
+
+    unsigned int s = state(), e = state(), cur = s;
+
+    if (max == 0) {
+      p_nfa[s].eps.push_back(e);
+      f = Fragment(s, e);
+      continue;
+    }
+
+    // Copies of the unit re[from, to), the first one being f
+    vector<Fragment> copies(1, f);
+    unsigned int     needed = (max == RE_UNBOUNDED ? (min > 1 ? min : 1) : max);
+
+    while (copies.size() < needed) {
+      unsigned int p = from;
+      Fragment     g;
+
+      if (!repetition(re, p, to, g) || p_nfa.size() > REGEX_MAX_NFA)
+        return false;
+      copies.push_back(g);
+    }
+
+    if (max == RE_UNBOUNDED) {
+      // Mandatory copies, the last one looping
+      for (unsigned int i = 0; i + 1 < copies.size(); i++) {
+        p_nfa[cur].eps.push_back(copies[i].first);
+        cur = copies[i].second;
+      }
+
+      Fragment & last = copies.back();
+      p_nfa[cur].eps.push_back(last.first);
+      p_nfa[last.second].eps.push_back(last.first);
+      p_nfa[last.second].eps.push_back(e);
+      if (min == 0)
+        p_nfa[cur].eps.push_back(e);
+    }
+    else {
+      // Mandatory copies, then optional ones each able to end the repetition
+      for (unsigned int i = 0; i < copies.size(); i++) {
+        if (i >= min)
+          p_nfa[cur].eps.push_back(e);
+        p_nfa[cur].eps.push_back(copies[i].first);
+        cur = copies[i].second;
+      }
+      p_nfa[cur].eps.push_back(e);
+    }
+
+    f = Fragment(s, e);
+  }
+
+  return true;
+}
+
+// Parses a group, a class, an escape or a single byte
+bool RegexSet::atom(const string & re, unsigned int & pos, Fragment & f) {
+  bitset<256> bytes;
+  bool        single;
+
+  if (pos >= re.size())
+    return false;
+
+  switch (re[pos]) {
+    case '(' :
+      pos++;
+      if (re.compare(pos, 2, "?:") == 0)
+        pos += 2;
+      else if (pos < re.size() && re[pos] == '?')
+        return false;               // look arounds and other groups
+
+      if (!alternation(re, pos, f) || pos >= re.size() || re[pos] != ')')
+        return false;
+      pos++;
+      return true;
+
+    case '[' :
+      pos++;
+      if (!bracket(re, pos, bytes))
+        return false;
+      f = set_fragment(bytes);
+      return true;
+
+    case '.' :
+      bytes.set().reset('\n');
+      pos++;
+      break;
+
+    case '\\' :
+      if (!escape(re, pos, bytes, single))
+        return false;
+      break;
+
+    case ')' : case '*' : case '+' : case '?' : case '^' : case '$' :
+      return false;
+
+    default :
+      bytes.set((unsigned char)re[pos++]);
+      break;
+  }
+
+  fold(bytes, p_fold);
+  f = set_fragment(bytes);
+
+  return true;
+}
+
+// Parses an escape starting at pos into a byte set. single tells if it stands
+// for a single byte
+bool RegexSet::escape(const string & re, unsigned int & pos, bitset<256> & bytes, bool & single) {
+  if (++pos >= re.size())
+    return false;
+
+  unsigned char c = re[pos++];
+
+  single = false;
+  switch (c) {
+    case 'd' : case 'D' :
+      for (unsigned int b = '0'; b <= '9'; b++)
+        bytes.set(b);
+      break;
+
+    case 'w' : case 'W' :
+      for (unsigned int b = 0; b < 256; b++)
+        if (isalnum(b) || b == '_')
+          bytes.set(b);
+      break;
+
+    case 's' : case 'S' :
+      bytes.set(' ').set('\t').set('\n').set('\r').set('\f').set('\v');
+      break;
+
+    case 'x' :
+      if (pos + 1 >= re.size() || !isxdigit(re[pos]) || !isxdigit(re[pos+1]))
+        return false;
+      bytes.set(strtoul(re.substr(pos, 2).c_str(), NULL, 16));
+      pos += 2;
+      single = true;
+      return true;
+
+    case 'n' : bytes.set('\n'); single = true; return true;
+    case 'r' : bytes.set('\r'); single = true; return true;
+    case 't' : bytes.set('\t'); single = true; return true;
+    case 'f' : bytes.set('\f'); single = true; return true;
+    case 'v' : bytes.set('\v'); single = true; return true;
+
+    default :
+      // Escaped punctuation stands for itself; other letters are not supported
+      if (isalnum(c))
+        return false;
+      bytes.set(c);
+      single = true;
+      return true;
+  }
+
+  if (c == 'D' || c == 'W' || c == 'S')
+    bytes.flip();
+
+  return true;
+}
+
+// Parses a class following '[' into a byte set
+bool RegexSet::bracket(const string & re, unsigned int & pos, bitset<256> & bytes) {
+  bool negate = false, first = true;
+
+  if (pos < re.size() && re[pos] == '^') {
+    negate = true;
+    pos++;
+  }
+
+  // A ']' first in the class stands for itself
+  while (pos < re.size() && (re[pos] != ']' || first)) {
+    bitset<256> item;
+    bool        single = true;
+
+    first = false;
+    if (re[pos] == '\\') {
+      if (!escape(re, pos, item, single))
+        return false;
+    }
+    else
+      item.set((unsigned char)re[pos++]);
+
+    // Range between two single bytes
+    if (single && pos + 1 < re.size() && re[pos] == '-' && re[pos+1] != ']') {
+      bitset<256>  high;
+      unsigned int lo = 0, hi = 0;
+
+      pos++;
+      if (re[pos] == '\\') {
+        if (!escape(re, pos, high, single) || !single)
+          return false;
+      }
+      else
+        high.set((unsigned char)re[pos++]);
+
+      while (!item[lo])
+        lo++;
+      while (!high[hi])
+        hi++;
+      if (hi < lo)
+        return false;
+
+      for (unsigned int b = lo; b <= hi; b++)
+        item.set(b);
+    }
+
+    bytes |= item;
+  }
+
+  if (pos >= re.size())
+    return false;
+  pos++;
+
+  fold(bytes, p_fold);
+  if (negate)
+    bytes.flip();
+
+  return true;
+}
+
+// Adds an expression and returns its identifier, or -1 if it is malformed. The
+// DFA must be built again
+int RegexSet::add(const string & re) {
+  unsigned int nfa = p_nfa.size(), sets = p_sets.size(), pos = 0;
+  bool         anchored = false;
+  Fragment     f;
+
+  p_fold = p_nocase;
+  if (re.compare(0, 4, "(?i)") == 0) {
+    p_fold = true;
+    pos    = 4;
+  }
+
+  if (pos < re.size() && re[pos] == '^') {
+    anchored = true;
+    pos++;
+  }
+
+  bool ok = alternation(re, pos, f) && pos == re.size() && p_nfa.size() <= REGEX_MAX_NFA;
+
+  // Expressions matching the empty string would match everywhere
+  if (ok) {
+    vector<unsigned int> start(1, f.first);
+
+    p_nfa[f.second].accept = p_patterns.size();
+    closure(start);
+    ok = !binary_search(start.begin(), start.end(), f.second);
+  }
+
+  if (!ok) {
+    p_nfa.resize(nfa);
+    p_sets.resize(sets);
+    p_malformed++;
+    return -1;
+  }
+
+  p_starts.push_back(f.first);
+  p_anchored.push_back(anchored);
+  p_patterns.push_back(re);
+  p_built = false;
+
+  return p_patterns.size() - 1;
+}
+
+// Adds the expressions listed in a file. Returns the number of expressions
+// added, or -1 if the file cannot be read
+int RegexSet::load(const char * fname) {
+  FILE * f = fopen(fname, "r");
+  char   line[1024];
+  int    added = 0;
+
+  if (f == NULL)
+    return -1;
+
+  while (fgets(line, sizeof(line), f) != NULL) {
+    unsigned int len = strlen(line);
+    while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r'))
+      line[--len] = '\0';
+
+    if (len == 0 || line[0] == '#')
+      continue;
+
+    if (add(string(line, len)) >= 0)
+      added++;
+  }
+
+  fclose(f);
+  return added;
+}
+
+// Replaces given NFA states by the states reachable from them through epsilon
+// transitions that have a byte set or accept, in increasing order
+void RegexSet::closure(vector<unsigned int> & states) {
+  vector<unsigned int> stack;
+
+  if (p_stamp.size() < p_nfa.size())
+    p_stamp.resize(p_nfa.size(), 0);
+  if (++p_mark == 0) {
+    p_stamp.assign(p_stamp.size(), 0);
+    p_mark = 1;
+  }
+
+  for (unsigned int i = 0; i < states.size(); i++)
+    if (p_stamp[states[i]] != p_mark) {
+      p_stamp[states[i]] = p_mark;
+      stack.push_back(states[i]);
+    }
+
+  states.clear();
+  while (!stack.empty()) {
+    const NState & n = p_nfa[stack.back()];
+
+    if (n.set >= 0 || n.accept >= 0)
+      states.push_back(stack.back());
+    stack.pop_back();
+
+    for (unsigned int i = 0; i < n.eps.size(); i++)
+      if (p_stamp[n.eps[i]] != p_mark) {
+        p_stamp[n.eps[i]] = p_mark;
+        stack.push_back(n.eps[i]);
+      }
+  }
+
+  sort(states.begin(), states.end());
+}
+
+// Computes the NFA states following given ones on a byte of given class,
+// unanchored expressions starting over
+void RegexSet::move(const vector<unsigned int> & from, unsigned int c, vector<unsigned int> & to) {
+  to.clear();
+  for (unsigned int i = 0; i < from.size(); i++) {
+    const NState & n = p_nfa[from[i]];
+    if (n.set >= 0 && p_sets[n.set][p_rep[c]])
+      to.push_back(n.next);
+  }
+
+  closure(to);
+  to.insert(to.end(), p_floating.begin(), p_floating.end());
+  sort(to.begin(), to.end());
+  to.erase(unique(to.begin(), to.end()), to.end());
+}
+
+// Lists the expressions accepted by given NFA states, in increasing order
+void RegexSet::accepted(const vector<unsigned int> & states, vector<unsigned int> & patterns) const {
+  patterns.clear();
+  for (unsigned int i = 0; i < states.size(); i++)
+    if (p_nfa[states[i]].accept >= 0)
+      patterns.push_back(p_nfa[states[i]].accept);
+
+  sort(patterns.begin(), patterns.end());
+  patterns.erase(unique(patterns.begin(), patterns.end()), patterns.end());
+}
+
+// Returns the DFA state of given NFA states, created (without transitions) if
+// they have none yet
+unsigned int RegexSet::cache(const vector<unsigned int> & subset) {
+  map<vector<unsigned int>, unsigned int>::iterator it = p_index.find(subset);
+
+  if (it != p_index.end())
+    return it->second;
+
+  unsigned int         k = p_subsets.size();
+  vector<unsigned int> patterns;
+
+  p_subsets.push_back(subset);
+  p_index[subset] = k;
+  p_table.resize(p_table.size() + p_classes, RE_UNKNOWN);
+
+  accepted(subset, patterns);
+  p_outputs.insert(p_outputs.end(), patterns.begin(), patterns.end());
+  p_out_first.push_back(p_outputs.size());
+
+  return k;
+}
+
+// Empties the cache of the lazy DFA, but for its start state
+void RegexSet::flush() {
+  vector<unsigned int> start = p_subsets[0];
+
+  p_subsets.clear();
+  p_index.clear();
+  p_table.clear();
+  p_outputs.clear();
+  p_out_first.assign(1, 0);
+  cache(start);
+
+  p_epoch++;
+  p_flushes++;
+}
+
+// Computes and caches the transition of a lazy DFA state on a byte of given
+// class. Returns the transition entry; the expressions it newly matches are
+// listed in fresh
+unsigned int RegexSet::step(unsigned int k, unsigned int c, vector<unsigned int> & fresh) {
+  vector<unsigned int> target, patterns;
+
+  move(p_subsets[k], c, target);
+  accepted(target, patterns);
+
+  fresh.clear();
+  set_difference(patterns.begin(), patterns.end(), p_outputs.begin() + p_out_first[k],
+                 p_outputs.begin() + p_out_first[k+1], back_inserter(fresh));
+
+  unsigned int flag = (fresh.empty() ? 0 : RE_MATCH);
+
+  // The state left is flushed with the others
+  if (p_index.find(target) == p_index.end() && p_subsets.size() >= REGEX_CACHE_STATES) {
+    flush();
+    return cache(target) * p_classes | flag;
+  }
+
+  unsigned int t = cache(target);
+  p_table[k * p_classes + c] = t * p_classes | flag;
+
+  return p_table[k * p_classes + c];
+}
+
+// Builds the DFA from the expressions. Returns false if it would be too large
+bool RegexSet::build() {
+  p_built = p_lazy = false;
+  p_table.clear();
+  p_outputs.clear();
+  p_out_first.assign(1, 0);
+  p_subsets.clear();
+  p_index.clear();
+  p_states = p_unminimized = 0;
+  p_flushes = 0;
+  p_epoch++;
+
+  // Byte classes: bytes belonging to the same sets share a class
+  unsigned int cls[256] = { 0 };
+
+  p_classes = 1;
+  for (unsigned int i = 0; i < p_sets.size(); i++) {
+    unsigned int split[256][2], n = 0;
+
+    memset(split, 0xFF, sizeof(split));
+    for (unsigned int b = 0; b < 256; b++) {
+      unsigned int & k = split[cls[b]][p_sets[i][b]];
+      if (k == RE_UNBOUNDED)
+        k = n++;
+      cls[b] = k;
+    }
+    p_classes = n;
+  }
+
+  for (unsigned int b = 0; b < 256; b++) {
+    p_class[b]      = cls[b];
+    p_rep[cls[b]]   = b;
+  }
+
+  // Start state: every expression starts; unanchored ones start again at each byte
+  vector<unsigned int> start(p_starts);
+
+  p_floating.clear();
+  for (unsigned int i = 0; i < p_starts.size(); i++)
+    if (!p_anchored[i])
+      p_floating.push_back(p_starts[i]);
+  closure(p_floating);
+  closure(start);
+
+  cache(start);
+
+  // Subset construction, in the order states are found
+  vector<unsigned int> trans, target;
+
+  for (unsigned int k = 0; k < p_subsets.size(); k++) {
+    for (unsigned int c = 0; c < p_classes; c++) {
+      move(p_subsets[k], c, target);
+      trans.push_back(cache(target));
+    }
+
+    // Too many states: build them as scans need them
+    if (p_subsets.size() > REGEX_MAX_STATES) {
+      p_lazy = true;
+      flush();
+      p_flushes = 0;
+      p_built   = true;
+      return true;
+    }
+  }
+
+  unsigned int n = p_unminimized = p_subsets.size();
+  vector< vector<unsigned int> > acc(n);
+
+  for (unsigned int k = 0; k < n; k++)
+    acc[k].assign(p_outputs.begin() + p_out_first[k], p_outputs.begin() + p_out_first[k+1]);
+
+  // Minimization: states accepting the same expressions start in the same
+  // block, which is split until its states have the same transitions
+  vector<unsigned int> block(n), split(n), key(p_classes + 1);
+  unsigned int         blocks;
+  {
+    map<vector<unsigned int>, unsigned int> ids;
+
+    for (unsigned int k = 0; k < n; k++)
+      block[k] = ids.insert(make_pair(acc[k], (unsigned int)ids.size())).first->second;
+    blocks = ids.size();
+  }
+
+  for (;;) {
+    map<vector<unsigned int>, unsigned int> ids;
+
+    for (unsigned int k = 0; k < n; k++) {
+      key[0] = block[k];
+      for (unsigned int c = 0; c < p_classes; c++)
+        key[c + 1] = block[trans[k * p_classes + c]];
+      split[k] = ids.insert(make_pair(key, (unsigned int)ids.size())).first->second;
+    }
+
+    block.swap(split);
+    if (ids.size() == blocks)
+      break;
+    blocks = ids.size();
+  }
+
+  // Breadth first numbering of the blocks from the start state
+  vector<unsigned int> member(blocks), number(blocks, RE_UNBOUNDED), order;
+
+  for (unsigned int k = 0; k < n; k++)
+    member[block[k]] = k;
+
+  order.push_back(block[0]);
+  number[block[0]] = 0;
+  for (unsigned int i = 0; i < order.size(); i++)
+    for (unsigned int c = 0; c < p_classes; c++) {
+      unsigned int t = block[trans[member[order[i]] * p_classes + c]];
+      if (number[t] == RE_UNBOUNDED) {
+        number[t] = order.size();
+        order.push_back(t);
+      }
+    }
+
+  p_states = order.size();
+  p_subsets.clear();
+  p_index.clear();
+  p_table.resize(p_states * p_classes);
+  p_outputs.clear();
+  p_out_first.assign(1, 0);
+
+  for (unsigned int i = 0; i < p_states; i++) {
+    const vector<unsigned int> & from = acc[member[order[i]]];
+
+    for (unsigned int c = 0; c < p_classes; c++) {
+      unsigned int                 t  = number[block[trans[member[order[i]] * p_classes + c]]];
+      const vector<unsigned int> & to = acc[member[order[t]]];
+
+      p_table[i * p_classes + c] = t * p_classes |
+                                   (includes(from.begin(), from.end(), to.begin(), to.end()) ? 0 : RE_MATCH);
+    }
+
+    p_outputs.insert(p_outputs.end(), from.begin(), from.end());
+    p_out_first.push_back(p_outputs.size());
+  }
+
+  p_built = true;
+  return true;
+}
+
+// Reports the expressions matching at DFA state to but not at state from, the
+// byte ending them being at given offset. Returns their number
+unsigned int RegexSet::report(unsigned int from, unsigned int to, unsigned long long offset,
+                              vector<PatternMatch> * matches) const {
+  unsigned int i = p_out_first[from], found = 0;
+
+  for (unsigned int j = p_out_first[to]; j < p_out_first[to+1]; j++) {
+    while (i < p_out_first[from+1] && p_outputs[i] < p_outputs[j])
+      i++;
+    if (i < p_out_first[from+1] && p_outputs[i] == p_outputs[j])
+      continue;
+
+    if (matches != NULL)
+      matches->push_back(PatternMatch(p_outputs[j], offset));
+    found++;
+  }
+
+  return found;
+}
+
+// Scans a block of a stream from the given state, which is updated. Returns
+// the number of matches found, appended to matches if not NULL; their offsets
+// count from the start of the stream
+unsigned int RegexSet::scan(const unsigned char * data, unsigned int len, MatchState & ms,
+                            vector<PatternMatch> * matches) {
+  if (!p_built || p_patterns.empty()) {
+    ms.offset += len;
+    return 0;
+  }
+
+  // State of a flushed cache: start over
+  if (ms.epoch != p_epoch) {
+    ms.state = 0;
+    ms.epoch = p_epoch;
+  }
+
+  const unsigned char * p     = data;
+  const unsigned char * end   = data + len;
+  unsigned int          s     = ms.state,
+                        found = 0;
+
+  if (!p_lazy) {
+    const unsigned int * table = &p_table[0];
+
+    while (p < end) {
+      unsigned int e = table[s + p_class[*p++]];
+
+      if (e & RE_MATCH) {
+        e &= ~RE_MATCH;
+        found += report(s / p_classes, e / p_classes, ms.offset + (p - data), matches);
+      }
+      s = e;
+    }
+  }
+  else {
+    vector<unsigned int> fresh;
+
+    while (p < end) {
+      unsigned int c = p_class[*p++],
+                   e = p_table[s + c];
+
+      if (e == RE_UNKNOWN) {
+        e = step(s / p_classes, c, fresh);
+
+        for (unsigned int i = 0; i < fresh.size() && matches != NULL; i++)
+          matches->push_back(PatternMatch(fresh[i], ms.offset + (p - data)));
+        found += fresh.size();
+      }
+      else if (e & RE_MATCH)
+        found += report(s / p_classes, (e & ~RE_MATCH) / p_classes, ms.offset + (p - data), matches);
+
+      s = e & ~RE_MATCH;
+    }
+
+    ms.epoch = p_epoch;
+  }
+
+  ms.state   = s;
+  ms.offset += len;
+
+  return found;
+}
+
+// Scans a block on its own. Returns the number of matches found, appended to
+// matches if not NULL
+unsigned int RegexSet::scan(const unsigned char * data, unsigned int len, vector<PatternMatch> * matches) {
+  MatchState ms;
+
+  return scan(data, len, ms, matches);
+}
+
+// Returns the expression of given identifier
+const string & RegexSet::pattern(unsigned int id) const {
+  return p_patterns[id];
+}
+
+// Returns the number of expressions
+unsigned int RegexSet::size() const {
+  return p_patterns.size();
+}
+
+// Returns the number of DFA states (cached ones if the DFA is lazy)
+unsigned int RegexSet::states() const {
+  return (p_lazy ? p_subsets.size() : p_states);
+}
+
+// Returns true if the DFA is built lazily
+bool RegexSet::lazy() const {
+  return p_lazy;
+}
+
+// Returns the number of expressions rejected
+unsigned int RegexSet::malformed() const {
+  return p_malformed;
+}
+
+// Returns the number of bytes used by the NFA and the DFA
+unsigned long long RegexSet::memory() const {
+  unsigned long long bytes = (p_table.size() + p_out_first.size() + p_outputs.size()) * sizeof(unsigned int) +
+                             p_nfa.size() * sizeof(NState) + p_sets.size() * sizeof(bitset<256>);
+
+  for (unsigned int i = 0; i < p_subsets.size(); i++)
+    bytes += 2 * p_subsets[i].size() * sizeof(unsigned int);
+
+  return bytes;
+}
+
+// Output operator summarizing the expressions and their automata
+ostream & operator<<(ostream & ostr, const RegexSet & rs) {
+  ostr << rs.p_patterns.size() << " expressions, " << rs.p_nfa.size() << " NFA states, ";
+  if (rs.p_lazy)
+    ostr << "lazy DFA (" << rs.states() << " states cached, " << rs.p_flushes << " flushes)";
+  else
+    ostr << rs.p_states << " DFA states (" << rs.p_unminimized << " before minimization)";
+  ostr << ", " << rs.p_classes << " byte classes (" << rs.memory() / 1024 << " KB)";
+  if (rs.p_malformed)
+    ostr << ", " << rs.p_malformed << " malformed";
+  ostr << endl << flush;
+
+  return ostr;
+}
+
+#endif
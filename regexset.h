@@ -0,0 +1,159 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef REGEXSET_H
+#define REGEXSET_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <bitset>
+
+#include "patterns.h"           // PatternMatch, MatchState
+
+using namespace std;
+
+#define REGEX_MAX_STATES   8192         // DFA states built ahead of time, beyond which states are built lazily
+#define REGEX_CACHE_STATES 4096         // states a lazy DFA caches before its cache is flushed
+#define REGEX_MAX_NFA      65536        // NFA states of a set
+#define REGEX_MAX_REPEAT   255          // highest bound of counted repetitions
+
+/* RegexSet: set of regular expressions searched for simultaneously with a
+ *   single DFA.
+ *
+ * Attributes
+ *   p_patterns  : expressions, in the order they were added
+ *   p_nocase    : ASCII letters match regardless of case
+ *   p_nfa       : Thompson NFA of the expressions, byte sets on transitions
+ *   p_sets      : byte sets of the NFA transitions
+ *   p_starts    : start state of each expression in p_nfa
+ *   p_anchored  : expressions anchored at the start of the stream (^)
+ *   p_class     : class of each byte value (bytes no set tells apart share one)
+ *   p_rep       : a byte value of each class
+ *   p_classes   : number of byte classes
+ *   p_table     : transitions, one row of p_classes entries per DFA state
+ *   p_out_first : first entry of p_outputs of each state (states + 1 entries)
+ *   p_outputs   : expressions matching at each state, in increasing order
+ *   p_floating  : NFA states of the unanchored expressions' starts, added at each byte
+ *   p_subsets, p_index : NFA states of each cached state, and the reverse (lazy DFA)
+ *   p_built, p_lazy : DFA reflects the expressions, and is built lazily
+ *   p_states    : DFA states (cached ones if lazy)
+ *   p_unminimized : DFA states before minimization
+ *   p_epoch, p_flushes : flushes of the lazy cache
+ *   p_malformed : expressions or lines of loaded files rejected
+ *
+ * Notes
+ *   1. supported syntax: literals, '.', classes ([a-z], [^...]), escapes
+ *      (\d \w \s and their negations, \xHH, \n \r \t \f \v, escaped
+ *      punctuation), groups ((...) and (?:...)), alternation, and the
+ *      quantifiers * + ? {m} {m,} {m,n}, lazy ones matching as greedy ones.
+ *      A leading ^ anchors an expression at the start of the stream, and a
+ *      leading (?i) makes it ignore case. '.' matches any byte but '\n'.
+ *      Back references, $, \b and look arounds are rejected, as are
+ *      expressions matching the empty string.
+ *   2. the DFA is built by subset construction over byte classes, then
+ *      minimized (Moore's partition refinement) and numbered breadth first.
+ *      Unanchored expressions restart at every byte, so a scan reads exactly
+ *      one transition per byte, whatever the number of expressions.
+ *   3. beyond REGEX_MAX_STATES states, the DFA is built lazily: transitions
+ *      are computed the first time they are taken and cached. A full cache
+ *      is flushed, which restarts streams still holding states of the older
+ *      cache, as after a gap.
+ *   4. a match is reported at the byte ending it, for each run of bytes
+ *      where the expression matches: "a+" is reported once per run of a's,
+ *      at its first byte. Offsets of starts are not known.
+ *   5. expression files hold one expression per line. Empty lines and lines
+ *      starting with '#' are ignored.
+ */
+class RegexSet {
+  public:
+    RegexSet(bool = false);                              // parameterized constructor
+
+    int add(const string &);                             // adds an expression, returns its identifier (-1 if malformed)
+    int load(const char *);                              // adds the expressions of a file
+    bool build();                                        // builds the DFA from the expressions
+
+    // Scans a block of a stream, continuing from given state. Returns the number
+    // of matches found, appended to matches if not NULL
+    unsigned int scan(const unsigned char *, unsigned int, MatchState &, vector<PatternMatch> * = NULL);
+    unsigned int scan(const unsigned char *, unsigned int, vector<PatternMatch> * = NULL);  // scans a single block
+
+    const string & pattern(unsigned int) const;          // expression of given identifier
+    unsigned int size() const;                           // number of expressions
+    unsigned int states() const;                         // number of DFA states
+    bool lazy() const;                                   // DFA is built lazily
+    unsigned int malformed() const;                      // expressions rejected
+    unsigned long long memory() const;                   // bytes used by the automata
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, const RegexSet &);
+
+  private:
+    // NFA state: transition on a byte set to next, or epsilon transitions
+    struct NState {
+      int                  set;       // index in p_sets, -1 if none
+      unsigned int         next;      // target of the byte set transition
+      vector<unsigned int> eps;       // targets of epsilon transitions
+      int                  accept;    // expression matching here, -1 if none
+    };
+
+    // NFA fragment: its start state, and its end state (no transition yet)
+    typedef pair<unsigned int, unsigned int> Fragment;
+
+    vector<string>                         p_patterns;
+    bool                                   p_nocase, p_fold;
+    vector<NState>                         p_nfa;
+    vector< bitset<256> >                  p_sets;
+    vector<unsigned int>                   p_starts;
+    vector<bool>                           p_anchored;
+    unsigned char                          p_class[256], p_rep[256];
+    unsigned int                           p_classes;
+    vector<unsigned int>                   p_table;
+    vector<unsigned int>                   p_out_first;
+    vector<unsigned int>                   p_outputs;
+    vector<unsigned int>                   p_floating;
+    vector< vector<unsigned int> >         p_subsets;
+    map<vector<unsigned int>, unsigned int> p_index;
+    vector<unsigned int>                   p_stamp;
+    unsigned int                           p_mark;
+    bool                                   p_built, p_lazy;
+    unsigned int                           p_states, p_unminimized, p_epoch;
+    unsigned long long                     p_flushes;
+    unsigned int                           p_malformed;
+
+    // Parsing into NFA fragments
+    unsigned int state(int = -1);
+    Fragment set_fragment(const bitset<256> &);
+    bool alternation(const string &, unsigned int &, Fragment &);
+    bool concatenation(const string &, unsigned int &, Fragment &);
+    bool repetition(const string &, unsigned int &, unsigned int, Fragment &);
+    bool atom(const string &, unsigned int &, Fragment &);
+    bool escape(const string &, unsigned int &, bitset<256> &, bool &);
+    bool bracket(const string &, unsigned int &, bitset<256> &);
+
+    // DFA construction
+    void closure(vector<unsigned int> &);
+    void move(const vector<unsigned int> &, unsigned int, vector<unsigned int> &);
+    void accepted(const vector<unsigned int> &, vector<unsigned int> &) const;
+    unsigned int cache(const vector<unsigned int> &);
+    void flush();
+    unsigned int step(unsigned int, unsigned int, vector<unsigned int> &);
+    unsigned int report(unsigned int, unsigned int, unsigned long long, vector<PatternMatch> *) const;
+};
+
+#endif
@@ -0,0 +1,226 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef RELOAD_CPP
+#define RELOAD_CPP
+
+#include <csignal>          // sigset_t, sigtimedwait
+#include <unistd.h>         // usleep
+#include <sys/stat.h>       // stat
+
+#include "reload.h"         // Snapshot, RuleSet, RuleLoader
+#include "exceptions.h"     // EFilterSyntaxException
+
+// Default constructor: no rules
+RuleSet::RuleSet()
+  : filter(NULL), classifier(NULL), matcher(NULL), indicators(NULL), generation(0) {
+}
+
+// Destructor
+RuleSet::~RuleSet() {
+  delete filter;
+  delete classifier;
+  delete matcher;
+  delete indicators;
+}
+
+// Parameterized constructor: in-process filter expression, classifier rule
+// file, payload pattern file, payload expression file and indicator file (NULL
+// for the unused ones), then classifier range expansion and tuple granularity
+RuleLoader::RuleLoader(const char * filter, const char * rules, const char * patterns, const char * regexes,
+                       const char * indicators, unsigned int expansion, unsigned int granularity)
+  : p_filter(filter), p_rules(rules), p_patterns(patterns), p_regexes(regexes), p_indicators(indicators),
+    p_expansion(expansion), p_granularity(granularity), p_polled(false),
+    p_generation(0), p_snapshot(NULL), p_running(false), p_stop(false) {
+  for (unsigned int i = 0; i < 4; i++)
+    p_mtime[i] = 0;
+  changed();
+}
+
+// Destructor
+RuleLoader::~RuleLoader() {
+  stop();
+}
+
+// Builds a rule set from the sources. Returns NULL if a source fails to load,
+// which is then described in error and identified by failed
+RuleSet * RuleLoader::load(string & error, Source & failed) {
+  RuleSet * set = new RuleSet;
+
+  failed = rl_none;
+
+  if (p_filter != NULL) {
+    try {
+      set->filter = new PacketFilter(p_filter);
+    }
+    catch (EFilterSyntaxException & e) {
+      error  = string(e.what()) + " in filter\n  " + p_filter + "\n  " + string(e.position, ' ') + "^";
+      failed = rl_filter;
+    }
+  }
+
+  if (failed == rl_none && p_rules != NULL) {
+    set->classifier = new PacketClassifier(p_expansion, p_granularity);
+    if (set->classifier->load(p_rules) < 0) {
+      error  = string("unable to read classifier rules (") + p_rules + ")";
+      failed = rl_classifier;
+    }
+    else
+      set->classifier->build();
+  }
+
+  if (failed == rl_none && (p_patterns != NULL || p_regexes != NULL)) {
+    set->matcher = new PayloadMatcher;
+    if (p_patterns != NULL && set->matcher->load(p_patterns) < 0) {
+      error  = string("unable to load payload patterns (") + p_patterns + ")";
+      failed = rl_patterns;
+    }
+    else if (p_regexes != NULL && set->matcher->load_regexes(p_regexes) < 0) {
+      error  = string("unable to load payload expressions (") + p_regexes + ")";
+      failed = rl_regexes;
+    }
+  }
+
+  if (failed == rl_none && p_indicators != NULL) {
+    set->indicators = new IndicatorSet;
+    if (set->indicators->load(p_indicators) < 0) {
+      error  = string("unable to load indicators (") + p_indicators + ")";
+      failed = rl_indicators;
+    }
+  }
+
+  if (failed != rl_none) {
+    delete set;
+    return NULL;
+  }
+
+  set->generation = ++p_generation;
+  return set;
+}
+
+// Returns true if some rules are loaded from a source
+bool RuleLoader::reloadable() const {
+  return p_filter != NULL || p_rules != NULL || p_patterns != NULL || p_regexes != NULL || p_indicators != NULL;
+}
+
+// Updates the modification times of the files (0 for missing ones). Returns
+// true if a file changed or appeared since the previous poll, false on the
+// first poll
+bool RuleLoader::changed() {
+  const char * files[4] = { p_rules, p_patterns, p_regexes, p_indicators };
+  bool         modified = false;
+  struct stat  st;
+
+  for (unsigned int i = 0; i < 4; i++) {
+    if (files[i] == NULL)
+      continue;
+
+    time_t mtime = (stat(files[i], &st) == 0 ? st.st_mtime : 0);
+    if (mtime != p_mtime[i]) {
+      modified   = modified || (p_polled && mtime != 0);
+      p_mtime[i] = mtime;
+    }
+  }
+
+  p_polled = true;
+  return modified;
+}
+
+// Builds a new rule set and publishes it, then deletes the set it replaced
+// once the capture thread no longer holds it
+void RuleLoader::reload() {
+  string    error;
+  Source    failed;
+  RuleSet * set = load(error, failed);
+
+  if (set == NULL) {
+    cerr << "warning - rules not reloaded, " << error << endl;
+    return;
+  }
+
+  RuleSet * old = p_snapshot->publish(set);
+  cout << "*** rules reloaded (generation " << set->generation << ")" << endl;
+
+  while (!p_snapshot->reclaimable() && !p_stop)
+    usleep(1000);
+
+  // Stopping while the capture thread may still hold it: leave it be
+  if (p_snapshot->reclaimable())
+    delete old;
+}
+
+// Body of the reload thread
+void * RuleLoader::run(void * arg) {
+  RuleLoader * loader = (RuleLoader *)arg;
+  sigset_t     hup;
+  timespec     poll = { RELOAD_POLL, 0 };
+
+  sigemptyset(&hup);
+  sigaddset(&hup, SIGHUP);
+
+  while (!loader->p_stop) {
+    int sig = sigtimedwait(&hup, NULL, &poll);
+
+    if (loader->p_stop)
+      break;
+
+    if (sig == SIGHUP || loader->changed())
+      loader->reload();
+  }
+
+  return NULL;
+}
+
+// Starts the thread publishing rebuilt rule sets to given snapshot. SIGHUP
+// is blocked in the calling thread (and in the threads it creates afterwards);
+// the reload thread blocks every signal. Returns false if the thread cannot
+// be created
+bool RuleLoader::start(Snapshot<RuleSet> & snapshot) {
+  sigset_t all, hup, saved;
+
+  if (p_running)
+    return true;
+
+  sigemptyset(&hup);
+  sigaddset(&hup, SIGHUP);
+  pthread_sigmask(SIG_BLOCK, &hup, NULL);
+
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &saved);
+
+  p_snapshot = &snapshot;
+  p_stop     = false;
+  p_running  = pthread_create(&p_thread, NULL, &RuleLoader::run, this) == 0;
+
+  pthread_sigmask(SIG_SETMASK, &saved, NULL);
+
+  return p_running;
+}
+
+// Stops the reload thread, waiting for any reload in progress to complete
+void RuleLoader::stop() {
+  if (!p_running)
+    return;
+
+  p_stop = true;
+  pthread_kill(p_thread, SIGHUP);
+  pthread_join(p_thread, NULL);
+
+  p_running = false;
+}
+
+#endif
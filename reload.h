@@ -0,0 +1,220 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef RELOAD_H
+#define RELOAD_H
+
+#include <iostream>
+#include <string>
+#include <ctime>
+#include <pthread.h>
+
+#include "filter.h"             // PacketFilter
+#include "classifier.h"         // PacketClassifier
+#include "patterns.h"           // PayloadMatcher
+#include "indicators.h"         // IndicatorSet
+
+using namespace std;
+
+#define RELOAD_POLL 1           // seconds between checks of the rule files
+
+/* Snapshot: versioned pointer to a T published by a writer thread to a single
+ *   reader thread, RCU style.
+ *
+ * Attributes
+ *   p_current : version handed to the reader
+ *   p_epoch   : number of versions published
+ *   p_reader  : epoch the reader saw when entering, 0 while it holds no version
+ *
+ * Notes
+ *   1. the reader brackets each use with enter() and leave(), which only store
+ *      and load a few words: it never waits for the writer.
+ *   2. publish() swaps the pointer and bumps the epoch. The version replaced
+ *      may be deleted once reclaimable(), that is once the reader holds no
+ *      version or entered after the swap, and so cannot see it any more.
+ *   3. versions are not modified by the writer once published.
+ */
+template <class T>
+class Snapshot {
+  public:
+    Snapshot(T * = NULL);                                // parameterized constructor
+
+    T * enter();                                         // reader: current version, held until leave()
+    void leave();                                        // reader: done with the version
+    T * publish(T *);                                    // writer: replaces the version, returns the old one
+    bool reclaimable() const;                            // writer: old versions are no longer held
+    T * current() const;                                 // current version (no reader holding it)
+
+  private:
+    T *                p_current;
+    unsigned long long p_epoch;
+    unsigned long long p_reader;
+
+    // Copying is not allowed
+    Snapshot(const Snapshot &);
+    Snapshot & operator=(const Snapshot &);
+};
+
+/* SnapshotReader: holds the current version of a Snapshot for the lifetime of
+ *   the instance, so every return path of the reader leaves it.
+ */
+template <class T>
+class SnapshotReader {
+  public:
+    SnapshotReader(Snapshot<T> & s) : p_snapshot(s), p_value(s.enter()) { }
+    ~SnapshotReader() { p_snapshot.leave(); }
+
+    T * operator->() const { return p_value; }
+    T & operator*() const { return *p_value; }
+
+  private:
+    Snapshot<T> & p_snapshot;
+    T *           p_value;
+};
+
+// Parameterized constructor: initial version
+template <class T>
+Snapshot<T>::Snapshot(T * value)
+  : p_current(value), p_epoch(1), p_reader(0) {
+}
+
+// Returns the current version, which stays valid until leave() is called
+template <class T>
+T * Snapshot<T>::enter() {
+  __atomic_store_n(&p_reader, __atomic_load_n(&p_epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+  return __atomic_load_n(&p_current, __ATOMIC_SEQ_CST);
+}
+
+// Releases the version returned by enter()
+template <class T>
+void Snapshot<T>::leave() {
+  __atomic_store_n(&p_reader, 0ULL, __ATOMIC_RELEASE);
+}
+
+// Makes given version current and returns the one it replaces, which the
+// caller deletes once reclaimable() returns true
+template <class T>
+T * Snapshot<T>::publish(T * value) {
+  T * old = __atomic_exchange_n(&p_current, value, __ATOMIC_SEQ_CST);
+  __atomic_add_fetch(&p_epoch, 1, __ATOMIC_SEQ_CST);
+
+  return old;
+}
+
+// Returns true if the reader can no longer hold a version replaced before
+template <class T>
+bool Snapshot<T>::reclaimable() const {
+  unsigned long long r = __atomic_load_n(&p_reader, __ATOMIC_SEQ_CST);
+
+  return r == 0 || r == __atomic_load_n(&p_epoch, __ATOMIC_SEQ_CST);
+}
+
+// Returns the current version, for use while no reader runs
+template <class T>
+T * Snapshot<T>::current() const {
+  return __atomic_load_n(&p_current, __ATOMIC_SEQ_CST);
+}
+
+/* RuleSet: rules applied to captured datagrams, loaded together from their
+ *   sources and replaced as a whole when reloaded.
+ *
+ * Attributes
+ *   filter     : in-process filter (NULL if none)
+ *   classifier : 5-tuple rule set (NULL if none)
+ *   matcher    : payload patterns and expressions, and their per-flow scanning state (NULL if none)
+ *   indicators : listed addresses and domains (NULL if none)
+ *   generation : number of the load that built the set (1 for the first)
+ */
+struct RuleSet {
+  PacketFilter *     filter;
+  PacketClassifier * classifier;
+  PayloadMatcher *   matcher;
+  IndicatorSet *     indicators;
+  unsigned int       generation;
+
+  RuleSet();                                             // default constructor
+  ~RuleSet();                                            // destructor
+
+  private:
+    // Copying is not allowed
+    RuleSet(const RuleSet &);
+    RuleSet & operator=(const RuleSet &);
+};
+
+/* RuleLoader: builds rule sets from their sources, and rebuilds them in a
+ *   background thread when asked to or when their files change.
+ *
+ * Attributes
+ *   p_filter, p_rules, p_patterns, p_regexes, p_indicators : sources (NULL if unused)
+ *   p_expansion, p_granularity : tuning of the classifier (see PacketClassifier)
+ *   p_mtime      : modification times of the rule, pattern, expression and indicator files
+ *                  (0 if missing)
+ *   p_polled     : modification times were polled once
+ *   p_generation : number of rule sets built
+ *   p_snapshot   : snapshot the rebuilt sets are published to
+ *   p_thread, p_running, p_stop : reload thread, and its state
+ *
+ * Notes
+ *   1. the reload thread waits for SIGHUP, which must be blocked in every
+ *      thread, and checks the modification times of the files every
+ *      RELOAD_POLL seconds. Prefix tables used by the filter are only
+ *      reloaded on SIGHUP.
+ *   2. a set is built entirely before being published, so a source that no
+ *      longer loads leaves the current set in force. The capture goes on
+ *      with the current set while the new one builds.
+ *   3. the state of rule sets (counters, payload scanning of flows) starts
+ *      over with each reload. Analyzers, ARP and flow tables are not part of
+ *      rule sets and keep theirs. The BPF filter is not reloaded.
+ */
+class RuleLoader {
+  public:
+    // Source failing to load
+    typedef enum {
+      rl_none, rl_filter, rl_classifier, rl_patterns, rl_indicators, rl_regexes
+    } Source;
+
+    // Parameterized constructor
+    RuleLoader(const char *, const char *, const char *, const char *, const char *, unsigned int = 8, unsigned int = 8);
+    ~RuleLoader();                                       // destructor
+
+    RuleSet * load(string &, Source &);                  // builds a rule set from the sources
+    bool reloadable() const;                             // some rules come from a source
+
+    bool start(Snapshot<RuleSet> &);                     // starts the reload thread
+    void stop();                                         // stops the reload thread
+
+  private:
+    const char *        p_filter, * p_rules, * p_patterns, * p_regexes, * p_indicators;
+    unsigned int        p_expansion, p_granularity;
+    time_t              p_mtime[4];
+    bool                p_polled;
+    unsigned int        p_generation;
+    Snapshot<RuleSet> * p_snapshot;
+    pthread_t           p_thread;
+    bool                p_running;
+    volatile bool       p_stop;
+
+    bool changed();
+    void reload();
+    static void * run(void *);
+
+    // Copying is not allowed
+    RuleLoader(const RuleLoader &);
+    RuleLoader & operator=(const RuleLoader &);
+};
+
+#endif
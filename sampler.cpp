@@ -0,0 +1,171 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef SAMPLER_CPP
+#define SAMPLER_CPP
+
+#include <sys/time.h>       // gettimeofday
+
+#include "sampler.h"        // PacketSampler
+#include "datagramfragment.h"  // hash_long
+
+// Parameterized constructor: sampling mode, rate N (1 in N) and adaptation
+PacketSampler::PacketSampler(Mode mode, unsigned int rate, bool adaptive)
+  : p_mode(mode), p_base(rate < 1 ? 1 : (rate > SAMPLE_MAX_RATE ? SAMPLE_MAX_RATE : rate)), p_shift(0),
+    p_adaptive(adaptive), p_skip(0), p_lag(~0ULL), p_window(0), p_seen(0), p_sampled(0),
+    p_raised(0), p_lowered(0) {
+  p_peak = p_base;
+}
+
+// Hashes the canonical 5-tuple of an Ethernet frame, the same for both
+// directions. Returns false if the frame is neither IPv4 nor IPv6
+bool PacketSampler::flow_hash(const unsigned char * frame, unsigned int len, unsigned long long & hash) {
+  unsigned int off = 12;
+
+  // Skip VLAN tags
+  while (off + 4 <= len && ((frame[off] == 0x81 && frame[off+1] == 0x00) || (frame[off] == 0x88 && frame[off+1] == 0xA8)))
+    off += 4;
+
+  if (off + 2 > len)
+    return false;
+
+  unsigned int          type  = frame[off] << 8 | frame[off+1];
+  const unsigned char * ip    = frame + off + 2;
+  unsigned int          avail = len - off - 2;
+  unsigned long long    a = 0, b = 0;
+  unsigned int          proto, hlen;
+
+  if (type == 0x0800 && avail >= 20 && (ip[0] >> 4) == 4) {
+    proto = ip[9];
+    a     = (unsigned long long)ip[12] << 24 | ip[13] << 16 | ip[14] << 8 | ip[15];
+    b     = (unsigned long long)ip[16] << 24 | ip[17] << 16 | ip[18] << 8 | ip[19];
+    hlen  = (ip[0] & 0x0F) * 4;
+
+    // Fragments do not all carry the ports
+    if ((ip[6] & 0x3F) != 0 || ip[7] != 0)
+      hlen = 0;
+  }
+  else if (type == 0x86DD && avail >= 40 && (ip[0] >> 4) == 6) {
+    proto = ip[6];
+    for (unsigned int i = 0; i < 16; i++) {
+      a = a * 0x100000001B3ULL ^ ip[8 + i];
+      b = b * 0x100000001B3ULL ^ ip[24 + i];
+    }
+    hlen = 40;
+  }
+  else
+    return false;
+
+  // Add the ports of TCP, UDP and SCTP
+  if (hlen >= 20 && (proto == 6 || proto == 17 || proto == 132) && avail >= hlen + 4) {
+    a = a << 16 | (ip[hlen] << 8 | ip[hlen+1]);
+    b = b << 16 | (ip[hlen+2] << 8 | ip[hlen+3]);
+  }
+
+  // Order the endpoints so both directions agree
+  if (a > b) {
+    unsigned long long t = a;
+    a = b;
+    b = t;
+  }
+
+  hash = hash_long(hash_long(a ^ (unsigned long long)proto << 56) + b);
+  return true;
+}
+
+// Adjusts the adaptive rate to the lowest lag of a window
+void PacketSampler::adapt(unsigned long long lag) {
+  if (lag > SAMPLE_LAG_HIGH && (p_base << (p_shift + 1)) <= SAMPLE_MAX_RATE) {
+    p_shift++;
+    p_raised++;
+    if ((p_base << p_shift) > p_peak)
+      p_peak = p_base << p_shift;
+  }
+  else if (lag < SAMPLE_LAG_LOW && p_shift > 0) {
+    p_shift--;
+    p_lowered++;
+  }
+}
+
+// Returns the weight of a datagram captured at given time (us): the rate N
+// if it is sampled, 0 if it must be skipped
+unsigned int PacketSampler::sample(const unsigned char * frame, unsigned int len, unsigned long long now) {
+  p_seen++;
+
+  if (p_adaptive) {
+    timeval tv;
+    gettimeofday(&tv, NULL);
+
+    unsigned long long clock = tv.tv_sec * 1000000ULL + tv.tv_usec;
+    unsigned long long lag   = (clock > now ? clock - now : 0);
+
+    if (lag < p_lag)
+      p_lag = lag;
+
+    if (++p_window >= SAMPLE_WINDOW) {
+      adapt(p_lag);
+      p_window = 0;
+      p_lag    = ~0ULL;
+    }
+  }
+
+  unsigned int       n = p_base << p_shift;
+  unsigned long long hash;
+  bool               kept;
+
+  if (n == 1)
+    kept = true;
+  else if (p_mode == sm_flow && flow_hash(frame, len, hash))
+    kept = hash % n == 0;
+  else {
+    kept = ++p_skip >= n;
+    if (kept)
+      p_skip = 0;
+  }
+
+  if (!kept)
+    return 0;
+
+  p_sampled++;
+  return n;
+}
+
+// Returns the current rate N
+unsigned int PacketSampler::rate() const {
+  return p_base << p_shift;
+}
+
+// Returns true if the rate follows the capture lag
+bool PacketSampler::adaptive() const {
+  return p_adaptive;
+}
+
+// Output operator summarizing the sampling
+ostream & operator<<(ostream & ostr, const PacketSampler & s) {
+  ostr << "Sampling: " << (s.p_mode == PacketSampler::sm_flow ? "flows" : "datagrams") << " 1 in " << s.p_base;
+  if (s.p_adaptive)
+    ostr << " (adaptive, now 1 in " << s.rate() << ", up to 1 in " << s.p_peak << ", raised "
+         << s.p_raised << " times, lowered " << s.p_lowered << " times)";
+  ostr << endl << "  " << s.p_sampled << " of " << s.p_seen << " datagrams analyzed";
+  if (s.p_seen)
+    ostr << " (" << 100.0 * s.p_sampled / s.p_seen << "%)";
+  ostr << endl << flush;
+
+  return ostr;
+}
+
+#endif
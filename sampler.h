@@ -0,0 +1,91 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <iostream>
+
+using namespace std;
+
+#define SAMPLE_MAX_RATE 4096            // highest 1-in-N rate, adaptive or not
+#define SAMPLE_WINDOW   1024            // datagrams between adjustments of adaptive rates
+#define SAMPLE_LAG_HIGH 100000          // capture lag (us) doubling an adaptive rate
+#define SAMPLE_LAG_LOW  10000           // capture lag (us) halving it back
+
+/* PacketSampler: decides which captured datagrams are analyzed, before any
+ *   parsing, so analysis cost can be capped during floods.
+ *
+ * Attributes
+ *   p_mode     : packet (1 in N datagrams) or flow (1 in N flows, whole) sampling
+ *   p_base     : configured rate N
+ *   p_shift    : adaptive rate is p_base << p_shift (always 0 if not adaptive)
+ *   p_adaptive : rate follows the capture lag
+ *   p_skip     : datagrams skipped since the last one sampled in packet mode
+ *   p_lag      : lowest capture lag of the current window (us)
+ *   p_window   : datagrams seen in the current window
+ *   p_seen, p_sampled : datagrams seen and sampled
+ *   p_raised, p_lowered, p_peak : adaptive rate changes, and highest rate reached
+ *
+ * Notes
+ *   1. a sampled datagram stands for N datagrams: sample() returns N, which
+ *      analyzers use as the weight of their counts so statistics estimate the
+ *      whole traffic. Distinct counts (sketches) and detector thresholds are
+ *      not scaled.
+ *   2. flow sampling keeps a datagram if the hash of its canonical 5-tuple is
+ *      a multiple of N, so both directions of a flow are kept or dropped
+ *      together and stateful analyzers see flows whole. Rates are N << k, so
+ *      flows kept at a high rate were also kept at the lower ones. Frames
+ *      other than IPv4 and IPv6 are sampled 1 in N; fragments are sampled on
+ *      addresses only. The outer header of tunnels is used.
+ *   3. the lag is the time between capture and processing, which grows when
+ *      the ring buffer backs up. The lowest lag of each window of
+ *      SAMPLE_WINDOW datagrams doubles the rate above SAMPLE_LAG_HIGH, and
+ *      halves it back toward N below SAMPLE_LAG_LOW. Read timeouts delay
+ *      single datagrams, not all of a window.
+ */
+class PacketSampler {
+  public:
+    // Sampling modes
+    typedef enum {
+      sm_packet, sm_flow
+    } Mode;
+
+    PacketSampler(Mode, unsigned int, bool = false);     // parameterized constructor
+
+    unsigned int sample(const unsigned char *, unsigned int, unsigned long long);  // weight of a datagram, 0 if skipped
+    unsigned int rate() const;                           // current rate N
+    bool adaptive() const;                               // rate follows the capture lag
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, const PacketSampler &);
+
+  private:
+    Mode               p_mode;
+    unsigned int       p_base, p_shift;
+    bool               p_adaptive;
+    unsigned int       p_skip;
+    unsigned long long p_lag;
+    unsigned int       p_window;
+    unsigned long long p_seen, p_sampled;
+    unsigned int       p_raised, p_lowered, p_peak;
+
+    static bool flow_hash(const unsigned char *, unsigned int, unsigned long long &);
+    void adapt(unsigned long long);
+};
+
+#endif
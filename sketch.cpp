@@ -0,0 +1,404 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef SKETCH_CPP
+#define SKETCH_CPP
+
+#include <cmath>         // pow, log
+#include <algorithm>     // lower_bound, partial_sort
+#include <set>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>   // SSE2 intrinsics
+#endif
+
+#include "sketch.h"      // CountMinSketch, HyperLogLog, TrafficSketches
+
+// Parameterized constructor: number of counters per row (rounded up to a
+// power of two) and number of rows
+CountMinSketch::CountMinSketch(unsigned int width, unsigned int depth)
+  : p_depth(depth ? depth : 1), p_total(0) {
+  p_width = 1;
+  while (p_width < width)
+    p_width <<= 1;
+
+  p_counters = new unsigned int[p_width * p_depth];
+  clear();
+}
+
+// Destructor
+CountMinSketch::~CountMinSketch() {
+  delete [] p_counters;
+}
+
+// Resets all counters
+void CountMinSketch::clear() {
+  memset(p_counters, 0, p_width * p_depth * sizeof(unsigned int));
+  p_total = 0;
+}
+
+// Adds given count to key, with conservative update: each counter of the key
+// is only raised up to the new estimate
+void CountMinSketch::add(unsigned long long key, unsigned int count) {
+  unsigned long long h  = hash_long(key);
+  unsigned int       h1 = (unsigned int)h, h2 = (unsigned int)(h >> 32) | 1;
+  unsigned int *     cell[32];
+  unsigned int       rows = (p_depth < 32 ? p_depth : 32);
+  unsigned long long low  = 0xFFFFFFFFULL;
+
+  // Rows are indexed by h1 + i * h2 (double hashing)
+  for (unsigned int i = 0; i < rows; i++) {
+    cell[i] = p_counters + i * p_width + ((h1 + i * h2) & (p_width - 1));
+    if (*cell[i] < low)
+      low = *cell[i];
+  }
+
+  unsigned long long target = low + count;
+  if (target > 0xFFFFFFFFULL)
+    target = 0xFFFFFFFFULL;
+
+  for (unsigned int i = 0; i < rows; i++)
+    if (*cell[i] < target)
+      *cell[i] = (unsigned int)target;
+
+  p_total += count;
+}
+
+// Returns the estimated count of key (never below the actual count)
+unsigned long long CountMinSketch::estimate(unsigned long long key) const {
+  unsigned long long h  = hash_long(key);
+  unsigned int       h1 = (unsigned int)h, h2 = (unsigned int)(h >> 32) | 1;
+  unsigned int       rows = (p_depth < 32 ? p_depth : 32);
+  unsigned long long low  = 0xFFFFFFFFULL;
+
+  for (unsigned int i = 0; i < rows; i++) {
+    unsigned int c = p_counters[i * p_width + ((h1 + i * h2) & (p_width - 1))];
+    if (c < low)
+      low = c;
+  }
+
+  return low;
+}
+
+// Adds the counters of another sketch of same dimensions. Returns false if
+// dimensions differ
+bool CountMinSketch::merge(const CountMinSketch & cms) {
+  if (cms.p_width != p_width || cms.p_depth != p_depth)
+    return false;
+
+  for (unsigned int i = 0; i < p_width * p_depth; i++) {
+    unsigned long long sum = (unsigned long long)p_counters[i] + cms.p_counters[i];
+    p_counters[i] = (sum > 0xFFFFFFFFULL ? 0xFFFFFFFFU : (unsigned int)sum);
+  }
+
+  p_total += cms.p_total;
+
+  return true;
+}
+
+// Returns the sum of all counts added
+unsigned long long CountMinSketch::total() const {
+  return p_total;
+}
+
+// Parameterized constructor: precision (number of register index bits)
+HyperLogLog::HyperLogLog(unsigned int precision) {
+  p_precision = (precision < 4 ? 4 : (precision > 16 ? 16 : precision));
+}
+
+// Returns true if the instance is in sparse mode
+bool HyperLogLog::sparse() const {
+  return p_dense.empty();
+}
+
+// Returns the number of bytes used by registers
+unsigned int HyperLogLog::memory() const {
+  return sparse() ? p_sparse.capacity() * sizeof(unsigned int) : p_dense.size();
+}
+
+// Forgets all keys and releases register memory
+void HyperLogLog::clear() {
+  vector<unsigned int>().swap(p_sparse);
+  vector<unsigned char>().swap(p_dense);
+}
+
+// Switches to dense mode
+void HyperLogLog::densify() {
+  p_dense.assign(1U << p_precision, 0);
+
+  for (unsigned int i = 0; i < p_sparse.size(); i++)
+    p_dense[p_sparse[i] >> 8] = p_sparse[i] & 0xFF;
+
+  vector<unsigned int>().swap(p_sparse);
+}
+
+// Raises given register to given value, if lower. Returns true if the
+// register was raised
+bool HyperLogLog::set(unsigned int idx, unsigned int value) {
+  if (!sparse()) {
+    if (p_dense[idx] >= value)
+      return false;
+    p_dense[idx] = value;
+    return true;
+  }
+
+  // Pairs are sorted by register: the value byte does not affect the order
+  vector<unsigned int>::iterator it = lower_bound(p_sparse.begin(), p_sparse.end(), idx << 8);
+
+  if (it != p_sparse.end() && (*it >> 8) == idx) {
+    if ((*it & 0xFF) >= value)
+      return false;
+    *it = idx << 8 | value;
+  }
+  else {
+    p_sparse.insert(it, idx << 8 | value);
+
+    // Pairs use 4 bytes: switch once they would use as much as dense registers
+    if (p_sparse.size() * 4 >= (1U << p_precision))
+      densify();
+  }
+
+  return true;
+}
+
+// Adds given key. Returns true if a register was raised, i.e. the estimate
+// changed
+bool HyperLogLog::add(unsigned long long key) {
+  unsigned long long h   = hash_long(key);
+  unsigned int       idx = (unsigned int)(h >> (64 - p_precision));
+  unsigned long long w   = h << p_precision;
+  unsigned int       rho = 1;   // position of the leftmost one of the remaining bits
+
+  while (rho <= 64 - p_precision && !(w & 0x8000000000000000ULL)) {
+    w <<= 1;
+    rho++;
+  }
+
+  return set(idx, rho);
+}
+
+// Returns the estimated number of distinct keys added
+double HyperLogLog::estimate() const {
+  unsigned int m     = 1U << p_precision;
+  unsigned int zeros = m;
+  double       sum   = 0.0;
+
+  if (sparse()) {
+    for (unsigned int i = 0; i < p_sparse.size(); i++)
+      sum += pow(2.0, -(double)(p_sparse[i] & 0xFF));
+    zeros = m - p_sparse.size();
+    sum  += zeros;
+  }
+  else {
+    zeros = 0;
+    for (unsigned int i = 0; i < m; i++) {
+      sum += pow(2.0, -(double)p_dense[i]);
+      if (p_dense[i] == 0)
+        zeros++;
+    }
+  }
+
+  double alpha = (m == 16 ? 0.673 : (m == 32 ? 0.697 : (m == 64 ? 0.709 : 0.7213 / (1.0 + 1.079 / m))));
+  double e     = alpha * m * m / sum;
+
+  // Small cardinalities: linear counting over empty registers is more accurate
+  if (e <= 2.5 * m && zeros > 0)
+    e = m * log((double)m / zeros);
+
+  return e;
+}
+
+// Merges the keys of another instance of same precision. Returns false if
+// precisions differ
+bool HyperLogLog::merge(const HyperLogLog & hll) {
+  if (hll.p_precision != p_precision)
+    return false;
+
+  if (hll.sparse()) {
+    for (unsigned int i = 0; i < hll.p_sparse.size(); i++)
+      set(hll.p_sparse[i] >> 8, hll.p_sparse[i] & 0xFF);
+    return true;
+  }
+
+  if (sparse())
+    densify();
+
+  unsigned int          m   = 1U << p_precision;
+  unsigned char *       dst = &p_dense[0];
+  const unsigned char * src = &hll.p_dense[0];
+  unsigned int          i   = 0;
+
+  // Registers are bytes: take their maximum 16 at a time
+#if defined(__SSE2__)
+  for (; i + 16 <= m; i += 16)
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_max_epu8(_mm_loadu_si128((const __m128i *)(dst + i)),
+                                                        _mm_loadu_si128((const __m128i *)(src + i))));
+#endif
+
+  for (; i < m; i++)
+    if (dst[i] < src[i])
+      dst[i] = src[i];
+
+  return true;
+}
+
+// Parameterized constructor: interval length in microseconds and number of
+// addresses tracked per statistic
+TrafficSketches::TrafficSketches(unsigned long long interval, unsigned int addresses)
+  : p_sources_per_dst(addresses), p_ports_per_src(addresses), p_bytes_per_net(8192, 4),
+    p_sources(14), p_destinations(14), p_interval(interval), p_start(0) {
+}
+
+// Returns true if the current interval is over at given time
+bool TrafficSketches::expired(unsigned long long now) const {
+  return p_start != 0 && now - p_start >= p_interval;
+}
+
+// Forgets all statistics and starts a new interval at given time
+void TrafficSketches::reset(unsigned long long now) {
+  p_sources_per_dst.clear();
+  p_ports_per_src.clear();
+  p_bytes_per_net.clear();
+  p_sources.clear();
+  p_destinations.clear();
+
+  p_start = now;
+}
+
+// Returns the key of a per-address table entry
+static FlowKey address_key(unsigned int ip) {
+  FlowKey key;
+
+  key.a_ip = ip;
+
+  return key;
+}
+
+// Counts a dissected packet of given wire size, captured at given time. A
+// sampled packet stands for weight packets in byte counts; distinct counts
+// are not scaled
+void TrafficSketches::add(const PacketMeta & meta, unsigned int len, unsigned long long now, unsigned int weight) {
+  if (p_start == 0)
+    p_start = now;   // first interval starts with the first packet
+
+  if (!meta.has_ip)
+    return;
+
+  bool               created;
+  unsigned long long scaled = (unsigned long long)len * weight;
+  unsigned int       bytes  = (scaled > 0xFFFFFFFFULL ? 0xFFFFFFFFU : (unsigned int)scaled);
+
+  p_sources.add(meta.src_ip);
+  p_destinations.add(meta.dst_ip);
+
+  p_sources_per_dst.insert(address_key(meta.dst_ip), now, created)->add(meta.src_ip);
+  p_ports_per_src.insert(address_key(meta.src_ip), now, created)->add(meta.protocol << 16 | meta.dport);
+
+  p_bytes_per_net.add(meta.src_ip >> 8, bytes);
+  if ((meta.dst_ip >> 8) != (meta.src_ip >> 8))
+    p_bytes_per_net.add(meta.dst_ip >> 8, bytes);
+}
+
+// Merges the statistics of another instance (e.g. of another worker)
+void TrafficSketches::merge(TrafficSketches & ts) {
+  bool created;
+
+  for (unsigned int i = 0; i < ts.p_sources_per_dst.capacity(); i++) {
+    FlowTable<HyperLogLog>::Entry & e = ts.p_sources_per_dst.entry(i);
+    if (e.last_seen != 0)
+      p_sources_per_dst.insert(e.key, e.last_seen, created)->merge(e.value);
+  }
+
+  for (unsigned int i = 0; i < ts.p_ports_per_src.capacity(); i++) {
+    FlowTable<HyperLogLog>::Entry & e = ts.p_ports_per_src.entry(i);
+    if (e.last_seen != 0)
+      p_ports_per_src.insert(e.key, e.last_seen, created)->merge(e.value);
+  }
+
+  p_bytes_per_net.merge(ts.p_bytes_per_net);
+  p_sources.merge(ts.p_sources);
+  p_destinations.merge(ts.p_destinations);
+
+  if (p_start == 0 || (ts.p_start != 0 && ts.p_start < p_start))
+    p_start = ts.p_start;
+}
+
+// Comparison function ordering (estimate, key) pairs by decreasing estimate
+static bool larger(const pair<double, unsigned int> & a, const pair<double, unsigned int> & b) {
+  return a.first > b.first;
+}
+
+// Displays the SKETCH_TOP_K addresses with largest estimates of a table
+static void show_top(ostream & ostr, FlowTable<HyperLogLog> & table, const char * title) {
+  vector< pair<double, unsigned int> > ranks;
+
+  for (unsigned int i = 0; i < table.capacity(); i++)
+    if (table.entry(i).last_seen != 0)
+      ranks.push_back(make_pair(table.entry(i).value.estimate(), table.entry(i).key.a_ip));
+
+  unsigned int k = (ranks.size() < SKETCH_TOP_K ? ranks.size() : SKETCH_TOP_K);
+  partial_sort(ranks.begin(), ranks.begin() + k, ranks.end(), larger);
+
+  ostr << title << endl;
+  for (unsigned int i = 0; i < k; i++) {
+    char outstr[32];
+    unsigned int ip = ranks[i].second;
+
+    sprintf(outstr, "%u.%u.%u.%u", ip >> 24, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF);
+    ostr << "  " << outstr << " : " << (unsigned long long)(ranks[i].first + 0.5) << endl;
+  }
+}
+
+// Output operator displaying the statistics of the current interval
+ostream & operator<<(ostream & ostr, TrafficSketches & ts) {
+  ostr << "distinct sources = " << (unsigned long long)(ts.p_sources.estimate() + 0.5)
+       << ", distinct destinations = " << (unsigned long long)(ts.p_destinations.estimate() + 0.5) << endl;
+
+  show_top(ostr, ts.p_sources_per_dst, "top destinations by distinct sources");
+  show_top(ostr, ts.p_ports_per_src, "top sources by distinct destination ports");
+
+  // The networks of tracked addresses are the candidates for the largest volumes
+  set<unsigned int> nets;
+  for (unsigned int i = 0; i < ts.p_sources_per_dst.capacity(); i++)
+    if (ts.p_sources_per_dst.entry(i).last_seen != 0)
+      nets.insert(ts.p_sources_per_dst.entry(i).key.a_ip >> 8);
+  for (unsigned int i = 0; i < ts.p_ports_per_src.capacity(); i++)
+    if (ts.p_ports_per_src.entry(i).last_seen != 0)
+      nets.insert(ts.p_ports_per_src.entry(i).key.a_ip >> 8);
+
+  vector< pair<double, unsigned int> > ranks;
+  for (set<unsigned int>::iterator it = nets.begin(); it != nets.end(); it++)
+    ranks.push_back(make_pair((double)ts.p_bytes_per_net.estimate(*it), *it));
+
+  unsigned int k = (ranks.size() < SKETCH_TOP_K ? ranks.size() : SKETCH_TOP_K);
+  partial_sort(ranks.begin(), ranks.begin() + k, ranks.end(), larger);
+
+  ostr << "top /24 networks by bytes" << endl;
+  for (unsigned int i = 0; i < k; i++) {
+    char outstr[32];
+    unsigned int net = ranks[i].second;
+
+    sprintf(outstr, "%u.%u.%u.0/24", net >> 16, (net >> 8) & 0xFF, net & 0xFF);
+    ostr << "  " << outstr << " : " << (unsigned long long)ranks[i].first << endl;
+  }
+
+  ostr << flush;
+
+  return ostr;
+}
+
+#endif
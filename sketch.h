@@ -0,0 +1,145 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <iostream>
+#include <vector>
+
+#include "packetmeta.h"         // PacketMeta
+#include "flowtable.h"          // FlowTable
+
+using namespace std;
+
+#define SKETCH_TOP_K 10         // number of keys displayed per statistic
+
+/* CountMinSketch: approximate per-key counters in fixed memory.
+ *
+ * Attributes
+ *   p_counters : depth rows of width counters
+ *   p_width    : number of counters per row (power of two)
+ *   p_depth    : number of rows
+ *   p_total    : sum of all counts added
+ *
+ * Notes
+ *   1. estimates never undercount. With conservative update, a count only
+ *      raises the counters of its key that are below the new estimate, which
+ *      reduces the overestimation caused by colliding keys.
+ *   2. sketches of same dimensions may be merged (e.g. per-thread sketches);
+ *      merged counters add up, preserving the no-undercount property.
+ */
+class CountMinSketch {
+  public:
+    CountMinSketch(unsigned int = 2048, unsigned int = 4);   // parameterized constructor
+    ~CountMinSketch();                                       // destructor
+
+    void add(unsigned long long, unsigned int = 1);          // adds a count to key
+    unsigned long long estimate(unsigned long long) const;   // returns estimated count of key
+    bool merge(const CountMinSketch &);                      // adds the counts of another sketch
+    void clear();                                            // resets all counters
+
+    unsigned long long total() const;                        // sum of all counts added
+
+  private:
+    unsigned int *     p_counters;
+    unsigned int       p_width, p_depth;
+    unsigned long long p_total;
+
+    // Copying is not allowed
+    CountMinSketch(const CountMinSketch &);
+    CountMinSketch & operator=(const CountMinSketch &);
+};
+
+/* HyperLogLog: approximate count of distinct keys.
+ *
+ * Attributes
+ *   p_precision : number of hash bits selecting a register (4 to 16)
+ *   p_sparse    : sorted (register << 8 | value) pairs of non-zero registers
+ *   p_dense     : one byte per register (empty while sparse)
+ *
+ * Notes
+ *   1. the standard error is 1.04 / sqrt(2^precision): about 3% for the
+ *      default precision of 10, 0.8% for a precision of 14.
+ *   2. a new instance only stores the registers it sets (sparse mode). It
+ *      switches to 2^precision bytes of registers (dense mode) once its 4-byte
+ *      pairs would use as much, so large numbers of mostly small instances
+ *      stay cheap. Memory never exceeds the dense size.
+ *   3. instances of same precision may be merged (e.g. per-thread instances):
+ *      dense registers are merged 16 at a time when SSE2 is available.
+ */
+class HyperLogLog {
+  public:
+    HyperLogLog(unsigned int = 10);                          // parameterized constructor
+
+    bool add(unsigned long long);                            // adds a key, returns true if the estimate changed
+    double estimate() const;                                 // returns estimated number of distinct keys
+    bool merge(const HyperLogLog &);                         // merges the keys of another instance
+    void clear();                                            // forgets all keys, back to sparse mode
+
+    bool sparse() const;                                     // instance is in sparse mode
+    unsigned int memory() const;                             // bytes used by registers
+
+  private:
+    unsigned int          p_precision;
+    vector<unsigned int>  p_sparse;
+    vector<unsigned char> p_dense;
+
+    bool set(unsigned int, unsigned int);                    // raises a register to given value
+    void densify();                                          // switches to dense mode
+};
+
+/* TrafficSketches: per-interval cardinality and volume statistics built on
+ *   sketches.
+ *
+ * Attributes
+ *   p_sources_per_dst : distinct source addresses of each destination
+ *   p_ports_per_src   : distinct destination ports (and protocols) of each source
+ *   p_bytes_per_net   : bytes sent to or from each /24 network
+ *   p_sources, p_destinations : distinct addresses over the interval
+ *   p_interval        : interval length in microseconds
+ *   p_start           : start time of the current interval (0 until first packet)
+ *
+ * Notes
+ *   1. per-address estimators live in bounded flow tables, so the number of
+ *      tracked addresses is capped; the least recently seen ones are evicted.
+ */
+class TrafficSketches {
+  public:
+    TrafficSketches(unsigned long long = 10000000, unsigned int = 16384);  // parameterized constructor
+
+    bool expired(unsigned long long) const;              // current interval is over at given time
+    void reset(unsigned long long);                      // starts a new interval at given time
+    void add(const PacketMeta &, unsigned int, unsigned long long, unsigned int = 1);  // counts a dissected packet
+    void merge(TrafficSketches &);                       // merges the statistics of another instance
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, TrafficSketches &);
+
+  private:
+    FlowTable<HyperLogLog> p_sources_per_dst;
+    FlowTable<HyperLogLog> p_ports_per_src;
+    CountMinSketch         p_bytes_per_net;
+    HyperLogLog            p_sources, p_destinations;
+    unsigned long long     p_interval, p_start;
+
+    // Copying is not allowed
+    TrafficSketches(const TrafficSketches &);
+    TrafficSketches & operator=(const TrafficSketches &);
+};
+
+#endif
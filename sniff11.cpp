@@ -33,6 +33,32 @@
 #include "ippacket.h"          // IPPacket
 #include "arppacket.h"         // ARPPacket
 #include "icmppacket.h"        // ICMPPacket
+#include "tcpsegment.h"        // TCPSegment
+#include "udpsegment.h"        // UDPSegment
+#include "dns.h"               // DNSMessage, DNSTransactionTable
+#include "http.h"              // HTTPFlow
+#include "tls.h"               // TLSAnalyzer
+#include "packetmeta.h"        // PacketMeta
+#include "tcplatency.h"        // TCPLatencyAnalyzer
+#include "tcpretrans.h"        // TCPRetransAnalyzer
+#include "heavyhitters.h"      // TopTalkers
+#include "sketch.h"            // TrafficSketches
+#include "portscan.h"          // PortScanDetector
+#include "synflood.h"          // SynFloodDetector
+#include "icmpcorrelator.h"    // ICMPCorrelator
+#include "tftpsession.h"       // TFTPSessionTracker
+#include "timeseries.h"        // TimeSeries
+#include "protohierarchy.h"    // ProtocolHierarchy
+#include "filter.h"            // PacketFilter
+#include "bpfgen.h"            // BPFGenerator
+#include "classifier.h"        // PacketClassifier
+#include "flowtable.h"         // FlowKey, FlowTable
+#include "patterns.h"          // PayloadMatcher
+#include "regexset.h"          // RegexSet
+#include "indicators.h"        // IndicatorSet
+#include "reload.h"            // Snapshot, RuleSet, RuleLoader
+#include "sampler.h"           // PacketSampler
+#include "tap.h"               // PacketTap
 
 using namespace std;
 
@@ -40,10 +66,29 @@ pcap_t        *pcap_session = NULL;   // libpcap session handle
 
 char          *strfilter = NULL;      // textual BPF filter
 bpf_program    binfilter;             // compiled BPF filter program
+Snapshot<RuleSet> rule_snapshot;      // filter, classifier, patterns and indicators in force
+RuleLoader    *rule_loader = NULL;    // rebuilds the rules on SIGHUP or when their files change
 
 pcap_dumper_t *logfile = NULL;        // file descriptor for datagram logging
+FILE          *seriesfile = NULL;     // file receiving time series records
 
 unsigned int capture_count = 0;       // count of captured datagrams
+PacketSampler *sampler = NULL;        // datagrams analyzed, decided before dissection
+PacketTap     *packet_tap = NULL;     // filtered outputs fed with every dissected datagram
+
+DNSTransactionTable *dns_transactions = NULL;   // DNS query/response pairing
+FlowTable<HTTPFlow>  *http_flows = NULL;         // HTTP header scanning per flow
+TLSAnalyzer          *tls_analyzer = NULL;       // TLS handshake summaries per flow
+TCPLatencyAnalyzer   *rtt_analyzer = NULL;       // TCP handshake and RTT measurements
+TCPRetransAnalyzer   *retrans_analyzer = NULL;   // TCP retransmission and window events
+TopTalkers           *top_talkers = NULL;        // heavy hitters per interval
+TrafficSketches      *traffic_sketches = NULL;   // cardinality and volume sketches per interval
+PortScanDetector     *port_scans = NULL;         // port scan and host sweep detection
+SynFloodDetector     *syn_floods = NULL;         // SYN flood detection
+ICMPCorrelator       *icmp_correlator = NULL;    // ICMP errors attached to their flows
+TFTPSessionTracker   *tftp_sessions = NULL;      // TFTP transfer reconstruction
+TimeSeries           *time_series = NULL;        // protocol counters per interval
+ProtocolHierarchy    *protocol_hierarchy = NULL; // protocol hierarchy statistics
 
 // Function releasing all resources before ending program execution
 void shutdown(int error_code) {
@@ -62,6 +107,114 @@ void shutdown(int error_code) {
   // Display the total number of datagrams captured
   cout << "*** " << capture_count << " datagrams captured" << endl;
 
+  if (sampler != NULL) {
+    cout << *sampler;
+    delete sampler;
+  }
+
+  // Complete the outputs of the tap subscriptions
+  if (packet_tap != NULL) {
+    packet_tap->close();
+    cout << *packet_tap;
+    delete packet_tap;
+  }
+
+  // Stop reloading the rules before reporting on them
+  if (rule_loader != NULL) {
+    rule_loader->stop();
+    delete rule_loader;
+  }
+
+  RuleSet *rules = rule_snapshot.publish(NULL);
+
+  if (rules != NULL && rules->generation > 1)
+    cout << "*** rules reloaded " << rules->generation - 1 << " times, counters since last reload" << endl;
+
+  if (rules != NULL && rules->filter != NULL)
+    cout << "*** " << rules->filter->rejected() << " datagrams rejected by in-process filter" << endl;
+
+  if (rules != NULL && rules->classifier != NULL)
+    cout << *rules->classifier;
+
+  // Display the reports of enabled analyzers
+  if (dns_transactions != NULL) {
+    cout << *dns_transactions;
+    delete dns_transactions;
+  }
+
+  if (http_flows != NULL) {
+    cout << "HTTP flows tracked = " << http_flows->count() << ", evicted = "
+         << http_flows->evicted() << endl;
+    delete http_flows;
+  }
+
+  if (tls_analyzer != NULL) {
+    cout << *tls_analyzer;
+    delete tls_analyzer;
+  }
+
+  if (rtt_analyzer != NULL) {
+    cout << *rtt_analyzer;
+    delete rtt_analyzer;
+  }
+
+  if (retrans_analyzer != NULL) {
+    cout << *retrans_analyzer;
+    delete retrans_analyzer;
+  }
+
+  if (top_talkers != NULL) {
+    cout << *top_talkers;
+    delete top_talkers;
+  }
+
+  if (traffic_sketches != NULL) {
+    cout << *traffic_sketches;
+    delete traffic_sketches;
+  }
+
+  if (port_scans != NULL) {
+    cout << *port_scans;
+    delete port_scans;
+  }
+
+  if (syn_floods != NULL) {
+    cout << *syn_floods;
+    delete syn_floods;
+  }
+
+  if (icmp_correlator != NULL) {
+    cout << *icmp_correlator;
+    delete icmp_correlator;
+  }
+
+  if (tftp_sessions != NULL) {
+    cout << *tftp_sessions;
+    delete tftp_sessions;
+  }
+
+  if (time_series != NULL) {
+    time_series->flush();
+    cout << *time_series;
+    delete time_series;
+  }
+
+  if (seriesfile != NULL)
+    fclose(seriesfile);
+
+  if (protocol_hierarchy != NULL) {
+    cout << *protocol_hierarchy;
+    delete protocol_hierarchy;
+  }
+
+  if (rules != NULL && rules->matcher != NULL)
+    cout << *rules->matcher;
+
+  if (rules != NULL && rules->indicators != NULL)
+    cout << "Indicators: " << *rules->indicators;
+
+  delete rules;
+
   exit(error_code); // we're done!
 }
 
@@ -72,29 +225,242 @@ void bypass_sigint(int sig_no) {
   shutdown(0); // we're done!
 }
 
+volatile sig_atomic_t phs_requested = 0;  // protocol hierarchy report requested by SIGUSR1
+
+// SIGUSR1 handler: the report is displayed by the capture callback, between
+// two datagrams, so capture goes on
+void request_phs(int) {
+  phs_requested = 1;
+}
+
 bool show_raw   = false;          // deactivate raw display of data captured
 bool quiet_mode = false;          // controls whether the callback display captured datagrams or not
 int  security_tool = 0;           // security tool to apply
+int  analyzers = 0;               // traffic analyzers to apply (bit mask)
 
 #define ARPSPOOF 1
+#define PORTSCAN 2
+#define SYNFLOOD 3
+
+#define AN_DNS     0x0001         // DNS query/response pairing
+#define AN_HTTP    0x0002         // HTTP request/response header scanning
+#define AN_TLS     0x0004         // TLS hello decoding and fingerprinting
+#define AN_RTT     0x0008         // TCP handshake and RTT measurement
+#define AN_RETRANS 0x0010         // TCP retransmission and window events
+#define AN_TOP     0x0020         // top talkers (heavy hitters) per interval
+#define AN_SKETCH  0x0040         // cardinality and volume sketches per interval
+#define AN_ICMP    0x0080         // ICMP error correlation to flows
+#define AN_TFTP    0x0100         // TFTP transfer reconstruction
+#define AN_SERIES  0x0200         // protocol counters per 1, 10 and 60 seconds interval
+#define AN_PHS     0x0400         // protocol hierarchy statistics
 
 // Macro replacing cout to apply conditional display in callback
 #define COUT if (!quiet_mode) cout
 
+// Applies payload analyzers to the innermost flow of a dissected frame
+void analyze_flow(PacketMeta & meta, unsigned long long now, RuleSet & rules) {
+  // TCP analyzers work on the flow the segment belongs to
+  if (meta.has_tcp) {
+    unsigned int dir = FlowKey::direction(meta.src_ip, meta.dst_ip, meta.sport, meta.dport);
+    FlowKey      key(meta.src_ip, meta.dst_ip, meta.sport, meta.dport, meta.protocol);
+
+    // Time the handshake and data acknowledgments
+    if (rtt_analyzer != NULL) {
+      const TCPLatencyFlow *flow = rtt_analyzer->process(key, dir, meta.tcp, meta.payload_len, now);
+
+      if (flow != NULL)
+        COUT << "------ TCP handshake ------" << endl << *flow;
+    }
+
+    // Classify retransmissions and window events
+    if (retrans_analyzer != NULL) {
+      unsigned int classes = retrans_analyzer->process(key, dir, meta.tcp, meta.payload_len, now);
+
+      if (classes != 0) {
+        COUT << "TCP analysis =";
+        if (classes & TCPR_RETRANSMISSION) COUT << " retransmission";
+        if (classes & TCPR_OUT_OF_ORDER)   COUT << " out-of-order";
+        if (classes & TCPR_DUP_ACK)        COUT << " duplicate-ACK";
+        if (classes & TCPR_ZERO_WINDOW)    COUT << " zero-window";
+        if (classes & TCPR_WINDOW_PROBE)   COUT << " window-probe";
+        COUT << endl << "flow " << *retrans_analyzer->counters(key) << endl;
+      }
+
+      if (retrans_analyzer->closed_interval() != NULL)
+        COUT << "------ TCP interval ------" << endl << *retrans_analyzer->closed_interval() << endl;
+    }
+
+    // Scan HTTP headers of the flow's payloads
+    if (http_flows != NULL && meta.payload != NULL &&
+        (meta.sport == 80 || meta.dport == 80 || meta.sport == 8080 || meta.dport == 8080)) {
+      bool      created;
+      HTTPFlow *flow = http_flows->insert(key, now, created);
+
+      if (flow->feed(dir, meta.tcp.sequence_nb(), meta.payload, meta.payload_len) > 0) {
+        if (analyzers & AN_HTTP)
+          COUT << "------ HTTP header ------" << endl << flow->record;
+
+        if (rules.indicators != NULL && flow->record.host[0] != '\0' && rules.indicators->contains(flow->record.host))
+          cout << endl << "**** ALERT - Listed indicator seen ****" << endl
+                       << "     HTTP host " << flow->record.host << endl << endl;
+      }
+    }
+
+    // Decode TLS hellos found in the first payloads of the flow
+    if (tls_analyzer != NULL && meta.payload != NULL) {
+      const TLSFlow *flow = tls_analyzer->process(key, dir, meta.payload, meta.payload_len, now);
+
+      if (flow != NULL) {
+        if (analyzers & AN_TLS)
+          COUT << "------ TLS handshake ------" << endl << *flow;
+
+        if (rules.indicators != NULL && flow->sni[0] != '\0' && rules.indicators->contains(flow->sni))
+          cout << endl << "**** ALERT - Listed indicator seen ****" << endl
+                       << "     TLS server name " << flow->sni << endl << endl;
+      }
+    }
+  }
+
+  // Attach ICMP errors to the flows they quote
+  if (icmp_correlator != NULL) {
+    FlowKey               key;
+    const ICMPFlowEvents *events;
+
+    switch (icmp_correlator->process(meta, now, key, events)) {
+      case ICMPCorrelator::icmpc_none :
+        break;
+      case ICMPCorrelator::icmpc_blackhole :
+        COUT << "------ PMTU black hole suspected ------" << endl << "flow " << key << endl << *events;
+        break;
+      case ICMPCorrelator::icmpc_loop :
+        COUT << "------ Routing loop suspected ------" << endl << "flow " << key << endl << *events;
+        break;
+      default :
+        COUT << "------ ICMP error of flow ------" << endl << "flow " << key << endl << *events;
+        break;
+    }
+  }
+
+  // Search payloads for patterns, TCP ones across the segments of their flow
+  if (rules.matcher != NULL && meta.payload != NULL && (meta.has_tcp || meta.has_udp)) {
+    static vector<PatternMatch> matches;
+
+    matches.clear();
+    if (meta.has_tcp)
+      rules.matcher->process(FlowKey(meta.src_ip, meta.dst_ip, meta.sport, meta.dport, meta.protocol),
+                             FlowKey::direction(meta.src_ip, meta.dst_ip, meta.sport, meta.dport),
+                             meta.tcp, meta.payload, meta.payload_len, now, matches);
+    else
+      rules.matcher->process(meta.payload, meta.payload_len, matches);
+
+    if (!matches.empty()) {
+      COUT << "------ Payload patterns ------" << endl;
+      for (unsigned int i = 0; i < matches.size(); i++)
+        COUT << "#" << (matches[i].pattern & ~PATTERN_REGEX) << " \"" << rules.matcher->printable(matches[i].pattern)
+             << "\" ending at byte " << matches[i].end << endl;
+    }
+  }
+
+  // Follow TFTP transfers from their request to their last block
+  if (tftp_sessions != NULL && meta.has_udp) {
+    const TFTPTransfer *transfer = tftp_sessions->process(meta, now);
+
+    if (transfer != NULL)
+      COUT << "------ TFTP transfer ------" << endl << *transfer;
+  }
+
+  // Decode DNS messages and pair queries with their responses
+  if (meta.has_udp && (meta.sport == 53 || meta.dport == 53)) {
+    DNSMessage dns = meta.udp.dns();
+
+    if (dns.valid()) {
+      COUT << "---------- DNS message ----------" << endl << dns;
+
+      // Flag queries for listed domains
+      if (rules.indicators != NULL && !dns.is_response()) {
+        char         name[DNS_MAX_NAME];
+        unsigned int pos = dns.first_question();
+        DNSQuestion  q;
+
+        for (unsigned int i = 0; i < dns.qdcount() && dns.next_question(pos, q, name, sizeof(name)); i++)
+          if (rules.indicators->contains(name))
+            cout << endl << "**** ALERT - Listed indicator seen ****" << endl
+                         << "     domain " << name << " queried" << endl << endl;
+      }
+
+      if (dns_transactions != NULL) {
+        unsigned long long delay;
+
+        if (!dns.is_response())
+          dns_transactions->query(meta.src_ip, meta.sport, dns.id(), now);
+        else if (dns_transactions->response(meta.dst_ip, meta.dport, dns.id(), now, delay))
+          COUT << "DNS response time = " << delay << " us" << endl;
+      }
+    }
+  }
+}
+
 // Callback given to pcap_loop() for processing captured datagrams
 void process_packet(u_char *user, const struct pcap_pkthdr * h, const u_char * packet) {
   static set<IPAddress> arpRequests;
   IPPacket ip;
   ARPPacket arp;
   ICMPPacket icmp;
+  TCPSegment tcp;
+  UDPSegment udp;
+  PacketMeta meta;
+
+  // Capture time in microseconds, used by analyzers
+  unsigned long long now = h->ts.tv_sec * 1000000ULL + h->ts.tv_usec;
+
+  // Skip datagrams not sampled before any parsing, unless the tap needs them;
+  // those sampled stand for weight datagrams in statistics
+  unsigned int weight = (sampler != NULL ? sampler->sample(packet, h->caplen, now) : 1);
+  if (weight == 0 && packet_tap == NULL) {
+    if (user != NULL)
+      pcap_dump(user, h, packet);
+    capture_count++;
+    return;
+  }
+
+  // Rules in force, held until the datagram is processed even if reloaded meanwhile
+  SnapshotReader<RuleSet> rules(rule_snapshot);
+
+  Datagram pkt(packet, h->caplen);        // initialized Datagram instance
+  EthernetFrame ether = pkt.ethernet();   // get EthernetFrame instance from transported data
+
+  // Walk the frame down to its innermost headers, through any tunnel
+  bool dissected = meta.dissect(ether);
+
+  // Deliver the datagram to the tap subscriptions, which see every datagram
+  // the BPF filter accepted, sampled or not
+  if (packet_tap != NULL)
+    packet_tap->process(meta, h, packet, now);
+
+  // Datagrams not sampled were only dissected for the tap
+  if (weight == 0) {
+    if (user != NULL)
+      pcap_dump(user, h, packet);
+    capture_count++;
+    return;
+  }
+
+  // Drop datagrams rejected by the in-process filter, which refines the BPF one
+  if (rules->filter != NULL && !rules->filter->match(meta, now))
+    return;
+
+  // Drop datagrams whose first matching rule is a drop rule
+  if (rules->classifier != NULL) {
+    unsigned int rule = rules->classifier->classify(meta);
+    if (rule != CLASSIFIER_NONE && rules->classifier->rule(rule).action == ClassifierRule::ra_drop)
+      return;
+  }
 
   COUT << "Grabbed " << h->caplen << " bytes (" << static_cast<int>(100.0 * h->caplen / h->len)
        << "%) of datagram received on " << ctime((const time_t*)&h->ts.tv_sec);
 
-  Datagram pkt(packet, h->caplen);        // initialized Datagram instance
   if (show_raw) COUT << "---------------- Raw data -----------------" << pkt << endl;
 
-  EthernetFrame ether = pkt.ethernet();   // get EthernetFrame instance from transported data
   COUT << "---------- Ethernet frame header ----------" << endl << ether;
 
   // Display payload content according to EtherType
@@ -109,6 +475,22 @@ void process_packet(u_char *user, const struct pcap_pkthdr * h, const u_char * p
         COUT << "------ ICMP packet header ------" << endl << icmp;
       }
 
+      // If it's a TCP segment, display its attributes
+      else if (ip.protocol() == IPPacket::ipp_tcp) {
+        tcp = ip.tcp();
+        COUT << "------ TCP segment header ------" << endl << tcp;
+      }
+
+      // If it's an UDP segment, display its attributes
+      else if (ip.protocol() == IPPacket::ipp_udp) {
+        udp = ip.udp();
+        COUT << "------ UDP segment header ------" << endl << udp;
+      }
+
+      // If it's a GRE packet, display its attributes
+      else if (ip.protocol() == IPPacket::ipp_gre)
+        COUT << "------ GRE packet header ------" << endl << ip.gre();
+
       break;
 
     case EthernetFrame::et_ARP :          // get ARPPacket instance from transported data
@@ -141,6 +523,92 @@ void process_packet(u_char *user, const struct pcap_pkthdr * h, const u_char * p
       break;
   }
 
+  // Count the frame in the top talkers of the current interval, reporting
+  // the previous interval when it is over
+  if (top_talkers != NULL) {
+    if (top_talkers->expired(now)) {
+      cout << "----------- Top talkers -----------" << endl << *top_talkers << endl;
+      top_talkers->reset(now);
+    }
+    top_talkers->add(meta, h->len, now, weight);
+  }
+
+  // Same for the sketch based statistics
+  if (traffic_sketches != NULL) {
+    if (traffic_sketches->expired(now)) {
+      cout << "--------- Traffic sketches ---------" << endl << *traffic_sketches << endl;
+      traffic_sketches->reset(now);
+    }
+    traffic_sketches->add(meta, h->len, now, weight);
+  }
+
+  // Count the frame at every node of its protocol hierarchy path
+  if (protocol_hierarchy != NULL) {
+    protocol_hierarchy->add(meta, h->len, weight);
+
+    if (phs_requested) {
+      phs_requested = 0;
+      cout << *protocol_hierarchy;
+    }
+  }
+
+  // Count the frame in the time series, which emit the buckets it closes
+  if (time_series != NULL)
+    time_series->add(meta, h->len, now, weight);
+
+  // Look for port scans and host sweeps
+  if (port_scans != NULL && dissected) {
+    unsigned int source, alerts = port_scans->process(meta, now, source);
+
+    if (alerts != PortScanDetector::ps_none) {
+      char outstr[16];
+      sprintf(outstr, "%u.%u.%u.%u", source >> 24, (source >> 16) & 0xFF, (source >> 8) & 0xFF, source & 0xFF);
+
+      if (alerts & PortScanDetector::ps_portscan)
+        cout << endl << "**** ALERT - Potential port scan detected ****" << endl
+                     << "     " << outstr << " probed about " << (unsigned int)port_scans->targets(source, now)
+                     << " targets (" << (unsigned int)(100 * port_scans->failure(source, now)) << "% failed)" << endl << endl;
+      if (alerts & PortScanDetector::ps_hostsweep)
+        cout << endl << "**** ALERT - Potential host sweep detected ****" << endl
+                     << "     " << outstr << " probed about " << (unsigned int)port_scans->hosts(source, now)
+                     << " hosts (" << (unsigned int)(100 * port_scans->failure(source, now)) << "% failed)" << endl << endl;
+    }
+  }
+
+  // Look for SYN floods
+  if (syn_floods != NULL && dissected) {
+    unsigned int      victim;
+    const SynTarget * target = syn_floods->process(meta, now, victim);
+
+    if (target != NULL) {
+      char outstr[16];
+      sprintf(outstr, "%u.%u.%u.%u", victim >> 24, (victim >> 16) & 0xFF, (victim >> 8) & 0xFF, victim & 0xFF);
+
+      cout << endl << "**** ALERT - Potential SYN flood detected ****" << endl
+                   << "     targeting " << outstr << endl << *target << endl;
+    }
+  }
+
+  if (dissected) {
+    if (meta.tunnels > 0) {
+      COUT << "------------- Tunnels -------------" << endl << meta;
+      COUT << "----- Inner IP packet header -----" << endl << meta.ip;
+    }
+
+    // Flag datagrams from or to listed addresses
+    if (rules->indicators != NULL) {
+      if (rules->indicators->contains(meta.src_ip))
+        cout << endl << "**** ALERT - Listed indicator seen ****" << endl
+                     << "     source address " << meta.ip.source_ip() << endl << endl;
+      if (rules->indicators->contains(meta.dst_ip))
+        cout << endl << "**** ALERT - Listed indicator seen ****" << endl
+                     << "     destination address " << meta.ip.destination_ip() << endl << endl;
+    }
+
+    // Apply analyzers to the innermost flow
+    analyze_flow(meta, now, *rules);
+  }
+
   COUT << endl << flush;
 
   // Log datagram if required
@@ -158,9 +626,21 @@ int main(int argc, char *argv[]) {
   char  errbuf[PCAP_ERRBUF_SIZE]; // to handle libpcap error messages
   int   siz     = 1518,           // max number of bytes captured for each datagram
         promisc = 0,              // deactive promiscuous mode
-        cnt     = -1;             // capture indefinitely
+        cnt     = -1,             // capture indefinitely
+        expansion   = 8,          // port prefixes a classifier range may expand to
+        granularity = 8;          // prefix lengths of classifier tuples are multiples of it
   char *wlogfname = NULL,         // filename where to log captured datagrams
-       *rlogfname = NULL;         // filename from which to read logged datagrams
+       *rlogfname = NULL,         // filename from which to read logged datagrams
+       *outdir    = NULL,         // directory where to write reconstructed files
+       *seriesfname = NULL,       // filename where to write time series records
+       *fexpr = NULL,             // in-process filter expression
+       *rulesfname = NULL,        // filename of the classifier rules
+       *patfname = NULL,          // filename of the payload patterns
+       *iocfname = NULL,          // filename of the indicator list or compiled set
+       *wiocfname = NULL,         // filename where to write the compiled indicator set
+       *samplespec = NULL,        // sampling mode and rate
+       *tapfname = NULL,          // filename of the tap subscriptions
+       *regexfname = NULL;        // filename of the payload regular expressions
 
   // Install Ctrl+C handler
   struct sigaction sa, osa;
@@ -169,8 +649,38 @@ int main(int argc, char *argv[]) {
   sigaction(SIGINT, &sa, &osa);
 
   // Process command line arguments
-  while ((argch = getopt(argc, argv, "hpqrd:f:i:l:n:s:")) != EOF)
+  while ((argch = getopt(argc, argv, "hpqra:d:e:f:g:i:l:m:n:o:s:t:x:F:I:R:S:T:W:")) != EOF)
     switch (argch) {
+      case 'a':           // apply specified traffic analyzer
+        if (string(optarg) == "dns")
+          analyzers |= AN_DNS;
+        else if (string(optarg) == "http")
+          analyzers |= AN_HTTP;
+        else if (string(optarg) == "tls")
+          analyzers |= AN_TLS;
+        else if (string(optarg) == "rtt")
+          analyzers |= AN_RTT;
+        else if (string(optarg) == "retrans")
+          analyzers |= AN_RETRANS;
+        else if (string(optarg) == "top")
+          analyzers |= AN_TOP;
+        else if (string(optarg) == "sketch")
+          analyzers |= AN_SKETCH;
+        else if (string(optarg) == "icmp")
+          analyzers |= AN_ICMP;
+        else if (string(optarg) == "tftp")
+          analyzers |= AN_TFTP;
+        else if (string(optarg) == "series")
+          analyzers |= AN_SERIES;
+        else if (string(optarg) == "phs")
+          analyzers |= AN_PHS;
+        else {
+          cerr << "error - unknow analyzer specified (" << optarg << ")" << endl;
+          return -11;
+        }
+
+        break;
+
       case 'd':           // device name
         device = optarg;
         break;
@@ -179,19 +689,56 @@ int main(int argc, char *argv[]) {
         strfilter = optarg;
         break;
 
+      case 'e':           // port prefixes a classifier range may expand to
+        expansion = atoi(optarg);
+        if (expansion < 1 || expansion > 30) {
+          cerr << "error - invalid classifier expansion (" << optarg << "), expected 1 to 30" << endl;
+          return -20;
+        }
+        break;
+
+      case 'F':           // in-process filter over dissected fields
+        fexpr = optarg;
+        break;
+
+      case 'g':           // granularity of the classifier tuples
+        granularity = atoi(optarg);
+        if (granularity < 1 || granularity > 16) {
+          cerr << "error - invalid classifier granularity (" << optarg << "), expected 1 to 16" << endl;
+          return -20;
+        }
+        break;
+
       case 'h':           // show help info
         cout << "Usage: sniff [-d XXX -h]" << endl;
+        cout << " -a : apply specified traffic analyzer (may be repeated)" << endl
+             << "      available analyzers: dns, http, tls, rtt, retrans, top, sketch, icmp, tftp, series, phs." << endl;
         cout << " -d XXX : device to capture from, where XXX is device name (ex: eth0)." << endl;
+        cout << " -e N : expand port ranges of classifier rules into at most N prefixes (1 to 30, default 8)." << endl;
         cout << " -f 'filter' : filter captures according to BPF expression (ex: 'ip or arp')." << endl;
+        cout << " -F 'filter' : filter captures on dissected fields (ex: 'tls.sni contains \"example\"')." << endl;
+        cout << " -g N : round prefix lengths of classifier tuples to multiples of N (1 to 16, default 8)." << endl;
         cout << " -h : show this information." << endl;
         cout << " -i file : read datagrams from given file instead of a device." << endl;
+        cout << " -I file : flag listed addresses, and domains queried or seen in HTTP hosts and TLS server names" << endl
+             << "      (list, or set compiled with -W)." << endl;
         cout << " -l file : log captured datagrams in given file." << endl;
+        cout << " -m file : search payloads for the patterns of given file (one per line, \\xHH for any byte)." << endl;
         cout << " -n : number of datagrams to capture." << endl;
+        cout << " -o dir : write files reconstructed by analyzers in given directory." << endl;
         cout << " -p : activate promiscuous capture mode." << endl;
         cout << " -q : activate quiet mode." << endl;
         cout << " -r : activate raw display of captured data." << endl;
+        cout << " -R file : classify datagrams against a ClassBench rule file (drop rules discard them)." << endl;
         cout << " -s : apply specified security application" << endl
-             << "      available applications: arpspoof." << endl;
+             << "      available applications: arpspoof, portscan, synflood." << endl;
+        cout << " -S mode:N[:adaptive] : analyze 1 in N datagrams (mode packet) or flows (mode flow)," << endl
+             << "      N raised while capture lags behind if adaptive (ex: flow:8:adaptive)." << endl;
+        cout << " -t file : write time series buckets in given file as binary records." << endl;
+        cout << " -T file : deliver datagrams to the filtered outputs listed in given file" << endl
+             << "      (one 'pcap|text|stats file [filter]' per line)." << endl;
+        cout << " -W file : write the indicator set loaded with -I in given file, mapped when loaded." << endl;
+        cout << " -x file : search payloads for the regular expressions of given file (one per line)." << endl;
 
         // Exit if only argument is -h
         if (argc == 2) return 0;
@@ -201,14 +748,26 @@ int main(int argc, char *argv[]) {
         rlogfname = optarg;
         break;
 
+      case 'I':           // filename of the indicator list or compiled set
+        iocfname = optarg;
+        break;
+
       case 'l':           // filename where to log captured datagrams
         wlogfname = optarg;
         break;
 
+      case 'm':           // filename of the payload patterns
+        patfname = optarg;
+        break;
+
       case 'n':           // number of datagrams to capture
         cnt = atoi(optarg);
         break;
 
+      case 'o':           // directory where to write reconstructed files
+        outdir = optarg;
+        break;
+
       case 'p':           // active promiscuous mode
         promisc = 1;
         break;
@@ -221,15 +780,43 @@ int main(int argc, char *argv[]) {
         show_raw = 1;
         break;
 
+      case 'R':           // filename of the classifier rules
+        rulesfname = optarg;
+        break;
+
       case 's':           // apply specified security tool
         if (string(optarg) == "arpspoof")
           security_tool = ARPSPOOF;
+        else if (string(optarg) == "portscan")
+          security_tool = PORTSCAN;
+        else if (string(optarg) == "synflood")
+          security_tool = SYNFLOOD;
         else {
           cerr << "error - unknow security tool specified (" << optarg << ")" << endl;
           return -10;
         }
 
         break;
+
+      case 'S':           // sampling mode and rate
+        samplespec = optarg;
+        break;
+
+      case 't':           // filename where to write time series records
+        seriesfname = optarg;
+        break;
+
+      case 'T':           // filename of the tap subscriptions
+        tapfname = optarg;
+        break;
+
+      case 'W':           // filename where to write the compiled indicator set
+        wiocfname = optarg;
+        break;
+
+      case 'x':           // filename of the payload regular expressions
+        regexfname = optarg;
+        break;
     }
 
   // Options -d and -i are mutually exclusives
@@ -314,6 +901,71 @@ int main(int argc, char *argv[]) {
     cout << "BPF filter = " << strfilter << endl;    // display applied filter
   }
 
+  // Load the rules applied to the datagrams the BPF filter accepted
+  rule_loader = new RuleLoader(fexpr, rulesfname, patfname, regexfname, iocfname, expansion, granularity);
+  {
+    static const int   exit_codes[] = { 0, -13, -14, -15, -16, -18 };
+    string             error;
+    RuleLoader::Source failed;
+    RuleSet           *loaded = rule_loader->load(error, failed);
+
+    if (loaded == NULL) {
+      cerr << "error - " << error << endl;
+      shutdown(exit_codes[failed]);    // Cleanup and quit
+    }
+
+    rule_snapshot.publish(loaded);
+  }
+
+  RuleSet *rules = rule_snapshot.current();
+
+  if (rules->filter != NULL) {
+    cout << "in-process filter = " << fexpr << " (" << rules->filter->size() << " instructions)" << endl;
+    COUT << *rules->filter;
+
+    // Move the tests header offsets can express into the kernel, after the
+    // BPF filter if one was provided, so fewer datagrams are copied to us
+    BPFGenerator kernel(*rules->filter, siz);
+    if (kernel.valid()) {
+      bpf_program prog;
+
+      if (strfilter != NULL)
+        kernel.prepend(binfilter);
+      kernel.program(prog);
+
+      if (pcap_setfilter(pcap_session, &prog) < 0)
+        cerr << "warning - pcap_setfilter() failed (" << pcap_geterr(pcap_session) << "), filtering in process only" << endl;
+      else {
+        cout << "kernel filter = " << prog.bf_len << " BPF instructions"
+             << (kernel.partial() ? ", remaining tests in process" : "") << endl;
+        COUT << kernel;
+      }
+    }
+  }
+
+  // Classifier rules are applied after the in-process filter
+  if (rules->classifier != NULL) {
+    cout << "classifier = " << rules->classifier->size() << " rules in " << rules->classifier->tuples() << " tuples"
+         << " (granularity " << granularity << ", expansion " << expansion << ")";
+    if (rules->classifier->malformed())
+      cout << ", " << rules->classifier->malformed() << " malformed lines";
+    cout << endl;
+  }
+
+  if (rules->matcher != NULL && patfname != NULL)
+    cout << "payload patterns = " << rules->matcher->patterns();
+
+  if (rules->matcher != NULL && regexfname != NULL)
+    cout << "payload expressions = " << rules->matcher->regexes();
+
+  // Indicators are mapped if they were compiled
+  if (rules->indicators != NULL) {
+    cout << "indicators = " << *rules->indicators;
+
+    if (wiocfname != NULL && !rules->indicators->save(wiocfname))
+      cerr << "warning - unable to write compiled indicators (" << wiocfname << ")" << endl;
+  }
+
   // If need be, open file where captured datagrams are to be logged
   if (wlogfname != NULL)
     if ((logfile = pcap_dump_open(pcap_session, wlogfname)) == NULL) {
@@ -321,10 +973,142 @@ int main(int argc, char *argv[]) {
       shutdown(-9);    // Cleanup and quit
   }
 
+  // If need be, open the outputs of the tap subscriptions
+  if (tapfname != NULL) {
+    string error;
+
+    packet_tap = new PacketTap;
+    if (packet_tap->load(tapfname, pcap_session, error) < 0) {
+      cerr << "error - " << error << endl;
+      shutdown(-19);    // Cleanup and quit
+    }
+
+    cout << "tap = " << packet_tap->size() << " subscriptions, " << packet_tap->predicates()
+         << " distinct predicates" << endl;
+  }
+
+  // Sample the datagrams analyzed if required
+  if (samplespec != NULL) {
+    string spec(samplespec);
+    string mode = spec.substr(0, spec.find(':'));
+    string rest = (spec.find(':') != string::npos ? spec.substr(spec.find(':') + 1) : "");
+    bool   adapt = false;
+
+    if (rest.size() >= 9 && rest.compare(rest.size() - 9, 9, ":adaptive") == 0) {
+      adapt = true;
+      rest.erase(rest.size() - 9);
+    }
+
+    int rate = atoi(rest.c_str());
+
+    if ((mode != "packet" && mode != "flow") || rate < 1 || rate > SAMPLE_MAX_RATE) {
+      cerr << "error - invalid sampling (" << samplespec << "), expected packet:N or flow:N with N from 1 to "
+           << SAMPLE_MAX_RATE << ", optionally followed by :adaptive" << endl;
+      shutdown(-17);    // Cleanup and quit
+    }
+
+    // The lag of datagrams read from a file says nothing of the capture
+    if (adapt && rlogfname != NULL) {
+      cerr << "warning - adaptive sampling ignored when reading a file" << endl;
+      adapt = false;
+    }
+
+    sampler = new PacketSampler(mode == "flow" ? PacketSampler::sm_flow : PacketSampler::sm_packet, rate, adapt);
+    cout << "sampling = " << mode << "s 1 in " << rate << (adapt ? " (adaptive)" : "") << endl;
+  }
+
   // Display any security application enabled
   switch (security_tool) {
     case ARPSPOOF: cout << "arp spoofing detection enabled..." << endl;
                    break;
+    case PORTSCAN: cout << "port scan and host sweep detection enabled..." << endl;
+                   port_scans = new PortScanDetector();
+                   break;
+    case SYNFLOOD: cout << "SYN flood detection enabled..." << endl;
+                   syn_floods = new SynFloodDetector();
+                   break;
+  }
+
+  // Allocate the state of enabled analyzers
+  if (analyzers & AN_DNS) {
+    dns_transactions = new DNSTransactionTable();
+    cout << "DNS transaction analysis enabled..." << endl;
+  }
+
+  // Indicators are also looked up in HTTP hosts and TLS server names, whose
+  // analyzers then run without displaying their results
+  if ((analyzers & AN_HTTP) || iocfname != NULL)
+    http_flows = new FlowTable<HTTPFlow>(8192);
+  if (analyzers & AN_HTTP)
+    cout << "HTTP header analysis enabled..." << endl;
+
+  if ((analyzers & AN_TLS) || iocfname != NULL)
+    tls_analyzer = new TLSAnalyzer();
+  if (analyzers & AN_TLS)
+    cout << "TLS handshake analysis enabled..." << endl;
+
+  if (analyzers & AN_RTT) {
+    rtt_analyzer = new TCPLatencyAnalyzer();
+    cout << "TCP latency analysis enabled..." << endl;
+  }
+
+  if (analyzers & AN_RETRANS) {
+    retrans_analyzer = new TCPRetransAnalyzer();
+    cout << "TCP retransmission analysis enabled..." << endl;
+  }
+
+  if (analyzers & AN_TOP) {
+    top_talkers = new TopTalkers();
+    cout << "Top talkers analysis enabled (10 seconds intervals)..." << endl;
+  }
+
+  if (analyzers & AN_SKETCH) {
+    traffic_sketches = new TrafficSketches();
+    cout << "Traffic sketches enabled (10 seconds intervals)..." << endl;
+  }
+
+  if (analyzers & AN_ICMP) {
+    icmp_correlator = new ICMPCorrelator();
+    cout << "ICMP error correlation enabled..." << endl;
+  }
+
+  if (analyzers & AN_TFTP) {
+    tftp_sessions = new TFTPSessionTracker(outdir);
+    if (outdir != NULL)
+      cout << "TFTP transfer reconstruction enabled (files written in " << outdir << ")..." << endl;
+    else
+      cout << "TFTP transfer reconstruction enabled..." << endl;
+  }
+
+  if (analyzers & AN_SERIES) {
+    if (seriesfname != NULL && (seriesfile = fopen(seriesfname, "wb")) == NULL) {
+      cerr << "error - unable to open time series file (" << seriesfname << ")" << endl;
+      shutdown(-12);    // Cleanup and quit
+    }
+
+    time_series = new TimeSeries(rlogfname != NULL ? rlogfname : device, seriesfile);
+    cout << "Time series enabled (1, 10 and 60 seconds intervals)..." << endl;
+  }
+
+  if (analyzers & AN_PHS) {
+    protocol_hierarchy = new ProtocolHierarchy();
+
+    // Display the statistics on demand, without pausing capture
+    struct sigaction su;
+    memset(&su, 0, sizeof(su));
+    su.sa_handler = &request_phs;
+    su.sa_flags   = SA_RESTART;
+    sigaction(SIGUSR1, &su, NULL);
+
+    cout << "Protocol hierarchy statistics enabled (kill -USR1 " << getpid() << " to display)..." << endl;
+  }
+
+  // Rebuild the rules on SIGHUP or when their files change, without pausing capture
+  if (rule_loader->reloadable()) {
+    if (rule_loader->start(rule_snapshot))
+      cout << "Rules reloadable (kill -HUP " << getpid() << " to reload)..." << endl;
+    else
+      cerr << "warning - unable to start rule reload thread" << endl;
   }
 
   // Start capturing...
@@ -0,0 +1,229 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef SYNFLOOD_CPP
+#define SYNFLOOD_CPP
+
+#include <cmath>          // log
+
+#include "synflood.h"     // SynFloodDetector
+
+// Default constructor
+SynTarget::SynTarget() : rate(0.0), half_open(0.0), entropy(0.0), evaluated(0), flooded(false) {
+  memset(ring, 0, sizeof(ring));
+  memset(sources, 0, sizeof(sources));
+  memset(prefix, 0, sizeof(prefix));
+  memset(prefix_count, 0, sizeof(prefix_count));
+}
+
+// Output operator displaying the metrics of the last window and the heaviest
+// source prefixes
+ostream & operator<<(ostream & ostr, const SynTarget & t) {
+  ostr << "SYN rate = " << (unsigned int)t.rate << "/s, half-open = " << (unsigned int)(100 * t.half_open)
+       << "%, source entropy = " << (unsigned int)(100 * t.entropy) << "%" << endl;
+
+  // Sort the prefixes by decreasing count (few entries: selection sort)
+  unsigned int order[SYNFLOOD_PREFIXES];
+  for (unsigned int i = 0; i < SYNFLOOD_PREFIXES; i++)
+    order[i] = i;
+  for (unsigned int i = 0; i < SYNFLOOD_PREFIXES; i++)
+    for (unsigned int j = i + 1; j < SYNFLOOD_PREFIXES; j++)
+      if (t.prefix_count[order[j]] > t.prefix_count[order[i]]) {
+        unsigned int k = order[i];  order[i] = order[j];  order[j] = k;
+      }
+
+  for (unsigned int i = 0; i < SYNFLOOD_PREFIXES && t.prefix_count[order[i]] > 0; i++) {
+    char outstr[32];
+    unsigned int p = t.prefix[order[i]];
+
+    sprintf(outstr, "%u.%u.%u.0/24", p >> 16, (p >> 8) & 0xFF, p & 0xFF);
+    ostr << "  top source " << outstr << " : about " << t.prefix_count[order[i]] << " SYNs" << endl;
+  }
+
+  ostr << flush;
+
+  return ostr;
+}
+
+// Parameterized constructor: number of destinations tracked
+SynFloodDetector::SynFloodDetector(unsigned int targets) : p_targets(targets), p_alerts(0) {
+  memset(p_handshakes, 0, sizeof(p_handshakes));
+}
+
+// Returns the tag of a connection from client to server endpoints (never 0)
+unsigned int SynFloodDetector::tag(unsigned int client, unsigned int cport, unsigned int server,
+                                   unsigned int sport) {
+  unsigned int h = hash_word(client ^ hash_word(server ^ (cport << 16 | sport)));
+
+  return h ? h : 1;
+}
+
+// Returns the activity of given destination, creating it if create is true
+// (NULL otherwise)
+SynTarget * SynFloodDetector::target(unsigned int ip, bool create, unsigned long long now) {
+  FlowKey key;
+  bool    created;
+
+  key.a_ip = ip;
+
+  return create ? p_targets.insert(key, now, created) : p_targets.find(key, now);
+}
+
+// Returns the ring slot of given second, recycling it if it holds an older one
+SynSecond & SynFloodDetector::slot(SynTarget & t, unsigned int second) {
+  SynSecond & s = t.ring[second % SYNFLOOD_SECONDS];
+
+  if (s.second != second) {
+    memset(&s, 0, sizeof(s));
+    s.second = second;
+  }
+
+  return s;
+}
+
+// Evaluates the metrics of given destination over the seconds preceding given
+// one. Returns true if a flood was just detected
+bool SynFloodDetector::evaluate(SynTarget & t, unsigned int second) {
+  unsigned long long syns = 0, acks = 0;
+
+  t.evaluated = second;
+
+  for (unsigned int i = 0; i < SYNFLOOD_SECONDS; i++)
+    if (t.ring[i].second != 0 && t.ring[i].second < second && second - t.ring[i].second <= SYNFLOOD_SECONDS) {
+      syns += t.ring[i].syns;
+      acks += t.ring[i].acks;
+    }
+
+  t.rate      = (double)syns / SYNFLOOD_SECONDS;
+  t.half_open = (syns > 0 && acks < syns ? 1.0 - (double)acks / syns : 0.0);
+
+  // Normalized Shannon entropy of the source buckets, which then decay
+  unsigned long long total = 0;
+  for (unsigned int i = 0; i < SYNFLOOD_BUCKETS; i++)
+    total += t.sources[i];
+
+  t.entropy = 0.0;
+  for (unsigned int i = 0; i < SYNFLOOD_BUCKETS; i++) {
+    if (t.sources[i] > 0) {
+      double p = (double)t.sources[i] / total;
+      t.entropy -= p * log(p);
+    }
+    t.sources[i] >>= 1;
+  }
+  t.entropy /= log((double)SYNFLOOD_BUCKETS);
+
+  for (unsigned int i = 0; i < SYNFLOOD_PREFIXES; i++)
+    t.prefix_count[i] >>= 1;
+
+  // Spread sources confirm a flood with fewer half-open connections.
+  // Hysteresis: the flood ends when the rate falls below half the threshold
+  double threshold = (t.entropy >= SYNFLOOD_ENTROPY ? SYNFLOOD_SPREAD_HALF_OPEN : SYNFLOOD_HALF_OPEN);
+
+  if (!t.flooded && t.rate >= SYNFLOOD_RATE && t.half_open >= threshold) {
+    t.flooded = true;
+    return true;
+  }
+
+  if (t.flooded && t.rate < SYNFLOOD_RATE / 2)
+    t.flooded = false;
+
+  return false;
+}
+
+// Processes a dissected packet: SYNs and ACKs are counted against their
+// destination, SYN/ACKs and RSTs against their source (the server)
+const SynTarget * SynFloodDetector::process(const PacketMeta & meta, unsigned long long now,
+                                            unsigned int & victim) {
+  if (!meta.has_tcp)
+    return NULL;
+
+  unsigned int second = (unsigned int)(now / 1000000);
+  bool         syn = meta.tcp.flag_syn(), ack = meta.tcp.flag_ack(), rst = meta.tcp.flag_rst();
+  SynTarget *  t;
+
+  if (second == 0)
+    second = 1;   // 0 marks unused slots
+
+  // Answers of the server and ACKs of the clients, for known destinations
+  // only; SYNs to any destination
+  bool server = rst || (syn && ack);
+
+  if ((t = target(server ? meta.src_ip : meta.dst_ip, syn && !server, now)) == NULL)
+    return NULL;
+
+  // Evaluate the destination on its first packet of a new second, before its
+  // counters are recycled
+  bool alert = (t->evaluated != second) && evaluate(*t, second);
+
+  if (rst)
+    slot(*t, second).rsts++;
+  else if (server) {
+    // Remember the ACK completing the handshake
+    unsigned int h = tag(meta.dst_ip, meta.dport, meta.src_ip, meta.sport);
+    Handshake &  e = p_handshakes[h % SYNFLOOD_HANDSHAKES];
+
+    e.tag    = h;
+    e.expect = meta.tcp.sequence_nb() + 1;
+    slot(*t, second).synacks++;
+  }
+  else if (!syn) {
+    // Only the ACK acknowledging a pending SYN/ACK completes a handshake
+    unsigned int h = tag(meta.src_ip, meta.sport, meta.dst_ip, meta.dport);
+    Handshake &  e = p_handshakes[h % SYNFLOOD_HANDSHAKES];
+
+    if (ack && e.tag == h && meta.tcp.ack_nb() == e.expect) {
+      e.tag = 0;
+      slot(*t, second).acks++;
+    }
+  }
+  else {
+    slot(*t, second).syns++;
+    t->sources[hash_word(meta.src_ip) % SYNFLOOD_BUCKETS]++;
+
+    // Space-Saving over source /24 prefixes: take over the lightest counter
+    unsigned int p = meta.src_ip >> 8, low = 0;
+    for (unsigned int i = 0; i < SYNFLOOD_PREFIXES; i++) {
+      if (t->prefix[i] == p && t->prefix_count[i] > 0) {
+        low = i;
+        break;
+      }
+      if (t->prefix_count[i] < t->prefix_count[low])
+        low = i;
+    }
+    t->prefix[low] = p;
+    t->prefix_count[low]++;
+  }
+
+  if (!alert)
+    return NULL;
+
+  p_alerts++;
+  victim = (server ? meta.src_ip : meta.dst_ip);
+
+  return t;
+}
+
+// Output operator displaying the detector statistics
+ostream & operator<<(ostream & ostr, const SynFloodDetector & sf) {
+  ostr << "SYN flood alerts = " << sf.p_alerts << ", destinations evicted = " << sf.p_targets.evicted() << endl;
+
+  ostr << flush;
+
+  return ostr;
+}
+
+#endif
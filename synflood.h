@@ -0,0 +1,137 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef SYNFLOOD_H
+#define SYNFLOOD_H
+
+#include <iostream>
+
+#include "packetmeta.h"         // PacketMeta
+#include "flowtable.h"          // FlowTable
+
+using namespace std;
+
+#define SYNFLOOD_SECONDS              8  // length of the rate window (ring of per-second counters)
+#define SYNFLOOD_RATE              1000  // SYN per second to a destination raising an alert
+#define SYNFLOOD_HALF_OPEN          0.8  // share of SYNs never followed by an ACK confirming a flood
+#define SYNFLOOD_SPREAD_HALF_OPEN   0.5  // share confirming a flood from spread (spoofed) sources
+#define SYNFLOOD_ENTROPY            0.9  // source entropy marking spread sources
+#define SYNFLOOD_HANDSHAKES       65536  // SYN/ACKs awaiting the client ACK, all destinations together
+#define SYNFLOOD_BUCKETS             64  // source hash buckets used to estimate source entropy
+#define SYNFLOOD_PREFIXES             8  // source /24 prefixes tracked per destination
+
+/* SynSecond: TCP activity toward a destination during one second.
+ *
+ * Attributes
+ *   second  : capture second counted (0 if slot unused)
+ *   syns    : SYN segments received
+ *   acks    : handshakes completed (client ACK acknowledging a SYN/ACK)
+ *   synacks : SYN/ACK segments sent back
+ *   rsts    : RST segments sent back (refused connections)
+ */
+struct SynSecond {
+  unsigned int second;
+  unsigned int syns, acks, synacks, rsts;
+};
+
+/* SynTarget: SYN activity of a destination address.
+ *
+ * Attributes
+ *   ring      : per-second counters of the last SYNFLOOD_SECONDS seconds
+ *   sources   : decayed SYN counts per source hash bucket
+ *   prefix, prefix_count : Space-Saving counters of the heaviest source /24 prefixes
+ *   rate, half_open, entropy : metrics of the last complete window
+ *   evaluated : second the metrics were last evaluated at
+ *   flooded   : the destination is under a SYN flood
+ *
+ * Notes
+ *   1. the state has a fixed size: nothing is allocated per source.
+ */
+struct SynTarget {
+  SynTarget();                                           // default constructor
+
+  SynSecond    ring[SYNFLOOD_SECONDS];
+  unsigned int sources[SYNFLOOD_BUCKETS];
+  unsigned int prefix[SYNFLOOD_PREFIXES];
+  unsigned int prefix_count[SYNFLOOD_PREFIXES];
+
+  double       rate, half_open, entropy;
+  unsigned int evaluated;
+  bool         flooded;
+
+  // Operator overloads
+  friend ostream & operator<<(ostream &, const SynTarget &);
+};
+
+/* SynFloodDetector: tells SYN floods from legitimate connection storms from
+ *   per-destination SYN rate, half-open ratio and source entropy.
+ *
+ * Attributes
+ *   p_targets    : per-destination activity
+ *   p_handshakes : SYN/ACKs sent, awaiting the ACK completing their handshake
+ *   p_alerts     : number of floods detected
+ *
+ * Notes
+ *   1. metrics are evaluated once per second and destination, by the first
+ *      packet of the second concerning it, over the last SYNFLOOD_SECONDS
+ *      complete seconds. A flood is reported when the SYN rate reaches
+ *      SYNFLOOD_RATE and at least SYNFLOOD_HALF_OPEN of SYNs are not followed
+ *      by a completed handshake, or SYNFLOOD_SPREAD_HALF_OPEN when the source
+ *      entropy reaches SYNFLOOD_ENTROPY; it ends when the rate falls below
+ *      half of it.
+ *   2. the half-open ratio is 1 - handshakes / SYNs. A handshake completes
+ *      when the client ACK acknowledges the SYN/ACK of the server, remembered
+ *      in a direct mapped table of SYNFLOOD_HANDSHAKES entries: ACKs of
+ *      established connections do not count, and a SYN/ACK overwritten
+ *      before its ACK only counts as half-open.
+ *   3. source entropy (0 to 1) is measured over SYNFLOOD_BUCKETS hash buckets
+ *      of source addresses, decayed by half every second: spoofed floods
+ *      spread evenly (close to 1), connection storms from a few clients do not
+ *      and need a higher half-open ratio to be reported.
+ *   4. a packet costs a flow table lookup and a few counter updates, so rates
+ *      hold at multi-million packets per second.
+ */
+class SynFloodDetector {
+  public:
+    SynFloodDetector(unsigned int = 65536);              // parameterized constructor
+
+    // Processes a dissected packet captured at given time. Returns the state of
+    // the destination when a flood against it was just detected (its address
+    // being given in target), NULL otherwise
+    const SynTarget * process(const PacketMeta &, unsigned long long, unsigned int &);
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, const SynFloodDetector &);
+
+  private:
+    // SYN/ACK awaiting its ACK
+    struct Handshake {
+      unsigned int tag;         // hash of the connection (0 if none)
+      unsigned int expect;      // acknowledgment number completing the handshake
+    };
+
+    FlowTable<SynTarget> p_targets;
+    Handshake            p_handshakes[SYNFLOOD_HANDSHAKES];
+    unsigned long long   p_alerts;
+
+    SynTarget * target(unsigned int, bool, unsigned long long);
+    SynSecond & slot(SynTarget &, unsigned int);
+    bool evaluate(SynTarget &, unsigned int);
+    static unsigned int tag(unsigned int, unsigned int, unsigned int, unsigned int);
+};
+
+#endif
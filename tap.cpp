@@ -0,0 +1,444 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef TAP_CPP
+#define TAP_CPP
+
+#include <cstring>          // strchr, strspn, strcspn
+#include <sstream>          // ostringstream
+
+#include "tap.h"            // TapSink, PacketTap
+#include "exceptions.h"     // EFilterSyntaxException
+
+// Parameterized constructor: kind of sink and file written
+TapSink::TapSink(Kind k, const string & p)
+  : kind(k), path(p), filter(NULL), root(0), dumper(NULL), file(NULL), hierarchy(NULL),
+    frames(0), bytes(0), prepared(0) {
+}
+
+// Destructor
+TapSink::~TapSink() {
+  if (dumper != NULL)
+    pcap_dump_close(dumper);
+  if (file != NULL)
+    fclose(file);
+  delete filter;
+  delete hierarchy;
+}
+
+// Default constructor: no subscriptions
+PacketTap::PacketTap()
+  : p_frame(0), p_meta(NULL), p_now(0), p_frames(0), p_deliveries(0), p_lookups(0), p_tests(0),
+    p_comparisons(0) {
+}
+
+// Destructor
+PacketTap::~PacketTap() {
+  for (unsigned int i = 0; i < p_sinks.size(); i++)
+    delete p_sinks[i];
+}
+
+// Reads the subscriptions of a file (see note 1), opening pcap outputs with
+// given session. Returns the number of subscriptions, or -1 if the file cannot
+// be read or a subscription is invalid, which is then described in error
+int PacketTap::load(const char * fname, pcap_t * session, string & error) {
+  FILE *       f = fopen(fname, "r");
+  char         line[1024];
+  unsigned int number = 0;
+
+  if (f == NULL) {
+    error = string("unable to read tap subscriptions (") + fname + ")";
+    return -1;
+  }
+
+  while (fgets(line, sizeof(line), f) != NULL) {
+    ostringstream where;
+    where << fname << ":" << ++number << ": ";
+
+    line[strcspn(line, "\r\n")] = '\0';
+
+    char * kind = line + strspn(line, " \t");
+    if (*kind == '\0' || *kind == '#')
+      continue;
+
+    char * path = kind + strcspn(kind, " \t");
+    if (*path != '\0')
+      *path++ = '\0';
+    path += strspn(path, " \t");
+
+    char * expr = path + strcspn(path, " \t");
+    if (*expr != '\0')
+      *expr++ = '\0';
+    expr += strspn(expr, " \t");
+
+    TapSink::Kind k;
+    if (strcmp(kind, "pcap") == 0)
+      k = TapSink::ts_pcap;
+    else if (strcmp(kind, "text") == 0)
+      k = TapSink::ts_text;
+    else if (strcmp(kind, "stats") == 0)
+      k = TapSink::ts_stats;
+    else {
+      error = where.str() + "unknown sink kind (" + kind + ")";
+      fclose(f);
+      return -1;
+    }
+
+    if (*path == '\0') {
+      error = where.str() + "missing output file";
+      fclose(f);
+      return -1;
+    }
+
+    if (p_sinks.size() >= TAP_MAX_SINKS) {
+      error = where.str() + "too many subscriptions";
+      fclose(f);
+      return -1;
+    }
+
+    TapSink * sink = new TapSink(k, path);
+    p_sinks.push_back(sink);
+
+    if (*expr != '\0') {
+      sink->expr = expr;
+      try {
+        sink->filter = new PacketFilter(expr);
+      }
+      catch (EFilterSyntaxException & e) {
+        error = where.str() + e.what() + " in filter\n  " + expr + "\n  " + string(e.position, ' ') + "^";
+        fclose(f);
+        return -1;
+      }
+      sink->root = convert(p_sinks.size() - 1, sink->filter->root());
+    }
+
+    if (k == TapSink::ts_pcap)
+      sink->dumper = pcap_dump_open(session, path);
+    else
+      sink->file = fopen(path, "w");
+
+    if (sink->dumper == NULL && sink->file == NULL) {
+      error = where.str() + "unable to open output file (" + path + ")";
+      fclose(f);
+      return -1;
+    }
+
+    if (k == TapSink::ts_stats)
+      sink->hierarchy = new ProtocolHierarchy;
+  }
+
+  fclose(f);
+  return p_sinks.size();
+}
+
+// Copies a node of the syntax tree of a sink's filter, and its descendants,
+// into the nodes of the tap. Returns the index of the copy
+unsigned int PacketTap::convert(unsigned int s, unsigned int n) {
+  const FilterNode & fn = p_sinks[s]->filter->node(n);
+  Node               node;
+
+  node.type      = fn.type;
+  node.value     = fn.value;
+  node.predicate = node.left = node.right = 0;
+
+  switch (fn.type) {
+    case FilterNode::fn_compare :
+    case FilterNode::fn_string :
+      node.predicate = predicate(s, n);
+      break;
+
+    case FilterNode::fn_and :
+    case FilterNode::fn_or :
+      node.left  = convert(s, fn.left);
+      node.right = convert(s, fn.right);
+      break;
+
+    case FilterNode::fn_not :
+      node.left = convert(s, fn.left);
+      break;
+
+    default :                            // fn_const
+      break;
+  }
+
+  p_nodes.push_back(node);
+  return p_nodes.size() - 1;
+}
+
+// Returns the identifier of the predicate of a comparison node of a sink's
+// filter, shared with the identical comparisons of other filters
+unsigned int PacketTap::predicate(unsigned int s, unsigned int n) {
+  const PacketFilter * filter = p_sinks[s]->filter;
+  const FilterNode &   fn     = filter->node(n);
+  ostringstream        key;
+
+  p_comparisons++;
+
+  // Prefix tables are identified by their file, strings by their text
+  key << fn.type << " " << fn.field << " " << fn.op << " ";
+  if (fn.type == FilterNode::fn_string || fn.op == fop_in)
+    key << filter->text(fn.text);
+  else
+    key << fn.operand << "/" << fn.mask;
+
+  map<string, unsigned int>::iterator it = p_keys.find(key.str());
+  if (it != p_keys.end())
+    return it->second;
+
+  Predicate p;
+  p.sink    = s;
+  p.node    = n;
+  p.group   = -1;
+  p.operand = fn.operand;
+  p.stamp   = 0;
+  p.result  = false;
+
+  // Equality tests on a field share a single load and lookup (flow fields
+  // depend on the flow state of each filter, and are left alone)
+  if (fn.type == FilterNode::fn_compare && fn.op == fop_eq &&
+      (fn.field < ff_flow_packets || fn.field > ff_flow_age)) {
+    pair<unsigned int, unsigned int> gkey(fn.field, fn.mask);
+    map<pair<unsigned int, unsigned int>, unsigned int>::iterator g = p_group_index.find(gkey);
+
+    if (g == p_group_index.end()) {
+      Group group;
+      group.sink     = s;
+      group.field    = fn.field;
+      group.mask     = fn.mask;
+      group.stamp    = 0;
+      group.matching = -1;
+
+      p_groups.push_back(group);
+      g = p_group_index.insert(make_pair(gkey, p_groups.size() - 1)).first;
+    }
+
+    p.group = g->second;
+    p_groups[p.group].values[fn.operand] = p_predicates.size();
+  }
+
+  p_predicates.push_back(p);
+  p_keys[key.str()] = p_predicates.size() - 1;
+
+  return p_predicates.size() - 1;
+}
+
+// Prepares the filter of a sink for the current frame, once per frame
+void PacketTap::prepare(unsigned int s) {
+  TapSink * sink = p_sinks[s];
+
+  if (sink->prepared != p_frame) {
+    sink->filter->begin(*p_meta, p_now);
+    sink->prepared = p_frame;
+  }
+}
+
+// Returns the result of a predicate for the current frame, computing it on
+// first use
+bool PacketTap::test(unsigned int id) {
+  Predicate & p = p_predicates[id];
+
+  p_lookups++;
+
+  if (p.group >= 0) {
+    Group & g = p_groups[p.group];
+
+    if (g.stamp != p_frame) {
+      unsigned int v;
+
+      prepare(g.sink);
+      g.matching = -1;
+      if (p_sinks[g.sink]->filter->load(g.field, *p_meta, v)) {
+        map<unsigned int, unsigned int>::const_iterator it = g.values.find(v & g.mask);
+        if (it != g.values.end())
+          g.matching = it->second;
+      }
+      g.stamp = p_frame;
+      p_tests++;
+    }
+
+    return g.matching == (int)id;
+  }
+
+  if (p.stamp != p_frame) {
+    prepare(p.sink);
+    p.result = p_sinks[p.sink]->filter->evaluate(p.node, *p_meta);
+    p.stamp  = p_frame;
+    p_tests++;
+  }
+
+  return p.result;
+}
+
+// Evaluates a node of the filters on the current frame
+bool PacketTap::evaluate(unsigned int n) {
+  const Node & node = p_nodes[n];
+
+  switch (node.type) {
+    case FilterNode::fn_const :
+      return node.value;
+
+    case FilterNode::fn_compare :
+    case FilterNode::fn_string :
+      return test(node.predicate);
+
+    case FilterNode::fn_and :
+      return evaluate(node.left) && evaluate(node.right);
+
+    case FilterNode::fn_or :
+      return evaluate(node.left) || evaluate(node.right);
+
+    default :                            // fn_not
+      return !evaluate(node.left);
+  }
+}
+
+// Delivers a dissected frame captured at given time to the sinks whose filter
+// accepts it. Returns the number of sinks the frame was delivered to
+unsigned int PacketTap::process(const PacketMeta & meta, const struct pcap_pkthdr * h,
+                                const unsigned char * packet, unsigned long long now) {
+  unsigned int delivered = 0;
+
+  p_frame++;
+  p_frames++;
+  p_meta = &meta;
+  p_now  = now;
+
+  // Flow state counts every frame, whether or not the filter needs it
+  for (unsigned int s = 0; s < p_sinks.size(); s++)
+    if (p_sinks[s]->filter != NULL && p_sinks[s]->filter->uses_flow())
+      prepare(s);
+
+  for (unsigned int s = 0; s < p_sinks.size(); s++) {
+    TapSink * sink = p_sinks[s];
+
+    if (sink->filter != NULL && !evaluate(sink->root))
+      continue;
+
+    sink->frames++;
+    sink->bytes += h->len;
+    delivered++;
+
+    switch (sink->kind) {
+      case TapSink::ts_pcap :
+        pcap_dump((unsigned char *)sink->dumper, h, packet);
+        break;
+
+      case TapSink::ts_text :
+        write_text(sink->file, meta, h);
+        break;
+
+      default :                          // ts_stats
+        sink->hierarchy->add(meta, h->len);
+        break;
+    }
+  }
+
+  p_deliveries += delivered;
+  p_meta = NULL;
+
+  return delivered;
+}
+
+// Writes a one line summary of a frame to a text sink
+void PacketTap::write_text(FILE * file, const PacketMeta & meta, const struct pcap_pkthdr * h) {
+  fprintf(file, "%lu.%06lu ", (unsigned long)h->ts.tv_sec, (unsigned long)h->ts.tv_usec);
+
+  if (!meta.has_ip) {
+    fprintf(file, "ether 0x%04x len %u\n", meta.ether_code, h->len);
+    return;
+  }
+
+  if (meta.has_tcp)
+    fprintf(file, "tcp ");
+  else if (meta.has_udp)
+    fprintf(file, "udp ");
+  else if (meta.has_icmp)
+    fprintf(file, "icmp ");
+  else
+    fprintf(file, "ip proto %u ", meta.protocol);
+
+  fprintf(file, "%u.%u.%u.%u:%u > %u.%u.%u.%u:%u len %u\n",
+          meta.src_ip >> 24, (meta.src_ip >> 16) & 0xFF, (meta.src_ip >> 8) & 0xFF, meta.src_ip & 0xFF,
+          meta.sport,
+          meta.dst_ip >> 24, (meta.dst_ip >> 16) & 0xFF, (meta.dst_ip >> 8) & 0xFF, meta.dst_ip & 0xFF,
+          meta.dport, h->len);
+}
+
+// Writes the statistics sinks, then closes every output
+void PacketTap::close() {
+  for (unsigned int s = 0; s < p_sinks.size(); s++) {
+    TapSink * sink = p_sinks[s];
+
+    if (sink->kind == TapSink::ts_stats && sink->file != NULL) {
+      ostringstream ostr;
+
+      ostr << "Tap subscription " << sink->path;
+      if (!sink->expr.empty())
+        ostr << " (" << sink->expr << ")";
+      ostr << endl << "  " << sink->frames << " frames, " << sink->bytes << " bytes" << endl
+           << *sink->hierarchy;
+
+      fputs(ostr.str().c_str(), sink->file);
+    }
+
+    if (sink->dumper != NULL) {
+      pcap_dump_close(sink->dumper);
+      sink->dumper = NULL;
+    }
+    if (sink->file != NULL) {
+      fclose(sink->file);
+      sink->file = NULL;
+    }
+  }
+}
+
+// Returns the number of subscriptions
+unsigned int PacketTap::size() const {
+  return p_sinks.size();
+}
+
+// Returns the number of distinct predicates of the filters
+unsigned int PacketTap::predicates() const {
+  return p_predicates.size();
+}
+
+// Operator overloads
+
+ostream & operator<<(ostream & ostr, const PacketTap & tap) {
+  static const char * kinds[] = { "pcap", "text", "stats" };
+
+  ostr << "Tap: " << tap.p_sinks.size() << " subscriptions, " << tap.p_predicates.size()
+       << " predicates shared by " << tap.p_comparisons << " comparisons, " << tap.p_groups.size()
+       << " field groups" << endl;
+
+  for (unsigned int s = 0; s < tap.p_sinks.size(); s++) {
+    const TapSink * sink = tap.p_sinks[s];
+
+    ostr << "  " << kinds[sink->kind] << " " << sink->path << " : " << sink->frames << " frames, "
+         << sink->bytes << " bytes";
+    if (!sink->expr.empty())
+      ostr << " (" << sink->expr << ")";
+    ostr << endl;
+  }
+
+  ostr << "  " << tap.p_frames << " frames, " << tap.p_deliveries << " deliveries, "
+       << tap.p_tests << " of " << tap.p_lookups << " predicate results computed" << endl << flush;
+
+  return ostr;
+}
+
+#endif
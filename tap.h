@@ -0,0 +1,182 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef TAP_H
+#define TAP_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <cstdio>
+
+#include <pcap.h>               // pcap_t, pcap_dumper_t, pcap_pkthdr
+
+#include "packetmeta.h"         // PacketMeta
+#include "filter.h"             // PacketFilter, FilterNode
+#include "protohierarchy.h"     // ProtocolHierarchy
+
+using namespace std;
+
+#define TAP_MAX_SINKS 256       // subscriptions of a tap at most
+
+/* TapSink: output of a tap subscription, receiving the frames its filter
+ *   accepts.
+ *
+ * Attributes
+ *   kind      : pcap file, one text line per frame, or statistics written on close
+ *   path      : file written
+ *   expr      : filter expression (empty for every frame)
+ *   filter    : filter of the subscription (NULL for every frame)
+ *   root      : root of the filter in the nodes of the tap
+ *   dumper    : pcap output (pcap sinks)
+ *   file      : text output (text and statistics sinks)
+ *   hierarchy : protocol hierarchy of the frames (statistics sinks)
+ *   frames, bytes : frames delivered, and their bytes
+ *   prepared  : last frame the filter was prepared for (see PacketFilter::begin)
+ */
+struct TapSink {
+  // Kinds of sinks
+  typedef enum {
+    ts_pcap, ts_text, ts_stats
+  } Kind;
+
+  Kind                kind;
+  string              path, expr;
+  PacketFilter *      filter;
+  unsigned int        root;
+  pcap_dumper_t *     dumper;
+  FILE *              file;
+  ProtocolHierarchy * hierarchy;
+  unsigned long long  frames, bytes;
+  unsigned long long  prepared;
+
+  TapSink(Kind, const string &);                         // parameterized constructor
+  ~TapSink();                                            // destructor
+
+  private:
+    // Copying is not allowed
+    TapSink(const TapSink &);
+    TapSink & operator=(const TapSink &);
+};
+
+/* PacketTap: delivers each dissected frame to every subscription whose filter
+ *   accepts it, evaluating the filters of all subscriptions together.
+ *
+ * Attributes
+ *   p_sinks      : subscriptions, in the order they were listed
+ *   p_nodes      : filters of the subscriptions, as trees of shared predicates
+ *   p_predicates : distinct comparisons of the filters
+ *   p_keys       : identifiers of the predicates, by textual key
+ *   p_groups     : equality predicates on the same field and mask
+ *   p_group_index : identifiers of the groups, by field and mask
+ *   p_frame      : number of the current frame, stamping the results of the frame
+ *   p_meta, p_now : current frame and its capture time
+ *   p_frames, p_deliveries, p_lookups, p_tests : frames processed, frames
+ *                  delivered to sinks, predicate results needed and computed
+ *   p_comparisons : comparisons in the filters before sharing
+ *
+ * Notes
+ *   1. subscription files hold one subscription per line:
+ *        kind file [filter]
+ *      where kind is pcap, text or stats, and the optional filter follows
+ *      the syntax of PacketFilter. Empty lines and lines starting with '#'
+ *      are ignored.
+ *   2. a comparison found in several filters is a single predicate, computed
+ *      at most once per frame and only when a filter needs it. Equality
+ *      predicates on the same field (e.g. tcp.port == 80, tcp.port == 443)
+ *      form a group resolved by one field load and one lookup, whatever the
+ *      number of subscriptions testing the field.
+ *   3. each predicate is evaluated by the filter it was first found in.
+ *      Filters testing flow fields are prepared for every frame, so their
+ *      flow state counts every frame; the others only when one of their
+ *      predicates is needed.
+ *   4. frames are dissected once by the caller, before the tap. The tap is
+ *      given every frame, including those sampling leaves out of analysis,
+ *      so its counts are not scaled.
+ */
+class PacketTap {
+  public:
+    PacketTap();                                         // default constructor
+    ~PacketTap();                                        // destructor
+
+    int load(const char *, pcap_t *, string &);          // reads the subscriptions of a file and opens their outputs
+    // Delivers a dissected frame captured at given time to the matching sinks.
+    // Returns the number of sinks it was delivered to
+    unsigned int process(const PacketMeta &, const struct pcap_pkthdr *, const unsigned char *,
+                         unsigned long long);
+    void close();                                        // writes statistics and closes the outputs
+
+    unsigned int size() const;                           // number of subscriptions
+    unsigned int predicates() const;                     // number of distinct predicates
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, const PacketTap &);
+
+  private:
+    // Comparison shared by filters
+    struct Predicate {
+      unsigned int sink;        // sink whose filter evaluates it
+      unsigned int node;        // comparison node in that filter
+      int          group;       // group of equality predicates (-1 if none)
+      unsigned int operand;     // value compared with, in groups
+      unsigned long long stamp; // frame of the result
+      bool         result;      // result for that frame
+    };
+
+    // Equality predicates on the same field and mask
+    struct Group {
+      unsigned int                      sink;     // sink whose filter loads the field
+      FilterField                       field;
+      unsigned int                      mask;
+      map<unsigned int, unsigned int>   values;   // predicate of each value compared with
+      unsigned long long                stamp;    // frame of the result
+      int                               matching; // predicate holding for that frame (-1 if none)
+    };
+
+    // Node of the filters of the subscriptions
+    struct Node {
+      FilterNode::NodeType type;
+      bool                 value;
+      unsigned int         predicate, left, right;
+    };
+
+    vector<TapSink *>                         p_sinks;
+    vector<Node>                              p_nodes;
+    vector<Predicate>                         p_predicates;
+    map<string, unsigned int>                 p_keys;
+    vector<Group>                             p_groups;
+    map<pair<unsigned int, unsigned int>, unsigned int> p_group_index;
+    unsigned long long                        p_frame;
+    const PacketMeta *                        p_meta;
+    unsigned long long                        p_now;
+    unsigned long long                        p_frames, p_deliveries, p_lookups, p_tests;
+    unsigned int                              p_comparisons;
+
+    unsigned int convert(unsigned int, unsigned int);
+    unsigned int predicate(unsigned int, unsigned int);
+    void prepare(unsigned int);
+    bool test(unsigned int);
+    bool evaluate(unsigned int);
+    void write_text(FILE *, const PacketMeta &, const struct pcap_pkthdr *);
+
+    // Copying is not allowed
+    PacketTap(const PacketTap &);
+    PacketTap & operator=(const PacketTap &);
+};
+
+#endif
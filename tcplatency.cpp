@@ -0,0 +1,229 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef TCPLATENCY_CPP
+#define TCPLATENCY_CPP
+
+#include "tcplatency.h"   // TCPLatencyAnalyzer
+
+// Handshake progress of a flow
+#define LAT_NONE     0    // no handshake seen (flow joined midway)
+#define LAT_SYN      1    // SYN seen
+#define LAT_SYNACK   2    // SYN/ACK seen
+#define LAT_DONE     3    // handshake complete, or abandoned
+
+// Returns true if sequence number a precedes b (modulo 2^32)
+static inline bool seq_before(unsigned int a, unsigned int b) {
+  return (int)(a - b) < 0;
+}
+
+// Default constructor
+TCPLatencyFlow::TCPLatencyFlow() : state(LAT_NONE), client(0), timestamps(false),
+                                   syn_time(0), synack_time(0), syn_seq(0), synack_seq(0),
+                                   server_delay(0), client_delay(0) {
+  for (unsigned int d = 0; d < 2; d++) {
+    seen[d]       = pending[d] = ts_pending[d] = false;
+    next_seq[d]   = pending_seq[d] = ts_val[d] = 0;
+    pending_time[d] = ts_time[d] = 0;
+  }
+}
+
+// Output operator displaying the flow handshake delays and RTT samples
+ostream & operator<<(ostream & ostr, const TCPLatencyFlow & flow) {
+  if (flow.state == LAT_DONE && flow.server_delay + flow.client_delay > 0)
+    ostr << "handshake = " << flow.server_delay + flow.client_delay << " us (server side "
+         << flow.server_delay << " us, client side " << flow.client_delay << " us)" << endl;
+
+  ostr << "RTT " << flow.rtt << (flow.timestamps ? " [timestamps]" : "") << endl;
+
+  ostr << flush;
+
+  return ostr;
+}
+
+// Parameterized constructor: capacities of the flow and server tables
+TCPLatencyAnalyzer::TCPLatencyAnalyzer(unsigned int flows, unsigned int servers)
+  : p_flows(flows), p_servers(servers), p_handshakes(0) {
+}
+
+// Returns the aggregate of the server endpoint of given flow
+TCPLatencyServer * TCPLatencyAnalyzer::server(const FlowKey & key, const TCPLatencyFlow & flow,
+                                              unsigned long long now) {
+  bool    created;
+  FlowKey skey;
+
+  // The server is endpoint b when the client sends from a to b
+  skey.protocol = key.protocol;
+  if (flow.client) {
+    skey.a_ip = key.b_ip;  skey.a_port = key.b_port;
+  }
+  else {
+    skey.a_ip = key.a_ip;  skey.a_port = key.a_port;
+  }
+
+  return p_servers.insert(skey, now, created);
+}
+
+// Processes a TCP segment, updating the handshake and RTT measurements of its
+// flow
+const TCPLatencyFlow * TCPLatencyAnalyzer::process(const FlowKey & key, unsigned int dir,
+                                                   const TCPSegment & tcp, unsigned int len,
+                                                   unsigned long long now) {
+  bool            created;
+  TCPLatencyFlow *flow = p_flows.insert(key, now, created);
+  unsigned int    d    = (dir ? 1 : 0);   // sender direction
+  unsigned int    r    = 1 - d;           // receiver direction
+  bool            done = false;
+
+  // Without handshake, guess the client from ports: it uses the higher one
+  if (created)
+    flow->client = (key.a_port > key.b_port ? 1 : 0);
+
+  // Time the handshake
+  if (tcp.flag_syn() && !tcp.flag_ack()) {
+    if (flow->state == LAT_NONE) {
+      flow->state    = LAT_SYN;
+      flow->client   = d;
+      flow->syn_time = now;
+      flow->syn_seq  = tcp.sequence_nb();
+    }
+    else if (flow->state == LAT_SYN)
+      flow->state = LAT_DONE;             // retransmitted SYN: response is ambiguous
+  }
+  else if (tcp.flag_syn() && tcp.flag_ack()) {
+    if (flow->state == LAT_SYN && d != flow->client && tcp.ack_nb() == flow->syn_seq + 1) {
+      flow->state        = LAT_SYNACK;
+      flow->server_delay = now - flow->syn_time;
+      flow->synack_time  = now;
+      flow->synack_seq   = tcp.sequence_nb();
+
+      server(key, *flow, now)->handshake.add(flow->server_delay);
+    }
+    else if (flow->state == LAT_SYNACK)
+      flow->state = LAT_DONE;             // retransmitted SYN/ACK
+  }
+  else if (tcp.flag_ack() && flow->state == LAT_SYNACK && d == flow->client) {
+    if (tcp.ack_nb() == flow->synack_seq + 1) {
+      flow->client_delay = now - flow->synack_time;
+      p_handshake.add(flow->server_delay + flow->client_delay);
+      p_handshakes++;
+      done = true;
+    }
+    flow->state = LAT_DONE;
+  }
+
+  // Decode options only if the header holds some
+  TCPOptions opts;
+  opts.has_timestamp = false;
+  if (tcp.header_length() > 20)
+    tcp.options(opts);
+
+  if (opts.has_timestamp)
+    flow->timestamps = true;
+
+  // Sequence space consumed by the segment (SYN and FIN count for one)
+  unsigned int seq  = tcp.sequence_nb();
+  unsigned int span = len + (tcp.flag_syn() ? 1 : 0) + (tcp.flag_fin() ? 1 : 0);
+  unsigned long long sample  = 0;
+  bool               sampled = false;
+
+  if (flow->timestamps) {
+    // Time the first segment carrying a new TSval until the peer echoes it
+    if (opts.has_timestamp) {
+      if (span > 0 && (flow->ts_time[d] == 0 || flow->ts_val[d] != opts.ts_val)) {
+        flow->ts_pending[d] = true;
+        flow->ts_val[d]     = opts.ts_val;
+        flow->ts_time[d]    = now;
+      }
+
+      if (flow->ts_pending[r] && tcp.flag_ack() && opts.ts_ecr == flow->ts_val[r]) {
+        sample  = now - flow->ts_time[r];
+        sampled = true;
+        flow->ts_pending[r] = false;
+      }
+    }
+  }
+  else {
+    // Time one outstanding segment per direction until acknowledged
+    if (span > 0) {
+      unsigned int end = seq + span;
+
+      if (!flow->seen[d] || seq_before(flow->next_seq[d], end)) {
+        if (flow->seen[d] && seq_before(seq, flow->next_seq[d]))
+          flow->pending[d] = false;       // partly retransmitted
+        else if (!flow->pending[d]) {
+          flow->pending[d]      = true;
+          flow->pending_seq[d]  = end;
+          flow->pending_time[d] = now;
+        }
+        flow->next_seq[d] = end;
+      }
+      else if (flow->pending[d] && seq_before(seq, flow->pending_seq[d]))
+        flow->pending[d] = false;         // retransmission: Karn's algorithm
+    }
+
+    if (flow->pending[r] && tcp.flag_ack() && !seq_before(tcp.ack_nb(), flow->pending_seq[r])) {
+      sample  = now - flow->pending_time[r];
+      sampled = true;
+      flow->pending[r] = false;
+    }
+  }
+
+  flow->seen[d] = true;
+
+  // Record the sample
+  if (sampled) {
+    flow->rtt.add(sample);
+
+    // Samples timing data sent by the client measure the server side
+    if (r == flow->client)
+      server(key, *flow, now)->rtt.add(sample);
+  }
+
+  return done ? flow : NULL;
+}
+
+// Output operator displaying the latency statistics of all flows and servers
+ostream & operator<<(ostream & ostr, TCPLatencyAnalyzer & lat) {
+  ostr << "TCP handshakes timed = " << lat.p_handshakes << ", flows evicted = "
+       << lat.p_flows.evicted() << endl;
+  if (lat.p_handshakes > 0)
+    ostr << "handshake " << lat.p_handshake << endl;
+
+  for (unsigned int i = 0; i < lat.p_servers.capacity(); i++) {
+    FlowTable<TCPLatencyServer>::Entry & e = lat.p_servers.entry(i);
+
+    if (e.last_seen == 0)
+      continue;
+
+    char outstr[32];
+    sprintf(outstr, "%u.%u.%u.%u:%u", e.key.a_ip >> 24, (e.key.a_ip >> 16) & 0xFF,
+            (e.key.a_ip >> 8) & 0xFF, e.key.a_ip & 0xFF, e.key.a_port);
+
+    ostr << "server " << outstr << endl;
+    if (e.value.handshake.count() > 0)
+      ostr << "  SYN/ACK delay " << e.value.handshake << endl;
+    if (e.value.rtt.count() > 0)
+      ostr << "  RTT " << e.value.rtt << endl;
+  }
+
+  ostr << flush;
+
+  return ostr;
+}
+
+#endif
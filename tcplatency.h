@@ -0,0 +1,130 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef TCPLATENCY_H
+#define TCPLATENCY_H
+
+#include <iostream>
+
+#include "tcpsegment.h"         // TCPSegment
+#include "flowtable.h"          // FlowTable, FlowKey
+#include "histogram.h"          // Histogram
+
+using namespace std;
+
+typedef Histogram<unsigned short> FlowHistogram;     // compact per-flow histogram
+typedef Histogram<unsigned int>   ServerHistogram;   // per-server aggregate histogram
+
+/* TCPLatencyFlow: passive latency measurement state of a TCP flow.
+ *
+ * Attributes
+ *   state          : handshake progress (see TCPLatencyAnalyzer)
+ *   client         : direction of the client (sender of the SYN, or of the
+ *                    higher port if the handshake was missed)
+ *   timestamps     : the flow carries TCP timestamps, used instead of data/ACK matching
+ *   syn_time, synack_time, syn_seq, synack_seq : handshake progress
+ *   server_delay   : SYN to SYN/ACK delay (capture point to server and back)
+ *   client_delay   : SYN/ACK to ACK delay (capture point to client and back)
+ *   next_seq       : per direction, sequence number following the highest byte sent
+ *   pending, pending_seq, pending_time : per direction, segment being timed
+ *                    (acknowledgment number expected and capture time)
+ *   ts_pending, ts_val, ts_time : per direction, timestamp value being timed
+ *   rtt            : RTT samples of the flow
+ *
+ * Notes
+ *   1. the capture point sits between both endpoints: a sample of direction d
+ *      times the path from the capture point to the receiver of d and back.
+ *   2. state size is fixed (about 300 bytes), whatever the flow lifetime.
+ */
+struct TCPLatencyFlow {
+  TCPLatencyFlow();                                      // default constructor
+
+  unsigned char      state;
+  unsigned char      client;
+  bool               timestamps;
+  bool               seen[2];
+
+  unsigned long long syn_time, synack_time;
+  unsigned int       syn_seq, synack_seq;
+  unsigned int       server_delay, client_delay;
+
+  unsigned int       next_seq[2];
+  bool               pending[2];
+  unsigned int       pending_seq[2];
+  unsigned long long pending_time[2];
+
+  bool               ts_pending[2];
+  unsigned int       ts_val[2];
+  unsigned long long ts_time[2];
+
+  FlowHistogram      rtt;
+
+  // Operator overloads
+  friend ostream & operator<<(ostream &, const TCPLatencyFlow &);
+};
+
+/* TCPLatencyServer: latency aggregate of a server endpoint.
+ *
+ * Attributes
+ *   handshake : SYN to SYN/ACK delays of connections to the server
+ *   rtt       : RTT samples of data sent to the server
+ */
+struct TCPLatencyServer {
+  ServerHistogram handshake;
+  ServerHistogram rtt;
+};
+
+/* TCPLatencyAnalyzer: passive measurement of TCP handshake delays and RTT.
+ *
+ * Attributes
+ *   p_flows      : per-flow state
+ *   p_servers    : per-server aggregates, keyed by server address and port
+ *   p_handshakes : number of complete handshakes timed
+ *   p_handshake  : complete handshake delays (SYN to ACK) of all flows
+ *
+ * Notes
+ *   1. handshakes are timed SYN -> SYN/ACK -> ACK, ignoring retransmitted SYNs
+ *      whose response is ambiguous.
+ *   2. ongoing RTT is sampled from TCP timestamps echoes when the flow carries
+ *      them, otherwise by matching one outstanding segment per direction with
+ *      the first acknowledgment covering it. Retransmissions cancel the pending
+ *      sample (Karn's algorithm).
+ */
+class TCPLatencyAnalyzer {
+  public:
+    TCPLatencyAnalyzer(unsigned int = 65536, unsigned int = 4096);  // parameterized constructor
+
+    // Processes a TCP segment of given flow and direction, carrying given number
+    // of payload bytes, at given time. Returns the flow state when its handshake
+    // just completed, NULL otherwise
+    const TCPLatencyFlow * process(const FlowKey &, unsigned int, const TCPSegment &,
+                                   unsigned int, unsigned long long);
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, TCPLatencyAnalyzer &);
+
+  private:
+    FlowTable<TCPLatencyFlow>   p_flows;
+    FlowTable<TCPLatencyServer> p_servers;
+
+    unsigned long long p_handshakes;
+    ServerHistogram    p_handshake;
+
+    TCPLatencyServer * server(const FlowKey &, const TCPLatencyFlow &, unsigned long long);
+};
+
+#endif
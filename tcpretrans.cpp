@@ -0,0 +1,173 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef TCPRETRANS_CPP
+#define TCPRETRANS_CPP
+
+#include "tcpretrans.h"   // TCPRetransAnalyzer
+
+// Returns true if sequence number a precedes b (modulo 2^32)
+static inline bool seq_before(unsigned int a, unsigned int b) {
+  return (int)(a - b) < 0;
+}
+
+// Default constructor
+TCPRetransCounters::TCPRetransCounters() : segments(0), retransmissions(0), out_of_order(0),
+                                           dup_acks(0), zero_windows(0), window_probes(0) {
+}
+
+// Counts a segment of given classes
+void TCPRetransCounters::add(unsigned int classes) {
+  segments++;
+  if (classes & TCPR_RETRANSMISSION) retransmissions++;
+  if (classes & TCPR_OUT_OF_ORDER)   out_of_order++;
+  if (classes & TCPR_DUP_ACK)        dup_acks++;
+  if (classes & TCPR_ZERO_WINDOW)    zero_windows++;
+  if (classes & TCPR_WINDOW_PROBE)   window_probes++;
+}
+
+// Output operator displaying the counters on one line
+ostream & operator<<(ostream & ostr, const TCPRetransCounters & c) {
+  ostr << "segments = " << c.segments << ", retransmissions = " << c.retransmissions
+       << ", out of order = " << c.out_of_order << ", duplicate ACKs = " << c.dup_acks
+       << ", zero windows = " << c.zero_windows << ", window probes = " << c.window_probes;
+
+  return ostr;
+}
+
+// Default constructor
+TCPRetransFlow::TCPRetransFlow() {
+  for (unsigned int d = 0; d < 2; d++) {
+    seen[d]     = has_ack[d] = false;
+    next_seq[d] = last_ack[d] = last_win[d] = 0;
+    advanced[d] = 0;
+  }
+}
+
+// Parameterized constructor: interval length in microseconds and capacity of
+// the flow table
+TCPRetransAnalyzer::TCPRetransAnalyzer(unsigned long long interval, unsigned int flows)
+  : p_flows(flows), p_interval(interval ? interval : 1), p_start(0), p_closed(0),
+    p_just_closed(false) {
+}
+
+// Processes a TCP segment, returning its classes
+unsigned int TCPRetransAnalyzer::process(const FlowKey & key, unsigned int dir,
+                                         const TCPSegment & tcp, unsigned int len,
+                                         unsigned long long now) {
+  bool            created;
+  TCPRetransFlow *flow    = p_flows.insert(key, now, created);
+  unsigned int    d       = (dir ? 1 : 0);   // sender direction
+  unsigned int    r       = 1 - d;           // receiver direction
+  unsigned int    classes = 0;
+
+  bool syn = tcp.flag_syn(), fin = tcp.flag_fin(), rst = tcp.flag_rst();
+
+  unsigned int seq  = tcp.sequence_nb();
+  unsigned int span = len + (syn ? 1 : 0) + (fin ? 1 : 0);   // SYN and FIN count for one
+  unsigned int end  = seq + span;
+  unsigned int win  = tcp.window_size();
+
+  // Zero window advertised outside of connection setup and teardown
+  if (win == 0 && !syn && !fin && !rst)
+    classes |= TCPR_ZERO_WINDOW;
+
+  // Classify segments carrying sequence space against the highest one sent
+  if (span > 0 && flow->seen[d]) {
+    bool keepalive = (len <= 1 && !syn && !fin && seq + 1 == flow->next_seq[d]);
+
+    if (len == 1 && seq == flow->next_seq[d] && flow->has_ack[r] && flow->last_win[r] == 0)
+      classes |= TCPR_WINDOW_PROBE;
+    else if (seq_before(seq, flow->next_seq[d]) && !keepalive) {
+      if (now - flow->advanced[d] < TCPR_REORDER_DELAY)
+        classes |= TCPR_OUT_OF_ORDER;
+      else
+        classes |= TCPR_RETRANSMISSION;
+    }
+  }
+
+  if (span > 0 && (!flow->seen[d] || seq_before(flow->next_seq[d], end))) {
+    flow->next_seq[d] = end;
+    flow->advanced[d] = now;
+  }
+  else if (!flow->seen[d])
+    flow->next_seq[d] = seq;
+
+  // Duplicate ACK: pure ACK repeating the previous acknowledgment and window
+  // while the peer has unacknowledged data
+  if (tcp.flag_ack()) {
+    unsigned int ack = tcp.ack_nb();
+
+    if (span == 0 && !rst && flow->has_ack[d] && ack == flow->last_ack[d] &&
+        win == flow->last_win[d] && win != 0 && flow->seen[r] && seq_before(ack, flow->next_seq[r]))
+      classes |= TCPR_DUP_ACK;
+
+    flow->has_ack[d]  = true;
+    flow->last_ack[d] = ack;
+    flow->last_win[d] = win;
+  }
+
+  flow->seen[d] = true;
+  flow->counters.add(classes);
+
+  // Close the current interval when the segment falls past it
+  p_just_closed = false;
+  if (p_start == 0)
+    p_start = now;
+  else if (now - p_start >= p_interval) {
+    p_history[p_closed % TCPR_HISTORY] = p_current;
+    p_closed++;
+    p_current     = TCPRetransCounters();
+    p_start      += (now - p_start) / p_interval * p_interval;
+    p_just_closed = true;
+  }
+
+  p_current.add(classes);
+  p_total.add(classes);
+
+  return classes;
+}
+
+// Returns the counters of given flow, if known
+const TCPRetransCounters * TCPRetransAnalyzer::counters(const FlowKey & key) {
+  TCPRetransFlow *flow = p_flows.find(key);
+
+  return flow ? &flow->counters : NULL;
+}
+
+// Returns the interval closed by the last call to process(), if any
+const TCPRetransCounters * TCPRetransAnalyzer::closed_interval() const {
+  if (p_just_closed)
+    return &p_history[(p_closed - 1) % TCPR_HISTORY];
+  else
+    return NULL;
+}
+
+// Output operator displaying the totals and the last closed intervals
+ostream & operator<<(ostream & ostr, const TCPRetransAnalyzer & tcpr) {
+  ostr << "TCP " << tcpr.p_total << ", flows evicted = " << tcpr.p_flows.evicted() << endl;
+
+  unsigned long long first = (tcpr.p_closed > TCPR_HISTORY ? tcpr.p_closed - TCPR_HISTORY : 0);
+  for (unsigned long long i = first; i < tcpr.p_closed; i++)
+    ostr << "  interval #" << i << ": " << tcpr.p_history[i % TCPR_HISTORY] << endl;
+
+  ostr << flush;
+
+  return ostr;
+}
+
+#endif
@@ -0,0 +1,134 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef TCPRETRANS_H
+#define TCPRETRANS_H
+
+#include <iostream>
+
+#include "tcpsegment.h"         // TCPSegment
+#include "flowtable.h"          // FlowTable, FlowKey
+
+using namespace std;
+
+// Segment classification bits returned by TCPRetransAnalyzer::process()
+#define TCPR_RETRANSMISSION  0x01   // segment resends data already seen
+#define TCPR_OUT_OF_ORDER    0x02   // segment fills a hole shortly after later data
+#define TCPR_DUP_ACK         0x04   // pure ACK repeating the previous one
+#define TCPR_ZERO_WINDOW     0x08   // sender advertises a zero window
+#define TCPR_WINDOW_PROBE    0x10   // one byte sent into the peer's zero window
+
+#define TCPR_REORDER_DELAY 3000     // delay (us) within which an older segment is deemed reordered
+#define TCPR_HISTORY         60     // number of closed intervals kept
+
+/* TCPRetransCounters: TCP health counters of a flow or of an interval.
+ *
+ * Attributes
+ *   segments        : number of segments seen
+ *   retransmissions, out_of_order, dup_acks, zero_windows, window_probes :
+ *                     number of segments of each class
+ */
+struct TCPRetransCounters {
+  TCPRetransCounters();                                  // default constructor
+
+  void add(unsigned int);                                // counts a segment of given classes
+
+  unsigned int segments;
+  unsigned int retransmissions;
+  unsigned int out_of_order;
+  unsigned int dup_acks;
+  unsigned int zero_windows;
+  unsigned int window_probes;
+
+  // Operator overloads
+  friend ostream & operator<<(ostream &, const TCPRetransCounters &);
+};
+
+/* TCPRetransFlow: sequence tracking state of a TCP flow.
+ *
+ * Attributes
+ *   seen      : per direction, a segment was seen
+ *   next_seq  : per direction, sequence number following the highest byte sent
+ *   advanced  : per direction, time next_seq last moved forward
+ *   has_ack, last_ack, last_win : per direction, last acknowledgment and window sent
+ *   counters  : classification counters of the flow
+ */
+struct TCPRetransFlow {
+  TCPRetransFlow();                                      // default constructor
+
+  bool               seen[2];
+  unsigned int       next_seq[2];
+  unsigned long long advanced[2];
+  bool               has_ack[2];
+  unsigned int       last_ack[2];
+  unsigned int       last_win[2];
+
+  TCPRetransCounters counters;
+};
+
+/* TCPRetransAnalyzer: classifies TCP segments as retransmitted, out of order,
+ *   duplicate ACK, zero window or window probe.
+ *
+ * Attributes
+ *   p_flows    : per-flow state
+ *   p_interval : interval length in microseconds
+ *   p_start    : start time of the current interval (0 until first segment)
+ *   p_current  : counters of the current interval
+ *   p_history  : ring of the last TCPR_HISTORY closed intervals
+ *   p_closed   : number of intervals closed
+ *   p_total    : counters since start
+ *   p_just_closed : the last call to process() closed an interval
+ *
+ * Notes
+ *   1. a segment costs one flow table lookup and a few comparisons; options
+ *      are not decoded, so the analyzer may be left enabled at line rate.
+ *   2. an older segment arriving within TCPR_REORDER_DELAY of the segment that
+ *      moved the sequence forward is deemed reordered, later ones retransmitted.
+ *   3. idle intervals are not recorded: the history only holds intervals in
+ *      which segments were seen.
+ */
+class TCPRetransAnalyzer {
+  public:
+    TCPRetransAnalyzer(unsigned long long = 1000000, unsigned int = 65536);  // parameterized constructor
+
+    // Processes a TCP segment of given flow and direction, carrying given number
+    // of payload bytes, at given time. Returns the segment classes (TCPR_* bits)
+    unsigned int process(const FlowKey &, unsigned int, const TCPSegment &,
+                         unsigned int, unsigned long long);
+
+    // Returns the counters of given flow, NULL if the flow is unknown
+    const TCPRetransCounters * counters(const FlowKey &);
+
+    // Returns the counters of the interval closed by the last call to process(),
+    // NULL if it did not close one
+    const TCPRetransCounters * closed_interval() const;
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, const TCPRetransAnalyzer &);
+
+  private:
+    FlowTable<TCPRetransFlow> p_flows;
+
+    unsigned long long p_interval, p_start;
+    TCPRetransCounters p_current;
+    TCPRetransCounters p_history[TCPR_HISTORY];
+    unsigned long long p_closed;
+    TCPRetransCounters p_total;
+    bool               p_just_closed;
+};
+
+#endif
@@ -123,8 +123,119 @@ unsigned int TCPSegment::pointer_urg() const {
   return char2word(p_data+18);
 }
 
+// Returns the window size field scaled by the given shift count, as negotiated
+// by the window scale options of the flow's SYN segments. Windows of SYN
+// segments are never scaled
+unsigned int TCPSegment::window(unsigned int wscale) const {
+  if (flag_syn())
+    return window_size();
+  else
+    return window_size() << (wscale > 14 ? 14 : wscale);
+}
+
+// Returns the offset of the first option, to be given to next_option()
+unsigned int TCPSegment::first_option() const {
+  return 20;
+}
+
+// Decodes the option found at offset pos within the header and advances pos
+// past it. Returns tcpo_end once the options are exhausted (end of header or
+// end of option list), or tcpo_malformed if an option length is invalid or
+// overruns the header. No-operation options are skipped
+TCPSegment::OptionStatus TCPSegment::next_option(unsigned int & pos, TCPOption & opt) const {
+  // Options end with the header, or with the captured bytes if truncated;
+  // the header length is not read from a missing or truncated fixed header
+  if (p_data == NULL || p_len < 20)
+    return tcpo_end;
+
+  unsigned int end = header_length();
+  if (end < 20)
+    return tcpo_end;
+  if (end > p_len)
+    end = p_len;
+
+  while (pos < end && p_data[pos] == 1)   // no-operation padding
+    pos++;
+
+  if (pos >= end || p_data[pos] == 0)     // end of option list
+    return tcpo_end;
+
+  // Every other option holds a length byte covering kind and length bytes
+  if (pos + 2 > end || p_data[pos+1] < 2 || pos + p_data[pos+1] > end)
+    return tcpo_malformed;
+
+  opt.kind   = p_data[pos];
+  opt.length = p_data[pos+1] - 2;
+  opt.value  = (opt.length > 0 ? p_data + pos + 2 : NULL);
+  pos       += p_data[pos+1];
+
+  return tcpo_option;
+}
+
+// Decodes the common options of the header into opts. Options with an
+// unexpected length are ignored. Returns false if the option list is
+// malformed, in which case opts holds the options decoded before the error
+bool TCPSegment::options(TCPOptions & opts) const {
+  TCPOption    opt;
+  unsigned int pos = first_option();
+  OptionStatus status;
+
+  opts.has_mss = opts.has_wscale = opts.sack_permitted = opts.has_timestamp = false;
+  opts.mss = opts.wscale = opts.sack_blocks = opts.ts_val = opts.ts_ecr = 0;
+  opts.malformed = false;
+
+  while ((status = next_option(pos, opt)) == tcpo_option)
+    switch (opt.kind) {
+      case 2 :                            // maximum segment size
+        if (opt.length == 2) {
+          opts.has_mss = true;
+          opts.mss     = char2word(opt.value);
+        }
+        break;
+
+      case 3 :                            // window scale
+        if (opt.length == 1) {
+          opts.has_wscale = true;
+          opts.wscale     = (opt.value[0] > 14 ? 14 : opt.value[0]);
+        }
+        break;
+
+      case 4 :                            // SACK permitted
+        if (opt.length == 0)
+          opts.sack_permitted = true;
+        break;
+
+      case 5 :                            // SACK blocks
+        if (opt.length % 8 == 0)
+          for (unsigned int i = 0; i < opt.length && opts.sack_blocks < TCP_MAX_SACK; i += 8) {
+            opts.sack_left[opts.sack_blocks]  = char4word(opt.value + i);
+            opts.sack_right[opts.sack_blocks] = char4word(opt.value + i + 4);
+            opts.sack_blocks++;
+          }
+        break;
+
+      case 8 :                            // timestamps
+        if (opt.length == 8) {
+          opts.has_timestamp = true;
+          opts.ts_val        = char4word(opt.value);
+          opts.ts_ecr        = char4word(opt.value + 4);
+        }
+        break;
+    }
+
+  opts.malformed = (status == tcpo_malformed);
+
+  return !opts.malformed;
+}
+
+// Returns the TLS record starting the payload (an empty instance if the
+// segment carries no data)
+TLSRecord TCPSegment::tls() {
+  return TLSRecord(false, data(), data() ? length() - header_length() : 0);
+}
+
 // Returns a string textually identifying most popular standard ports
-const char * TCPSegment::port_name(unsigned int num) const {
+const char * TCPSegment::port_name(unsigned int num) {
   switch (num) {
     case  20:
     case  21: return "FTP";
@@ -184,6 +295,25 @@ ostream & operator<<(ostream & ostr, const TCPSegment & tcp) {
 
     sprintf(outstr, "0x%.4x", tcp.checksum());
     ostr << "checksum = " << outstr << endl;
+
+    // Decode options only if the header holds some
+    if (tcp.header_length() > 20) {
+      TCPOptions opts;
+      tcp.options(opts);
+
+      if (opts.has_mss)
+        ostr << "MSS option = " << opts.mss << endl;
+      if (opts.has_wscale)
+        ostr << "window scale option = " << opts.wscale << endl;
+      if (opts.sack_permitted)
+        ostr << "SACK permitted option" << endl;
+      for (unsigned int i = 0; i < opts.sack_blocks; i++)
+        ostr << "SACK block = " << opts.sack_left[i] << "-" << opts.sack_right[i] << endl;
+      if (opts.has_timestamp)
+        ostr << "timestamps option = " << opts.ts_val << ", echo " << opts.ts_ecr << endl;
+      if (opts.malformed)
+        ostr << "malformed options" << endl;
+    }
   }
 
   ostr << flush;
@@ -21,9 +21,51 @@
 #include <iostream>
 
 #include "datagramfragment.h"   // DatagramFragment
+#include "tls.h"                // TLSRecord
 
 using namespace std;
 
+#define TCP_MAX_SACK 4          // SACK blocks decoded at most (RFC 2018)
+
+/* TCPOption: one option of a TCP segment header, as returned by the option
+ *   iterator.
+ *
+ * Attributes
+ *   kind   : option kind
+ *   length : number of value bytes (option length minus kind and length bytes)
+ *   value  : option value within the segment (NULL if length is 0)
+ */
+struct TCPOption {
+  unsigned int          kind;
+  unsigned int          length;
+  const unsigned char * value;
+};
+
+/* TCPOptions: common TCP options decoded from a segment header.
+ *
+ * Attributes
+ *   has_mss, mss                 : maximum segment size (RFC 793)
+ *   has_wscale, wscale           : window scale shift count (RFC 7323), capped to 14
+ *   sack_permitted               : SACK permitted option present (RFC 2018)
+ *   sack_blocks, sack_left/right : SACK blocks (edges in sequence number space)
+ *   has_timestamp, ts_val/ts_ecr : timestamps option (RFC 7323)
+ *   malformed                    : an option length overran the header, decoding stopped
+ */
+struct TCPOptions {
+  bool         has_mss;
+  unsigned int mss;
+  bool         has_wscale;
+  unsigned int wscale;
+  bool         sack_permitted;
+  unsigned int sack_blocks;
+  unsigned int sack_left[TCP_MAX_SACK];
+  unsigned int sack_right[TCP_MAX_SACK];
+  bool         has_timestamp;
+  unsigned int ts_val;
+  unsigned int ts_ecr;
+  bool         malformed;
+};
+
 /* TCPSegment: class mapping the inherited data block as an TCP segment.
  *
  * Attributes
@@ -38,6 +80,11 @@ using namespace std;
  */
 class TCPSegment : public DatagramFragment {
   public:
+    // Enumeration of option iterator results
+    typedef enum {
+      tcpo_option, tcpo_end, tcpo_malformed
+    } OptionStatus;
+
     TCPSegment(bool = false);                             // default constructor
     TCPSegment(bool, unsigned char *, unsigned int);      // parameterized constructor
 
@@ -65,14 +112,18 @@ class TCPSegment : public DatagramFragment {
     unsigned int window_size() const;                     // access to window size field
     unsigned int checksum() const;                        // access to checksum field
     unsigned int pointer_urg() const;                     // access to urgent pointer field
+    unsigned int window(unsigned int) const;              // window size scaled by the flow's shift count
 
-    // Operator overloads
-    friend ostream & operator<<(ostream &, const TCPSegment &);
+    unsigned int first_option() const;                    // offset of the first option
+    OptionStatus next_option(unsigned int &, TCPOption &) const;  // decodes option at offset, advances offset
+    bool options(TCPOptions &) const;                     // decodes common options, returns false if malformed
+
+    TLSRecord tls();                                      // returns TLS record starting the payload
 
-  protected:
+    static const char * port_name(unsigned int);          // textual identification of standard ports
 
-    // Returns a string textually identifying standard ports
-    const char * port_name(unsigned int) const;
+    // Operator overloads
+    friend ostream & operator<<(ostream &, const TCPSegment &);
 };
 
 #endif
@@ -41,6 +41,8 @@ TFTPDatagram::TFTPOperation TFTPDatagram::operation() const {
     case 2  : return tftp_wrq;
     case 3  : return tftp_data;
     case 4  : return tftp_ack;
+    case 5  : return tftp_error;
+    case 6  : return tftp_oack;      // option acknowledgment (RFC 2347)
     default : return tftp_none;
   }
 }
@@ -108,6 +110,8 @@ ostream & operator<<(ostream & ostr, const TFTPDatagram & tftp) {
                                      break;
       case TFTPDatagram::tftp_error: ostr << "ERROR" << endl;
                                      break;
+      case TFTPDatagram::tftp_oack : ostr << "OPTION ACK" << endl;
+                                     break;
       default                      : ostr << "unknown" << endl;
                                      break;
     }
@@ -29,7 +29,7 @@ class TFTPDatagram : public DatagramFragment {
   public:
     // enumeration des codes d'operation du protocole TFTP
     typedef enum {
-      tftp_wrq, tftp_rrq, tftp_data, tftp_ack, tftp_error, tftp_none
+      tftp_wrq, tftp_rrq, tftp_data, tftp_ack, tftp_error, tftp_oack, tftp_none
     }   TFTPOperation;
 
     TFTPDatagram(bool = false);                          // default constructor
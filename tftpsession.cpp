@@ -0,0 +1,331 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef TFTPSESSION_CPP
+#define TFTPSESSION_CPP
+
+#include <cstdlib>          // atoi
+#include <cstring>          // strrchr
+#include <cctype>           // isalnum
+#include <strings.h>        // strcasecmp
+
+#include "tftpsession.h"    // TFTPSessionTracker
+
+// Default constructor
+TFTPTransfer::TFTPTransfer() : client(0), client_port(0), server(0), server_port(0), write(false),
+                               block_size(TFTP_BLOCK), start(0), last(0), bytes(0), blocks(0),
+                               last_block(0), retransmissions(0), data_time(0), complete(false),
+                               failed(false), error_code(0), output(-1) {
+  filename[0] = '\0';
+}
+
+// Returns the average throughput of the transfer in bytes per second
+double TFTPTransfer::throughput() const {
+  return last > start ? bytes * 1000000.0 / (last - start) : 0.0;
+}
+
+// Output operator displaying the transfer progress and statistics
+ostream & operator<<(ostream & ostr, const TFTPTransfer & t) {
+  char outstr[64];
+
+  sprintf(outstr, "%u.%u.%u.%u:%u", t.client >> 24, (t.client >> 16) & 0xFF, (t.client >> 8) & 0xFF,
+          t.client & 0xFF, t.client_port);
+  ostr << (t.write ? "WRITE " : "READ ") << t.filename << " by " << outstr;
+  sprintf(outstr, "%u.%u.%u.%u:%u", t.server >> 24, (t.server >> 16) & 0xFF, (t.server >> 8) & 0xFF,
+          t.server & 0xFF, t.server_port);
+  ostr << " from " << outstr << endl;
+
+  ostr << "  " << t.bytes << " bytes in " << t.blocks << " blocks of " << t.block_size
+       << ", " << (unsigned long long)t.throughput() << " bytes/s, " << t.retransmissions
+       << " retransmitted blocks";
+  if (t.complete)
+    ostr << ", complete";
+  else if (t.failed)
+    ostr << ", failed (error " << t.error_code << ")";
+  ostr << endl;
+
+  if (t.ack_latency.count() > 0)
+    ostr << "  ACK latency " << t.ack_latency << endl;
+
+  ostr << flush;
+
+  return ostr;
+}
+
+// Parameterized constructor: directory receiving reconstructed files (NULL
+// for none) and number of transfers tracked
+TFTPSessionTracker::TFTPSessionTracker(const char * directory, unsigned int transfers)
+  : p_transfers(transfers), p_directory(directory), p_complete(0), p_failed(0) {
+  for (unsigned int i = 0; i < TFTP_FILES; i++) {
+    p_files[i].file = NULL;
+    p_files[i].used = 0;
+  }
+}
+
+// Destructor: closes output files
+TFTPSessionTracker::~TFTPSessionTracker() {
+  for (unsigned int i = 0; i < TFTP_FILES; i++)
+    if (p_files[i].file != NULL)
+      fclose(p_files[i].file);
+}
+
+// Returns the key of a transfer: client endpoint and server address
+static FlowKey transfer_key(unsigned int client, unsigned int port, unsigned int server) {
+  FlowKey key;
+
+  key.a_ip     = client;
+  key.a_port   = port;
+  key.b_ip     = server;
+  key.protocol = 17;
+
+  return key;
+}
+
+// Opens the output file of given transfer, closing the least recently
+// written one if all are busy
+void TFTPSessionTracker::open_output(const FlowKey & key, TFTPTransfer & t, unsigned long long now) {
+  if (p_directory == NULL)
+    return;
+
+  unsigned int victim = 0;
+  for (unsigned int i = 0; i < TFTP_FILES; i++) {
+    if (p_files[i].file == NULL) {
+      victim = i;
+      break;
+    }
+    if (p_files[i].used < p_files[victim].used)
+      victim = i;
+  }
+
+  if (p_files[victim].file != NULL)
+    fclose(p_files[victim].file);
+
+  // Keep only the base name of the requested file, with safe characters
+  const char * base = strrchr(t.filename, '/');
+  base = (base ? base + 1 : t.filename);
+
+  char name[TFTP_MAX_NAME];
+  unsigned int n = 0;
+  for (; base[n] && n < TFTP_MAX_NAME - 1; n++)
+    name[n] = (isalnum((unsigned char)base[n]) || base[n] == '.' || base[n] == '-' ? base[n] : '_');
+  name[n] = '\0';
+
+  char path[1024];
+  snprintf(path, sizeof(path), "%s/%u.%u.%u.%u_%u_%s", p_directory, t.client >> 24, (t.client >> 16) & 0xFF,
+           (t.client >> 8) & 0xFF, t.client & 0xFF, t.client_port, name[0] && name[0] != '.' ? name : "file");
+
+  p_files[victim].file  = fopen(path, "wb");
+  p_files[victim].owner = key;
+  p_files[victim].used  = now;
+
+  t.output = (p_files[victim].file != NULL ? (int)victim : -1);
+}
+
+// Closes the output file of given transfer, if still owned
+void TFTPSessionTracker::close_output(TFTPTransfer & t) {
+  if (t.output < 0)
+    return;
+
+  Output & out = p_files[t.output];
+  if (out.file != NULL && out.owner == transfer_key(t.client, t.client_port, t.server)) {
+    fclose(out.file);
+    out.file = NULL;
+    out.used = 0;
+  }
+
+  t.output = -1;
+}
+
+// Appends a new DATA block to the output file of given transfer, if still owned
+void TFTPSessionTracker::write_output(const FlowKey & key, TFTPTransfer & t, const unsigned char * data,
+                                      unsigned int len, unsigned long long now) {
+  if (t.output < 0)
+    return;
+
+  Output & out = p_files[t.output];
+  if (out.file == NULL || !(out.owner == key)) {
+    t.output = -1;   // file was closed for another transfer
+    return;
+  }
+
+  fwrite(data, 1, len, out.file);
+  out.used = now;
+}
+
+// Processes a dissected packet, following requests and their DATA/ACK exchange
+const TFTPTransfer * TFTPSessionTracker::process(const PacketMeta & meta, unsigned long long now) {
+  if (!meta.has_udp || meta.payload == NULL || meta.payload_len < 4)
+    return NULL;
+
+  const unsigned char * p      = meta.payload;
+  unsigned int          len    = meta.payload_len;
+  unsigned int          opcode = char2word(p);
+  bool                  created;
+  TFTPTransfer *        t;
+  FlowKey               key;
+
+  // Requests start a transfer
+  if ((opcode == 1 || opcode == 2) && meta.dport == TFTP_PORT) {
+    key = transfer_key(meta.src_ip, meta.sport, meta.dst_ip);
+    t   = p_transfers.insert(key, now, created);
+
+    if (!created) {
+      if (t->start != 0 && t->blocks == 0)
+        return NULL;      // retransmitted request
+      close_output(*t);
+      *t = TFTPTransfer();
+    }
+
+    t->client      = meta.src_ip;
+    t->client_port = meta.sport;
+    t->server      = meta.dst_ip;
+    t->write       = (opcode == 2);
+    t->start       = t->last = now;
+
+    // Filename and mode are NUL terminated strings, followed by options
+    unsigned int pos = 2, n = 0;
+    while (pos < len && p[pos] && n < TFTP_MAX_NAME - 1)
+      t->filename[n++] = p[pos++];
+    t->filename[n] = '\0';
+
+    open_output(key, *t, now);
+    return NULL;
+  }
+
+  if (opcode < 3 || opcode > 6)
+    return NULL;
+
+  // Other datagrams flow between the client endpoint and the server: find
+  // which endpoint is the client
+  bool from_client = true;
+  key = transfer_key(meta.src_ip, meta.sport, meta.dst_ip);
+  if ((t = p_transfers.find(key, now)) == NULL) {
+    from_client = false;
+    key = transfer_key(meta.dst_ip, meta.dport, meta.src_ip);
+    if ((t = p_transfers.find(key, now)) == NULL)
+      return NULL;
+  }
+
+  // Ended transfers are ignored, except for the acknowledgment of the last block
+  if (t->failed || (t->complete && t->data_time == 0))
+    return NULL;
+
+  unsigned int server_port = (from_client ? meta.dport : meta.sport);
+  if (t->server_port == 0 && server_port != TFTP_PORT)
+    t->server_port = server_port;
+
+  // DATA flows from the server on reads, from the client on writes
+  bool data_sender = (from_client == t->write);
+
+  switch (opcode) {
+    case 3 : {                                                // DATA
+      if (!data_sender)
+        return NULL;
+
+      unsigned int block = char2word(p + 2);
+
+      if (block == ((t->last_block + 1) & 0xFFFF)) {
+        t->last_block = block;
+        t->blocks++;
+        t->bytes     += len - 4;
+        t->last       = now;
+        t->data_time  = now;
+        write_output(key, *t, p + 4, len - 4, now);
+
+        // A short block ends the transfer once acknowledged
+        if (len - 4 < t->block_size)
+          t->complete = true;
+      }
+      else if (block == t->last_block && t->blocks > 0)
+        t->retransmissions++;
+      break;
+    }
+
+    case 4 : {                                                // ACK
+      if (data_sender)
+        return NULL;
+
+      if (char2word(p + 2) == t->last_block && t->data_time != 0) {
+        t->ack_latency.add(now - t->data_time);
+        t->data_time = 0;
+      }
+
+      if (t->complete) {
+        p_complete++;
+        close_output(*t);
+        return t;
+      }
+      break;
+    }
+
+    case 5 :                                                  // ERROR
+      t->failed     = true;
+      t->error_code = char2word(p + 2);
+      p_failed++;
+      close_output(*t);
+      return t;
+
+    case 6 : {                                                // OACK: look for blksize option
+      unsigned int pos = 2;
+
+      while (pos < len) {
+        const char * name = (const char *)p + pos;
+        while (pos < len && p[pos]) pos++;
+        if (++pos >= len) break;
+        const char * value = (const char *)p + pos;
+        while (pos < len && p[pos]) pos++;
+        if (pos++ >= len) break;
+
+        if (strcasecmp(name, "blksize") == 0 && atoi(value) >= 8)
+          t->block_size = atoi(value);
+      }
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+// Output operator displaying statistics and the transfers still in progress,
+// stalled ones being flagged
+ostream & operator<<(ostream & ostr, TFTPSessionTracker & tftp) {
+  unsigned long long latest = 0;
+
+  for (unsigned int i = 0; i < tftp.p_transfers.capacity(); i++)
+    if (tftp.p_transfers.entry(i).last_seen > latest)
+      latest = tftp.p_transfers.entry(i).last_seen;
+
+  ostr << "TFTP transfers complete = " << tftp.p_complete << ", failed = " << tftp.p_failed
+       << ", evicted = " << tftp.p_transfers.evicted() << endl;
+
+  for (unsigned int i = 0; i < tftp.p_transfers.capacity(); i++) {
+    FlowTable<TFTPTransfer>::Entry & e = tftp.p_transfers.entry(i);
+
+    if (e.last_seen == 0 || e.value.complete || e.value.failed)
+      continue;
+
+    if (latest - e.value.last >= TFTP_STALL)
+      ostr << "stalled ";
+    ostr << e.value;
+  }
+
+  ostr << flush;
+
+  return ostr;
+}
+
+#endif
@@ -0,0 +1,129 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef TFTPSESSION_H
+#define TFTPSESSION_H
+
+#include <iostream>
+#include <cstdio>
+
+#include "packetmeta.h"         // PacketMeta
+#include "flowtable.h"          // FlowTable, FlowKey
+#include "tcplatency.h"         // FlowHistogram
+
+using namespace std;
+
+#define TFTP_PORT      69       // port of TFTP requests
+#define TFTP_MAX_NAME 128       // characters of requested filenames kept
+#define TFTP_BLOCK    512       // default block size (RFC 1350)
+#define TFTP_STALL    5000000   // delay (us) without progress after which a transfer is stalled
+#define TFTP_FILES     64       // output files open at once
+
+/* TFTPTransfer: state of a TFTP transfer, from its request to its last block.
+ *
+ * Attributes
+ *   client, client_port : requesting endpoint
+ *   server, server_port : serving endpoint (server_port is 0 until the server
+ *                         answers from its ephemeral port)
+ *   filename, write     : requested file and direction (true for WRQ)
+ *   block_size          : negotiated block size
+ *   start, last         : request time and time of last progress
+ *   bytes, blocks       : data transferred (new blocks only)
+ *   last_block          : last block number received (16 bits, wrapping)
+ *   retransmissions     : DATA blocks received again
+ *   data_time           : capture time of the last new DATA block (0 once acknowledged)
+ *   ack_latency         : DATA to ACK delays
+ *   complete, failed    : transfer ended with a short block, or with an ERROR
+ *   error_code          : code of the ERROR datagram
+ *   output              : index of the output file (-1 if none)
+ */
+struct TFTPTransfer {
+  TFTPTransfer();                                        // default constructor
+
+  unsigned int       client, client_port, server, server_port;
+  char               filename[TFTP_MAX_NAME];
+  bool               write;
+  unsigned int       block_size;
+
+  unsigned long long start, last;
+  unsigned long long bytes;
+  unsigned int       blocks, last_block, retransmissions;
+  unsigned long long data_time;
+  FlowHistogram      ack_latency;
+
+  bool               complete, failed;
+  unsigned int       error_code;
+  int                output;
+
+  double throughput() const;                             // bytes per second since the request
+
+  // Operator overloads
+  friend ostream & operator<<(ostream &, const TFTPTransfer &);
+};
+
+/* TFTPSessionTracker: follows TFTP transfers from their request to port 69 to
+ *   the DATA/ACK exchange on the server's ephemeral port.
+ *
+ * Attributes
+ *   p_transfers : transfers keyed by client endpoint and server address
+ *   p_directory : directory receiving reconstructed files (NULL if none)
+ *   p_files     : output files, shared by all transfers
+ *   p_complete, p_failed : statistics
+ *
+ * Notes
+ *   1. a transfer is identified by the client endpoint and the server address
+ *      only, since the server answers from a port unknown at request time.
+ *   2. reconstructed files are written block by block as new DATA blocks
+ *      arrive, so memory does not depend on file sizes. At most TFTP_FILES
+ *      files are open at once: the least recently written one is closed (and
+ *      left truncated) when another is needed.
+ */
+class TFTPSessionTracker {
+  public:
+    TFTPSessionTracker(const char * = NULL, unsigned int = 4096);  // parameterized constructor
+    ~TFTPSessionTracker();                                         // destructor
+
+    // Processes a dissected packet captured at given time. Returns the transfer
+    // it completed or failed, NULL otherwise
+    const TFTPTransfer * process(const PacketMeta &, unsigned long long);
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, TFTPSessionTracker &);
+
+  private:
+    // Output file
+    struct Output {
+      FILE *             file;
+      FlowKey            owner;
+      unsigned long long used;
+    };
+
+    FlowTable<TFTPTransfer> p_transfers;
+    const char *            p_directory;
+    Output                  p_files[TFTP_FILES];
+    unsigned long long      p_complete, p_failed;
+
+    void open_output(const FlowKey &, TFTPTransfer &, unsigned long long);
+    void close_output(TFTPTransfer &);
+    void write_output(const FlowKey &, TFTPTransfer &, const unsigned char *, unsigned int, unsigned long long);
+
+    // Copying is not allowed
+    TFTPSessionTracker(const TFTPSessionTracker &);
+    TFTPSessionTracker & operator=(const TFTPSessionTracker &);
+};
+
+#endif
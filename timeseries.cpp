@@ -0,0 +1,212 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef TIMESERIES_CPP
+#define TIMESERIES_CPP
+
+#include <cstring>          // memset, strcmp
+
+#include "timeseries.h"     // TimeSeries
+
+// Bucket intervals of each resolution, in seconds
+static const unsigned int ts_intervals[TS_RESOLUTIONS] = { 1, 10, 60 };
+
+// Parameterized constructor: interface name and file receiving binary
+// records (NULL to emit text lines on the standard output)
+TimeSeries::TimeSeries(const char * interface, FILE * output) : p_interface(interface), p_output(output) {
+  memset(p_buckets, 0, sizeof(p_buckets));
+  for (unsigned int r = 0; r < TS_RESOLUTIONS; r++)
+    p_head[r] = 0;
+
+  // Resolve the name of every port once; slot 0 stands for unnamed ports
+  unsigned int names = 1;
+
+  p_names[0] = NULL;
+  for (unsigned int port = 0; port < 65536; port++) {
+    const char * name = TCPSegment::port_name(port);
+    if (strcmp(name, "unknown") == 0 || strcmp(name, "ephemeral") == 0)
+      name = UDPSegment::port_name(port);
+
+    p_ports[port] = 0;
+    if (strcmp(name, "unknown") == 0 || strcmp(name, "ephemeral") == 0)
+      continue;
+
+    unsigned int slot = 1;
+    while (slot < names && strcmp(p_names[slot], name) != 0)
+      slot++;
+    if (slot == names) {
+      if (names == TS_PORT_NAMES)
+        continue;      // no slot left for this name
+      p_names[names++] = name;
+    }
+
+    p_ports[port] = slot;
+  }
+
+  for (; names < TS_PORT_NAMES; names++)
+    p_names[names] = NULL;
+}
+
+// Counts a packet of given length captured at given time (us) in the 1 second
+// bucket, closing the buckets it does not belong to. A sampled packet stands
+// for weight packets
+void TimeSeries::add(const PacketMeta & meta, unsigned int len, unsigned long long now, unsigned int weight) {
+  unsigned long long bytes = (unsigned long long)len * weight;
+
+  // Close buckets finest first, so each is folded before its coarser one closes
+  for (unsigned int r = 0; r < TS_RESOLUTIONS; r++) {
+    unsigned long long start = now - now % (ts_intervals[r] * 1000000ULL);
+    if (p_buckets[r][p_head[r]].start != start)
+      close(r, start);
+  }
+
+  Bucket & b = p_buckets[0][p_head[0]];
+
+  b.packets[TS_SLOT_TOTAL] += weight;
+  b.bytes[TS_SLOT_TOTAL] += bytes;
+
+  unsigned int ether;
+  switch (meta.ether_code) {
+    case 0x0800 : ether = 0; break;
+    case 0x0806 : ether = 1; break;
+    case 0x86DD : ether = 2; break;
+    default     : ether = 3; break;
+  }
+  b.packets[TS_SLOT_ETHER + ether] += weight;
+  b.bytes[TS_SLOT_ETHER + ether] += bytes;
+
+  if (meta.has_ip) {
+    b.packets[TS_SLOT_PROTOCOL + (meta.protocol & 0xFF)] += weight;
+    b.bytes[TS_SLOT_PROTOCOL + (meta.protocol & 0xFF)] += bytes;
+
+    if (meta.has_tcp || meta.has_udp) {
+      unsigned int port = (p_ports[meta.dport] ? p_ports[meta.dport] : p_ports[meta.sport]);
+      if (port != 0) {
+        b.packets[TS_SLOT_PORT + port] += weight;
+        b.bytes[TS_SLOT_PORT + port] += bytes;
+      }
+    }
+  }
+}
+
+// Closes the current bucket of every resolution, emitting those not empty
+void TimeSeries::flush() {
+  for (unsigned int r = 0; r < TS_RESOLUTIONS; r++)
+    close(r, 0);
+}
+
+// Closes the current bucket of given resolution and starts a new one at given
+// time (us). A bucket holding counts is emitted, folded in the current bucket
+// of the next resolution and kept in the ring
+void TimeSeries::close(unsigned int r, unsigned long long start) {
+  Bucket & b = p_buckets[r][p_head[r]];
+
+  if (b.packets[TS_SLOT_TOTAL] != 0) {
+    emit(r, b);
+
+    if (r + 1 < TS_RESOLUTIONS) {
+      Bucket & coarse = p_buckets[r+1][p_head[r+1]];
+
+      // The coarser bucket is empty until first folded into
+      if (coarse.packets[TS_SLOT_TOTAL] == 0)
+        coarse.start = b.start - b.start % (ts_intervals[r+1] * 1000000ULL);
+
+      for (unsigned int i = 0; i < TS_SLOTS; i++) {
+        coarse.packets[i] += b.packets[i];
+        coarse.bytes[i]   += b.bytes[i];
+      }
+    }
+
+    // Keep the closed bucket, reusing the oldest one
+    p_head[r] = (p_head[r] + 1) % TS_HISTORY;
+  }
+
+  Bucket & next = p_buckets[r][p_head[r]];
+  memset(&next, 0, sizeof(next));
+  next.start = start;
+}
+
+// Writes a closed bucket of given resolution, either as binary records of its
+// non-zero counters or as one text line
+void TimeSeries::emit(unsigned int r, const Bucket & b) const {
+  if (p_output != NULL) {
+    TimeSeriesRecord rec;
+
+    rec.start    = b.start / 1000000;
+    rec.interval = ts_intervals[r];
+    for (unsigned int i = 0; i < TS_SLOTS; i++)
+      if (b.packets[i] != 0) {
+        rec.slot    = i;
+        rec.packets = b.packets[i];
+        rec.bytes   = b.bytes[i];
+        fwrite(&rec, sizeof(rec), 1, p_output);
+      }
+  }
+  else {
+    char name[16];
+
+    cout << ts_intervals[r] << "s " << b.start / 1000000 << " " << p_interface;
+    for (unsigned int i = 0; i < TS_SLOTS; i++)
+      if (b.packets[i] != 0) {
+        slot_name(i, name);
+        cout << " " << name << "=" << b.packets[i] << "/" << b.bytes[i];
+      }
+    cout << endl;
+  }
+}
+
+// Writes the textual name of a counter slot in given buffer (16 characters)
+void TimeSeries::slot_name(unsigned int slot, char * name) const {
+  static const char * ethers[] = { "IPv4", "ARP", "IPv6", "other" };
+
+  if (slot == TS_SLOT_TOTAL)
+    strcpy(name, "total");
+  else if (slot < TS_SLOT_PROTOCOL)
+    strcpy(name, ethers[slot - TS_SLOT_ETHER]);
+  else if (slot < TS_SLOT_PORT)
+    switch (slot - TS_SLOT_PROTOCOL) {
+      case  1 : strcpy(name, "ICMP"); break;
+      case  6 : strcpy(name, "TCP"); break;
+      case 17 : strcpy(name, "UDP"); break;
+      case 47 : strcpy(name, "GRE"); break;
+      default : sprintf(name, "ip%u", slot - TS_SLOT_PROTOCOL); break;
+    }
+  else
+    sprintf(name, "%.15s", p_names[slot - TS_SLOT_PORT]);
+}
+
+// Output operator displaying the closed 60 seconds buckets still in the ring,
+// oldest first
+ostream & operator<<(ostream & ostr, const TimeSeries & ts) {
+  const unsigned int r = TS_RESOLUTIONS - 1;
+
+  ostr << "Time series of " << ts.p_interface << " (" << ts_intervals[r] << " seconds buckets):" << endl;
+
+  for (unsigned int i = 1; i <= TS_HISTORY; i++) {
+    const TimeSeries::Bucket & b = ts.p_buckets[r][(ts.p_head[r] + i) % TS_HISTORY];
+
+    if (b.packets[TS_SLOT_TOTAL] != 0 && &b != &ts.p_buckets[r][ts.p_head[r]])
+      ostr << "  " << b.start / 1000000 << " : " << b.packets[TS_SLOT_TOTAL] << " packets, "
+           << b.bytes[TS_SLOT_TOTAL] << " bytes" << endl;
+  }
+
+  ostr << flush;
+
+  return ostr;
+}
+
+#endif
@@ -0,0 +1,112 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef TIMESERIES_H
+#define TIMESERIES_H
+
+#include <iostream>
+#include <cstdio>
+
+#include "packetmeta.h"         // PacketMeta
+
+using namespace std;
+
+#define TS_RESOLUTIONS 3        // bucket intervals: 1, 10 and 60 seconds
+#define TS_HISTORY     8        // closed buckets kept per resolution
+#define TS_PORT_NAMES 32        // distinct well-known port names counted at most
+
+// Counter slots of a bucket: total, EtherTypes, IP protocols and port names
+#define TS_SLOT_TOTAL    0
+#define TS_SLOT_ETHER    1                        // IPv4, ARP, IPv6, other
+#define TS_SLOT_PROTOCOL (TS_SLOT_ETHER + 4)      // one per IP protocol number
+#define TS_SLOT_PORT     (TS_SLOT_PROTOCOL + 256) // one per port name
+#define TS_SLOTS         (TS_SLOT_PORT + TS_PORT_NAMES)
+
+/* TimeSeriesRecord: binary form of one non-zero counter of a closed bucket.
+ *
+ * Attributes
+ *   start    : bucket start time, in seconds since the epoch
+ *   interval : bucket length in seconds
+ *   slot     : counter slot (see TS_SLOT_* definitions)
+ *   packets, bytes : counted traffic
+ */
+struct TimeSeriesRecord {
+  unsigned long long start;
+  unsigned int       interval;
+  unsigned int       slot;
+  unsigned long long packets;
+  unsigned long long bytes;
+};
+
+/* TimeSeries: packets and bytes counted per EtherType, IP protocol and
+ *   well-known port over fixed intervals of 1, 10 and 60 seconds.
+ *
+ * Attributes
+ *   p_interface : name of the capture interface, labelling emitted buckets
+ *   p_output    : file receiving binary records (NULL to emit text lines)
+ *   p_ports     : port number to port name slot (0 for unnamed ports)
+ *   p_names     : port names, by slot
+ *   p_buckets   : ring of buckets of each resolution, current one first at p_head
+ *   p_head      : index of the current bucket of each resolution
+ *
+ * Notes
+ *   1. only the 1 second bucket is updated per packet: a handful of counter
+ *      increments in preallocated memory. Coarser buckets are folded from
+ *      the finer ones as these close, so all resolutions stay consistent.
+ *   2. buckets are aligned on multiples of their interval. Closed buckets
+ *      are emitted once, then kept in the ring until overwritten; empty
+ *      buckets (capture gaps) are neither emitted nor stored.
+ *   3. port names come from the port_name() tables of TCPSegment and
+ *      UDPSegment, resolved once into a table indexed by port number. A
+ *      packet is counted under the name of its destination port if any,
+ *      else of its source port.
+ */
+class TimeSeries {
+  public:
+    TimeSeries(const char * = "", FILE * = NULL);        // parameterized constructor
+
+    void add(const PacketMeta &, unsigned int, unsigned long long, unsigned int = 1);  // counts a packet at given time
+    void flush();                                        // closes and emits current buckets
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, const TimeSeries &);
+
+  private:
+    // Counters of an interval
+    struct Bucket {
+      unsigned long long start;
+      unsigned long long packets[TS_SLOTS];
+      unsigned long long bytes[TS_SLOTS];
+    };
+
+    const char *       p_interface;
+    FILE *             p_output;
+    unsigned char      p_ports[65536];
+    const char *       p_names[TS_PORT_NAMES];
+    Bucket             p_buckets[TS_RESOLUTIONS][TS_HISTORY];
+    unsigned int       p_head[TS_RESOLUTIONS];
+
+    void close(unsigned int, unsigned long long);        // closes current bucket of a resolution
+    void emit(unsigned int, const Bucket &) const;       // writes a closed bucket
+    void slot_name(unsigned int, char *) const;          // textual name of a counter slot
+
+    // Copying is not allowed
+    TimeSeries(const TimeSeries &);
+    TimeSeries & operator=(const TimeSeries &);
+};
+
+#endif
@@ -0,0 +1,545 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef TLS_CPP
+#define TLS_CPP
+
+#include <cstring>       // memcpy, memset
+
+#include "tls.h"
+
+#define TLS_HEADER_LEN 5     // length of TLS record header in bytes
+
+// Computes the MD5 digest of a memory block (RFC 1321), as required by JA3
+static void tls_md5(const unsigned char * msg, unsigned int len, unsigned char digest[16]) {
+  static const unsigned int K[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+  };
+  static const unsigned int R[16] = { 7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21 };
+
+  unsigned int  h[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+  unsigned char tail[128];
+  unsigned int  full = len & ~63U,                    // bytes processed straight from msg
+                tlen = ((len - full + 8) / 64 + 1) * 64;  // bytes of padded tail
+
+  // Build the padded tail: remaining bytes, 0x80, zeros and bit length
+  memset(tail, 0, sizeof(tail));
+  memcpy(tail, msg + full, len - full);
+  tail[len - full] = 0x80;
+  unsigned long long bits = (unsigned long long)len * 8;
+  for (unsigned int i = 0; i < 8; i++)
+    tail[tlen - 8 + i] = bits >> (8 * i);
+
+  for (unsigned int off = 0; off < full + tlen; off += 64) {
+    const unsigned char * blk = (off < full ? msg + off : tail + off - full);
+    unsigned int w[16];
+
+    for (unsigned int i = 0; i < 16; i++)
+      w[i] = blk[4*i] | blk[4*i+1] << 8 | blk[4*i+2] << 16 | (unsigned int)blk[4*i+3] << 24;
+
+    unsigned int a = h[0], b = h[1], c = h[2], d = h[3];
+
+    for (unsigned int i = 0; i < 64; i++) {
+      unsigned int f, g;
+
+      if (i < 16)      { f = (b & c) | (~b & d);  g = i; }
+      else if (i < 32) { f = (d & b) | (~d & c);  g = (5*i + 1) % 16; }
+      else if (i < 48) { f = b ^ c ^ d;           g = (3*i + 5) % 16; }
+      else             { f = c ^ (b | ~d);        g = (7*i) % 16; }
+
+      unsigned int r = R[(i / 16) * 4 + i % 4],
+                   t = d;
+      d = c;
+      c = b;
+      f += a + K[i] + w[g];
+      b += f << r | f >> (32 - r);
+      a = t;
+    }
+
+    h[0] += a;  h[1] += b;  h[2] += c;  h[3] += d;
+  }
+
+  for (unsigned int i = 0; i < 16; i++)
+    digest[i] = h[i/4] >> (8 * (i%4));
+}
+
+// Appends "-"-separated decimal values to a string buffer, returning its new length
+static unsigned int tls_list(char * buf, unsigned int pos, unsigned int size,
+                             const unsigned short * vals, unsigned int cnt) {
+  for (unsigned int i = 0; i < cnt && pos < size; i++)
+    pos += snprintf(buf + pos, size - pos, (i ? "-%u" : "%u"), vals[i]);
+
+  return (pos < size ? pos : size - 1);
+}
+
+// Computes the JA3 fingerprint of a ClientHello or the JA3S fingerprint of a
+// ServerHello: the MD5 digest of the decimal field lists, GREASE values excluded
+void TLSHello::fingerprint(unsigned char digest[16]) const {
+  char           str[(TLS_MAX_CIPHERS + TLS_MAX_EXTENSIONS + TLS_MAX_GROUPS + TLS_MAX_FORMATS) * 6 + 16];
+  unsigned short fmt[TLS_MAX_FORMATS];
+  unsigned int   pos;
+
+  pos = snprintf(str, sizeof(str), "%u,", version);
+  pos = tls_list(str, pos, sizeof(str), ciphers, cipher_count);
+  pos += snprintf(str + pos, sizeof(str) - pos, ",");
+  pos = tls_list(str, pos, sizeof(str), extensions, extension_count);
+
+  if (client) {
+    for (unsigned int i = 0; i < format_count; i++)
+      fmt[i] = formats[i];
+
+    pos += snprintf(str + pos, sizeof(str) - pos, ",");
+    pos = tls_list(str, pos, sizeof(str), groups, group_count);
+    pos += snprintf(str + pos, sizeof(str) - pos, ",");
+    pos = tls_list(str, pos, sizeof(str), fmt, format_count);
+  }
+
+  tls_md5((const unsigned char *)str, pos, digest);
+}
+
+// Default constructor
+TLSRecord::TLSRecord(bool owned) : DatagramFragment(owned) {
+}
+
+// Parameterized constructor
+TLSRecord::TLSRecord(bool owned, unsigned char * s, unsigned int l) : DatagramFragment(owned, s, l) {
+}
+
+// Returns the TLS record header length in bytes
+unsigned int TLSRecord::header_length() const {
+  return TLS_HEADER_LEN;
+}
+
+// Returns true if the bytes start with a plausible TLS record header
+bool TLSRecord::valid() const {
+  return p_data != NULL && p_len >= TLS_HEADER_LEN && p_data[0] >= 20 && p_data[0] <= 24 && p_data[1] == 3;
+}
+
+// Returns the content type field (20 = change cipher spec, 21 = alert,
+// 22 = handshake, 23 = application data)
+unsigned int TLSRecord::content_type() const {
+  return p_data[0];
+}
+
+// Returns the record layer version field
+unsigned int TLSRecord::version() const {
+  return char2word(p_data+1);
+}
+
+// Returns the length of the record payload
+unsigned int TLSRecord::record_length() const {
+  return char2word(p_data+3);
+}
+
+// Returns the handshake message type of handshake records, 0 otherwise
+unsigned int TLSRecord::handshake_type() const {
+  if (p_len > TLS_HEADER_LEN && content_type() == 22)
+    return p_data[TLS_HEADER_LEN];
+  else
+    return 0;
+}
+
+// Indicates if a cipher suite, extension or group value is a GREASE value
+// (RFC 8701), which fingerprints must ignore
+bool TLSRecord::grease(unsigned int v) {
+  return (v & 0x0F0F) == 0x0A0A && (v >> 8) == (v & 0xFF);
+}
+
+// Decodes the ClientHello or ServerHello carried by the record. Returns
+// tls_partial if the data block ends before the hello does (the caller may
+// retry with more bytes), and tls_invalid if the bytes are not a hello. A hello
+// fragmented over several records is reported as invalid
+TLSRecord::TLSParseResult TLSRecord::hello(TLSHello & h) const {
+  if (p_data == NULL || p_len == 0 || p_data[0] != 22 || (p_len > 1 && p_data[1] != 3))
+    return tls_invalid;
+  if (p_len < TLS_HEADER_LEN + 4)
+    return tls_partial;
+
+  const unsigned char * hs   = p_data + TLS_HEADER_LEN;
+  unsigned int          type = hs[0],
+                        hlen = hs[1] << 16 | hs[2] << 8 | hs[3];
+
+  if ((type != 1 && type != 2) || hlen + 4 > record_length())
+    return tls_invalid;
+  if (TLS_HEADER_LEN + 4 + hlen > p_len)
+    return tls_partial;
+
+  const unsigned char * p   = hs + 4,
+                      * end = p + hlen;
+
+  h.client            = (type == 1);
+  h.supported_version = 0;
+  h.sni[0]            = '\0';
+  h.alpn[0]           = '\0';
+  h.cipher_count = h.extension_count = h.group_count = h.format_count = 0;
+
+  // Version and random, then session ID
+  if (p + 35 > end)
+    return tls_invalid;
+  h.version = char2word(p);
+  p += 34;
+  p += 1 + *p;
+
+  // Cipher suites (offered list, or the one selected by server)
+  if (h.client) {
+    if (p + 2 > end || p + 2 + char2word(p) > end)
+      return tls_invalid;
+
+    const unsigned char * cend = p + 2 + char2word(p);
+    for (p += 2; p + 2 <= cend; p += 2)
+      if (!grease(char2word(p)) && h.cipher_count < TLS_MAX_CIPHERS)
+        h.ciphers[h.cipher_count++] = char2word(p);
+    p = cend;
+
+    if (p + 1 > end)
+      return tls_invalid;
+    p += 1 + *p;                      // compression methods
+  }
+  else {
+    if (p + 3 > end)
+      return tls_invalid;
+    h.ciphers[h.cipher_count++] = char2word(p);
+    p += 3;                           // cipher suite and compression method
+  }
+
+  // Extensions are optional
+  if (p >= end)
+    return p == end ? tls_complete : tls_invalid;
+  if (p + 2 > end || p + 2 + char2word(p) > end)
+    return tls_invalid;
+
+  const unsigned char * xend = p + 2 + char2word(p);
+
+  for (p += 2; p + 4 <= xend; ) {
+    unsigned int          xtype = char2word(p),
+                          xlen  = char2word(p+2);
+    const unsigned char * x     = p + 4;
+
+    if (x + xlen > xend)
+      return tls_invalid;
+
+    if (!grease(xtype) && h.extension_count < TLS_MAX_EXTENSIONS)
+      h.extensions[h.extension_count++] = xtype;
+
+    switch (xtype) {
+      case 0:     // server name: list length, name type, name length, name
+        if (h.client && xlen >= 5 && x[2] == 0 && 5 + char2word(x+3) <= xlen) {
+          unsigned int n = char2word(x+3);
+          if (n >= TLS_MAX_SNI)
+            n = TLS_MAX_SNI - 1;
+          memcpy(h.sni, x + 5, n);
+          h.sni[n] = '\0';
+        }
+        break;
+
+      case 16:    // ALPN: list length, then length-prefixed protocol names
+        if (xlen >= 3 && (unsigned int)x[2] + 3 <= xlen) {
+          unsigned int n = x[2];
+          if (n >= TLS_MAX_ALPN)
+            n = TLS_MAX_ALPN - 1;
+          memcpy(h.alpn, x + 3, n);
+          h.alpn[n] = '\0';
+        }
+        break;
+
+      case 10:    // supported groups
+        if (xlen >= 2)
+          for (unsigned int i = 2; i + 2 <= xlen && i < 2 + char2word(x); i += 2)
+            if (!grease(char2word(x+i)) && h.group_count < TLS_MAX_GROUPS)
+              h.groups[h.group_count++] = char2word(x+i);
+        break;
+
+      case 11:    // EC point formats
+        for (unsigned int i = 1; i < xlen && i <= x[0] && h.format_count < TLS_MAX_FORMATS; i++)
+          h.formats[h.format_count++] = x[i];
+        break;
+
+      case 43:    // supported versions: list offered by client, selected by server
+        if (!h.client && xlen == 2)
+          h.supported_version = char2word(x);
+        else if (h.client && xlen >= 1)
+          for (unsigned int i = 1; i + 2 <= xlen && i <= x[0]; i += 2)
+            if (!grease(char2word(x+i)) && char2word(x+i) > h.supported_version)
+              h.supported_version = char2word(x+i);
+        break;
+    }
+
+    p = x + xlen;
+  }
+
+  return tls_complete;
+}
+
+// Returns a string textually identifying protocol versions
+static const char * tls_version_name(unsigned int v) {
+  switch (v) {
+    case 0x0300 : return "SSL 3.0";
+    case 0x0301 : return "TLS 1.0";
+    case 0x0302 : return "TLS 1.1";
+    case 0x0303 : return "TLS 1.2";
+    case 0x0304 : return "TLS 1.3";
+    default     : return "unknown";
+  }
+}
+
+// Displays a fingerprint in hexadecimal form
+static void tls_hex(ostream & ostr, const unsigned char d[16]) {
+  char outstr[4];
+
+  for (unsigned int i = 0; i < 16; i++) {
+    sprintf(outstr, "%.2x", d[i]);
+    ostr << outstr;
+  }
+}
+
+// Output operator displaying the TLS record header fields, and the content of
+// hellos in human readable form
+ostream & operator<<(ostream & ostr, const TLSRecord & tls) {
+  if (tls.valid()) {
+    char outstr[8];
+
+    ostr << "content type = ";
+    switch (tls.content_type()) {
+      case 20 : ostr << "change cipher spec"; break;
+      case 21 : ostr << "alert"; break;
+      case 22 : ostr << "handshake"; break;
+      case 23 : ostr << "application data"; break;
+      default : ostr << "heartbeat"; break;
+    }
+    ostr << " [" << tls.content_type() << "]" << endl;
+
+    sprintf(outstr, "0x%.4x", tls.version());
+    ostr << "record version = " << tls_version_name(tls.version()) << " [" << outstr << "]" << endl;
+    ostr << "record length = " << tls.record_length() << endl;
+
+    TLSHello h;
+    if (tls.hello(h) == TLSRecord::tls_complete) {
+      unsigned char digest[16];
+
+      ostr << (h.client ? "ClientHello" : "ServerHello") << " version = "
+           << tls_version_name(h.supported_version ? h.supported_version : h.version) << endl;
+      if (h.sni[0] != '\0')
+        ostr << "server name = " << h.sni << endl;
+      if (h.alpn[0] != '\0')
+        ostr << "ALPN = " << h.alpn << endl;
+      ostr << "cipher suites = " << h.cipher_count << ", extensions = " << h.extension_count << endl;
+
+      h.fingerprint(digest);
+      ostr << (h.client ? "JA3 = " : "JA3S = ");
+      tls_hex(ostr, digest);
+      ostr << endl;
+    }
+  }
+
+  ostr << flush;
+
+  return ostr;
+}
+
+// Default constructor
+TLSFlow::TLSFlow()
+  : done(false), client_seen(false), server_seen(false), version(0), cipher(0) {
+  packets[0] = packets[1] = 0;
+  buffer[0]  = buffer[1]  = -1;
+  sni[0] = alpn[0] = '\0';
+  memset(ja3, 0, sizeof(ja3));
+  memset(ja3s, 0, sizeof(ja3s));
+}
+
+// Output operator displaying the flow's handshake summary
+ostream & operator<<(ostream & ostr, const TLSFlow & f) {
+  char outstr[8];
+
+  ostr << "version = " << tls_version_name(f.version) << endl;
+  if (f.client_seen) {
+    if (f.sni[0] != '\0')
+      ostr << "server name = " << f.sni << endl;
+    if (f.alpn[0] != '\0')
+      ostr << "ALPN = " << f.alpn << endl;
+    ostr << "JA3 = ";
+    tls_hex(ostr, f.ja3);
+    ostr << endl;
+  }
+  if (f.server_seen) {
+    sprintf(outstr, "0x%.4x", f.cipher);
+    ostr << "cipher suite = " << outstr << endl;
+    ostr << "JA3S = ";
+    tls_hex(ostr, f.ja3s);
+    ostr << endl;
+  }
+
+  ostr << flush;
+
+  return ostr;
+}
+
+// Parameterized constructor
+TLSAnalyzer::TLSAnalyzer(unsigned int flows)
+  : p_flows(flows), p_hellos(0), p_reassembled(0), p_invalid(0) {
+  for (unsigned int i = 0; i < TLS_BUFFERS; i++) {
+    p_buffers[i].len     = 0;
+    p_buffers[i].started = 0;
+  }
+}
+
+// Decodes the hello starting the given bytes and caches its fields in the flow
+// summary. Returns true if a hello was decoded; partial is set if more bytes
+// are needed
+bool TLSAnalyzer::decode(TLSFlow & f, const unsigned char * bytes, unsigned int n, bool & partial) {
+  TLSRecord rec(false, (unsigned char *)bytes, n);
+  TLSHello  h;
+
+  partial = false;
+
+  switch (rec.hello(h)) {
+    case TLSRecord::tls_partial : partial = true;
+                                  return false;
+    case TLSRecord::tls_invalid : p_invalid++;
+                                  return false;
+    default                     : break;
+  }
+
+  p_hellos++;
+
+  if (h.client && !f.client_seen) {
+    memcpy(f.sni, h.sni, sizeof(f.sni));
+    memcpy(f.alpn, h.alpn, sizeof(f.alpn));
+    f.version     = (h.supported_version ? h.supported_version : h.version);
+    f.client_seen = true;
+    h.fingerprint(f.ja3);
+  }
+  else if (!h.client && !f.server_seen) {
+    f.cipher      = h.ciphers[0];
+    f.version     = (h.supported_version ? h.supported_version : h.version);
+    f.server_seen = true;
+    h.fingerprint(f.ja3s);
+  }
+  else
+    return false;
+
+  return true;
+}
+
+// Processes a TCP payload of given flow and direction. Only flows whose first
+// payload is a TLS handshake record are tracked, and only their first data
+// packets are inspected. Returns the flow summary when a hello was just decoded
+const TLSFlow * TLSAnalyzer::process(const FlowKey & key, unsigned int dir, const unsigned char * payload,
+                                     unsigned int len, unsigned long long now) {
+  if (payload == NULL || len == 0)
+    return NULL;
+
+  dir &= 1;
+
+  TLSFlow * f = p_flows.find(key, now);
+  if (f == NULL) {
+    if (len < TLS_HEADER_LEN || payload[0] != 22 || payload[1] != 3)
+      return NULL;
+
+    bool created;
+    f = p_flows.insert(key, now, created);
+  }
+
+  // Steady state: nothing left to learn from this flow
+  if (f->done)
+    return NULL;
+
+  if (f->packets[dir]++ >= TLS_MAX_PACKETS) {
+    f->done = true;
+    return NULL;
+  }
+
+  // Append the payload to the hello being reassembled, if any
+  const unsigned char * bytes = payload;
+  unsigned int          n     = len;
+  int                   b     = f->buffer[dir];
+
+  if (b >= 0) {
+    Buffer & buf = p_buffers[b];
+
+    if (!(buf.owner == key) || buf.dir != dir || buf.len == 0) {
+      f->buffer[dir] = -1;    // buffer was stolen by another flow: give up
+      return NULL;
+    }
+
+    unsigned int m = (len < TLS_MAX_HELLO - buf.len ? len : TLS_MAX_HELLO - buf.len);
+    memcpy(buf.data + buf.len, payload, m);
+    buf.len += m;
+
+    bytes = buf.data;
+    n     = buf.len;
+  }
+
+  bool partial,
+       decoded = decode(*f, bytes, n, partial);
+
+  if (partial && (b < 0 || n < TLS_MAX_HELLO)) {
+    // The hello continues in next segments: save its beginning
+    if (b < 0) {
+      b = 0;
+      for (unsigned int i = 0; i < TLS_BUFFERS; i++) {
+        if (p_buffers[i].len == 0) {
+          b = i;
+          break;
+        }
+        if (p_buffers[i].started < p_buffers[b].started)
+          b = i;
+      }
+
+      Buffer & buf = p_buffers[b];
+      buf.owner   = key;
+      buf.dir     = dir;
+      buf.started = now;
+      buf.len     = (len < TLS_MAX_HELLO ? len : TLS_MAX_HELLO);
+      memcpy(buf.data, payload, buf.len);
+
+      f->buffer[dir] = b;
+      p_reassembled++;
+    }
+
+    return NULL;
+  }
+
+  // Release the reassembly buffer
+  if (b >= 0) {
+    p_buffers[b].len = 0;
+    f->buffer[dir]   = -1;
+  }
+
+  if (f->client_seen && f->server_seen)
+    f->done = true;
+
+  return decoded ? f : NULL;
+}
+
+// Output operator displaying the analyzer statistics
+ostream & operator<<(ostream & ostr, const TLSAnalyzer & tls) {
+  ostr << "TLS hellos decoded = " << tls.p_hellos << ", reassembled = " << tls.p_reassembled
+       << ", invalid = " << tls.p_invalid << ", flows evicted = " << tls.p_flows.evicted() << endl;
+
+  ostr << flush;
+
+  return ostr;
+}
+
+#endif
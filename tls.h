@@ -0,0 +1,169 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef TLS_H
+#define TLS_H
+
+#include <iostream>
+
+#include "datagramfragment.h"   // DatagramFragment
+#include "flowtable.h"          // FlowKey, FlowTable
+
+using namespace std;
+
+#define TLS_MAX_SNI        256     // buffer size for server names
+#define TLS_MAX_ALPN        32     // buffer size for the first ALPN protocol
+#define TLS_MAX_CIPHERS    128     // cipher suites kept from a hello
+#define TLS_MAX_EXTENSIONS  64     // extension types kept from a hello
+#define TLS_MAX_GROUPS      32     // supported groups kept from a hello
+#define TLS_MAX_FORMATS      8     // EC point formats kept from a hello
+#define TLS_MAX_HELLO     8192     // largest hello reassembled across segments
+#define TLS_MAX_PACKETS      4     // data packets inspected per flow direction
+#define TLS_BUFFERS         64     // reassembly buffers shared by all flows
+
+/* TLSHello: fields decoded from a ClientHello or ServerHello handshake message.
+ *   Lists keep their wire order, as needed by fingerprints.
+ */
+struct TLSHello {
+  bool           client;                          // ClientHello (true) or ServerHello
+  unsigned int   version;                         // legacy version field of the hello
+  unsigned int   supported_version;               // highest supported_versions entry (0 if absent)
+  char           sni[TLS_MAX_SNI];                // server name (empty if absent)
+  char           alpn[TLS_MAX_ALPN];              // first ALPN protocol (empty if absent)
+
+  unsigned short ciphers[TLS_MAX_CIPHERS];        // offered (or selected) cipher suites
+  unsigned int   cipher_count;
+  unsigned short extensions[TLS_MAX_EXTENSIONS];  // extension types in wire order
+  unsigned int   extension_count;
+  unsigned short groups[TLS_MAX_GROUPS];          // supported groups (elliptic curves)
+  unsigned int   group_count;
+  unsigned char  formats[TLS_MAX_FORMATS];        // EC point formats
+  unsigned int   format_count;
+
+  // Computes the JA3 (ClientHello) or JA3S (ServerHello) MD5 fingerprint
+  void fingerprint(unsigned char [16]) const;
+};
+
+/* TLSRecord: class mapping the inherited data block as a TLS record.
+ *
+ * Attributes
+ *   p_data (inherited) : array of bytes
+ *   p_len (inherited)  : size of p_data
+ *
+ * Notes
+ *   1. the data block referenced by p_data may not be owned by the instance
+ *      but instead owned by a Datagram instance which shares its data with
+ *      instances of classes derived from DatagramFragment, including this
+ *      class.
+ *   2. every read of the hello is bounds checked against both the record and
+ *      the data block; malformed hellos are reported, never thrown.
+ */
+class TLSRecord : public DatagramFragment {
+  public:
+    // Outcome of hello decoding
+    typedef enum {
+      tls_complete, tls_partial, tls_invalid
+    } TLSParseResult;
+
+    TLSRecord(bool = false);                             // default constructor
+    TLSRecord(bool, unsigned char *, unsigned int);      // parameterized constructor
+
+    unsigned int header_length() const;                  // length of TLS record header in bytes
+
+    bool valid() const;                                  // indicates if bytes look like a TLS record
+
+    // Routines returning header field values
+    unsigned int content_type() const;                   // 22 for handshake records
+    unsigned int version() const;                        // record layer version
+    unsigned int record_length() const;                  // length of the record payload
+    unsigned int handshake_type() const;                 // 1 = ClientHello, 2 = ServerHello
+
+    TLSParseResult hello(TLSHello &) const;              // decodes a ClientHello or ServerHello
+
+    static bool grease(unsigned int);                    // indicates if value is a GREASE value
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, const TLSRecord &);
+};
+
+/* TLSFlow: per-flow TLS handshake summary cached by the TLS analyzer.
+ */
+struct TLSFlow {
+  bool           done;                // no more packets of the flow need inspection
+  bool           client_seen;         // ClientHello decoded
+  bool           server_seen;         // ServerHello decoded
+  unsigned char  packets[2];          // data packets inspected per direction
+  short          buffer[2];           // reassembly buffer per direction (-1 if none)
+  unsigned int   version;             // negotiated (or offered) protocol version
+  unsigned int   cipher;              // cipher suite selected by server
+  char           sni[TLS_MAX_SNI];    // server name requested by client
+  char           alpn[TLS_MAX_ALPN];  // first ALPN protocol offered by client
+  unsigned char  ja3[16];             // client fingerprint
+  unsigned char  ja3s[16];            // server fingerprint
+
+  TLSFlow();                          // default constructor
+
+  // Operator overloads
+  friend ostream & operator<<(ostream &, const TLSFlow &);
+};
+
+/* TLSAnalyzer: extracts the handshake summary of TLS flows from the first data
+ *   packets of each flow and caches it in a flow table.
+ *
+ * Attributes
+ *   p_flows   : per-flow summaries
+ *   p_buffers : reassembly buffers for hellos spanning several segments
+ *   p_hellos, p_reassembled, p_invalid : statistics
+ *
+ * Notes
+ *   1. once both hellos were decoded, or TLS_MAX_PACKETS data packets were seen
+ *      in a direction, the flow is marked done and its packets only cost a flow
+ *      table lookup.
+ *   2. reassembly buffers are shared by all flows and stolen from the oldest
+ *      owner when all are busy, keeping memory bounded.
+ */
+class TLSAnalyzer {
+  public:
+    TLSAnalyzer(unsigned int = 16384);                   // parameterized constructor
+
+    // Processes a TCP payload of given flow and direction at given time. Returns the
+    // flow summary when a hello was just decoded, NULL otherwise
+    const TLSFlow * process(const FlowKey &, unsigned int, const unsigned char *,
+                            unsigned int, unsigned long long);
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, const TLSAnalyzer &);
+
+  private:
+    // Reassembly buffer
+    struct Buffer {
+      FlowKey            owner;
+      unsigned int       dir;
+      unsigned long long started;
+      unsigned int       len;
+      unsigned char      data[TLS_MAX_HELLO];
+    };
+
+    FlowTable<TLSFlow> p_flows;
+    Buffer             p_buffers[TLS_BUFFERS];
+
+    unsigned long long p_hellos, p_reassembled, p_invalid;
+
+    bool decode(TLSFlow &, const unsigned char *, unsigned int, bool &);
+};
+
+#endif
@@ -58,8 +58,28 @@ TFTPDatagram UDPSegment::tftp() {
   return TFTPDatagram(false, data(), length() - header_length());
 }
 
+// Returns DNS message transported in payload. The length field is used to
+// exclude any link layer padding captured after the segment
+DNSMessage UDPSegment::dns() {
+  // Segment too short to hold the UDP header, length field included
+  if (length() < header_length())
+    return DNSMessage(false, NULL, 0);
+
+  unsigned int l = length() - header_length();
+
+  if (len() >= header_length() && len() - header_length() < l)
+    l = len() - header_length();
+
+  return DNSMessage(false, data(), data() ? l : 0);
+}
+
+// Returns VXLAN packet transported in payload
+VXLANPacket UDPSegment::vxlan() {
+  return VXLANPacket(false, data(), data() ? length() - header_length() : 0);
+}
+
 // Returns a string textually identifying most popular standard ports
-const char * UDPSegment::port_name(unsigned int num) const {
+const char * UDPSegment::port_name(unsigned int num) {
   switch (num) {
     case  20:
     case  21: return "FTP";
@@ -77,6 +97,7 @@ const char * UDPSegment::port_name(unsigned int num) const {
     case 389: return "LDAP";
     case 546:
     case 547: return "DHCP";
+    case 4789: return "VXLAN";
   }
 
   // Distinguish assigned ports from ephemerals
@@ -22,6 +22,8 @@
 
 #include "datagramfragment.h"   // DatagramFragment
 #include "tftp.h"               // TFTPDatagram
+#include "dns.h"                // DNSMessage
+#include "vxlan.h"              // VXLANPacket
 
 using namespace std;
 
@@ -51,14 +53,13 @@ class UDPSegment : public DatagramFragment {
     unsigned int checksum() const;                        // access to checksum field
 
     TFTPDatagram tftp();                                  // returns TFTP datagram transported in payload
+    DNSMessage dns();                                     // returns DNS message transported in payload
+    VXLANPacket vxlan();                                  // returns VXLAN packet transported in payload
+
+    static const char * port_name(unsigned int);          // textual identification of standard ports
 
     // Operator overloads
     friend ostream & operator<<(ostream &, const UDPSegment &);
-
-  protected:
-
-    // Returns a string textually identifying standard ports
-    const char * port_name(unsigned int) const;
 };
 
 #endif
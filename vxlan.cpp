@@ -0,0 +1,69 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef VXLAN_CPP
+#define VXLAN_CPP
+
+#include "vxlan.h"           // VXLANPacket
+#include "ethernetframe.h"   // EthernetFrame
+
+#define VXLAN_HEADER_LEN 8   // length of VXLAN header in bytes
+
+// Default constructor
+VXLANPacket::VXLANPacket(bool owned) : DatagramFragment(owned) {
+}
+
+// Parameterized constructor
+VXLANPacket::VXLANPacket(bool owned, unsigned char * s, unsigned int l) : DatagramFragment(owned, s, l) {
+}
+
+// Returns the VXLAN header length in bytes
+unsigned int VXLANPacket::header_length() const {
+  return VXLAN_HEADER_LEN;
+}
+
+// Returns true if the header is complete and announces a valid VNI
+bool VXLANPacket::valid() const {
+  return p_data != NULL && p_len >= VXLAN_HEADER_LEN && flag_vni();
+}
+
+// Returns the I flag value
+bool VXLANPacket::flag_vni() const {
+  return p_data[0] & 0x08;
+}
+
+// Returns the VXLAN network identifier (24 bits)
+unsigned int VXLANPacket::vni() const {
+  return char4word(p_data+4) >> 8;
+}
+
+// Returns the Ethernet frame transported as payload
+EthernetFrame VXLANPacket::ethernet() {
+  return EthernetFrame(false, data(), data() ? length() - header_length() : 0);
+}
+
+// Output operator displaying the VXLAN header fields in human readable form
+ostream & operator<<(ostream & ostr, const VXLANPacket & vxlan) {
+  if (vxlan.valid())
+    ostr << "VXLAN network identifier (VNI) = " << vxlan.vni() << endl;
+
+  ostr << flush;
+
+  return ostr;
+}
+
+#endif
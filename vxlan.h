@@ -0,0 +1,61 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2014 Marco Lavoie
+    marco@marcolavoie.ca
+*/
+#ifndef VXLAN_H
+#define VXLAN_H
+
+#include <iostream>
+
+#include "datagramfragment.h"   // DatagramFragment
+
+using namespace std;
+
+#define VXLAN_PORT 4789         // IANA assigned UDP port
+
+class EthernetFrame;            // defined in ethernetframe.h
+
+/* VXLANPacket: class mapping the inherited data block as a VXLAN header (RFC 7348).
+ *
+ * Attributes
+ *   p_data (inherited) : array of bytes
+ *   p_len (inherited)  : size of p_data
+ *
+ * Notes
+ *   1. the data block referenced by p_data may not be owned by the instance
+ *      but instead owned by a Datagram instance which shares its data with
+ *      instances of classes derived from DatagramFragment, including this
+ *      class.
+ */
+class VXLANPacket : public DatagramFragment {
+  public:
+    VXLANPacket(bool = false);                           // default constructor
+    VXLANPacket(bool, unsigned char *, unsigned int);    // parameterized constructor
+
+    unsigned int header_length() const;                  // length of VXLAN header in bytes
+
+    bool valid() const;                                  // indicates if the header is complete and valid
+
+    bool flag_vni() const;                               // I flag (VNI field is valid)
+    unsigned int vni() const;                            // VXLAN network identifier
+
+    EthernetFrame ethernet();                            // returns Ethernet frame transported in payload
+
+    // Operator overloads
+    friend ostream & operator<<(ostream &, const VXLANPacket &);
+};
+
+#endif